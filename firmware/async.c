@@ -0,0 +1,231 @@
+#include <cyu3system.h>
+#include <cyu3error.h>
+#include <cyu3dma.h>
+
+#include "async.h"
+#include "cpu_handler.h"
+#include "rdwr.h"
+#include "hwtimer.h"
+#include "log.h"
+
+#ifndef DEBUG_ASYNC
+#undef log_debug
+#define log_debug(...) do {} while (0)
+#endif
+
+uint8_t gAsyncMem[ASYNC_BUFFERS][ASYNC_BUFFER_SIZE] __attribute__ ((aligned (32)));
+CyU3PDmaBuffer_t gAsyncBufs[ASYNC_BUFFERS];
+async_stats_t gAsyncStats;
+
+// free buffers, returned by the data thread and taken by async_get
+uint8_t gAsyncFree[ASYNC_BUFFERS];
+volatile uint32_t gAsyncFreeHead=0; // written by the data thread only
+volatile uint32_t gAsyncFreeTail=0; // written by async_get only
+// committed buffers in order, put by async_commit and sent by the data thread
+uint8_t gAsyncReady[ASYNC_BUFFERS];
+volatile uint32_t gAsyncReadyHead=0; // written by async_commit only
+volatile uint32_t gAsyncReadyTail=0; // written by the data thread only
+
+volatile CyBool_t gAsyncOpen;  // async_get and async_commit work
+volatile CyBool_t gAsyncLast;  // the last commit is in, gAsyncEnd is its ready count
+volatile uint32_t gAsyncEnd;
+uint32_t gAsyncCommitted;      // bytes committed, producer side
+CyBool_t gAsyncActive;         // the current transaction is an async read
+CyBool_t gAsyncRunning;        // the producer hasn't been stopped
+async_producer_t *gAsyncProducer; // the one started last, for async_stop
+CyBool_t gAsyncPending;        // a buffer is on the channel
+
+static async_producer_t *async_producer(void) {
+  return (async_producer_t*)gRdwrCmd.io_handler->userdata;
+}
+
+CyU3PDmaBuffer_t *async_get(void) {
+  CyU3PDmaBuffer_t *buf;
+  uint32_t tail = gAsyncFreeTail;
+
+  if (!gAsyncOpen) return NULL;
+  if (tail == gAsyncFreeHead) {
+    ++gAsyncStats.overruns;
+    return NULL;
+  }
+  buf = &gAsyncBufs[gAsyncFree[tail & (ASYNC_BUFFERS-1)]];
+  buf->count = 0;
+  buf->size = ASYNC_BUFFER_SIZE;
+  buf->status = 0;
+  gAsyncFreeTail = tail+1;
+  return buf;
+}
+
+uint16_t async_commit(CyU3PDmaBuffer_t *buf, CyBool_t last) {
+  uint32_t head = gAsyncReadyHead, left;
+
+  if (!gAsyncOpen) return CY_U3P_ERROR_NOT_STARTED;
+  if (buf < gAsyncBufs || buf >= gAsyncBufs + ASYNC_BUFFERS || buf->count > ASYNC_BUFFER_SIZE)
+    return CY_U3P_ERROR_BAD_ARGUMENT;
+  if (!RDWR_STREAMING()) {
+    left = gRdwrCmd.header.transfer_length - gAsyncCommitted;
+    if (buf->count >= left) {
+      buf->count = left;
+      last = CyTrue;
+    }
+  }
+  // a short packet ends the host's transfer so only the last commit of a
+  // read can have one
+  if ((RDWR_STREAMING() || !last) && buf->count % gRdwrCmd.ep_buffer_size)
+    return CY_U3P_ERROR_BAD_ARGUMENT;
+  gAsyncCommitted += buf->count;
+  gAsyncReady[head & (ASYNC_BUFFERS-1)] = buf - gAsyncBufs;
+  gAsyncReadyHead = head+1;
+  ++gAsyncStats.commits;
+  if (head+1 - gAsyncReadyTail > gAsyncStats.max_ready)
+    gAsyncStats.max_ready = head+1 - gAsyncReadyTail;
+  if (last) {
+    gAsyncEnd = head+1;
+    gAsyncLast = CyTrue;
+    gAsyncOpen = CyFalse;
+  }
+  io_handler_ready();
+  return 0;
+}
+
+static void async_stop(void) {
+  gAsyncOpen = CyFalse;
+  if (gAsyncRunning && gAsyncProducer->stop) gAsyncProducer->stop();
+  gAsyncRunning = CyFalse;
+}
+
+void async_uninit(void) {
+  async_stop();
+  gAsyncActive = gAsyncPending = CyFalse;
+}
+
+static void async_finish(uint16_t status) {
+  CyU3PDmaBuffer_t zlp;
+  uint32_t sent = gRdwrCmd.transfered_so_far;
+
+  async_stop();
+  gAckPkt.status |= status;
+  gExtAck.dma_status |= status;
+  // normal mode for the ack.  Like sram_term.c the endpoint isn't
+  // flushed, the last packets can still be in it.
+  CyU3PDmaChannelReset(&glChHandleBulkSrc);
+  CyU3PDmaChannelSetXfer(&glChHandleBulkSrc, 0);
+  if (!status && !RDWR_STREAMING() && sent < gRdwrCmd.header.transfer_length &&
+      !(sent % gRdwrCmd.ep_buffer_size)) {
+    // whole packets don't end the host's transfer, a zero length one does
+    if (!CyU3PDmaChannelGetBuffer(&glChHandleBulkSrc, &zlp, 500))
+      CyU3PDmaChannelCommitBuffer(&glChHandleBulkSrc, 0, 0);
+  }
+  log_debug ( "async done %d bytes %d commits\n", sent, gAsyncStats.commits );
+  cpu_handler_commit_ack();
+  gRdwrCmd.done = 1;
+}
+
+uint16_t async_handler_start() {
+  async_producer_t *producer = async_producer();
+  uint16_t status;
+  int i;
+
+  // a transaction the host gave up on without VC_ABORT
+  if (gAsyncRunning) async_stop();
+  status = cpu_handler_cmd_start();
+  if (status) return status;
+
+  gAsyncActive = producer && gRdwrCmd.header.command == COMMAND_READ &&
+                 gRdwrCmd.header.transfer_length &&
+                 !(gRdwrCmd.header.flags & ~RDWR_FLAG_EXT_ACK);
+  gAsyncPending = CyFalse;
+  if (!gAsyncActive) return 0;
+
+  CyU3PMemSet((uint8_t*)&gAsyncStats, 0, sizeof(gAsyncStats));
+  for (i=0; i<ASYNC_BUFFERS; ++i) {
+    gAsyncBufs[i].buffer = gAsyncMem[i];
+    gAsyncFree[i] = i;
+  }
+  gAsyncFreeTail = 0;
+  gAsyncFreeHead = ASYNC_BUFFERS;
+  gAsyncReadyHead = gAsyncReadyTail = 0;
+  gAsyncCommitted = 0;
+  gAsyncLast = CyFalse;
+  gAsyncEnd = 0;
+  gAsyncProducer = producer;
+  gAsyncOpen = gAsyncRunning = CyTrue;
+  if (producer->start) producer->start();
+  return 0;
+}
+
+uint16_t async_handler_dmacb() {
+  CyU3PDmaBuffer_t *buf, send;
+  uint32_t t0, tail;
+  uint16_t status;
+
+  if (gAsyncActive && gRdwrCmd.abort) {
+    async_stop();
+    gAsyncActive = gAsyncPending = CyFalse;
+  }
+  if (!gAsyncActive) return cpu_handler_dmacb(); // an abort resets the channels
+
+  tail = gAsyncReadyTail;
+  if (!gAsyncPending) {
+    if ((gAsyncLast && tail == gAsyncEnd) || gRdwrCmd.stream_stop) {
+      async_finish(0);
+      return 0;
+    }
+    if (tail == gAsyncReadyHead) {
+      // async_commit wakes us
+      gExtAck.wait_ticks += rdwr_busy_wait();
+      return 0;
+    }
+    buf = &gAsyncBufs[gAsyncReady[tail & (ASYNC_BUFFERS-1)]];
+    if (buf->count) {
+      send.buffer = buf->buffer;
+      send.count = buf->count;
+      send.size = (buf->count + 15) & ~15; // a multiple of 16 inside the pool buffer
+      send.status = 0;
+      CyU3PDmaChannelReset(&glChHandleBulkSrc);
+      status = CyU3PDmaChannelSetupSendBuffer(&glChHandleBulkSrc, &send);
+      if (status) {
+        log_error ( "async override fail %d\n", status );
+        async_finish(status);
+        return 0;
+      }
+      gAsyncPending = CyTrue;
+    }
+  }
+
+  if (gAsyncPending) {
+    t0 = hwtimer_ticks();
+    status = CyU3PDmaChannelWaitForCompletion(&glChHandleBulkSrc, 500);
+    gExtAck.wait_ticks += hwtimer_ticks() - t0;
+    if (status == CY_U3P_ERROR_TIMEOUT) {
+      ++gExtAck.dma_waits;
+      return status; // the data loop calls again
+    }
+    gAsyncPending = CyFalse;
+    if (gRdwrCmd.abort) return async_handler_dmacb();
+    if (status) {
+      log_error ( "async override wait fail %d\n", status );
+      async_finish(status);
+      return 0;
+    }
+  }
+
+  // the host has it, back to the producer
+  buf = &gAsyncBufs[gAsyncReady[tail & (ASYNC_BUFFERS-1)]];
+  gRdwrCmd.transfered_so_far += buf->count;
+  gStreamTotal += buf->count;
+  ++gAsyncStats.sent;
+  gAsyncReadyTail = tail+1;
+  gAsyncFree[gAsyncFreeHead & (ASYNC_BUFFERS-1)] = buf - gAsyncBufs;
+  gAsyncFreeHead = gAsyncFreeHead+1;
+  return 0;
+}
+
+handler_t glAsyncHandler = {
+  cpu_handler_setup,
+  cpu_handler_teardown,
+  async_handler_start,
+  async_handler_dmacb,
+  0,
+  cpu_handler_abort
+};
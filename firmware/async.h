@@ -0,0 +1,83 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+/**
+ * Reads from handler owned dma buffers.
+ *
+ * A terminal declared with DECLARE_ASYNC_HANDLER doesn't fill buffers
+ * from the data thread.  Its producer (an isr, a gpif callback, another
+ * thread) takes free buffers from a pool of ASYNC_BUFFERS with
+ * async_get(), fills them at its own pace and hands each back with
+ * async_commit().  The data thread sends committed buffers in order
+ * straight from the pool (dma override mode, like sram_term.c) and
+ * returns them to the pool once the host has them, so the producer can
+ * have several buffers filling or queued while one is on the wire.
+ *
+ * The transaction completes after the last commit: the one that reaches
+ * the read's length or one with last set, which can end a read short.
+ * Every other commit has to be whole packets since a short packet ends
+ * the host's transfer.  Streams run until the host stops them or a last
+ * commit, and take whole packets only (a short packet is the end of a
+ * stream.)
+ *
+ * The producer is the io_handler's userdata, an async_producer_t.  start
+ * is called once the pool is open for the transaction, stop when it's
+ * over, aborted, replaced by the next transaction or the host switches
+ * to another terminal (async_uninit); after stop async_get returns NULL
+ * and async_commit fails.  async_get and async_commit are isr safe but have to be called
+ * from one context at a time.  Gets, sets, writes and reads with other
+ * flags than RDWR_FLAG_EXT_ACK go through the cpu handler and the
+ * terminal's read and write handlers instead.
+ *
+ * Add async.c to SOURCE for terminals declared with it.
+ **/
+
+#include "handlers.h"
+
+#ifndef ASYNC_BUFFERS
+#define ASYNC_BUFFERS 4 // a power of 2
+#endif
+#ifndef ASYNC_BUFFER_SIZE
+#define ASYNC_BUFFER_SIZE 0x2000 // whole packets at every speed
+#endif
+
+typedef struct {
+  void (*start)(void); // the pool is open, start producing (app thread)
+  void (*stop)(void);  // the transaction is over, stop committing
+} async_producer_t;
+
+typedef struct {
+  uint32_t commits;
+  uint32_t sent;
+  uint32_t overruns;  // async_get with no free buffer
+  uint32_t max_ready; // most committed buffers waiting to be sent
+} async_stats_t;
+
+extern async_stats_t gAsyncStats;
+extern handler_t glAsyncHandler;
+
+/**
+ * A free buffer of ASYNC_BUFFER_SIZE bytes (size) for the producer or
+ * NULL if they're all filling or queued, or the transaction is over.
+ **/
+CyU3PDmaBuffer_t *async_get(void);
+
+/**
+ * Queues buf (from async_get) with buf->count bytes to be sent.  last
+ * ends the transaction after it.  Returns CY_U3P_ERROR_NOT_STARTED after
+ * the last commit or stop and CY_U3P_ERROR_BAD_ARGUMENT for a buffer
+ * that isn't whole packets, unless it's the last of a read.  The buffer
+ * isn't queued then and is still the producer's.
+ **/
+uint16_t async_commit(CyU3PDmaBuffer_t *buf, CyBool_t last);
+
+/**
+ * Stops the producer of a transaction still running.  The uninit handler
+ * of async terminals.
+ **/
+void async_uninit(void);
+
+#define DECLARE_ASYNC_HANDLER(term, init_func, read_func, write_func, producer) \
+  DECLARE_HANDLER(&glAsyncHandler,term,0,init_func,read_func,write_func,0,0,async_uninit,producer)
+
+#endif
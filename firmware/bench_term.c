@@ -0,0 +1,246 @@
+
+#include <cyu3system.h>
+#include <cyu3error.h>
+#include <cyu3usb.h>
+
+#include "main.h"
+#include "bench_term.h"
+#include "hwtimer.h"
+#include "prbs.h"
+#include "rdwr.h"
+#include "log.h"
+#include <fx3_terminals.h>
+
+#ifndef DEBUG_BENCH
+#undef log_debug
+#define log_debug(...) do {} while (0)
+#endif
+
+typedef struct {
+  uint32_t mode;
+  uint32_t seed;
+  uint32_t verify;
+  uint32_t errors;  // mismatched words in the last data write
+  uint32_t bit_errors; // flipped bits in the mismatched words
+  uint32_t dropped; // times the checker lost sync in the last data write
+  uint32_t phy_errors; // accumulated CyU3PUsbGetErrorCounts
+  uint32_t link_errors;
+  uint32_t bytes;   // bytes in the last data transaction
+  uint32_t elapsed; // hwtimer ticks of the last data transaction
+  uint32_t word;    // next pattern word
+  uint32_t t0;
+  uint16_t filled;  // buffers written this transaction (BENCH_PATTERN_STATIC)
+} bench_t;
+
+bench_t gBench = { BENCH_PATTERN_COUNTER, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+#define RAMP_WORD(s) (((s) & 0xFFFF) | ((s)+1) << 16)
+#define RAMP_NEXT(w) ((((w)+2) & 0xFFFF) | (((w) & 0xFFFF0000) + 0x20000))
+
+static uint32_t bench_first_word() {
+  switch (gBench.mode) {
+    case BENCH_PATTERN_PRBS: return PRBS_SEED(gBench.seed);
+    case BENCH_PATTERN_RAMP: return RAMP_WORD(gBench.seed);
+    default: return gBench.seed;
+  }
+}
+
+static uint32_t bench_next(uint32_t w) {
+  switch (gBench.mode) {
+    case BENCH_PATTERN_COUNTER: return w+1;
+    case BENCH_PATTERN_PRBS: return prbs31_next(w);
+    case BENCH_PATTERN_RAMP: return RAMP_NEXT(w);
+    default: return w;
+  }
+}
+
+uint16_t bench_init() {
+  if (gRdwrCmd.header.reg_addr != BENCH_DATA) return 0;
+  gBench.word = bench_first_word();
+  gBench.errors = 0;
+  gBench.bit_errors = 0;
+  gBench.dropped = 0;
+  gBench.bytes = 0;
+  gBench.elapsed = 0;
+  gBench.filled = 0;
+  gBench.t0 = hwtimer_ticks();
+  return 0;
+}
+
+// dma buffers are 32 byte aligned so whole words are safe
+static void bench_fill(CyU3PDmaBuffer_t* buf) {
+  uint32_t *p = (uint32_t*)buf->buffer;
+  uint16_t n = buf->count>>2;
+  uint32_t w = gBench.word;
+
+  switch (gBench.mode) {
+    case BENCH_PATTERN_COUNTER:
+      while (n--) *p++ = w++;
+      break;
+    case BENCH_PATTERN_PRBS:
+      while (n--) {
+        *p++ = w;
+        w = prbs31_next(w);
+      }
+      break;
+    case BENCH_PATTERN_RAMP:
+      while (n--) {
+        *p++ = w;
+        w = RAMP_NEXT(w);
+      }
+      break;
+    case BENCH_PATTERN_STATIC:
+      if (gBench.filled >= CY_FX_EP_BUF_COUNT) {
+        p += n;
+        break;
+      }
+      ++gBench.filled;
+      // fall through
+    default:
+      while (n--) *p++ = w;
+      break;
+  }
+  if (buf->count & 3) {
+    // odd length transfer gets the low bytes of the next word
+    CyU3PMemCopy((uint8_t*)p, (uint8_t*)&w, buf->count & 3);
+    w = bench_next(w);
+  }
+  gBench.word = w;
+}
+
+/**
+ * The fast path is a single compare per word.  Mismatched words are
+ * counted and their flipped bits added up.  A word with more than
+ * BENCH_SYNC_BITS flipped bits is more likely data from somewhere else
+ * in the stream (a dropped or repeated buffer) than a corrupted word so
+ * the checker relocks to it and counts a drop instead.  That way a lost
+ * buffer costs one drop instead of every following word.
+ *
+ * Counter words a few buffers apart differ in only a few bits so
+ * COUNTER relocks when the word is off by whole packets (every dma
+ * buffer is whole packets) and the next word follows it instead.
+ **/
+#ifndef BENCH_SYNC_BITS
+#define BENCH_SYNC_BITS 8
+#endif
+
+static uint32_t bench_mismatch(uint32_t got, uint32_t expected) {
+  uint32_t bits = __builtin_popcount(got ^ expected);
+  if (bits > BENCH_SYNC_BITS) {
+    ++gBench.dropped;
+    return got;
+  }
+  ++gBench.errors;
+  gBench.bit_errors += bits;
+  return expected;
+}
+
+static uint32_t bench_counter_mismatch(uint32_t got, uint32_t expected, uint32_t next) {
+  int32_t packet = gRdwrCmd.ep_buffer_size>>2; // 0 before the app started (rdwr_local)
+  if (packet && !((int32_t)(got - expected) % packet) && next == got+1) {
+    ++gBench.dropped;
+    return got;
+  }
+  return bench_mismatch(got, expected);
+}
+
+static void bench_check(CyU3PDmaBuffer_t* buf) {
+  const uint32_t *p = (const uint32_t*)buf->buffer;
+  uint16_t n = buf->count>>2;
+  uint32_t w = gBench.word;
+
+  switch (gBench.mode) {
+    case BENCH_PATTERN_COUNTER:
+      for (; n--; ++p, ++w)
+        if (*p != w) w = bench_counter_mismatch(*p, w, n ? p[1] : *p+1);
+      break;
+    case BENCH_PATTERN_PRBS:
+      for (; n--; ++p, w = prbs31_next(w))
+        if (*p != w) w = bench_mismatch(*p, w);
+      break;
+    case BENCH_PATTERN_RAMP:
+      for (; n--; ++p, w = RAMP_NEXT(w))
+        if (*p != w) w = bench_mismatch(*p, w);
+      break;
+    default:
+      for (; n--; ++p)
+        if (*p != w) w = bench_mismatch(*p, w);
+      break;
+  }
+  gBench.word = w;
+}
+
+static void bench_link_errors() {
+  uint16_t phy=0, lnk=0;
+  // counts are cleared by the read and only kept for super speed
+  if (CyU3PUsbGetErrorCounts(&phy, &lnk) == CY_U3P_SUCCESS) {
+    gBench.phy_errors += phy;
+    gBench.link_errors += lnk;
+  }
+}
+
+static void bench_account(CyU3PDmaBuffer_t* buf) {
+  gBench.bytes = gRdwrCmd.transfered_so_far + buf->count;
+  gBench.elapsed = hwtimer_ticks() - gBench.t0;
+}
+
+uint16_t bench_read(CyU3PDmaBuffer_t* buf) {
+  uint32_t val;
+  switch (gRdwrCmd.header.reg_addr) {
+    case BENCH_DATA:
+      bench_fill(buf);
+      bench_account(buf);
+      return 0;
+    case BENCH_MODE: val = gBench.mode; break;
+    case BENCH_SEED: val = gBench.seed; break;
+    case BENCH_VERIFY: val = gBench.verify; break;
+    case BENCH_ERRORS: val = gBench.errors; break;
+    case BENCH_BYTES: val = gBench.bytes; break;
+    case BENCH_ELAPSED: val = gBench.elapsed; break;
+    case BENCH_TICKS_HZ: val = HWTIMER_HZ; break;
+    case BENCH_BIT_ERRORS: val = gBench.bit_errors; break;
+    case BENCH_DROPPED: val = gBench.dropped; break;
+    case BENCH_PHY_ERRORS:
+      bench_link_errors();
+      val = gBench.phy_errors;
+      break;
+    case BENCH_LINK_ERRORS:
+      bench_link_errors();
+      val = gBench.link_errors;
+      break;
+    default:
+      return 1;
+  }
+  CyU3PMemCopy(buf->buffer, (uint8_t*)&val, 4);
+  return 0;
+}
+
+uint16_t bench_write(CyU3PDmaBuffer_t* buf) {
+  uint32_t val;
+  if (gRdwrCmd.header.reg_addr == BENCH_DATA) {
+    if (gBench.verify) bench_check(buf);
+    bench_account(buf);
+    return 0;
+  }
+
+  CyU3PMemCopy((uint8_t*)&val, buf->buffer, 4);
+  switch (gRdwrCmd.header.reg_addr) {
+    case BENCH_MODE:
+      if (val > BENCH_PATTERN_RAMP) return 1;
+      gBench.mode = val;
+      break;
+    case BENCH_SEED: gBench.seed = val; break;
+    case BENCH_VERIFY: gBench.verify = val; break;
+    case BENCH_PHY_ERRORS:
+    case BENCH_LINK_ERRORS:
+      // any write restarts both counts
+      bench_link_errors();
+      gBench.phy_errors = 0;
+      gBench.link_errors = 0;
+      break;
+    default:
+      return 1;
+  }
+  log_debug ( "bench reg %d=%d\n", gRdwrCmd.header.reg_addr, val );
+  return 0;
+}
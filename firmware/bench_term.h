@@ -0,0 +1,40 @@
+#ifndef BENCH_TERM_H
+#define BENCH_TERM_H
+
+#include "handlers.h"
+
+/**
+ * Data generator and sink for measuring the usb pipe.
+ *
+ * Reads from the data register return a pattern selected by the mode
+ * register.  Writes to the data register are counted and optionally
+ * checked against the same pattern.  Each data transaction restarts the
+ * pattern from the seed register and records the bytes transferred and
+ * the device time from the start of the transaction until the last
+ * buffer was handled.
+ *
+ * Checked writes count mismatched words, flipped bits and the number of
+ * times the checker had to relock to the stream (dropped or repeated
+ * buffers, detected in PRBS and COUNTER data.)  Together with the usb phy/link error counts that makes a
+ * cable/hub qualification test at full rate.  See py/fx3/linktest.py.
+ **/
+
+enum BENCH_PATTERN {
+  BENCH_PATTERN_COUNTER=0,  // 32 bit words counting up from seed
+  BENCH_PATTERN_PRBS,       // PRBS31 words (see prbs.h) starting with seed
+  BENCH_PATTERN_CONSTANT,   // seed repeated
+  BENCH_PATTERN_STATIC,     // seed repeated but only the first buffers of each
+                         // transaction are written.  The cpu doesn't
+                         // touch the rest of the data.
+  BENCH_PATTERN_RAMP        // 16 bit samples counting up from the low half
+                         // of seed (slowly varying sensor data)
+};
+
+uint16_t bench_init();
+uint16_t bench_read(CyU3PDmaBuffer_t*);
+uint16_t bench_write(CyU3PDmaBuffer_t*);
+
+#define DECLARE_BENCH_HANDLER(term) \
+  DECLARE_HANDLER(&glCpuHandler,term,0,bench_init,bench_read,bench_write,0,0,0,0)
+
+#endif
@@ -0,0 +1,158 @@
+
+#include <cyu3system.h>
+#include <cyu3error.h>
+#include <cyu3gpio.h>
+
+#include "capture.h"
+#include "hwtimer.h"
+#include "notify.h"
+#include "rdwr.h"
+#include "log.h"
+#include <fx3_terminals.h>
+
+#ifndef DEBUG_CAPTURE
+#undef log_debug
+#define log_debug(...) do {} while (0)
+#endif
+
+capture_edge_t gCaptureRing[CAPTURE_RING_SIZE];
+volatile uint32_t gCaptureHead=0; // written by isr only
+volatile uint32_t gCaptureTail=0; // written by capture_read only
+volatile uint32_t gCaptureDropped=0;
+uint16_t gCaptureSeq=0;
+uint8_t gCaptureEdge[CAPTURE_GPIO_COUNT]; // CyU3PGpioIntrMode_t per pin, 0 if off
+uint8_t gCapturePin=0;
+
+static uint32_t capture_count() {
+  return (gCaptureHead - gCaptureTail) & (CAPTURE_RING_SIZE-1);
+}
+
+CyBool_t capture_isr(uint8_t gpioId) {
+  uint32_t head, next;
+  CyBool_t level=CyFalse;
+
+  if (gpioId >= CAPTURE_GPIO_COUNT || !gCaptureEdge[gpioId]) return CyFalse;
+
+  head = gCaptureHead;
+  next = (head+1) & (CAPTURE_RING_SIZE-1);
+  ++gCaptureSeq;
+  if (next == gCaptureTail) {
+    ++gCaptureDropped;
+    return CyTrue;
+  }
+  CyU3PGpioSimpleGetValue(gpioId, &level);
+  gCaptureRing[head].ticks = hwtimer_ticks();
+  gCaptureRing[head].pin = gpioId;
+  gCaptureRing[head].level = level ? 1 : 0;
+  gCaptureRing[head].seq = gCaptureSeq-1;
+  gCaptureHead = next;
+  if (capture_count() == CAPTURE_RING_SIZE/2)
+    notify_post(NOTIFY_CAPTURE, CAPTURE_RING_SIZE/2, gCaptureDropped);
+  return CyTrue;
+}
+
+static uint16_t capture_config(uint8_t pin, uint32_t edge) {
+  CyU3PGpioSimpleConfig_t cfg;
+  CyU3PReturnStatus_t status;
+
+  if (edge > CY_U3P_GPIO_INTR_BOTH_EDGE) return 1;
+  if (!edge) {
+    if (gCaptureEdge[pin]) {
+      gCaptureEdge[pin] = 0;
+      CyU3PGpioDisable(pin);
+    }
+    return 0;
+  }
+
+  // take the pin away from whatever the io matrix had it set to
+  status = CyU3PDeviceGpioOverride(pin, CyTrue);
+  if (status) {
+    log_error ( "Fail to override capture gpio %d: %d\n", pin, status );
+    return status;
+  }
+  CyU3PMemSet((uint8_t*)&cfg, 0, sizeof(cfg));
+  cfg.outValue    = CyFalse;
+  cfg.driveLowEn  = CyFalse;
+  cfg.driveHighEn = CyFalse;
+  cfg.inputEn     = CyTrue;
+  cfg.intrMode    = (CyU3PGpioIntrMode_t)edge;
+  gCaptureEdge[pin] = edge; // before the first interrupt can come in
+  status = CyU3PGpioSetSimpleConfig(pin, &cfg);
+  if (status) {
+    log_error ( "Fail to config capture gpio %d: %d\n", pin, status );
+    gCaptureEdge[pin] = 0;
+    return status;
+  }
+  log_debug ( "capture gpio %d edge %d\n", pin, edge );
+  return 0;
+}
+
+/**
+ * Copies as many whole edges as fit in the buffer and fills the rest
+ * with CAPTURE_PAD_PIN edges.
+ **/
+static void capture_drain(CyU3PDmaBuffer_t* buf) {
+  uint32_t n = buf->count / sizeof(capture_edge_t);
+  uint32_t avail = capture_count();
+  uint32_t tail = gCaptureTail;
+  uint8_t *dst = buf->buffer;
+
+  if (n>avail) n=avail;
+  while (n) {
+    uint32_t run = CAPTURE_RING_SIZE - tail;
+    if (run>n) run=n;
+    CyU3PMemCopy(dst, (uint8_t*)&gCaptureRing[tail], run*sizeof(capture_edge_t));
+    dst += run*sizeof(capture_edge_t);
+    tail = (tail+run) & (CAPTURE_RING_SIZE-1);
+    n -= run;
+  }
+  gCaptureTail = tail;
+  CyU3PMemSet(dst, CAPTURE_PAD_PIN, buf->count - (dst-buf->buffer));
+}
+
+uint16_t capture_read(CyU3PDmaBuffer_t* buf) {
+  uint32_t val;
+  switch (gRdwrCmd.header.reg_addr) {
+    case CAPTURE_PIN:
+      val = gCapturePin;
+      break;
+    case CAPTURE_EDGE:
+      val = gCaptureEdge[gCapturePin];
+      break;
+    case CAPTURE_COUNT:
+      val = capture_count();
+      break;
+    case CAPTURE_DROPPED:
+      val = gCaptureDropped;
+      break;
+    case CAPTURE_TICKS_HZ:
+      val = HWTIMER_HZ;
+      break;
+    case CAPTURE_EDGES:
+      capture_drain(buf);
+      return 0;
+    default:
+      return 1;
+  }
+  CyU3PMemCopy(buf->buffer, (uint8_t*)&val, 4);
+  return 0;
+}
+
+uint16_t capture_write(CyU3PDmaBuffer_t* buf) {
+  uint32_t val;
+  CyU3PMemCopy((uint8_t*)&val, buf->buffer, 4);
+  switch (gRdwrCmd.header.reg_addr) {
+    case CAPTURE_PIN:
+      if (val >= CAPTURE_GPIO_COUNT) return 1;
+      gCapturePin = val;
+      return 0;
+    case CAPTURE_EDGE:
+      return capture_config(gCapturePin, val);
+    case CAPTURE_DROPPED:
+      gCaptureTail = gCaptureHead;
+      gCaptureDropped = 0;
+      return 0;
+    default:
+      return 1;
+  }
+}
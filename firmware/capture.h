@@ -0,0 +1,43 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+/**
+ * GPIO edge capture.
+ *
+ * The CAPTURE terminal enables edge interrupts on free pins.  The gpio
+ * interrupt records the hwtimer timestamp, pin and level of each edge
+ * into a ring buffer that the host drains in bulk from the edges
+ * register, so short pulses aren't missed between polls.  When the ring
+ * passes half full a NOTIFY_CAPTURE is posted (see notify.h) so the host
+ * doesn't have to poll the count either.  See py/fx3/capture.py.
+ *
+ * Add capture.c to SOURCE and -D GPIO_CAPTURE to CCFLAGS to enable.
+ **/
+
+#include "handlers.h"
+
+#ifndef CAPTURE_RING_SIZE
+#define CAPTURE_RING_SIZE 1024 // edges, must be a power of 2
+#endif
+#define CAPTURE_GPIO_COUNT 61
+#define CAPTURE_PAD_PIN 0xFF // pin of the fill after the last edge in a read
+
+typedef struct {
+  uint32_t ticks; // hwtimer_ticks at the interrupt
+  uint8_t pin;
+  uint8_t level;  // pin value read in the interrupt
+  uint16_t seq;   // counts every edge so drops show as a gap
+} capture_edge_t;
+
+/**
+ * GPIO interrupt hook.  Returns CyTrue if gpioId is being captured.
+ **/
+CyBool_t capture_isr(uint8_t gpioId);
+
+uint16_t capture_read(CyU3PDmaBuffer_t*);
+uint16_t capture_write(CyU3PDmaBuffer_t*);
+
+#define DECLARE_CAPTURE_HANDLER(term) \
+  DECLARE_HANDLER(&glCpuHandler,term,0,0,capture_read,capture_write,0,0,0,0)
+
+#endif
@@ -0,0 +1,109 @@
+#include <cyu3system.h>
+#include <cyu3error.h>
+
+#include "compress.h"
+#include "main.h"
+#include "rdwr.h"
+#include "log.h"
+
+#ifndef DEBUG_COMPRESS
+#undef log_debug
+#define log_debug(...) do {} while (0)
+#endif
+
+#define COMPRESS_MAX_BUFFER (1024*CY_FX_DMA_SIZE_MULTIPLIER*CY_FX_EP_BURST_LENGTH) // Src buffer size at super speed
+
+uint8_t gCompressOut[COMPRESS_MAX_BUFFER] __attribute__ ((aligned (32)));
+uint8_t gCompressCodec=COMPRESS_RAW;
+
+/**
+ * Returns the compressed bytes or 0 if they don't fit in max.
+ **/
+static uint32_t compress_rle(const uint16_t *in, uint32_t n, uint8_t *out, uint32_t max) {
+  uint8_t *o = out, *end = out + max, *lit = 0; // control byte of the open literal token
+  uint32_t run;
+  uint16_t v;
+  while (n) {
+    v = *in;
+    for (run = 1; run < n && run < 130 && in[run] == v; ++run);
+    if (o + 3 > end) return 0;
+    if (run >= 3) {
+      *o++ = 0x80 + run - 3;
+      *o++ = v;
+      *o++ = v >> 8;
+      lit = 0;
+      in += run;
+      n -= run;
+    } else {
+      if (!lit) {
+        lit = o++;
+        *lit = 0;
+      } else {
+        ++*lit;
+      }
+      *o++ = v;
+      *o++ = v >> 8;
+      if (*lit == 0x7f) lit = 0;
+      ++in;
+      --n;
+    }
+  }
+  return o - out;
+}
+
+static uint32_t compress_delta(const uint16_t *in, uint32_t n, uint8_t *out, uint32_t max) {
+  uint8_t *o = out, *end = out + max;
+  uint16_t prev = 0, z;
+  int16_t d;
+  while (n--) {
+    if (o + 3 > end) return 0;
+    d = *in - prev;
+    prev = *in++;
+    z = (d << 1) ^ (d >> 15);
+    if (z < 0x80) {
+      *o++ = z;
+    } else if (z < 0x4000) {
+      *o++ = z | 0x80;
+      *o++ = z >> 7;
+    } else {
+      *o++ = z | 0x80;
+      *o++ = (z >> 7) | 0x80;
+      *o++ = z >> 14;
+    }
+  }
+  return o - out;
+}
+
+uint16_t compress_start(void) {
+  uint16_t flags = gRdwrCmd.header.flags;
+  gCompressCodec = (flags & RDWR_FLAG_COMPRESS_MASK) >> RDWR_FLAG_COMPRESS_SHIFT;
+  if (!gCompressCodec) return 0;
+  if (gCompressCodec > COMPRESS_DELTA || !RDWR_FRAMED()) {
+    log_error ( "Bad compress codec %d\n", gCompressCodec );
+    gCompressCodec = COMPRESS_RAW;
+    return 1;
+  }
+  log_debug ( "compress codec %d\n", gCompressCodec );
+  return 0;
+}
+
+uint32_t compress_frame(CyU3PDmaBuffer_t *buf, compress_hdr_t *hdr) {
+  uint32_t n = 0;
+
+  hdr->raw_count = buf->count;
+  hdr->reserved = 0;
+  // words only, and it has to save something to be worth the copy
+  if (!(buf->count & 1) && buf->count <= COMPRESS_MAX_BUFFER) {
+    if (gCompressCodec == COMPRESS_RLE)
+      n = compress_rle((const uint16_t*)buf->buffer, buf->count/2, gCompressOut, buf->count-1);
+    else
+      n = compress_delta((const uint16_t*)buf->buffer, buf->count/2, gCompressOut, buf->count-1);
+  }
+  if (!n) {
+    hdr->codec = COMPRESS_RAW;
+    return buf->count;
+  }
+  CyU3PMemCopy(buf->buffer, gCompressOut, n);
+  hdr->codec = gCompressCodec;
+  return n;
+}
@@ -0,0 +1,48 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+/**
+ * Per buffer compression of framed streams.
+ *
+ * A streaming read with RDWR_FLAG_FRAMING and RDWR_FLAG_COMPRESS(codec)
+ * compresses each buffer after the read handler fills it.  The frame is
+ * the frame_hdr_t, a compress_hdr_t and the compressed payload padded to
+ * whole packets, so sparse or slowly varying data costs fewer packets on
+ * a link the data would otherwise saturate.  Every frame decodes on its
+ * own; a buffer that doesn't shrink goes out as COMPRESS_RAW.
+ *
+ * Both codecs work on 16 bit little endian words:
+ *
+ *  COMPRESS_RLE    a control byte c then, for c < 0x80, c+1 literal
+ *                  words or, for c >= 0x80, one word repeated c-0x80+3
+ *                  times.
+ *  COMPRESS_DELTA  the difference from the previous word (0 before the
+ *                  first) zigzag encoded as a 1 to 3 byte varint, low 7
+ *                  bits first with 0x80 set on all but the last byte.
+ *
+ * The loops are byte stores and compares only, no divides or unaligned
+ * loads for the ARM926.  A buffer costs one pass plus a copy of the
+ * compressed bytes back into the dma buffer.
+ *
+ * Add compress.c to SOURCE and -D READ_COMPRESS to CCFLAGS to enable.
+ * Without it streams with the flag fail to start.
+ **/
+
+#include "handlers.h"
+#include "vendor_commands.h"
+
+extern uint8_t gCompressCodec; // COMPRESS_CODEC of the current stream, 0 for none
+
+/**
+ * Checks the flags.  Called by cpu_handler_cmd_start for every
+ * transaction.
+ **/
+uint16_t compress_start(void);
+
+/**
+ * Compresses buf in place and fills in hdr.  Returns the payload bytes
+ * after hdr.
+ **/
+uint32_t compress_frame(CyU3PDmaBuffer_t *buf, compress_hdr_t *hdr);
+
+#endif
@@ -17,16 +17,57 @@ SOURCE += $(FX3DIR)handlers.c
 SOURCE += $(FX3DIR)../../../Microchip/M24XX/fx3/m24xx.c
 SOURCE += $(FX3DIR)main.c
 SOURCE += $(FX3DIR)fx3_term.c
+SOURCE += $(FX3DIR)bench_term.c
+SOURCE += $(FX3DIR)membench.c
 SOURCE += $(FX3DIR)serial.c # remove and replace with alt for non i2c serial
 SOURCE += $(FX3DIR)log.c
+SOURCE += $(FX3DIR)hwtimer.c
+SOURCE += $(FX3DIR)notify.c
 # only needed if you want firmware_di
 #SOURCE += $(FX3DIR)di.c
+# only needed for the sampling profiler (also set PROF_GPIO below)
+#SOURCE += $(FX3DIR)prof.c
+# only needed for gpio edge capture (also set GPIO_CAPTURE below)
+#SOURCE += $(FX3DIR)capture.c
+# only needed for register macros (also set MACRO_ENGINE below)
+#SOURCE += $(FX3DIR)macro.c
+# only needed for the register sampler (also set SAMPLER below)
+#SOURCE += $(FX3DIR)sampler.c
+# only needed for pre-trigger capture (also set PRETRIG below)
+#SOURCE += $(FX3DIR)pretrig.c
+# only needed for the sram scratch terminal (also set SRAM_TERM below)
+#SOURCE += $(FX3DIR)sram_term.c
+# only needed for read path reduction kernels (also set READ_REDUCE below)
+#SOURCE += $(FX3DIR)reduce.c
+# only needed for compressed streams (also set READ_COMPRESS below)
+#SOURCE += $(FX3DIR)compress.c
+# only needed for terminals that fill their own buffers (DECLARE_ASYNC_HANDLER)
+#SOURCE += $(FX3DIR)async.c
 
 # add any custom debugging or cflags
 #CCFLAGS += -Dxxx
 #BUILD_CCFLAGS += -DENABLE_LOGGING
 #BUILD_CCFLAGS += -DDEBUG_MAIN
 
+# hardware timers use complex gpio blocks.  Pick pins that are free
+# on your board and don't share a block (pin%8).  Without HWTIMER_GPIO
+# the timebase (VC_TIME, ext ack and bench ticks) is CyU3PGetTime, 1 kHz.
+#BUILD_CCFLAGS += -DHWTIMER_GPIO=xx
+#BUILD_CCFLAGS += -DPROF_GPIO=xx
+#BUILD_CCFLAGS += -DGPIO_CAPTURE
+#BUILD_CCFLAGS += -DMACRO_ENGINE
+#BUILD_CCFLAGS += -DSAMPLER
+#BUILD_CCFLAGS += -DSAMPLER_GPIO=xx
+#BUILD_CCFLAGS += -DPRETRIG
+#BUILD_CCFLAGS += -DPRETRIG_RING_SIZE=0x20000
+#BUILD_CCFLAGS += -DSRAM_TERM
+#BUILD_CCFLAGS += -DSRAM_TERM_SIZE=0x10000
+#BUILD_CCFLAGS += -DREAD_REDUCE
+#BUILD_CCFLAGS += -DREAD_COMPRESS
+#BUILD_CCFLAGS += -DASYNC_BUFFERS=8
+# time the cpu handler dma calls (MEMBENCH dma_stats)
+#BUILD_CCFLAGS += -DDMA_STATS
+
 # enable if you want to have di get/set functionality inside the fx3
 # requires adding a source file with di_main
 # TODO this is changed since handler change.
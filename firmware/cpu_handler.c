@@ -7,6 +7,18 @@
 #include "log.h"
 #include "error_handler.h"
 #include "main.h"
+#include "dma_stats.h"
+#include "hwtimer.h"
+#include "cpu_handler.h"
+#ifdef READ_REDUCE
+#include "reduce.h"
+#endif
+#ifdef READ_COMPRESS
+#include "compress.h"
+#define SRC_HEADER() (RDWR_FRAMED() ? sizeof(frame_hdr_t) + (gCompressCodec ? sizeof(compress_hdr_t) : 0) : 0)
+#else
+#define SRC_HEADER() (RDWR_FRAMED() ? sizeof(frame_hdr_t) : 0)
+#endif
 
 #ifndef DEBUG_CPU_HANDLER
 #undef log_debug
@@ -19,45 +31,189 @@ CyU3PDmaChannel glChHandleBulkSrc;  /* DMA MANUAL_OUT channel handle. */
 CyBool_t gCpuHandlerActive = CyFalse;
 extern rdwr_cmd_t gRdwrCmd;
 ack_pkt_t gAckPkt;
+uint64_t gStreamTotal; // bytes sent by the current streaming read
+ext_ack_pkt_t gExtAck; // metrics of the current command for RDWR_FLAG_EXT_ACK
+uint16_t gSrcHeader; // prodHeader of glChHandleBulkSrc, room for a frame_hdr_t
+uint32_t gFrameSeq;  // next frame_hdr_t.seq of a framed stream
+CyU3PDmaBuffer_t gWriteBuf; // Sink buffer being written
+CyBool_t gWriteHeld;        // gWriteBuf's write handler returned IO_HANDLER_BUSY
+CyU3PDmaBuffer_t gReadBuf;  // Src buffer a v2 read handler is filling
+uint32_t gReadFill;         // bytes of gReadBuf filled so far
+uint32_t gReadWant;         // bytes gReadBuf should get
+CyBool_t gReadHeld;         // gReadBuf goes back to the handler for more
+CyBool_t gReadShort;        // a v2 read handler ended the read early
+
+/* The last numbered get.  A retry of it (same header and seq) is answered
+ * from here instead of reading the terminal again. */
+#define REPLAY_MAX 64
+#define REPLAY_CACHEABLE() (gRdwrCmd.header.command == COMMAND_GET && \
+                            gRdwrCmd.header.seq && \
+                            gRdwrCmd.header.transfer_length <= REPLAY_MAX)
+typedef struct {
+  rdwr_data_header_t header;
+  ack_pkt_t ack;
+  uint8_t data[REPLAY_MAX];
+  CyBool_t valid;
+} replay_t;
+replay_t gReplay;
+CyBool_t gReplaying; // current command is answered from gReplay
+#ifdef DMA_STATS
+dma_stat_t gDmaStats[DMA_STAT_COUNT];
+#endif
+
+uint16_t cpu_handler_create_src(uint16_t header);
+void cpu_handler_send(CyU3PDmaBuffer_t *buf_p);
 
 void cpu_handler_read(CyU3PDmaBuffer_t *buf_p) {
   uint32_t status;
   log_debug("C %d\n", buf_p->size);
-  buf_p->count = (gRdwrCmd.transfered_so_far + buf_p->size > gRdwrCmd.header.transfer_length) ? gRdwrCmd.header.transfer_length - gRdwrCmd.transfered_so_far : buf_p->size;
+  if (RDWR_STREAMING()) {
+    buf_p->count = buf_p->size; // full buffers so only the ack is a short packet
+  } else {
+    buf_p->count = (gRdwrCmd.transfered_so_far + buf_p->size > gRdwrCmd.header.transfer_length) ? gRdwrCmd.header.transfer_length - gRdwrCmd.transfered_so_far : buf_p->size;
+  }
 
   // Call the read handler if the read handler function exists and if
   // the status is still OK. Otherwise, try continuing the data
   // transfer with bogus data.
-  if(gRdwrCmd.io_handler->read_handler && gAckPkt.status == 0) {
+  if (gReplaying) {
+    CyU3PMemCopy(buf_p->buffer, gReplay.data, buf_p->count);
+  } else if(gRdwrCmd.io_handler->read_handler && gAckPkt.status == 0) {
+#ifdef READ_REDUCE
+    if (gReduceKernel)
+      status=reduce_read(buf_p);
+    else
+#endif
     status=gRdwrCmd.io_handler->read_handler(buf_p);
     if (status) {
       log_error ( "Read handler fail status=%u\n", status);
       gAckPkt.status |= status;
+      gExtAck.handler_status |= status;
     }
   }
-
   gRdwrCmd.transfered_so_far += buf_p->count;
-  status=CyU3PDmaChannelCommitBuffer(&glChHandleBulkSrc, buf_p->count, 0);
+  gStreamTotal += buf_p->count;
+  cpu_handler_send(buf_p);
+}
+
+/* Commits a filled Src buffer of buf_p->count bytes. */
+void cpu_handler_send(CyU3PDmaBuffer_t *buf_p) {
+  uint32_t status;
+  if (!gReplaying && REPLAY_CACHEABLE())
+    CyU3PMemCopy(gReplay.data, buf_p->buffer, buf_p->count);
+
+  if (RDWR_FRAMED()) {
+    // the header space in front of the buffer, sent with it
+    frame_hdr_t *frame = (frame_hdr_t*)(buf_p->buffer - gSrcHeader);
+#ifdef READ_COMPRESS
+    if (gCompressCodec)
+      buf_p->count = compress_frame(buf_p, (compress_hdr_t*)(frame+1));
+#endif
+    frame->id = FRAME_HDR_ID;
+    frame->status = gAckPkt.status;
+    frame->seq = gFrameSeq++;
+    frame->count = buf_p->count + gSrcHeader - sizeof(frame_hdr_t);
+    frame->ticks = hwtimer_ticks();
+    buf_p->count += gSrcHeader;
+#ifdef READ_COMPRESS
+    // whole packets so a short frame isn't taken for the end of the stream
+    if (gCompressCodec)
+      buf_p->count = (buf_p->count + gRdwrCmd.ep_buffer_size - 1) & ~(gRdwrCmd.ep_buffer_size - 1);
+#endif
+  }
+  status=DMA_STAT(DMA_STAT_COMMIT, CyU3PDmaChannelCommitBuffer(&glChHandleBulkSrc, buf_p->count, 0));
   if (status) log_error( "RD: Dma Channel fail to commit buffer: %u\n", status);
   gAckPkt.status |= status;
+  gExtAck.dma_status |= status;
   if (gAckPkt.status) {
     log_error ( "gAckPck.status %d\n" );
   }
   log_debug("R %d/%d\n", gRdwrCmd.transfered_so_far, gRdwrCmd.header.transfer_length);
 }
 
-void cpu_handler_write(CyU3PDmaBuffer_t *buf_p) {
+/* v2 read handlers fill gReadBuf in one or more calls.  It goes out when
+ * full or, short, at the end of a read. */
+void cpu_handler_readv(void) {
+  CyU3PDmaBuffer_t iov;
+  uint16_t status = 0;
+
+  iov.buffer = gReadBuf.buffer + gReadFill;
+  iov.size = gReadBuf.size - gReadFill;
+  iov.count = gReadWant - gReadFill;
+  iov.status = 0;
+  // after a failure the rest goes out as whatever is in the buffer
+  if (gAckPkt.status == 0) {
+    status = gRdwrCmd.io_handler->readv_handler(&iov, 1);
+    if (iov.count > gReadWant - gReadFill) iov.count = gReadWant - gReadFill;
+  }
+  if (status && status != IO_HANDLER_BUSY) {
+    log_error ( "Read handler fail status=%u\n", status);
+    gAckPkt.status |= status;
+    gExtAck.handler_status |= status;
+    iov.count = gReadWant - gReadFill;
+    status = 0;
+  }
+  // transfered_so_far stays the offset of the next byte the handler fills
+  gReadFill += iov.count;
+  gRdwrCmd.transfered_so_far += iov.count;
+  gStreamTotal += iov.count;
+  if (status == IO_HANDLER_BUSY || (RDWR_STREAMING() && gReadFill < gReadWant)) {
+    gReadHeld = CyTrue;
+    return;
+  }
+  gReadHeld = CyFalse;
+  gReadShort = gReadFill < gReadWant;
+  gReadBuf.count = gReadFill;
+  cpu_handler_send(&gReadBuf);
+  if (gReadShort && gReadFill && !(gReadFill % gRdwrCmd.ep_buffer_size)) {
+    // whole packets don't end the host's transfer, a zero length one does
+    if (!CyU3PDmaChannelGetBuffer(&glChHandleBulkSrc, &iov, 500))
+      CyU3PDmaChannelCommitBuffer(&glChHandleBulkSrc, 0, 0);
+  }
+}
+
+/* v2 write handlers say what they took in the iov, the rest is busy */
+static uint16_t cpu_handler_writev(CyU3PDmaBuffer_t *buf_p) {
+  CyU3PDmaBuffer_t iov = *buf_p;
+  uint16_t status = gRdwrCmd.io_handler->writev_handler(&iov, 1);
+  if (status && status != IO_HANDLER_BUSY) return status;
+  if (iov.count >= buf_p->count) return 0;
+  buf_p->buffer += iov.count;
+  buf_p->count -= iov.count;
+  return IO_HANDLER_BUSY;
+}
+
+/* Returns IO_HANDLER_BUSY if the handler kept buf_p for another pass. */
+uint16_t cpu_handler_write(CyU3PDmaBuffer_t *buf_p) {
   uint32_t status;
-  if(gRdwrCmd.io_handler->write_handler && gAckPkt.status == 0) {
-    status =  gRdwrCmd.io_handler->write_handler(buf_p);
-    if (status) log_error ( "Write handler fail status: %u\n", status);
+  uint8_t *start = buf_p->buffer;
+  if (gAckPkt.status) {
+    status = 0; // drop the rest after a failure
+  } else if (gRdwrCmd.io_handler->writev_handler) {
+    status = cpu_handler_writev(buf_p);
+  } else if (gRdwrCmd.io_handler->write_handler) {
+    status = gRdwrCmd.io_handler->write_handler(buf_p);
+  } else {
+    status = 0;
+  }
+  if (status == IO_HANDLER_BUSY) {
+    // the bytes it took count, the Sink buffer stays with us
+    gRdwrCmd.transfered_so_far += buf_p->buffer - start;
+    log_debug("WRITE busy %d/%d\n", gRdwrCmd.transfered_so_far, gRdwrCmd.header.transfer_length);
+    return IO_HANDLER_BUSY;
+  }
+  if (status) {
+    log_error ( "Write handler fail status: %u\n", status);
     gAckPkt.status |= status;
+    gExtAck.handler_status |= status;
   }
-  status = CyU3PDmaChannelDiscardBuffer(&glChHandleBulkSink);
+  status = DMA_STAT(DMA_STAT_DISCARD, CyU3PDmaChannelDiscardBuffer(&glChHandleBulkSink));
   if (status) log_error ( "WR: Dma Channel fail to discared buffer: %u\n", status);
   gAckPkt.status |= status;
+  gExtAck.dma_status |= status;
   gRdwrCmd.transfered_so_far += buf_p->count;
   log_debug("WRITE %d/%d\n", gRdwrCmd.transfered_so_far, gRdwrCmd.header.transfer_length);
+  return 0;
 }
 
 /* commits the ack packet when any cpu handler is done */
@@ -67,11 +223,32 @@ void cpu_handler_commit_ack() {
 
   status = CyU3PDmaChannelGetBuffer (&glChHandleBulkSrc, &buf_p, 500 ); //CYU3P_NO_WAIT);
   if (status == CY_U3P_SUCCESS) {
-    CyU3PMemCopy(buf_p.buffer, (uint8_t *) (&gAckPkt), sizeof(gAckPkt));
-    CyU3PDmaChannelCommitBuffer (&glChHandleBulkSrc, sizeof(gAckPkt),0);
+    buf_p.buffer -= gSrcHeader; // the ack is a packet of its own, no frame
+
+    if (RDWR_STREAMING()) {
+      stream_ack_pkt_t *ack = (stream_ack_pkt_t*)buf_p.buffer;
+      CyU3PMemCopy((uint8_t*)&ack->ack, (uint8_t *) (&gAckPkt), sizeof(gAckPkt));
+      ack->total_lo = (uint32_t)gStreamTotal;
+      ack->total_hi = (uint32_t)(gStreamTotal>>32);
+      CyU3PDmaChannelCommitBuffer (&glChHandleBulkSrc, sizeof(*ack),0);
+    } else if (gRdwrCmd.header.flags & RDWR_FLAG_EXT_ACK) {
+      CyU3PMemCopy((uint8_t*)&gExtAck.ack, (uint8_t *) (&gAckPkt), sizeof(gAckPkt));
+      gExtAck.t_end = hwtimer_ticks();
+      gExtAck.ticks_hz = HWTIMER_HZ;
+      gExtAck.bytes = gRdwrCmd.transfered_so_far;
+      CyU3PMemCopy(buf_p.buffer, (uint8_t *) (&gExtAck), sizeof(gExtAck));
+      CyU3PDmaChannelCommitBuffer (&glChHandleBulkSrc, sizeof(gExtAck),0);
+    } else {
+      CyU3PMemCopy(buf_p.buffer, (uint8_t *) (&gAckPkt), sizeof(gAckPkt));
+      CyU3PDmaChannelCommitBuffer (&glChHandleBulkSrc, sizeof(gAckPkt),0);
+    }
   }
   if (gAckPkt.status) {
     log_info("ACK %d\n", gAckPkt.status);
+  } else if (!gReplaying && !gReadShort && REPLAY_CACHEABLE()) {
+    CyU3PMemCopy((uint8_t*)&gReplay.header, (uint8_t*)&gRdwrCmd.header, sizeof(gReplay.header));
+    CyU3PMemCopy((uint8_t*)&gReplay.ack, (uint8_t*)&gAckPkt, sizeof(gAckPkt));
+    gReplay.valid = CyTrue;
   }
 }
 
@@ -80,26 +257,84 @@ uint16_t cpu_handler_cmd_start() {
   gAckPkt.id       = ACK_PKT_ID;
   gAckPkt.checksum = 0;
   gAckPkt.status   = 0;
-  gAckPkt.reserved = 0;
+  gAckPkt.seq      = gRdwrCmd.header.seq;
+  gStreamTotal = 0;
+  CyU3PMemSet((uint8_t*)&gExtAck, 0, sizeof(gExtAck));
+  gExtAck.t_start = hwtimer_ticks();
+  gFrameSeq = 0;
+  gWriteHeld = CyFalse;
+  gReadHeld = gReadShort = CyFalse;
+
+#ifdef READ_REDUCE
+  if (reduce_start()) return 1;
+#else
+  if (gRdwrCmd.header.flags & RDWR_FLAG_REDUCE_MASK) return 1; // built without reduce.c
+#endif
+#ifdef READ_COMPRESS
+  if (compress_start()) return 1;
+#else
+  if (gRdwrCmd.header.flags & RDWR_FLAG_COMPRESS_MASK) return 1; // built without compress.c
+#endif
+
+  // framed streams need header space in the Src buffers
+  if (gSrcHeader != SRC_HEADER()) {
+    CyU3PDmaChannelDestroy (&glChHandleBulkSrc);
+    if (cpu_handler_create_src(SRC_HEADER())) return 1;
+    cpu_handler_reset_read();
+  }
+
+  gReplaying = gReplay.valid && gRdwrCmd.header.seq &&
+    !CyU3PMemCmp(&gReplay.header, &gRdwrCmd.header, sizeof(gReplay.header));
+  if (gReplaying) {
+    log_debug ( "replay seq %d\n", gRdwrCmd.header.seq );
+    gAckPkt.checksum = gReplay.ack.checksum;
+  } else {
+    gReplay.valid = CyFalse; // only the last transaction can be retried
+  }
   return 0;
 }
 
 uint16_t cpu_handler_readcb() {
      // a read
-     CyU3PDmaBuffer_t dmaBuf_p;
-     uint16_t ret = CyU3PDmaChannelGetBuffer (&glChHandleBulkSrc, &dmaBuf_p, 500 ); //CYU3P_WAIT_FOREVER);
+     uint32_t t0 = hwtimer_ticks();
+     uint16_t ret;
+     if (gReadHeld) {
+         // a v2 handler is filling it in pieces
+         gExtAck.wait_ticks += rdwr_busy_wait();
+         cpu_handler_readv();
+         return 0;
+     }
+     ret = DMA_STAT(DMA_STAT_GET_SRC, CyU3PDmaChannelGetBuffer (&glChHandleBulkSrc, &gReadBuf, 500 )); //CYU3P_WAIT_FOREVER);
+     gExtAck.wait_ticks += hwtimer_ticks() - t0;
      if (ret != CY_U3P_SUCCESS) {
+         ++gExtAck.dma_waits;
          log_debug ( "didn't get a read buffer: %d\n", ret );
          return ret;
      }
-     cpu_handler_read(&dmaBuf_p);
+     if (gRdwrCmd.io_handler->readv_handler && !gReplaying) {
+         uint32_t left = gRdwrCmd.header.transfer_length - gRdwrCmd.transfered_so_far;
+         gReadWant = (RDWR_STREAMING() || left > gReadBuf.size) ? gReadBuf.size : left;
+         gReadFill = 0;
+         cpu_handler_readv();
+     } else {
+         cpu_handler_read(&gReadBuf);
+     }
      return 0;
 }
 
 uint16_t cpu_handler_writecb() {
-     CyU3PDmaBuffer_t dmaBuf_p;
-     uint16_t ret = CyU3PDmaChannelGetBuffer (&glChHandleBulkSink, &dmaBuf_p, 500 ); //CYU3P_WAIT_FOREVER);
+     uint32_t t0 = hwtimer_ticks();
+     uint16_t ret;
+     if (gWriteHeld) {
+         // the handler was busy with it, give the sink time and retry
+         gExtAck.wait_ticks += rdwr_busy_wait();
+         gWriteHeld = cpu_handler_write(&gWriteBuf) == IO_HANDLER_BUSY;
+         return 0;
+     }
+     ret = DMA_STAT(DMA_STAT_GET_SINK, CyU3PDmaChannelGetBuffer (&glChHandleBulkSink, &gWriteBuf, 500 )); //CYU3P_WAIT_FOREVER);
+     gExtAck.wait_ticks += hwtimer_ticks() - t0;
      if (ret != CY_U3P_SUCCESS) {
+         ++gExtAck.dma_waits;
          // no buffer to write currently
          CyU3PDmaState_t stat;
          log_debug ( "didn't get write buffer: %d\n", ret );
@@ -108,7 +343,7 @@ uint16_t cpu_handler_writecb() {
          return ret;
      }
      
-     cpu_handler_write(&dmaBuf_p);
+     gWriteHeld = cpu_handler_write(&gWriteBuf) == IO_HANDLER_BUSY;
      return 0;
 }
 
@@ -122,18 +357,31 @@ uint16_t cpu_handler_dmacb() {
         return 1;
     }
 
+    if (gRdwrCmd.abort) {
+        cpu_handler_abort();
+        return 0;
+    }
+
     if (gRdwrCmd.header.command & bmSETWRITE) {
         // a write
         // wait for a buffer on the producer socket
         ret=cpu_handler_writecb();
         if (ret) return ret;
         
+    } else if (RDWR_STREAMING()) {
+        // buffers until the host stops the stream
+        if (!gRdwrCmd.stream_stop) return cpu_handler_readcb();
+        if (gReadHeld) gStreamTotal -= gReadFill; // the ack goes in its place
+        log_debug ( "stream stop %d\n", (uint32_t)gStreamTotal );
+        cpu_handler_commit_ack();
+        gRdwrCmd.done = 1;
+        return 0;
     } else {
         ret = cpu_handler_readcb();
         if (ret) return ret;
     }
     
-    if (gRdwrCmd.transfered_so_far >= gRdwrCmd.header.transfer_length) {
+    if (gRdwrCmd.transfered_so_far >= gRdwrCmd.header.transfer_length || gReadShort) {
         cpu_handler_commit_ack();
         gRdwrCmd.done = 1; // note setting done to 1 even if the buffer didn't work
     }
@@ -153,6 +401,7 @@ uint16_t cpu_handler_dmacb() {
 // flush by itself didn't break it
 
 uint16_t cpu_handler_reset_write() {
+  gWriteHeld = CyFalse; // a held buffer goes with the reset
   
   // cpu term at least seems ok with or
   // without flushing so leaving for now.
@@ -174,6 +423,7 @@ uint16_t cpu_handler_reset_write() {
 }
 
 uint16_t cpu_handler_reset_read() {
+  gReadHeld = CyFalse; // a part filled v2 buffer goes with the reset
 
   CyU3PUsbFlushEp(CY_FX_EP_CONSUMER);
 
@@ -189,6 +439,34 @@ uint16_t cpu_handler_reset_read() {
   return apiRetStatus;
 }
 
+/* Creates the DMA MANUAL_OUT (USB IN transfer) channel for the consumer
+ * socket.  header bytes in front of every buffer are left for the cpu
+ * (framed streams); GetBuffer returns the space after them. */
+uint16_t cpu_handler_create_src(uint16_t header) {
+  CyU3PDmaChannelConfig_t dmaCfg;
+  CyU3PReturnStatus_t apiRetStatus;
+
+  CyU3PMemSet ((uint8_t *)&dmaCfg, 0, sizeof (dmaCfg));
+  dmaCfg.size      = gRdwrCmd.ep_buffer_size * CY_FX_DMA_SIZE_MULTIPLIER;
+  // framed streams get more packets per buffer at every speed so the
+  // padding of compressed frames costs little.  Raw and compressed
+  // framing share the size so their throughput compares.
+  if (gRdwrCmd.ep_buffer_size == 1024 || header)
+    dmaCfg.size *= CY_FX_EP_BURST_LENGTH; 
+  dmaCfg.count     = CY_FX_EP_BUF_COUNT;
+  dmaCfg.prodSckId = CY_U3P_CPU_SOCKET_PROD;
+  dmaCfg.consSckId = CY_FX_EP_CONSUMER_SOCKET;
+  dmaCfg.dmaMode   = CY_U3P_DMA_MODE_BYTE;
+  dmaCfg.prodHeader = header;
+  apiRetStatus = CyU3PDmaChannelCreate (&glChHandleBulkSrc, CY_U3P_DMA_TYPE_MANUAL_OUT, &dmaCfg);
+  if (apiRetStatus != CY_U3P_SUCCESS) {
+    log_error("CyU3PDmaChannelCreate failed, Error code = %d\n", apiRetStatus);
+    error_handler(apiRetStatus);
+  }
+  gSrcHeader = header;
+  return apiRetStatus;
+}
+
 /* This function sets up the DMA channels to pipe data to and from the
  * CPU so that cpu handlers can deals with it. */
 uint16_t cpu_handler_setup(uint16_t unused) {
@@ -231,16 +509,7 @@ uint16_t cpu_handler_setup(uint16_t unused) {
         error_handler(apiRetStatus);
       }
 
-      /* Create a DMA MANUAL_OUT (USB IN transfer) channel for the consumer socket. */
-      dmaCfg.prodSckId = CY_U3P_CPU_SOCKET_PROD;
-      dmaCfg.consSckId = CY_FX_EP_CONSUMER_SOCKET;
-      if (gRdwrCmd.ep_buffer_size == 1024)
-        dmaCfg.size *= CY_FX_EP_BURST_LENGTH; 
-      apiRetStatus = CyU3PDmaChannelCreate (&glChHandleBulkSrc, CY_U3P_DMA_TYPE_MANUAL_OUT, &dmaCfg);
-      if (apiRetStatus != CY_U3P_SUCCESS) {
-        log_error("CyU3PDmaChannelCreate failed, Error code = %d\n", apiRetStatus);
-        error_handler(apiRetStatus);
-      }
+      cpu_handler_create_src(0);
   }
 
   apiRetStatus = cpu_handler_reset_read();
@@ -259,6 +528,16 @@ uint16_t cpu_handler_setup(uint16_t unused) {
   return apiRetStatus;
 }
 
+/* VC_ABORT, on the data thread once it sees gRdwrCmd.abort: drops
+ * whatever is buffered, re-arms the channels and acks. */
+void cpu_handler_abort(void) {
+  cpu_handler_reset_read();
+  cpu_handler_reset_write();
+  gAckPkt.status |= RDWR_STATUS_ABORTED;
+  cpu_handler_commit_ack();
+  gRdwrCmd.done = 1;
+}
+
 /* This function tears down the DMA channels setup for CPU type handlers. */
 void cpu_handler_teardown(void) {
   /* Destroy the channels */
@@ -274,6 +553,7 @@ handler_t glCpuHandler = {
   cpu_handler_teardown,
   cpu_handler_cmd_start,
   cpu_handler_dmacb,
-  0
+  0,
+  cpu_handler_abort
 };
 
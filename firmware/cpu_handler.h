@@ -0,0 +1,28 @@
+#ifndef CPU_HANDLER_H
+#define CPU_HANDLER_H
+
+/**
+ * Parts of the cpu handler for handler types that share its dma
+ * channels and ack (sram_term.c, async.c.)  A handler_t with cpu_handler_setup
+ * and cpu_handler_teardown keeps the channels when the transaction
+ * switches to or from a glCpuHandler terminal.
+ **/
+
+#include "handlers.h"
+
+extern CyU3PDmaChannel glChHandleBulkSink; // usb OUT to the cpu
+extern CyU3PDmaChannel glChHandleBulkSrc;  // cpu to usb IN
+extern ack_pkt_t gAckPkt;
+extern ext_ack_pkt_t gExtAck;
+extern uint64_t gStreamTotal; // bytes sent by the current streaming read
+
+uint16_t cpu_handler_setup(uint16_t);
+void cpu_handler_teardown(void);
+void cpu_handler_abort(void);
+uint16_t cpu_handler_cmd_start();
+uint16_t cpu_handler_dmacb();
+void cpu_handler_commit_ack();
+uint16_t cpu_handler_reset_read();
+uint16_t cpu_handler_reset_write();
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef DMA_STATS_H
+#define DMA_STATS_H
+
+#include <cyu3types.h>
+
+/**
+ * Call counts and hwtimer ticks spent in the cpu handler's dma calls.
+ * Add -D DMA_STATS to CCFLAGS to enable and read them from the MEMBENCH
+ * terminal.  Get counts include the time spent waiting for the host to
+ * fill/drain a buffer so commit/discard are the pure call overhead.
+ **/
+
+enum DMA_STAT {
+  DMA_STAT_GET_SRC=0, // CyU3PDmaChannelGetBuffer on the read channel
+  DMA_STAT_COMMIT,    // CyU3PDmaChannelCommitBuffer
+  DMA_STAT_GET_SINK,  // CyU3PDmaChannelGetBuffer on the write channel
+  DMA_STAT_DISCARD,   // CyU3PDmaChannelDiscardBuffer
+  DMA_STAT_COUNT
+};
+
+typedef struct {
+  uint32_t calls;
+  uint32_t ticks;
+} dma_stat_t;
+
+#ifdef DMA_STATS
+#include "hwtimer.h"
+
+extern dma_stat_t gDmaStats[DMA_STAT_COUNT];
+
+#define DMA_STAT(which, call) ({ \
+  uint32_t _t0 = hwtimer_ticks(); \
+  CyU3PReturnStatus_t _ret = (call); \
+  gDmaStats[which].ticks += hwtimer_ticks() - _t0; \
+  ++gDmaStats[which].calls; \
+  _ret; })
+#else
+#define DMA_STAT(which, call) (call)
+#endif
+
+#endif
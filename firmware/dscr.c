@@ -124,7 +124,7 @@ const uint8_t CyFxUSBSSConfigDscr1[] __attribute__ ((aligned (32))) =
     /* Configuration descriptor */
     0x09,                           /* Descriptor size */
     CY_U3P_USB_CONFIG_DESCR,        /* Configuration descriptor type */
-    0x35,0x00,                      /* Length of this descriptor and all sub descriptors */
+    0x42,0x00,                      /* Length of this descriptor and all sub descriptors */
     0x01,                           /* Number of interfaces */
     0x01,                           /* Configuration number */
     0x00,                           /* COnfiguration string index */
@@ -148,7 +148,7 @@ const uint8_t CyFxUSBSSConfigDscr1[] __attribute__ ((aligned (32))) =
     CY_U3P_USB_INTRFC_DESCR,        /* Interface Descriptor type */
     0x00,                           /* Interface number */
     0x01,                           /* Alternate setting number */
-    0x02,                           /* Number of end points */
+    0x03,                           /* Number of end points */
     0xFF,                           /* Interface class */
     0x1F,                           /* Interface sub class */
     0x01,                           /* Interface protocol code */
@@ -182,7 +182,22 @@ const uint8_t CyFxUSBSSConfigDscr1[] __attribute__ ((aligned (32))) =
     CY_U3P_SS_EP_COMPN_DESCR,       /* SS endpoint companion descriptor type */
     (CY_FX_EP_BURST_LENGTH-1),      /* Max no. of packets in a burst : 0: burst 1 packet at a time */
     0x00,                           /* Max streams for bulk EP = 0 (No streams) */
-    0x00,0x00                       /* Service interval for the EP : 0 for bulk */
+    0x00,0x00,                      /* Service interval for the EP : 0 for bulk */
+
+    /* Endpoint descriptor for notify EP */
+    0x07,                           /* Descriptor size */
+    CY_U3P_USB_ENDPNT_DESCR,        /* Endpoint descriptor type */
+    CY_FX_EP_NOTIFY,                /* Endpoint address and description */
+    CY_U3P_USB_EP_INTR,             /* Interrupt endpoint type */
+    NOTIFY_PKT_SIZE,0x00,           /* Max packet size = 64 bytes */
+    0x04,                           /* Servicing interval : 2^(4-1) * 125us = 1ms */
+
+    /* Super speed endpoint companion descriptor for notify EP */
+    0x06,                           /* Descriptor size */
+    CY_U3P_SS_EP_COMPN_DESCR,       /* SS endpoint companion descriptor type */
+    0x00,                           /* Max no. of packets in a burst : 0: burst 1 packet at a time */
+    0x00,                           /* Attributes : 0 for interrupt */
+    NOTIFY_PKT_SIZE,0x00            /* Bytes per service interval */
 };
 
 /* Standard high speed configuration descriptor */
@@ -191,7 +206,7 @@ const uint8_t CyFxUSBHSConfigDscr1[] __attribute__ ((aligned (32))) =
     /* Configuration descriptor */
     0x09,                           /* Descriptor size */
     CY_U3P_USB_CONFIG_DESCR,        /* Configuration descriptor type */
-    0x29,0x00,                      /* Length of this descriptor and all sub descriptors */
+    0x30,0x00,                      /* Length of this descriptor and all sub descriptors */
     0x01,                           /* Number of interfaces */
     0x01,                           /* Configuration number */
     0x00,                           /* COnfiguration string index */
@@ -214,7 +229,7 @@ const uint8_t CyFxUSBHSConfigDscr1[] __attribute__ ((aligned (32))) =
     CY_U3P_USB_INTRFC_DESCR,        /* Interface Descriptor type */
     0x00,                           /* Interface number */
     0x01,                           /* Alternate setting number */
-    0x02,                           /* Number of endpoints */
+    0x03,                           /* Number of endpoints */
     0xFF,                           /* Interface class */
     0x1F,                           /* Interface sub class */
     0x01,                           /* Interface protocol code */
@@ -234,7 +249,15 @@ const uint8_t CyFxUSBHSConfigDscr1[] __attribute__ ((aligned (32))) =
     CY_FX_EP_CONSUMER,              /* Endpoint address and description */
     CY_U3P_USB_EP_BULK,             /* Bulk endpoint type */
     0x00,0x02,                      /* Max packet size = 512 bytes */
-    0x00                            /* Servicing interval for data transfers : 0 for bulk */
+    0x00,                           /* Servicing interval for data transfers : 0 for bulk */
+
+    /* Endpoint descriptor for notify EP */
+    0x07,                           /* Descriptor size */
+    CY_U3P_USB_ENDPNT_DESCR,        /* Endpoint descriptor type */
+    CY_FX_EP_NOTIFY,                /* Endpoint address and description */
+    CY_U3P_USB_EP_INTR,             /* Interrupt endpoint type */
+    NOTIFY_PKT_SIZE,0x00,           /* Max packet size = 64 bytes */
+    0x04                            /* Servicing interval : 2^(4-1) * 125us = 1ms */
 };
 
 /* Standard full speed configuration descriptor */
@@ -243,7 +266,7 @@ const uint8_t CyFxUSBFSConfigDscr1[] __attribute__ ((aligned (32))) =
     /* Configuration descriptor */
     0x09,                           /* Descriptor size */
     CY_U3P_USB_CONFIG_DESCR,        /* Configuration descriptor type */
-    0x20,0x00,                      /* Length of this descriptor and all sub descriptors */
+    0x27,0x00,                      /* Length of this descriptor and all sub descriptors */
     0x01,                           /* Number of interfaces */
     0x01,                           /* Configuration number */
     0x00,                           /* COnfiguration string index */
@@ -255,7 +278,7 @@ const uint8_t CyFxUSBFSConfigDscr1[] __attribute__ ((aligned (32))) =
     CY_U3P_USB_INTRFC_DESCR,        /* Interface descriptor type */
     0x00,                           /* Interface number */
     0x00,                           /* Alternate setting number */
-    0x02,                           /* Number of endpoints */
+    0x03,                           /* Number of endpoints */
     0xFF,                           /* Interface class */
     0x00,                           /* Interface sub class */
     0x00,                           /* Interface protocol code */
@@ -275,7 +298,15 @@ const uint8_t CyFxUSBFSConfigDscr1[] __attribute__ ((aligned (32))) =
     CY_FX_EP_CONSUMER,              /* Endpoint address and description */
     CY_U3P_USB_EP_BULK,             /* Bulk endpoint type */
     0x40,0x00,                      /* Max packet size = 64 bytes */
-    0x00                            /* Servicing interval for data transfers : 0 for bulk */
+    0x00,                           /* Servicing interval for data transfers : 0 for bulk */
+
+    /* Endpoint descriptor for notify EP */
+    0x07,                           /* Descriptor size */
+    CY_U3P_USB_ENDPNT_DESCR,        /* Endpoint descriptor type */
+    CY_FX_EP_NOTIFY,                /* Endpoint address and description */
+    CY_U3P_USB_EP_INTR,             /* Interrupt endpoint type */
+    NOTIFY_PKT_SIZE,0x00,           /* Max packet size = 64 bytes */
+    0x01                            /* Servicing interval : 1ms */
 };
 
 /* Standard language ID string descriptor */
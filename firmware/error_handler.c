@@ -14,6 +14,7 @@
 #define RECONFIG_IO_MATRIX
 #endif
 #include "log.h"
+#include "notify.h"
 
 void error_handler_0(CyU3PReturnStatus_t apiRetStatus, CyBool_t init) {
   /* Application failed with the error code apiRetStatus */
@@ -37,6 +38,9 @@ if (init) {
 }
 
 #endif
+  // the host may still be listening
+  notify_post(NOTIFY_ERROR, apiRetStatus, 0);
+  notify_flush();
   for (;;) {
     log_error("The app is stuck in the error_handler: %d\n", apiRetStatus );
     /* Thread sleep : 100 ms */
@@ -3,7 +3,30 @@
 #include <m24xx.h>
 #include "fx3_terminals.h"
 #include "fx3_term.h"
+#include "bench_term.h"
+#include "membench.h"
 #include "log.h"
+#ifdef PROF_GPIO
+#include "prof.h"
+#endif
+#ifdef GPIO_CAPTURE
+#include "capture.h"
+#endif
+#ifdef MACRO_ENGINE
+#include "macro.h"
+#endif
+#ifdef SAMPLER
+#include "sampler.h"
+#endif
+#ifdef PRETRIG
+#include "pretrig.h"
+#endif
+#ifdef SRAM_TERM
+#include "sram_term.h"
+#endif
+#ifdef READ_REDUCE
+#include "reduce.h"
+#endif
 
 m24xx_config_t m24_config = { .dev_addr = TERM_FX3_PROM,
 			      .bit_rate = 400000,
@@ -20,8 +43,31 @@ io_handler_t io_handlers[] = {
 #ifdef USB_LOGGING
   DECLARE_LOG_HANDLER(TERM_LOG),
 #endif
+#endif
+#ifdef PROF_GPIO
+  DECLARE_PROF_HANDLER(TERM_PROF),
+#endif
+#ifdef GPIO_CAPTURE
+  DECLARE_CAPTURE_HANDLER(TERM_CAPTURE),
+#endif
+#ifdef MACRO_ENGINE
+  DECLARE_MACRO_HANDLER(TERM_MACRO),
+#endif
+#ifdef SAMPLER
+  DECLARE_SAMPLER_HANDLER(TERM_SAMPLER),
+#endif
+#ifdef PRETRIG
+  DECLARE_PRETRIG_HANDLER(TERM_PRETRIG),
+#endif
+#ifdef SRAM_TERM
+  DECLARE_SRAM_HANDLER(TERM_SRAM),
+#endif
+#ifdef READ_REDUCE
+  DECLARE_REDUCE_HANDLER(TERM_REDUCE),
 #endif
   DECLARE_DUMMY_HANDLER(TERM_DUMMY_FX3),
+  DECLARE_BENCH_HANDLER(TERM_BENCH),
+  DECLARE_MEMBENCH_HANDLER(TERM_MEMBENCH),
   DECLARE_FX3_HANDLER(TERM_FX3),
   DECLARE_M24XX_HANDLER(TERM_FX3_PROM, &m24_config),
   DECLARE_TERMINATOR
@@ -83,18 +83,58 @@ typedef uint16_t (*io_handler_read_func)(CyU3PDmaBuffer_t *);
 
 /**
  * WRITE handlers: uint16_t write_handler(CyU3PDmaBuffer_t *buf_p):
- *  The number of bytes available in the write buffer (EP2FIFOBUF) are stored in
- *  rdwr_data.bytes_avail.  The write_handler must handle the available bytes
- *  without blocking. The handler can return FALSE instead of TRUE to allow
- *  another pass at the same data if the write call would block.
+ *  buf_p->count bytes at buf_p->buffer are the next data of the transaction.
+ *  The write_handler must handle the available bytes without blocking.  If
+ *  the sink can't take them all yet it returns IO_HANDLER_BUSY instead: the
+ *  buffer is held (the host's next packets wait in the endpoint) and passed
+ *  again once the sink calls io_handler_ready() or RDWR_BUSY_WAIT_MS pass.
+ *  A handler that took the first n bytes before it got busy advances
+ *  buf_p->buffer and reduces buf_p->count by n so the retry has the rest.
  *  
  *  \return uint16_t: status code that gets OR'd with all other statuses
  *      and returned as part of the ack packet. 0 means success.
+ *      IO_HANDLER_BUSY means call again.
  * 
  *  Leave null to write dummy data.
  **/
 typedef uint16_t (*io_handler_write_func)(CyU3PDmaBuffer_t *);
 
+#define IO_HANDLER_BUSY 0xFFFF // write handler kept the buffer, call again
+
+/**
+ * Wakes the data thread to retry a write handler that returned
+ * IO_HANDLER_BUSY.  Call it from the sink's isr, callback or thread when
+ * it can take more data.  Safe to call when nothing is waiting.
+ **/
+void io_handler_ready(void);
+
+
+/**
+ * V2 (vectored) handlers: uint16_t readv_handler(CyU3PDmaBuffer_t *iov, uint16_t n)
+ * and uint16_t writev_handler(CyU3PDmaBuffer_t *iov, uint16_t n):
+ *  iov[0..n-1] are the next buffers of the transaction in order, each with
+ *  iov[i].count bytes to fill (reads) or take (writes).  The handler sets
+ *  iov[i].count to the bytes it actually moved; the first buffer it leaves
+ *  short is the last one it used.  gRdwrCmd.transfered_so_far is the
+ *  transaction offset of iov[0].buffer.  The cpu handler has one dma
+ *  buffer at a time to offer (n is 1), rdwr_local up to IO_HANDLER_IOV_MAX.
+ *
+ *  Reads: a short buffer ends the transaction there (the host gets a short
+ *  transfer, the ext ack has the byte count.)  A stream instead offers the
+ *  rest of the buffer again since only the ack may be a short packet.
+ *  Writes: the bytes not taken are offered again like IO_HANDLER_BUSY.
+ *  Either can return IO_HANDLER_BUSY to be called again with the rest
+ *  after io_handler_ready().
+ *
+ *  \return uint16_t: status like the v1 handlers.
+ *
+ *  Set with DECLARE_HANDLER_V2.  Terminals with a v2 handler don't use the
+ *  v1 read/write handlers and can't be read through a reduce kernel.
+ **/
+typedef uint16_t (*io_handler_readv_func)(CyU3PDmaBuffer_t *, uint16_t);
+typedef uint16_t (*io_handler_writev_func)(CyU3PDmaBuffer_t *, uint16_t);
+
+#define IO_HANDLER_IOV_MAX 8 // most buffers in one v2 call
 
 /**
  * Optional code to be run before a read/write transaction.  Function can be
@@ -148,6 +188,7 @@ typedef void (*handler_teardown_func)(); // teardown for this handler nullable
 typedef uint16_t (*handler_start_func)(); //  nullable
 typedef uint16_t (*handler_dma_cb_func)(); // call from data thread (nullable) return 0 to call in data loop
 typedef CyBool_t (*handler_filter_func)(uint16_t);  // nullable if filter is non-null, allows filter of terminal address (more than one)
+typedef void (*handler_abort_func)(); // from the handler's dma cb once VC_ABORT set gRdwrCmd.abort, ends the transaction (nullable, VC_ABORT stalls without it)
 
 typedef struct {
     handler_setup_func handler_setup;
@@ -155,6 +196,7 @@ typedef struct {
     handler_start_func handler_start;
     handler_dma_cb_func handler_dma_cb;
     handler_filter_func handler_filter;
+    handler_abort_func handler_abort;
 } handler_t;
 
 // fx3 pre-provided handlers
@@ -180,6 +222,8 @@ typedef struct {
   io_handler_chksum_func chksum_handler;
   io_handler_uninit_func uninit_handler;
   void *userdata;
+  io_handler_readv_func readv_handler;   // v2, 0 for v1 handlers
+  io_handler_writev_func writev_handler; // v2, 0 for v1 handlers
 } io_handler_t;
 
 /**
@@ -203,6 +247,12 @@ extern io_handler_t io_handlers[];
 #define DECLARE_HANDLER(handler, term, boot_func, init_func, read_func, write_func, status_func, chksum_func, uninit_func, user_data) \
   {handler, term, boot_func, init_func, read_func, write_func, status_func, chksum_func, uninit_func, (void *) user_data} 
 
+/**
+ * Same for v2 handlers (readv/writev in place of read/write.)
+ **/
+#define DECLARE_HANDLER_V2(handler, term, boot_func, init_func, readv_func, writev_func, status_func, chksum_func, uninit_func, user_data) \
+  {handler, term, boot_func, init_func, 0, 0, status_func, chksum_func, uninit_func, (void *) user_data, readv_func, writev_func}
+
 /**
  *  io_handlers must be null terminated.  If you don't have an address 0 terminator
  *  as the last handler, you can use the NULL handler
@@ -210,6 +260,10 @@ extern io_handler_t io_handlers[];
 #define DECLARE_TERMINATOR \
   DECLARE_HANDLER(0,0,0,0,0,0,0,0,0,0)
 
+/**
+ * Reads return whatever is left in the dma buffer and writes are dropped.
+ * See bench_term.h for a terminal that generates and checks real data.
+ **/
 #define DECLARE_DUMMY_HANDLER(TERM_ADDR) \
   DECLARE_HANDLER(&glCpuHandler,TERM_ADDR,0,0,0,0,0,0,0,0)
 
@@ -0,0 +1,132 @@
+
+#include <cyu3system.h>
+#include <cyu3error.h>
+#include <cyu3gpio.h>
+
+#include "hwtimer.h"
+#include "log.h"
+
+#ifndef DEBUG_HWTIMER
+#undef log_debug
+#define log_debug(...) do {} while (0)
+#endif
+
+typedef struct {
+  uint8_t gpio;
+  hwtimer_cb cb; // NULL for an unused slot
+} hwtimer_periodic_t;
+
+hwtimer_periodic_t gHwTimers[HWTIMER_MAX_PERIODIC];
+
+// hwtimer_ticks64 state.  The os timer runs well inside the ~21s wrap.
+#define HWTIMER_WRAP_MS 5000
+CyU3PTimer gHwTimerWrap;
+uint32_t gHwTimerLast, gHwTimerHigh;
+
+static CyU3PReturnStatus_t hwtimer_config(uint8_t gpio, uint32_t period, CyU3PGpioIntrMode_t intr) {
+  CyU3PGpioComplexConfig_t cfg;
+  CyU3PReturnStatus_t status;
+
+  // take the pin away from whatever the io matrix had it set to
+  status = CyU3PDeviceGpioOverride(gpio, CyFalse);
+  if (status) {
+    log_error ( "Fail to override timer gpio %d: %d\n", gpio, status );
+    return status;
+  }
+
+  CyU3PMemSet((uint8_t*)&cfg, 0, sizeof(cfg));
+  cfg.outValue    = CyFalse;
+  cfg.driveLowEn  = CyFalse;
+  cfg.driveHighEn = CyFalse;
+  cfg.inputEn     = CyFalse;
+  cfg.pinMode     = CY_U3P_GPIO_MODE_STATIC;
+  cfg.intrMode    = intr;
+  cfg.timerMode   = CY_U3P_GPIO_TIMER_HIGH_FREQ;
+  cfg.timer       = 0;
+  cfg.period      = period;
+  cfg.threshold   = period;
+  status = CyU3PGpioSetComplexConfig(gpio, &cfg);
+  if (status) log_error ( "Fail to config timer gpio %d: %d\n", gpio, status );
+  return status;
+}
+
+static void hwtimer_wrap_cb(uint32_t unused) {
+  hwtimer_ticks64();
+}
+
+void hwtimer_boot(void) {
+#ifdef HWTIMER_GPIO
+  hwtimer_config(HWTIMER_GPIO, 0xFFFFFFFF, CY_U3P_GPIO_NO_INTR);
+  log_debug ( "hwtimer timebase on gpio %d\n", HWTIMER_GPIO );
+#endif
+  gHwTimerLast = hwtimer_ticks();
+  gHwTimerHigh = 0;
+  CyU3PTimerCreate(&gHwTimerWrap, hwtimer_wrap_cb, 0, HWTIMER_WRAP_MS, HWTIMER_WRAP_MS, CYU3P_AUTO_ACTIVATE);
+}
+
+uint32_t hwtimer_ticks(void) {
+#ifdef HWTIMER_GPIO
+  uint32_t ticks=0;
+  CyU3PGpioComplexSampleNow(HWTIMER_GPIO, &ticks);
+  return ticks;
+#else
+  return CyU3PGetTime();
+#endif
+}
+
+uint64_t hwtimer_ticks64(void) {
+  uint32_t mask, ticks, high;
+  mask = CyU3PVicDisableAllInterrupts();
+  ticks = hwtimer_ticks();
+  if (ticks < gHwTimerLast) ++gHwTimerHigh;
+  gHwTimerLast = ticks;
+  high = gHwTimerHigh;
+  CyU3PVicEnableInterrupts(mask);
+  return ((uint64_t)high << 32) | ticks;
+}
+
+CyU3PReturnStatus_t hwtimer_periodic_start(uint8_t gpio, uint32_t rate_hz, hwtimer_cb cb) {
+  CyU3PReturnStatus_t status;
+  int i, slot=-1;
+
+  if (!rate_hz || !cb || rate_hz > HWTIMER_GPIO_FAST_HZ) return CY_U3P_ERROR_BAD_ARGUMENT;
+
+  for (i=0;i<HWTIMER_MAX_PERIODIC;++i) {
+    if (gHwTimers[i].cb && gHwTimers[i].gpio == gpio) { slot=i; break; }
+    if (!gHwTimers[i].cb && slot<0) slot=i;
+  }
+  if (slot<0) return CY_U3P_ERROR_MEMORY_ERROR;
+
+  // don't dispatch to the old callback while reconfiguring
+  gHwTimers[slot].cb = 0;
+  gHwTimers[slot].gpio = gpio;
+
+  status = hwtimer_config(gpio, HWTIMER_GPIO_FAST_HZ / rate_hz, CY_U3P_GPIO_INTR_TIMER_ZERO);
+  if (status) return status;
+
+  gHwTimers[slot].cb = cb;
+  log_debug ( "periodic timer gpio %d %d Hz\n", gpio, rate_hz );
+  return 0;
+}
+
+void hwtimer_periodic_stop(uint8_t gpio) {
+  int i;
+  for (i=0;i<HWTIMER_MAX_PERIODIC;++i) {
+    if (gHwTimers[i].cb && gHwTimers[i].gpio == gpio) {
+      gHwTimers[i].cb = 0;
+      CyU3PGpioDisable(gpio);
+    }
+  }
+}
+
+CyBool_t hwtimer_isr(uint8_t gpioId) {
+  int i;
+  for (i=0;i<HWTIMER_MAX_PERIODIC;++i) {
+    hwtimer_cb cb = gHwTimers[i].cb;
+    if (cb && gHwTimers[i].gpio == gpioId) {
+      cb();
+      return CyTrue;
+    }
+  }
+  return CyFalse;
+}
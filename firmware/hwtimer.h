@@ -0,0 +1,77 @@
+#ifndef HWTIMER_H
+#define HWTIMER_H
+
+#include <cyu3types.h>
+
+/**
+ * Hardware timers.
+ *
+ * The SDK doesn't expose a general purpose timer so the complex GPIO
+ * blocks are used in timer mode instead.  Each timer needs a pin that
+ * isn't used on the board, and no two timers may share a complex block
+ * (pin%8).  The pins are never driven.
+ *
+ * -D HWTIMER_GPIO=<pin> enables a free running timebase clocked from the
+ *  fast GPIO clock set up in init_gpio.  Without it hwtimer_ticks falls
+ *  back to CyU3PGetTime and HWTIMER_HZ is 1000.
+ *
+ * Periodic timers are started on demand by the features that need them
+ * (profiler etc) on their own pins.
+ **/
+
+#ifdef HWTIMER_GPIO
+#ifndef HWTIMER_HZ
+// init_gpio sets fastClkDiv=2 from SYS_CLK (403.2MHz)
+// define HWTIMER_HZ=192000000 if SYS_CLK_400 is false.
+#define HWTIMER_HZ 201600000
+#endif
+#else
+#undef HWTIMER_HZ
+#define HWTIMER_HZ 1000
+#endif
+
+// fast clock rate used for periodic timers (regardless of HWTIMER_GPIO)
+#ifndef HWTIMER_GPIO_FAST_HZ
+#define HWTIMER_GPIO_FAST_HZ 201600000
+#endif
+
+#define HWTIMER_MAX_PERIODIC 4
+
+/**
+ * Called from interrupt context.  Must not block.
+ **/
+typedef void (*hwtimer_cb)(void);
+
+/**
+ * Called once from init_gpio after the gpio block is initialized.
+ **/
+void hwtimer_boot(void);
+
+/**
+ * Current timebase count.  Wraps at 32 bits (about 21 seconds at
+ * the default clock rate.)
+ **/
+uint32_t hwtimer_ticks(void);
+
+/**
+ * The timebase extended to 64 bits so it doesn't wrap.  hwtimer_boot
+ * starts an os timer that calls this often enough to catch every wrap of
+ * hwtimer_ticks.  Safe from any thread.
+ **/
+uint64_t hwtimer_ticks64(void);
+
+/**
+ * Start calling cb rate_hz times per second from the GPIO interrupt
+ * for the timer on gpio.  Calling again for the same pin changes the
+ * rate.
+ **/
+CyU3PReturnStatus_t hwtimer_periodic_start(uint8_t gpio, uint32_t rate_hz, hwtimer_cb cb);
+void hwtimer_periodic_stop(uint8_t gpio);
+
+/**
+ * GPIO interrupt hook.  Returns CyTrue if gpioId belonged to a periodic
+ * timer.
+ **/
+CyBool_t hwtimer_isr(uint8_t gpioId);
+
+#endif
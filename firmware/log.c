@@ -57,6 +57,7 @@ void init_uart_debug() {
 #ifdef USB_LOGGING
 
 #include "rdwr.h"
+#include "notify.h"
 
 CyBool_t glLogBoot=CyFalse;
 uint8_t log_buffer[LOG_BUFFER_SIZE];
@@ -110,6 +111,8 @@ void log_stmt2(unsigned LEVEL, const uint8_t* stmt) {
       log_buffer[glLogSize]=LEVEL;
       CyU3PMemCopy(log_buffer+glLogSize+1, stmt, len-1);
       glLogSize += len;
+      // once per batch, the host drains the log when it hears about it
+      if (glLogSize == len) notify_post(NOTIFY_LOG, glLogSize, 0);
     }
 
   CyU3PMutexPut(&log_mutex);
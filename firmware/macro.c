@@ -0,0 +1,314 @@
+#include <cyu3system.h>
+#include <cyu3error.h>
+#include <cyu3gpio.h>
+#include <cyu3os.h>
+
+#include "macro.h"
+#include "main.h"
+#include "hwtimer.h"
+#include "notify.h"
+#include "rdwr.h"
+#include "log.h"
+#include <fx3_terminals.h>
+
+#ifndef DEBUG_MACRO
+#undef log_debug
+#define log_debug(...) do {} while (0)
+#endif
+
+typedef struct {
+  macro_op_t ops[MACRO_MAX_OPS];
+  uint8_t result[MACRO_RESULT_SIZE]; // macro_result_t then GET values
+  uint8_t trigger;      // MACRO_TRIGGER_MODE armed
+  uint8_t pin;
+  uint8_t fired;        // MACRO_TRIGGER_MODE of the pending run
+  uint32_t period;      // ms
+  uint32_t runs;
+  uint32_t missed;      // triggers while a run was already pending
+  CyU3PTimer timer;
+  CyBool_t timer_created;
+} macro_slot_t;
+
+macro_slot_t gMacroSlots[MACRO_SLOTS];
+volatile uint32_t gMacroPending=0; // bit per slot, set by triggers
+uint8_t gMacroSlot=0; // slot the registers apply to
+uint8_t gMacroPinSlot[MACRO_GPIO_COUNT]; // slot+1 triggered by each gpio
+
+/**
+ * Marks the slot to run.  Safe from interrupts and timer callbacks.
+ **/
+static void macro_trigger(uint8_t slot, uint8_t trigger) {
+  uint32_t mask = CyU3PVicDisableAllInterrupts();
+  if (gMacroPending & (1<<slot)) {
+    ++gMacroSlots[slot].missed;
+  } else {
+    gMacroPending |= 1<<slot;
+    gMacroSlots[slot].fired = trigger;
+  }
+  CyU3PVicEnableInterrupts(mask);
+  CyU3PEventSet(&glThreadEvent, NITRO_EVENT_MACRO, CYU3P_EVENT_OR);
+}
+
+CyBool_t macro_isr(uint8_t gpioId) {
+  uint8_t slot;
+  if (gpioId >= MACRO_GPIO_COUNT || !gMacroPinSlot[gpioId]) return CyFalse;
+  slot = gMacroPinSlot[gpioId]-1;
+  macro_trigger(slot, gMacroSlots[slot].trigger);
+  return CyTrue;
+}
+
+static void macro_timer_cb(uint32_t slot) {
+  macro_trigger(slot, MACRO_TRIGGER_TIMER);
+}
+
+static void macro_disarm(macro_slot_t *s) {
+  if (s->trigger >= MACRO_TRIGGER_RISING && s->trigger <= MACRO_TRIGGER_BOTH) {
+    gMacroPinSlot[s->pin] = 0;
+    CyU3PGpioDisable(s->pin);
+  } else if (s->trigger == MACRO_TRIGGER_TIMER) {
+    CyU3PTimerStop(&s->timer);
+  }
+  s->trigger = MACRO_TRIGGER_NONE;
+}
+
+static uint16_t macro_arm(uint8_t slot, uint32_t trigger) {
+  macro_slot_t *s = &gMacroSlots[slot];
+  CyU3PGpioSimpleConfig_t cfg;
+  CyU3PReturnStatus_t status;
+
+  if (trigger > MACRO_TRIGGER_TIMER) return 1;
+  macro_disarm(s);
+
+  if (trigger == MACRO_TRIGGER_TIMER) {
+    if (!s->period) return 1;
+    if (!s->timer_created) {
+      status = CyU3PTimerCreate(&s->timer, macro_timer_cb, slot, s->period, s->period, CYU3P_NO_ACTIVATE);
+      if (status) return status;
+      s->timer_created = CyTrue;
+    } else {
+      CyU3PTimerModify(&s->timer, s->period, s->period);
+    }
+    s->trigger = MACRO_TRIGGER_TIMER;
+    return CyU3PTimerStart(&s->timer);
+  }
+
+  if (trigger == MACRO_TRIGGER_NONE) return 0;
+  if (gMacroPinSlot[s->pin]) return 1; // another slot's pin
+
+  // take the pin away from whatever the io matrix had it set to
+  status = CyU3PDeviceGpioOverride(s->pin, CyTrue);
+  if (status) {
+    log_error ( "Fail to override macro gpio %d: %d\n", s->pin, status );
+    return status;
+  }
+  CyU3PMemSet((uint8_t*)&cfg, 0, sizeof(cfg));
+  cfg.outValue    = CyFalse;
+  cfg.driveLowEn  = CyFalse;
+  cfg.driveHighEn = CyFalse;
+  cfg.inputEn     = CyTrue;
+  cfg.intrMode    = (CyU3PGpioIntrMode_t)trigger; // same values as CY_U3P_GPIO_INTR_*_EDGE
+  s->trigger = trigger;
+  gMacroPinSlot[s->pin] = slot+1; // before the first interrupt can come in
+  status = CyU3PGpioSetSimpleConfig(s->pin, &cfg);
+  if (status) {
+    log_error ( "Fail to config macro gpio %d: %d\n", s->pin, status );
+    gMacroPinSlot[s->pin] = 0;
+    s->trigger = MACRO_TRIGGER_NONE;
+  }
+  return status;
+}
+
+/**
+ * Reads op's register into val masked to the op width.
+ **/
+static uint16_t macro_get(macro_op_t *op, uint32_t *val) {
+  uint16_t status;
+  *val = 0;
+  // handlers copy whole 32 bit registers so always hand them 4 bytes
+  status = rdwr_local(COMMAND_GET, op->term, op->reg, (uint8_t*)val, op->width);
+  if (op->width < 4) *val &= (1u << (op->width*8)) - 1;
+  return status;
+}
+
+static void macro_run(uint8_t slot) {
+  macro_slot_t *s = &gMacroSlots[slot];
+  macro_result_t *r = (macro_result_t*)s->result;
+  uint8_t *out = s->result + sizeof(macro_result_t);
+  macro_op_t *op;
+  uint32_t acc=0, steps=0, pc=0, wait;
+  uint16_t status=MACRO_STATUS_OK, handler_status=0;
+
+  CyU3PMemSet(s->result, 0, sizeof(macro_result_t));
+  r->slot = slot;
+  r->trigger = s->fired;
+  r->t_start = hwtimer_ticks();
+
+  while (pc < MACRO_MAX_OPS && s->ops[pc].op != MACRO_OP_END) {
+    if (steps == MACRO_MAX_STEPS) {
+      status = MACRO_STATUS_STEPS;
+      break;
+    }
+    ++steps;
+    op = &s->ops[pc];
+    if ((op->op == MACRO_OP_SET || op->op == MACRO_OP_GET || op->op == MACRO_OP_POLL) &&
+        (op->width < 1 || op->width > 4)) {
+      status = MACRO_STATUS_BAD_OP;
+      break;
+    }
+    switch (op->op) {
+      case MACRO_OP_SET:
+        handler_status = rdwr_local(COMMAND_SET, op->term, op->reg, (uint8_t*)&op->val, op->width);
+        break;
+      case MACRO_OP_GET:
+        if (out + op->width > s->result + MACRO_RESULT_SIZE) {
+          status = MACRO_STATUS_FULL;
+          break;
+        }
+        handler_status = macro_get(op, &acc);
+        CyU3PMemCopy(out, (uint8_t*)&acc, op->width);
+        out += op->width;
+        break;
+      case MACRO_OP_WAIT:
+        CyU3PThreadSleep(op->val);
+        break;
+      case MACRO_OP_POLL:
+        for (wait=op->arg;;--wait) {
+          handler_status = macro_get(op, &acc);
+          if (handler_status || (acc & op->mask) == op->val) break;
+          if (!wait) {
+            status = MACRO_STATUS_TIMEOUT;
+            break;
+          }
+          CyU3PThreadSleep(1);
+        }
+        break;
+      case MACRO_OP_JUMP_EQ:
+      case MACRO_OP_JUMP_NE:
+        if (((acc & op->mask) == op->val) == (op->op == MACRO_OP_JUMP_EQ)) {
+          pc = op->arg;
+          continue;
+        }
+        break;
+      default:
+        status = MACRO_STATUS_BAD_OP;
+    }
+    if (handler_status) status = MACRO_STATUS_HANDLER;
+    if (status) break;
+    ++pc;
+  }
+
+  r->status = status;
+  r->handler_status = handler_status;
+  r->pc = pc;
+  r->steps = steps;
+  r->run = ++s->runs;
+  r->bytes = out - s->result - sizeof(macro_result_t);
+  r->t_end = hwtimer_ticks();
+  log_debug ( "macro %d status %d pc %d steps %d\n", slot, status, pc, steps );
+  notify_post(NOTIFY_MACRO, slot, status);
+}
+
+void macro_service(void) {
+  uint32_t mask;
+  uint8_t slot;
+
+  for (slot=0; slot<MACRO_SLOTS; ++slot) {
+    if (!(gMacroPending & (1<<slot))) continue;
+    if (!gRdwrCmd.done) {
+      // a host transaction has the handlers, try again shortly
+      CyU3PThreadSleep(1);
+      CyU3PEventSet(&glThreadEvent, NITRO_EVENT_MACRO, CYU3P_EVENT_OR);
+      return;
+    }
+    macro_run(slot);
+    mask = CyU3PVicDisableAllInterrupts();
+    gMacroPending &= ~(1<<slot); // after the run so triggers during it count as missed
+    CyU3PVicEnableInterrupts(mask);
+  }
+}
+
+/**
+ * Copies the part of src that buf covers at the current transaction
+ * offset and zero fills past the end.
+ **/
+static void macro_copy_out(CyU3PDmaBuffer_t *buf, uint8_t *src, uint32_t len) {
+  uint32_t off = gRdwrCmd.transfered_so_far, n=0;
+  if (off < len) n = len-off < buf->count ? len-off : buf->count;
+  CyU3PMemCopy(buf->buffer, src+off, n);
+  CyU3PMemSet(buf->buffer+n, 0, buf->count-n);
+}
+
+uint16_t macro_read(CyU3PDmaBuffer_t* buf) {
+  macro_slot_t *s = &gMacroSlots[gMacroSlot];
+  uint32_t val;
+  switch (gRdwrCmd.header.reg_addr) {
+    case MACRO_SLOT:
+      val = gMacroSlot;
+      break;
+    case MACRO_PROGRAM:
+      macro_copy_out(buf, (uint8_t*)s->ops, sizeof(s->ops));
+      return 0;
+    case MACRO_TRIGGER:
+      val = s->trigger;
+      break;
+    case MACRO_PIN:
+      val = s->pin;
+      break;
+    case MACRO_PERIOD:
+      val = s->period;
+      break;
+    case MACRO_RUNS:
+      val = s->runs;
+      break;
+    case MACRO_MISSED:
+      val = s->missed;
+      break;
+    case MACRO_RESULT:
+      macro_copy_out(buf, s->result, sizeof(macro_result_t) + ((macro_result_t*)s->result)->bytes);
+      return 0;
+    default:
+      return 1;
+  }
+  CyU3PMemCopy(buf->buffer, (uint8_t*)&val, 4);
+  return 0;
+}
+
+uint16_t macro_write(CyU3PDmaBuffer_t* buf) {
+  macro_slot_t *s = &gMacroSlots[gMacroSlot];
+  uint32_t val, off;
+
+  if (gRdwrCmd.header.reg_addr == MACRO_PROGRAM) {
+    // a new program replaces the whole slot, ops past it are MACRO_OP_END
+    off = gRdwrCmd.transfered_so_far;
+    if (!off) CyU3PMemSet((uint8_t*)s->ops, 0, sizeof(s->ops));
+    if (off + buf->count > sizeof(s->ops)) return 1;
+    CyU3PMemCopy((uint8_t*)s->ops + off, buf->buffer, buf->count);
+    return 0;
+  }
+
+  CyU3PMemCopy((uint8_t*)&val, buf->buffer, 4);
+  switch (gRdwrCmd.header.reg_addr) {
+    case MACRO_SLOT:
+      if (val >= MACRO_SLOTS) return 1;
+      gMacroSlot = val;
+      return 0;
+    case MACRO_RUN:
+      if (val >= MACRO_SLOTS) return 1;
+      macro_trigger(val, MACRO_TRIGGER_NONE);
+      return 0;
+    case MACRO_TRIGGER:
+      return macro_arm(gMacroSlot, val);
+    case MACRO_PIN:
+      if (val >= MACRO_GPIO_COUNT || s->trigger) return 1; // disarm first
+      s->pin = val;
+      return 0;
+    case MACRO_PERIOD:
+      s->period = val;
+      return 0;
+    case MACRO_MISSED:
+      s->missed = 0;
+      return 0;
+    default:
+      return 1;
+  }
+}
@@ -0,0 +1,107 @@
+#ifndef MACRO_H
+#define MACRO_H
+
+/**
+ * Register macros.
+ *
+ * A macro is a short program of gets, sets, waits and polls against the
+ * other cpu handler terminals in io_handlers[] that the firmware runs
+ * itself, so a sequence like arming a sensor doesn't cost the host a
+ * round trip per register.  Programs are loaded into one of MACRO_SLOTS
+ * slots through the MACRO terminal and run on a write to the run
+ * register, on a gpio edge or from a periodic timer.  Each run fills the
+ * slot's result buffer (a macro_result_t and then the values of the GET
+ * ops) which the host reads back in one transaction.  A NOTIFY_MACRO
+ * (see notify.h) says when it's ready.  See py/fx3/macro.py.
+ *
+ * Macros run on the app thread between host transactions (rdwr_local)
+ * so a trigger that fires during a transaction runs when it's done and
+ * the host's next transaction waits for a running macro.  Keep waits
+ * and poll timeouts short.
+ *
+ * Add macro.c to SOURCE and -D MACRO_ENGINE to CCFLAGS to enable.
+ **/
+
+#include "handlers.h"
+
+#ifndef MACRO_SLOTS
+#define MACRO_SLOTS 4
+#endif
+#ifndef MACRO_MAX_OPS
+#define MACRO_MAX_OPS 64 // per slot
+#endif
+#ifndef MACRO_RESULT_SIZE
+#define MACRO_RESULT_SIZE 1024 // per slot including the macro_result_t
+#endif
+#define MACRO_MAX_STEPS 10000 // ops per run, stops loops that never exit
+#define MACRO_GPIO_COUNT 61
+
+enum MACRO_OP_CODE {
+  MACRO_OP_END=0,  // end of the program
+  MACRO_OP_SET,    // write val to term/reg
+  MACRO_OP_GET,    // read term/reg into the result and the accumulator
+  MACRO_OP_WAIT,   // sleep val ms
+  MACRO_OP_POLL,   // read term/reg every ms until (value & mask) == val,
+                   // arg ms at most.  The value is left in the accumulator.
+  MACRO_OP_JUMP_EQ, // continue at op arg if (accumulator & mask) == val
+  MACRO_OP_JUMP_NE  // continue at op arg if (accumulator & mask) != val
+};
+
+enum MACRO_RUN_STATUS {
+  MACRO_STATUS_OK=0,
+  MACRO_STATUS_HANDLER, // a terminal returned handler_status
+  MACRO_STATUS_TIMEOUT, // a POLL didn't match in time
+  MACRO_STATUS_STEPS,   // ran MACRO_MAX_STEPS ops
+  MACRO_STATUS_FULL,    // GET values didn't fit in MACRO_RESULT_SIZE
+  MACRO_STATUS_BAD_OP   // unknown op or register width
+};
+
+enum MACRO_TRIGGER_MODE {
+  MACRO_TRIGGER_NONE=0,   // only the run register
+  MACRO_TRIGGER_RISING,   // edges on the pin register's gpio
+  MACRO_TRIGGER_FALLING,
+  MACRO_TRIGGER_BOTH,
+  MACRO_TRIGGER_TIMER     // every period ms
+};
+
+typedef struct {
+  uint8_t op;     // MACRO_OP_CODE
+  uint8_t width;  // register bytes (1-4) for SET, GET and POLL
+  uint16_t term;
+  uint32_t reg;
+  uint32_t val;
+  uint32_t mask;
+  uint32_t arg;
+} macro_op_t;
+
+typedef struct {
+  uint16_t status;         // MACRO_RUN_STATUS
+  uint16_t handler_status; // for MACRO_STATUS_HANDLER
+  uint8_t slot;
+  uint8_t trigger;         // MACRO_TRIGGER_MODE that started the run
+  uint16_t pc;             // op the run ended at
+  uint32_t steps;          // ops run
+  uint32_t run;            // runs of this slot so far including this one
+  uint32_t t_start;        // hwtimer ticks
+  uint32_t t_end;
+  uint32_t bytes;          // GET values following this header
+} macro_result_t;
+
+/**
+ * Runs the macros whose triggers fired.  Called by the app thread on
+ * NITRO_EVENT_MACRO and every main loop pass.
+ **/
+void macro_service(void);
+
+/**
+ * GPIO interrupt hook.  Returns CyTrue if gpioId triggers a macro.
+ **/
+CyBool_t macro_isr(uint8_t gpioId);
+
+uint16_t macro_read(CyU3PDmaBuffer_t*);
+uint16_t macro_write(CyU3PDmaBuffer_t*);
+
+#define DECLARE_MACRO_HANDLER(term) \
+  DECLARE_HANDLER(&glCpuHandler,term,0,0,macro_read,macro_write,0,0,0,0)
+
+#endif
@@ -11,6 +11,18 @@
 #include "rdwr.h"
 #include "error_handler.h"
 #include "cyu3gpio.h"
+#include "hwtimer.h"
+#include "notify.h"
+#include "membench.h"
+#ifdef GPIO_CAPTURE
+#include "capture.h"
+#endif
+#ifdef MACRO_ENGINE
+#include "macro.h"
+#endif
+#ifdef PRETRIG
+#include "pretrig.h"
+#endif
 #include "log.h"
 
 #ifndef DEBUG_MAIN
@@ -19,12 +31,31 @@
 #endif
 
 
-#ifndef GPIO_INTERRUPT
-#define GPIO_INTERRUPT 0
-#else
+#ifdef GPIO_INTERRUPT
 void GPIO_INTERRUPT (uint8_t);
 #endif
 
+/**
+ * GPIO interrupt callback.  Pins owned by nitro features (hwtimer.c etc)
+ * are handled here, anything else is passed to the firmware's
+ * GPIO_INTERRUPT if it defined one.
+ **/
+void nitro_gpio_interrupt (uint8_t gpioId) {
+  if (hwtimer_isr(gpioId)) return;
+#ifdef GPIO_CAPTURE
+  if (capture_isr(gpioId)) return;
+#endif
+#ifdef MACRO_ENGINE
+  if (macro_isr(gpioId)) return;
+#endif
+#ifdef PRETRIG
+  if (pretrig_isr(gpioId)) return;
+#endif
+#ifdef GPIO_INTERRUPT
+  GPIO_INTERRUPT(gpioId);
+#endif
+}
+
 #ifndef SS_INIT
 CyBool_t glSSInit=CyTrue;
 #else
@@ -136,7 +167,7 @@ void init_gpio (void) {
     gpioClock.clkSrc = CY_U3P_SYS_CLK;
     gpioClock.halfDiv = 0;
 
-    apiRetStatus = CyU3PGpioInit(&gpioClock, GPIO_INTERRUPT);
+    apiRetStatus = CyU3PGpioInit(&gpioClock, nitro_gpio_interrupt);
     if (apiRetStatus != 0) {
         /* Error Handling */
       log_error("CyU3PGpioInit failed, error code = %d\n", apiRetStatus);
@@ -144,6 +175,8 @@ void init_gpio (void) {
     }
     log_debug ( "GPIO block initialized\n");
 
+    hwtimer_boot();
+
 #ifdef UXN1340
     apiRetStatus = CyU3PDeviceGpioOverride (GPIO_USB3_SS_MUX, CyTrue); // Start High
     if (apiRetStatus) log_error ( "Fail to override usb3_ss_mux: %d\n", apiRetStatus);
@@ -217,6 +250,8 @@ void CyFxNitroApplnStart (void) {
   CyU3PUsbFlushEp(CY_FX_EP_PRODUCER);
   CyU3PUsbFlushEp(CY_FX_EP_CONSUMER);
 
+  notify_start(gRdwrCmd.ep_buffer_size);
+
   /* Update the status flag. */
   glIsApplnActive = CyTrue;
 
@@ -250,6 +285,7 @@ void CyFxNitroApplnStop (void) {
 
   // clean up DMA channels and anything left by current event handler
   rdwr_teardown();
+  notify_stop();
 
   /* Flush the endpoint memory */
   CyU3PUsbFlushEp(CY_FX_EP_PRODUCER);
@@ -717,6 +753,7 @@ CyBool_t CyFxNitroApplnUSBSetupCB (
       break;
     case CY_U3P_USB_VENDOR_RQT:
       handled = CyTrue;
+      if (handle_fast_vendor_cmd(bRequest, bReqType, wLength)) break;
       glSetupDat0=setupdat0;
       glSetupDat1=setupdat1;
       // TODO could we monitor entry/exit of handle event
@@ -949,7 +986,13 @@ void NitroDataThread_Entry (uint32_t input) {
 void NitroAppThread_Entry (uint32_t input) {
 
   CyU3PReturnStatus_t ret;
-  uint32_t eventMask = NITRO_EVENT_VENDOR_CMD|NITRO_EVENT_BREAK|NITRO_EVENT_REBOOT|NITRO_EVENT_USB2; // can add more events
+  uint32_t eventMask = NITRO_EVENT_VENDOR_CMD|NITRO_EVENT_BREAK|NITRO_EVENT_REBOOT|NITRO_EVENT_USB2|NITRO_EVENT_NOTIFY|NITRO_EVENT_MEMBENCH; // can add more events
+#ifdef MACRO_ENGINE
+  eventMask |= NITRO_EVENT_MACRO;
+#endif
+#ifdef PRETRIG
+  eventMask |= NITRO_EVENT_PRETRIG;
+#endif
   uint32_t eventStat;
 
   /* Initialize the debug and other io modules module */
@@ -960,6 +1003,7 @@ void NitroAppThread_Entry (uint32_t input) {
   log_info ("io matrix init %d\n", ret);
   init_i2c();
   init_gpio();
+  notify_boot();
 
   /* Initialize the bulk loop application */
   CyFxNitroApplnInit();
@@ -983,6 +1027,14 @@ void NitroAppThread_Entry (uint32_t input) {
          }
      }
 
+     notify_flush(); // records left over while the host wasn't reading
+#ifdef MACRO_ENGINE
+     macro_service();
+#endif
+#ifdef PRETRIG
+     pretrig_service();
+#endif
+
 #ifdef ENABLE_LOGGING
     {
       uint16_t phy, link;
@@ -1012,6 +1064,25 @@ void NitroAppThread_Entry (uint32_t input) {
                 ((glSetupDat1 & CY_U3P_USB_LENGTH_MASK)  >> CY_U3P_USB_LENGTH_POS) ); // wLength
         }
 
+        if (eventStat & NITRO_EVENT_NOTIFY) {
+            notify_flush();
+        }
+
+#ifdef MACRO_ENGINE
+        if (eventStat & NITRO_EVENT_MACRO) {
+            macro_service();
+        }
+#endif
+#ifdef PRETRIG
+        if (eventStat & NITRO_EVENT_PRETRIG) {
+            pretrig_service();
+        }
+#endif
+
+        if (eventStat & NITRO_EVENT_MEMBENCH) {
+            membench_service();
+        }
+
         if (eventStat & NITRO_EVENT_REBOOT) {
             CyU3PThreadSleep(500);
             #ifdef CX3
@@ -1167,7 +1238,7 @@ int main (void) {
   }
 
   /* Initialize the caches. Enable both Instruction and Data caches. */
-  status = CyU3PDeviceCacheControl (CyTrue, CyFalse, CyFalse);
+  status = CyU3PDeviceCacheControl (CyTrue, CY_FX_DCACHE_ENABLE, CyFalse);
   if (status != CY_U3P_SUCCESS) {
     error_handler(status);
   }
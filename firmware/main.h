@@ -43,6 +43,7 @@
 #define CY_FX_EP_BURST_LENGTH          (8)                      /* max burst length */
 #define CY_FX_EP_BUF_COUNT             (2)                       /* num ep buffers */
 #define CY_FX_DMA_SIZE_MULTIPLIER   (2)                          /* double buffer size to decrease latency */
+#define CY_FX_DCACHE_ENABLE         (CyFalse)                    /* data cache state set in main() */
 #define CY_FX_NITRO_THREAD_STACK       (0x1000)                  /* Bulk loop application thread stack size */
 #define CY_FX_NITRO_THREAD_PRIORITY    (8)                       /* Bulk loop application thread priority */
 
@@ -62,6 +63,12 @@
 
 #define CY_FX_EP_PRODUCER_SOCKET        CY_U3P_UIB_SOCKET_PROD_1    /* Socket 1 is producer */
 #define CY_FX_EP_CONSUMER_SOCKET        CY_U3P_UIB_SOCKET_CONS_1    /* Socket 1 is consumer */
+#define CY_FX_EP_NOTIFY                 0x82    /* EP 2 IN, interrupt (notify.c) */
+#define CY_FX_EP_NOTIFY_SOCKET          CY_U3P_UIB_SOCKET_CONS_2
+#define NOTIFY_PKT_SIZE                 64      /* notify EP max packet at every speed */
+#define NOTIFY_BUF_COUNT                2
+#define CY_FX_MEMBENCH_SOCKET           CY_U3P_UIB_SOCKET_CONS_3 /* EP 3 IN isn't used, membench.c dma calls */
+
 /* Used with FX3 Silicon. */
 #define CY_FX_PRODUCER_PPORT_SOCKET    CY_U3P_PIB_SOCKET_0    /* P-port Socket 0 is producer */
 #define CY_FX_CONSUMER_PPORT_SOCKET    CY_U3P_PIB_SOCKET_3    /* P-port Socket 3 is consumer */
@@ -85,6 +92,10 @@ extern CyU3PEvent glThreadEvent;       /* event to cause app thread to wake up *
 #define NITRO_EVENT_BREAK        (1<<2) /* break the main loop */
 #define NITRO_EVENT_REBOOT       (1<<3) /* reboot the firmware */
 #define NITRO_EVENT_USB2         (1<<4) /* glSSInit changed */ 
+#define NITRO_EVENT_NOTIFY       (1<<5) /* notify_post queued a record */
+#define NITRO_EVENT_MACRO        (1<<6) /* a macro trigger fired (macro.c) */
+#define NITRO_EVENT_PRETRIG      (1<<7) /* pretrig capture has a chunk to read (pretrig.c) */
+#define NITRO_EVENT_MEMBENCH     (1<<8) /* a membench run was written (membench.c) */
 
 extern uint8_t glUsbConfiguration;
 
@@ -0,0 +1,220 @@
+#include <cyu3system.h>
+#include <cyu3error.h>
+#include <cyu3dma.h>
+
+#include "main.h"
+#include "membench.h"
+#include "dma_stats.h"
+#include "hwtimer.h"
+#include "rdwr.h"
+#include "log.h"
+#include <fx3_terminals.h>
+
+#ifndef DEBUG_MEMBENCH
+#undef log_debug
+#define log_debug(...) do {} while (0)
+#endif
+
+typedef struct {
+  uint32_t size;
+  uint32_t iters;
+  uint32_t method;
+  uint32_t dcache;
+  uint32_t elapsed;
+  uint32_t get_ticks;    // MEMBENCH_DMA_CALLS: in GetBuffer
+  uint32_t commit_ticks; // MEMBENCH_DMA_CALLS: in CommitBuffer
+  uint16_t status;       // of the last run
+  volatile CyBool_t pending; // run written, the app thread hasn't finished it
+} membench_t;
+
+membench_t gMemBench = { 4096, 256, MEMBENCH_COPY_MEMCOPY, 0, 0, 0, 0, 0, CyFalse };
+
+static void membench_wordcopy(uint32_t *dst, const uint32_t *src, uint32_t n) {
+  while (n>=4) {
+    dst[0]=src[0];
+    dst[1]=src[1];
+    dst[2]=src[2];
+    dst[3]=src[3];
+    dst+=4; src+=4; n-=4;
+  }
+  while (n--) *dst++ = *src++;
+}
+
+static uint16_t membench_copy() {
+  uint8_t *src, *dst;
+  uint32_t i, t0;
+
+  src = (uint8_t*)CyU3PDmaBufferAlloc(gMemBench.size);
+  dst = (uint8_t*)CyU3PDmaBufferAlloc(gMemBench.size);
+  if (!src || !dst) {
+    if (src) CyU3PDmaBufferFree(src);
+    if (dst) CyU3PDmaBufferFree(dst);
+    return CY_U3P_ERROR_MEMORY_ERROR;
+  }
+  CyU3PMemSet(src, 0xa5, gMemBench.size);
+
+  t0 = hwtimer_ticks();
+  for (i=0;i<gMemBench.iters;++i) {
+    switch (gMemBench.method) {
+      case MEMBENCH_COPY_WORDCOPY:
+        membench_wordcopy((uint32_t*)dst, (const uint32_t*)src, gMemBench.size>>2);
+        break;
+      case MEMBENCH_COPY_MEMSET:
+        CyU3PMemSet(dst, (uint8_t)i, gMemBench.size);
+        break;
+      default:
+        CyU3PMemCopy(dst, src, gMemBench.size);
+        break;
+    }
+  }
+  gMemBench.elapsed = hwtimer_ticks() - t0;
+
+  CyU3PDmaBufferFree(src);
+  CyU3PDmaBufferFree(dst);
+  return 0;
+}
+
+/**
+ * GetBuffer/CommitBuffer pairs on a manual channel of size byte buffers
+ * to the unused CY_FX_MEMBENCH_SOCKET.  Nothing drains the socket so
+ * every MEMBENCH_DMA_COUNT buffers the channel is reset to get them back
+ * (not counted.)
+ **/
+static uint16_t membench_dma_calls() {
+  CyU3PDmaChannel ch;
+  CyU3PDmaChannelConfig_t dmaCfg;
+  CyU3PDmaBuffer_t buf;
+  uint32_t i, t0, t1;
+  uint16_t status;
+
+  CyU3PMemSet((uint8_t*)&dmaCfg, 0, sizeof(dmaCfg));
+  dmaCfg.size = (gMemBench.size + 15) & ~15;
+  dmaCfg.count = MEMBENCH_DMA_COUNT;
+  dmaCfg.prodSckId = CY_U3P_CPU_SOCKET_PROD;
+  dmaCfg.consSckId = CY_FX_MEMBENCH_SOCKET;
+  dmaCfg.dmaMode = CY_U3P_DMA_MODE_BYTE;
+  status = CyU3PDmaChannelCreate(&ch, CY_U3P_DMA_TYPE_MANUAL_OUT, &dmaCfg);
+  if (status) {
+    log_error ( "membench channel create fail %d\n", status );
+    return status;
+  }
+  CyU3PDmaChannelSetXfer(&ch, 0);
+
+  gMemBench.get_ticks = gMemBench.commit_ticks = 0;
+  for (i=0;i<gMemBench.iters && !status;++i) {
+    if (i && !(i % MEMBENCH_DMA_COUNT)) {
+      CyU3PDmaChannelReset(&ch);
+      CyU3PDmaChannelSetXfer(&ch, 0);
+    }
+    t0 = hwtimer_ticks();
+    status = CyU3PDmaChannelGetBuffer(&ch, &buf, CYU3P_NO_WAIT);
+    t1 = hwtimer_ticks();
+    if (!status) status = CyU3PDmaChannelCommitBuffer(&ch, gMemBench.size, 0);
+    gMemBench.commit_ticks += hwtimer_ticks() - t1;
+    gMemBench.get_ticks += t1 - t0;
+  }
+  gMemBench.elapsed = gMemBench.get_ticks + gMemBench.commit_ticks;
+  if (status) log_error ( "membench dma call %d fail %d\n", i, status );
+
+  CyU3PDmaChannelReset(&ch);
+  CyU3PDmaChannelDestroy(&ch);
+  return status;
+}
+
+static uint16_t membench_run() {
+  CyU3PReturnStatus_t status;
+  uint16_t ret;
+
+  if (gMemBench.dcache) {
+    // let the dma api clean/invalidate so the notify channel (and the
+    // dma method's own calls) stay coherent while the cache is on
+    status = CyU3PDeviceCacheControl(CyTrue, CyTrue, CyTrue);
+    if (status) log_error ( "Enable dcache failed %d\n", status );
+  }
+
+  ret = gMemBench.method == MEMBENCH_DMA_CALLS ? membench_dma_calls() : membench_copy();
+
+  if (gMemBench.dcache) {
+    // write back anything dirty before going back to uncached access
+    CyU3PSysFlushDCache();
+    CyU3PDeviceCacheControl(CyTrue, CY_FX_DCACHE_ENABLE, CyFalse);
+  }
+
+  log_debug ( "membench %d x %d: %d ticks\n", gMemBench.size, gMemBench.iters, gMemBench.elapsed );
+  return ret;
+}
+
+void membench_service(void) {
+  if (!gMemBench.pending) return;
+  if (!gRdwrCmd.done) {
+    // a host transaction has the dma channels, try again shortly
+    CyU3PThreadSleep(1);
+    CyU3PEventSet(&glThreadEvent, NITRO_EVENT_MEMBENCH, CYU3P_EVENT_OR);
+    return;
+  }
+  gMemBench.status = membench_run();
+  gMemBench.pending = CyFalse;
+}
+
+uint16_t membench_read(CyU3PDmaBuffer_t* buf) {
+  uint32_t val;
+  switch (gRdwrCmd.header.reg_addr) {
+    case MEMBENCH_SIZE: val = gMemBench.size; break;
+    case MEMBENCH_ITERS: val = gMemBench.iters; break;
+    case MEMBENCH_METHOD: val = gMemBench.method; break;
+    case MEMBENCH_DCACHE: val = gMemBench.dcache; break;
+    case MEMBENCH_ELAPSED: val = gMemBench.elapsed; break;
+    case MEMBENCH_RUN: val = gMemBench.pending ? 1 : 0; break;
+    case MEMBENCH_STATUS: val = gMemBench.status; break;
+    case MEMBENCH_GET_TICKS: val = gMemBench.get_ticks; break;
+    case MEMBENCH_COMMIT_TICKS: val = gMemBench.commit_ticks; break;
+    case MEMBENCH_TICKS_HZ: val = HWTIMER_HZ; break;
+    case MEMBENCH_DMA_BUF_SIZE:
+      val = gRdwrCmd.ep_buffer_size * CY_FX_DMA_SIZE_MULTIPLIER;
+      break;
+    case MEMBENCH_DMA_STATS:
+#ifdef DMA_STATS
+      CyU3PMemSet(buf->buffer, 0, buf->count);
+      CyU3PMemCopy(buf->buffer, (uint8_t*)gDmaStats,
+                   buf->count < sizeof(gDmaStats) ? buf->count : sizeof(gDmaStats));
+      return 0;
+#else
+      return 1;
+#endif
+    default:
+      return 1;
+  }
+  CyU3PMemCopy(buf->buffer, (uint8_t*)&val, 4);
+  return 0;
+}
+
+uint16_t membench_write(CyU3PDmaBuffer_t* buf) {
+  uint32_t val;
+  CyU3PMemCopy((uint8_t*)&val, buf->buffer, 4);
+  if (gMemBench.pending) return 1; // wait for the run to finish
+  switch (gRdwrCmd.header.reg_addr) {
+    case MEMBENCH_SIZE: gMemBench.size = val; break;
+    case MEMBENCH_ITERS: gMemBench.iters = val; break;
+    case MEMBENCH_METHOD:
+      if (val > MEMBENCH_DMA_CALLS) return 1;
+      gMemBench.method = val;
+      break;
+    case MEMBENCH_DCACHE: gMemBench.dcache = val; break;
+    case MEMBENCH_RUN:
+      if (!gMemBench.size || gMemBench.size > MEMBENCH_MAX_SIZE) return 1;
+      // after the ack, from the app thread (membench_service)
+      gMemBench.pending = CyTrue;
+      CyU3PEventSet(&glThreadEvent, NITRO_EVENT_MEMBENCH, CYU3P_EVENT_OR);
+      return 0;
+    case MEMBENCH_DMA_STATS:
+#ifdef DMA_STATS
+      CyU3PMemSet((uint8_t*)gDmaStats, 0, sizeof(gDmaStats));
+      return 0;
+#else
+      return 1;
+#endif
+    default:
+      return 1;
+  }
+  return 0;
+}
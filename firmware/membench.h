@@ -0,0 +1,53 @@
+#ifndef MEMBENCH_H
+#define MEMBENCH_H
+
+/**
+ * Internal bandwidth measurements.
+ *
+ * Writing the run register starts a run: size bytes copied iters times
+ * with the selected method, or for MEMBENCH_DMA_CALLS iters
+ * GetBuffer/CommitBuffer pairs on a manual channel of size byte buffers.
+ * The app thread runs it after the transaction is over (membench_service)
+ * and records the elapsed hwtimer ticks; reading run returns 1 until
+ * it's done and status has the result.  Writes fail while a run is
+ * pending.
+ *
+ * With dcache set the data cache is on for the duration of the run only,
+ * with the dma api handling it (see CyU3PDeviceCacheControl), so dma
+ * calls are timed with the cache maintenance they'd need with the cache
+ * on.
+ *
+ * The dma_stats register returns the dma_stat_t counters from the cpu
+ * handler (see dma_stats.h) when built with -D DMA_STATS.  Writing it
+ * clears them.  Use py/fx3/membench.py to sweep and print the results.
+ **/
+
+#include "handlers.h"
+
+#ifndef MEMBENCH_MAX_SIZE
+#define MEMBENCH_MAX_SIZE 16384
+#endif
+#ifndef MEMBENCH_DMA_COUNT
+#define MEMBENCH_DMA_COUNT 4 // MEMBENCH_DMA_CALLS channel buffers
+#endif
+
+enum MEMBENCH_COPY {
+  MEMBENCH_COPY_MEMCOPY=0, // CyU3PMemCopy
+  MEMBENCH_COPY_WORDCOPY,  // 32 bit word loop
+  MEMBENCH_COPY_MEMSET,    // CyU3PMemSet (write only)
+  MEMBENCH_DMA_CALLS       // CyU3PDmaChannelGetBuffer/CommitBuffer, no data
+                           // (get_ticks and commit_ticks split elapsed)
+};
+
+/**
+ * Runs a pending run.  Called by the app thread on NITRO_EVENT_MEMBENCH.
+ **/
+void membench_service(void);
+
+uint16_t membench_read(CyU3PDmaBuffer_t*);
+uint16_t membench_write(CyU3PDmaBuffer_t*);
+
+#define DECLARE_MEMBENCH_HANDLER(term) \
+  DECLARE_HANDLER(&glCpuHandler,term,0,0,membench_read,membench_write,0,0,0,0)
+
+#endif
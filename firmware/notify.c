@@ -0,0 +1,123 @@
+#include <cyu3system.h>
+#include <cyu3error.h>
+#include <cyu3dma.h>
+#include <cyu3usb.h>
+
+#include "notify.h"
+#include "main.h"
+#include "hwtimer.h"
+#include "log.h"
+
+#ifndef DEBUG_NOTIFY
+#undef log_debug
+#define log_debug(...) do {} while (0)
+#endif
+
+CyU3PDmaChannel glChHandleNotify; /* DMA MANUAL_OUT channel to the interrupt EP. */
+CyBool_t gNotifyBoot = CyFalse;
+CyBool_t gNotifyActive = CyFalse;
+CyU3PMutex gNotifyMutex;
+
+// filled by notify_post, drained by notify_flush
+notify_pkt_t gNotifyRing[NOTIFY_RING];
+uint32_t gNotifyHead, gNotifyTail;
+uint16_t gNotifySeq;
+
+void notify_boot(void) {
+  CyU3PMutexCreate(&gNotifyMutex, CYU3P_NO_INHERIT);
+  gNotifyBoot = CyTrue;
+}
+
+void notify_start(uint16_t ep_buffer_size) {
+  CyU3PEpConfig_t epCfg;
+  CyU3PDmaChannelConfig_t dmaCfg;
+  CyU3PReturnStatus_t apiRetStatus;
+
+  CyU3PMemSet ((uint8_t *)&epCfg, 0, sizeof (epCfg));
+  epCfg.enable = CyTrue;
+  epCfg.epType = CY_U3P_USB_EP_INTR;
+  epCfg.burstLen = 1;
+  epCfg.streams = 0;
+  epCfg.pcktSize = NOTIFY_PKT_SIZE;
+  apiRetStatus = CyU3PSetEpConfig(CY_FX_EP_NOTIFY, &epCfg);
+  if (apiRetStatus != CY_U3P_SUCCESS) {
+    log_error("CyU3PSetEpConfig notify failed, Error code = %d\n", apiRetStatus);
+    return;
+  }
+
+  CyU3PMemSet ((uint8_t *)&dmaCfg, 0, sizeof (dmaCfg));
+  dmaCfg.size      = NOTIFY_PKT_SIZE;
+  dmaCfg.count     = NOTIFY_BUF_COUNT;
+  dmaCfg.prodSckId = CY_U3P_CPU_SOCKET_PROD;
+  dmaCfg.consSckId = CY_FX_EP_NOTIFY_SOCKET;
+  dmaCfg.dmaMode   = CY_U3P_DMA_MODE_BYTE;
+  apiRetStatus = CyU3PDmaChannelCreate (&glChHandleNotify, CY_U3P_DMA_TYPE_MANUAL_OUT, &dmaCfg);
+  if (apiRetStatus != CY_U3P_SUCCESS) {
+    log_error("CyU3PDmaChannelCreate notify failed, Error code = %d\n", apiRetStatus);
+    return;
+  }
+  CyU3PUsbFlushEp(CY_FX_EP_NOTIFY);
+  CyU3PDmaChannelSetXfer (&glChHandleNotify, 0);
+  gNotifyActive = CyTrue;
+}
+
+void notify_stop(void) {
+  CyU3PEpConfig_t epCfg;
+  if (!gNotifyActive) return;
+  CyU3PMutexGet(&gNotifyMutex, CYU3P_WAIT_FOREVER);
+  gNotifyActive = CyFalse;
+  CyU3PDmaChannelDestroy (&glChHandleNotify);
+  CyU3PMutexPut(&gNotifyMutex);
+  CyU3PUsbFlushEp(CY_FX_EP_NOTIFY);
+  CyU3PMemSet ((uint8_t *)&epCfg, 0, sizeof (epCfg));
+  epCfg.enable = CyFalse;
+  CyU3PSetEpConfig(CY_FX_EP_NOTIFY, &epCfg);
+}
+
+CyBool_t notify_post(uint16_t event, uint32_t arg0, uint32_t arg1) {
+  uint32_t mask;
+  notify_pkt_t *p;
+  CyBool_t ret = CyFalse;
+
+  mask = CyU3PVicDisableAllInterrupts();
+  if (gNotifyHead - gNotifyTail < NOTIFY_RING) {
+    p = &gNotifyRing[gNotifyHead % NOTIFY_RING];
+    p->event = event;
+    p->seq = gNotifySeq;
+    p->ticks = hwtimer_ticks();
+    p->arg0 = arg0;
+    p->arg1 = arg1;
+    ++gNotifyHead;
+    ret = CyTrue;
+  }
+  ++gNotifySeq; // dropped records leave a gap
+  CyU3PVicEnableInterrupts(mask);
+
+  if (ret && gNotifyBoot) CyU3PEventSet(&glThreadEvent, NITRO_EVENT_NOTIFY, CYU3P_EVENT_OR);
+  return ret;
+}
+
+void notify_flush(void) {
+  CyU3PDmaBuffer_t buf;
+  uint16_t n;
+
+  if (!gNotifyBoot) return; // error_handler before the app thread started
+  CyU3PMutexGet(&gNotifyMutex, CYU3P_WAIT_FOREVER);
+  while (gNotifyHead != gNotifyTail) {
+    if (!gNotifyActive) {
+      gNotifyTail = gNotifyHead; // nobody to send to
+      break;
+    }
+    // a full buffer means the host isn't reading, the ring takes the rest
+    if (CyU3PDmaChannelGetBuffer (&glChHandleNotify, &buf, CYU3P_NO_WAIT)) break;
+    n = 0;
+    while (gNotifyHead != gNotifyTail && n + sizeof(notify_pkt_t) <= buf.size) {
+      CyU3PMemCopy(buf.buffer + n, (uint8_t*)&gNotifyRing[gNotifyTail % NOTIFY_RING], sizeof(notify_pkt_t));
+      n += sizeof(notify_pkt_t);
+      ++gNotifyTail;
+    }
+    log_debug ( "notify %d bytes\n", n );
+    CyU3PDmaChannelCommitBuffer (&glChHandleNotify, n, 0);
+  }
+  CyU3PMutexPut(&gNotifyMutex);
+}
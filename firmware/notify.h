@@ -0,0 +1,48 @@
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+#include <cyu3types.h>
+#include "vendor_commands.h"
+
+/**
+ * Device to host notifications on the interrupt IN endpoint
+ * (CY_FX_EP_NOTIFY.)
+ *
+ * notify_post queues a notify_pkt_t and wakes the app thread, which
+ * sends whatever is queued (several records per packet when they pile
+ * up.)  The host just keeps a read pending on the endpoint instead of
+ * polling registers.  Records posted while nothing is reading or the
+ * queue is full are dropped; the host sees the gap in seq.
+ *
+ * Events below NOTIFY_USER are posted by nitro itself.  Firmware can
+ * post its own from NOTIFY_USER up.
+ **/
+
+#define NOTIFY_RING 32 // queued records, power of 2
+
+/**
+ * Called once from the app thread before usb is started.
+ **/
+void notify_boot(void);
+
+/**
+ * Configures the endpoint and its dma channel when the host sets the
+ * configuration (CyFxNitroApplnStart) and tears them down again.
+ **/
+void notify_start(uint16_t ep_buffer_size);
+void notify_stop(void);
+
+/**
+ * Queues an event.  Doesn't block so it's safe from any thread or from
+ * interrupt context (gpio callbacks etc.)  Returns CyFalse if the record
+ * was dropped.
+ **/
+CyBool_t notify_post(uint16_t event, uint32_t arg0, uint32_t arg1);
+
+/**
+ * Sends queued records.  Called by the app thread on NITRO_EVENT_NOTIFY;
+ * thread context only.
+ **/
+void notify_flush(void);
+
+#endif
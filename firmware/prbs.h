@@ -0,0 +1,24 @@
+#ifndef PRBS_H
+#define PRBS_H
+
+#include <cyu3types.h>
+
+/**
+ * PRBS31 (x^31 + x^28 + 1) generated 32 bits at a time.
+ *
+ * Bit j of each word is bit 32k+j of the sequence so the words can be
+ * checked (or regenerated) on the host from any received word.  See
+ * py/fx3/prbs.py for the host implementation.
+ *
+ * An all zero word locks the generator so seeds of 0 are changed to 1.
+ **/
+#define PRBS_SEED(x) ((x) ? (x) : 1)
+
+static inline uint32_t prbs31_next(uint32_t w) {
+  uint32_t t = (w>>4) ^ (w>>1);
+  t ^= t<<28;
+  t ^= t<<31;
+  return t;
+}
+
+#endif
@@ -0,0 +1,332 @@
+#include <cyu3system.h>
+#include <cyu3error.h>
+#include <cyu3gpio.h>
+#include <cyu3os.h>
+
+#include "pretrig.h"
+#include "main.h"
+#include "hwtimer.h"
+#include "notify.h"
+#include "rdwr.h"
+#include "log.h"
+#include <fx3_terminals.h>
+
+#ifndef DEBUG_PRETRIG
+#undef log_debug
+#define log_debug(...) do {} while (0)
+#endif
+
+uint8_t gPretrigRing[PRETRIG_RING_SIZE] __attribute__ ((aligned (32)));
+
+uint16_t gPretrigSourceTerm=0;
+uint32_t gPretrigSourceReg=0;
+uint32_t gPretrigChunk=1024;
+uint32_t gPretrigSize=PRETRIG_RING_SIZE;
+uint32_t gPretrigPre=0;
+uint32_t gPretrigPost=0;
+uint8_t gPretrigTrigger=PRETRIG_TRIGGER_HOST;
+uint8_t gPretrigPin=0;
+uint16_t gPretrigMatchTerm=0;
+uint32_t gPretrigMatchReg=0;
+uint32_t gPretrigMatchMask=0;
+uint32_t gPretrigMatchValue=0;
+CyBool_t gPretrigPinArmed=CyFalse;
+
+volatile uint8_t gPretrigState=PRETRIG_STATE_IDLE;
+volatile uint64_t gPretrigWritten=0; // ring bytes read from the source since armed
+uint64_t gPretrigAt=0;               // gPretrigWritten at the trigger
+uint64_t gPretrigStart=0;            // window in gPretrigWritten bytes
+uint64_t gPretrigEnd=0;
+pretrig_info_t gPretrigInfo;
+
+/**
+ * Moves ARMED to TRIGGERED.  Safe from interrupts; the trigger lands
+ * on the chunk boundary the ring has reached.
+ **/
+static void pretrig_fire(uint8_t trigger) {
+  uint32_t mask = CyU3PVicDisableAllInterrupts();
+  if (gPretrigState == PRETRIG_STATE_ARMED) {
+    gPretrigState = PRETRIG_STATE_TRIGGERED;
+    gPretrigAt = gPretrigWritten;
+    gPretrigInfo.trigger = trigger;
+    gPretrigInfo.trigger_ticks = hwtimer_ticks();
+  }
+  CyU3PVicEnableInterrupts(mask);
+  CyU3PEventSet(&glThreadEvent, NITRO_EVENT_PRETRIG, CYU3P_EVENT_OR);
+}
+
+CyBool_t pretrig_isr(uint8_t gpioId) {
+  if (!gPretrigPinArmed || gpioId != gPretrigPin) return CyFalse;
+  pretrig_fire(gPretrigTrigger);
+  return CyTrue;
+}
+
+static void pretrig_pin_release(void) {
+  if (!gPretrigPinArmed) return;
+  gPretrigPinArmed = CyFalse;
+  CyU3PGpioDisable(gPretrigPin);
+}
+
+static uint16_t pretrig_pin_config(void) {
+  CyU3PGpioSimpleConfig_t cfg;
+  CyU3PReturnStatus_t status;
+
+  // take the pin away from whatever the io matrix had it set to
+  status = CyU3PDeviceGpioOverride(gPretrigPin, CyTrue);
+  if (status) {
+    log_error ( "Fail to override pretrig gpio %d: %d\n", gPretrigPin, status );
+    return status;
+  }
+  CyU3PMemSet((uint8_t*)&cfg, 0, sizeof(cfg));
+  cfg.outValue    = CyFalse;
+  cfg.driveLowEn  = CyFalse;
+  cfg.driveHighEn = CyFalse;
+  cfg.inputEn     = CyTrue;
+  cfg.intrMode    = (CyU3PGpioIntrMode_t)gPretrigTrigger; // same values as CY_U3P_GPIO_INTR_*_EDGE
+  gPretrigPinArmed = CyTrue; // before the first interrupt can come in
+  status = CyU3PGpioSetSimpleConfig(gPretrigPin, &cfg);
+  if (status) {
+    log_error ( "Fail to config pretrig gpio %d: %d\n", gPretrigPin, status );
+    gPretrigPinArmed = CyFalse;
+  }
+  return status;
+}
+
+/**
+ * Freezes the window and tells the host.  status is the handler status
+ * that stopped the capture early, 0 if the post bytes are in.
+ **/
+static void pretrig_done(uint16_t status) {
+  uint64_t oldest;
+  uint32_t mask;
+
+  pretrig_pin_release();
+  mask = CyU3PVicDisableAllInterrupts();
+  if (gPretrigState == PRETRIG_STATE_ARMED) gPretrigAt = gPretrigWritten; // never fired
+  gPretrigState = PRETRIG_STATE_DONE;
+  CyU3PVicEnableInterrupts(mask);
+
+  oldest = gPretrigWritten > gPretrigSize ? gPretrigWritten - gPretrigSize : 0;
+  gPretrigStart = gPretrigAt > gPretrigPre ? gPretrigAt - gPretrigPre : 0;
+  if (gPretrigStart < oldest) gPretrigStart = oldest;
+  gPretrigEnd = gPretrigAt + gPretrigPost;
+  if (gPretrigEnd > gPretrigWritten) gPretrigEnd = gPretrigWritten;
+
+  gPretrigInfo.status = status;
+  gPretrigInfo.pre = gPretrigAt - gPretrigStart;
+  gPretrigInfo.post = gPretrigEnd - gPretrigAt;
+  log_debug ( "pretrig window %d+%d status %d\n", gPretrigInfo.pre, gPretrigInfo.post, status );
+  notify_post(NOTIFY_PRETRIG, gPretrigEnd - gPretrigStart, status);
+}
+
+static void pretrig_disarm(void) {
+  pretrig_pin_release();
+  gPretrigState = PRETRIG_STATE_IDLE;
+}
+
+static uint16_t pretrig_arm(void) {
+  io_handler_t *handler = rdwr_find_handler(gPretrigSourceTerm);
+
+  pretrig_disarm();
+  if (!handler || handler->handler != &glCpuHandler || gPretrigSourceTerm == TERM_PRETRIG ||
+      !gPretrigChunk || (gPretrigChunk & 3) || gPretrigSize % gPretrigChunk ||
+      // the ring can get a chunk past the end of the window before it stops
+      gPretrigPre + gPretrigPost + gPretrigChunk > gPretrigSize ||
+      gPretrigTrigger > PRETRIG_TRIGGER_MATCH) {
+    log_error ( "Bad pretrig setup term %d chunk %d\n", gPretrigSourceTerm, gPretrigChunk );
+    return 1;
+  }
+  CyU3PMemSet((uint8_t*)&gPretrigInfo, 0, sizeof(gPretrigInfo));
+  gPretrigWritten = 0;
+  gPretrigAt = gPretrigStart = gPretrigEnd = 0;
+  gPretrigState = PRETRIG_STATE_ARMED;
+  if (gPretrigTrigger >= PRETRIG_TRIGGER_RISING && gPretrigTrigger <= PRETRIG_TRIGGER_BOTH) {
+    uint16_t status = pretrig_pin_config();
+    if (status) {
+      gPretrigState = PRETRIG_STATE_IDLE;
+      return status;
+    }
+  }
+  CyU3PEventSet(&glThreadEvent, NITRO_EVENT_PRETRIG, CYU3P_EVENT_OR);
+  return 0;
+}
+
+void pretrig_service(void) {
+  uint8_t *dst;
+  uint16_t status;
+  uint32_t mask, val;
+
+  if (gPretrigState != PRETRIG_STATE_ARMED && gPretrigState != PRETRIG_STATE_TRIGGERED) return;
+  if (!gRdwrCmd.done) {
+    // a host transaction has the handlers, try again shortly
+    CyU3PThreadSleep(1);
+    CyU3PEventSet(&glThreadEvent, NITRO_EVENT_PRETRIG, CYU3P_EVENT_OR);
+    return;
+  }
+
+  // the ring is a whole number of chunks so a chunk never wraps
+  dst = gPretrigRing + (uint32_t)(gPretrigWritten % gPretrigSize);
+  status = rdwr_local(COMMAND_READ, gPretrigSourceTerm, gPretrigSourceReg, dst, gPretrigChunk);
+  if (status) {
+    pretrig_done(status);
+    return;
+  }
+  mask = CyU3PVicDisableAllInterrupts();
+  gPretrigWritten += gPretrigChunk;
+  CyU3PVicEnableInterrupts(mask);
+  gPretrigInfo.captured = gPretrigWritten;
+
+  if (gPretrigState == PRETRIG_STATE_ARMED && gPretrigTrigger == PRETRIG_TRIGGER_MATCH) {
+    val = 0; // handlers copy whole 32 bit registers
+    status = rdwr_local(COMMAND_GET, gPretrigMatchTerm, gPretrigMatchReg, (uint8_t*)&val, 4);
+    if (status) {
+      pretrig_done(status);
+      return;
+    }
+    if ((val & gPretrigMatchMask) == gPretrigMatchValue) pretrig_fire(PRETRIG_TRIGGER_MATCH);
+  }
+  if (gPretrigState == PRETRIG_STATE_TRIGGERED && gPretrigWritten >= gPretrigAt + gPretrigPost) {
+    pretrig_done(0);
+    return;
+  }
+  CyU3PEventSet(&glThreadEvent, NITRO_EVENT_PRETRIG, CYU3P_EVENT_OR);
+}
+
+/**
+ * Copies the window part buf covers at the current transaction offset,
+ * oldest byte first, and zero fills past the end.
+ **/
+static uint16_t pretrig_window(CyU3PDmaBuffer_t *buf) {
+  uint64_t pos = gPretrigStart + gRdwrCmd.transfered_so_far;
+  uint32_t n=0, off, first;
+
+  if (gPretrigState != PRETRIG_STATE_DONE) return 1;
+  if (pos < gPretrigEnd) n = gPretrigEnd - pos < buf->count ? gPretrigEnd - pos : buf->count;
+  off = pos % gPretrigSize;
+  first = gPretrigSize - off < n ? gPretrigSize - off : n;
+  CyU3PMemCopy(buf->buffer, gPretrigRing + off, first);
+  CyU3PMemCopy(buf->buffer + first, gPretrigRing, n - first);
+  CyU3PMemSet(buf->buffer + n, 0, buf->count - n);
+  return 0;
+}
+
+uint16_t pretrig_read(CyU3PDmaBuffer_t* buf) {
+  uint32_t val;
+  switch (gRdwrCmd.header.reg_addr) {
+    case PRETRIG_SOURCE_TERM:
+      val = gPretrigSourceTerm;
+      break;
+    case PRETRIG_SOURCE_REG:
+      val = gPretrigSourceReg;
+      break;
+    case PRETRIG_CHUNK:
+      val = gPretrigChunk;
+      break;
+    case PRETRIG_SIZE:
+      val = gPretrigSize;
+      break;
+    case PRETRIG_PRE:
+      val = gPretrigPre;
+      break;
+    case PRETRIG_POST:
+      val = gPretrigPost;
+      break;
+    case PRETRIG_TRIGGER:
+      val = gPretrigTrigger;
+      break;
+    case PRETRIG_PIN:
+      val = gPretrigPin;
+      break;
+    case PRETRIG_MATCH_TERM:
+      val = gPretrigMatchTerm;
+      break;
+    case PRETRIG_MATCH_REG:
+      val = gPretrigMatchReg;
+      break;
+    case PRETRIG_MATCH_MASK:
+      val = gPretrigMatchMask;
+      break;
+    case PRETRIG_MATCH_VALUE:
+      val = gPretrigMatchValue;
+      break;
+    case PRETRIG_ARM:
+      val = gPretrigState;
+      break;
+    case PRETRIG_INFO:
+      gPretrigInfo.state = gPretrigState;
+      CyU3PMemSet(buf->buffer, 0, buf->count);
+      CyU3PMemCopy(buf->buffer, (uint8_t*)&gPretrigInfo,
+                   buf->count < sizeof(gPretrigInfo) ? buf->count : sizeof(gPretrigInfo));
+      return 0;
+    case PRETRIG_WINDOW:
+      return pretrig_window(buf);
+    default:
+      return 1;
+  }
+  CyU3PMemCopy(buf->buffer, (uint8_t*)&val, 4);
+  return 0;
+}
+
+uint16_t pretrig_write(CyU3PDmaBuffer_t* buf) {
+  uint32_t val;
+  CyU3PMemCopy((uint8_t*)&val, buf->buffer, 4);
+
+  switch (gRdwrCmd.header.reg_addr) {
+    case PRETRIG_ARM:
+      if (!val) {
+        pretrig_disarm();
+        return 0;
+      }
+      return pretrig_arm();
+    case PRETRIG_FIRE:
+      if (gPretrigState != PRETRIG_STATE_ARMED) return 1;
+      pretrig_fire(PRETRIG_TRIGGER_HOST);
+      return 0;
+  }
+
+  // setup only changes while not capturing
+  if (gPretrigState == PRETRIG_STATE_ARMED || gPretrigState == PRETRIG_STATE_TRIGGERED) return 1;
+  switch (gRdwrCmd.header.reg_addr) {
+    case PRETRIG_SOURCE_TERM:
+      gPretrigSourceTerm = val;
+      return 0;
+    case PRETRIG_SOURCE_REG:
+      gPretrigSourceReg = val;
+      return 0;
+    case PRETRIG_CHUNK:
+      gPretrigChunk = val;
+      return 0;
+    case PRETRIG_SIZE:
+      if (!val || val > PRETRIG_RING_SIZE) return 1;
+      gPretrigSize = val;
+      return 0;
+    case PRETRIG_PRE:
+      gPretrigPre = val;
+      return 0;
+    case PRETRIG_POST:
+      gPretrigPost = val;
+      return 0;
+    case PRETRIG_TRIGGER:
+      if (val > PRETRIG_TRIGGER_MATCH) return 1;
+      gPretrigTrigger = val;
+      return 0;
+    case PRETRIG_PIN:
+      if (val >= PRETRIG_GPIO_COUNT) return 1;
+      gPretrigPin = val;
+      return 0;
+    case PRETRIG_MATCH_TERM:
+      gPretrigMatchTerm = val;
+      return 0;
+    case PRETRIG_MATCH_REG:
+      gPretrigMatchReg = val;
+      return 0;
+    case PRETRIG_MATCH_MASK:
+      gPretrigMatchMask = val;
+      return 0;
+    case PRETRIG_MATCH_VALUE:
+      gPretrigMatchValue = val;
+      return 0;
+    default:
+      return 1;
+  }
+}
@@ -0,0 +1,75 @@
+#ifndef PRETRIG_H
+#define PRETRIG_H
+
+/**
+ * Triggered capture with pre-trigger history.
+ *
+ * Once armed, the PRETRIG terminal keeps reading a source terminal
+ * register (BENCH data, SAMPLER rows or any other cpu handler terminal)
+ * a chunk at a time into a ring buffer in SRAM.  A trigger freezes the
+ * ring once post bytes past the trigger are in.  The trigger can be a
+ * write to the fire register, a gpio edge, or a register whose value
+ * matches after a chunk.  The host then reads the window (pre bytes
+ * before the trigger and post after) in one transaction.  Rare events
+ * are caught without streaming all the time.  NOTIFY_PRETRIG says when
+ * the window is ready.  See py/fx3/pretrig.py.
+ *
+ * Capture runs on the app thread between host transactions like
+ * macros (rdwr_local), so host transactions pause it and the trigger
+ * position is only as fine as chunk.
+ *
+ * Add pretrig.c to SOURCE and -D PRETRIG to CCFLAGS to enable.  The ring
+ * is a static PRETRIG_RING_SIZE buffer; raise it to use more SRAM.
+ **/
+
+#include "handlers.h"
+
+#ifndef PRETRIG_RING_SIZE
+#define PRETRIG_RING_SIZE 0x10000
+#endif
+#define PRETRIG_GPIO_COUNT 61
+
+enum PRETRIG_TRIGGER_MODE {
+  PRETRIG_TRIGGER_HOST=0, // only the fire register
+  PRETRIG_TRIGGER_RISING, // edges on the pin register's gpio
+  PRETRIG_TRIGGER_FALLING,
+  PRETRIG_TRIGGER_BOTH,
+  PRETRIG_TRIGGER_MATCH   // (match_term/match_reg & match_mask) == match_value
+};
+
+enum PRETRIG_STATE {
+  PRETRIG_STATE_IDLE=0,
+  PRETRIG_STATE_ARMED,     // filling the ring, waiting for the trigger
+  PRETRIG_STATE_TRIGGERED, // filling the post trigger bytes
+  PRETRIG_STATE_DONE       // window ready
+};
+
+typedef struct {
+  uint32_t state;         // PRETRIG_STATE
+  uint32_t captured;      // bytes read from the source since armed (low 32 bits)
+  uint32_t pre;           // window bytes before the trigger (less than
+                          // the pre register if it fired early)
+  uint32_t post;          // window bytes from the trigger on
+  uint32_t trigger_ticks; // hwtimer ticks at the trigger
+  uint16_t trigger;       // PRETRIG_TRIGGER_MODE that fired
+  uint16_t status;        // source or match handler status that stopped the capture
+} pretrig_info_t;
+
+/**
+ * Reads the next chunk while armed.  Called by the app thread on
+ * NITRO_EVENT_PRETRIG and every main loop pass.
+ **/
+void pretrig_service(void);
+
+/**
+ * GPIO interrupt hook.  Returns CyTrue if gpioId is the trigger pin.
+ **/
+CyBool_t pretrig_isr(uint8_t gpioId);
+
+uint16_t pretrig_read(CyU3PDmaBuffer_t*);
+uint16_t pretrig_write(CyU3PDmaBuffer_t*);
+
+#define DECLARE_PRETRIG_HANDLER(term) \
+  DECLARE_HANDLER(&glCpuHandler,term,0,0,pretrig_read,pretrig_write,0,0,0,0)
+
+#endif
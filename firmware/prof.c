@@ -0,0 +1,137 @@
+
+#include <cyu3system.h>
+#include <cyu3error.h>
+
+#include "prof.h"
+#include "hwtimer.h"
+#include "rdwr.h"
+#include "log.h"
+#include <fx3_terminals.h>
+
+#ifndef PROF_GPIO
+#error "Add -DPROF_GPIO=<pin> to CCFLAGS to use the profiler"
+#endif
+
+#ifndef DEBUG_PROF
+#undef log_debug
+#define log_debug(...) do {} while (0)
+#endif
+
+/**
+ * ThreadX's _tx_thread_context_save leaves the interrupted context on the
+ * IRQ stack as {spsr, r10, r12, pc, r0-r3} before the SDK isr switches to
+ * the system stack.  The GPIO callback runs after that so the banked IRQ
+ * sp still points at the frame.  Override if a different SDK/ThreadX port
+ * lays it out differently.
+ **/
+#ifndef PROF_IRQ_PC_INDEX
+#define PROF_IRQ_PC_INDEX 3
+#endif
+
+prof_sample_t gProfRing[PROF_RING_SIZE];
+volatile uint32_t gProfHead=0; // written by isr only
+volatile uint32_t gProfTail=0; // written by prof_read only
+volatile uint32_t gProfDropped=0;
+uint32_t gProfRate=0;
+
+static uint32_t prof_irq_pc(void) {
+#ifdef __arm__
+  uint32_t *irq_sp;
+  uint32_t cpsr, tmp;
+  // peek at the banked IRQ mode sp with interrupts off.
+  __asm__ volatile (
+      "mrs %1, cpsr\n\t"
+      "bic %2, %1, #0x1f\n\t"
+      "orr %2, %2, #0x92\n\t" // IRQ mode, I bit set
+      "msr cpsr_c, %2\n\t"
+      "mov %0, sp\n\t"
+      "msr cpsr_c, %1\n\t"
+      : "=r" (irq_sp), "=&r" (cpsr), "=&r" (tmp) );
+  return irq_sp[PROF_IRQ_PC_INDEX];
+#else
+  return 0;
+#endif
+}
+
+static void prof_sample(void) {
+  uint32_t head = gProfHead;
+  uint32_t next = (head+1) & (PROF_RING_SIZE-1);
+  if (next == gProfTail) {
+    ++gProfDropped;
+    return;
+  }
+  gProfRing[head].pc = prof_irq_pc();
+  gProfRing[head].thread = (uint32_t)CyU3PThreadIdentify();
+  gProfHead = next;
+}
+
+static uint32_t prof_count() {
+  return (gProfHead - gProfTail) & (PROF_RING_SIZE-1);
+}
+
+/**
+ * Copies as many whole samples as fit in the buffer and zero fills the
+ * rest.  pc==0 samples should be ignored by the host.
+ **/
+static void prof_drain(CyU3PDmaBuffer_t* buf) {
+  uint32_t n = buf->count / sizeof(prof_sample_t);
+  uint32_t avail = prof_count();
+  uint32_t tail = gProfTail;
+  uint8_t *dst = buf->buffer;
+
+  if (n>avail) n=avail;
+  while (n) {
+    uint32_t run = PROF_RING_SIZE - tail;
+    if (run>n) run=n;
+    CyU3PMemCopy(dst, (uint8_t*)&gProfRing[tail], run*sizeof(prof_sample_t));
+    dst += run*sizeof(prof_sample_t);
+    tail = (tail+run) & (PROF_RING_SIZE-1);
+    n -= run;
+  }
+  gProfTail = tail;
+  CyU3PMemSet(dst, 0, buf->count - (dst-buf->buffer));
+}
+
+uint16_t prof_read(CyU3PDmaBuffer_t* buf) {
+  uint32_t val;
+  switch (gRdwrCmd.header.reg_addr) {
+    case PROF_RATE:
+      val = gProfRate;
+      break;
+    case PROF_COUNT:
+      val = prof_count();
+      break;
+    case PROF_DROPPED:
+      val = gProfDropped;
+      break;
+    case PROF_SAMPLES:
+      prof_drain(buf);
+      return 0;
+    default:
+      return 1;
+  }
+  CyU3PMemCopy(buf->buffer, (uint8_t*)&val, 4);
+  return 0;
+}
+
+uint16_t prof_write(CyU3PDmaBuffer_t* buf) {
+  uint32_t rate;
+  uint16_t ret;
+  switch (gRdwrCmd.header.reg_addr) {
+    case PROF_RATE:
+      CyU3PMemCopy((uint8_t*)&rate, buf->buffer, 4);
+      hwtimer_periodic_stop(PROF_GPIO);
+      // a new rate starts a new profile
+      gProfTail = gProfHead;
+      gProfDropped = 0;
+      gProfRate = 0;
+      if (!rate) return 0;
+      ret = hwtimer_periodic_start(PROF_GPIO, rate, prof_sample);
+      if (ret) return ret;
+      gProfRate = rate;
+      log_debug ( "profiler %d Hz\n", rate );
+      return 0;
+    default:
+      return 1;
+  }
+}
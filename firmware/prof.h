@@ -0,0 +1,34 @@
+#ifndef PROF_H
+#define PROF_H
+
+/**
+ * Statistical profiler.
+ *
+ * A periodic hardware timer (see hwtimer.h) interrupts the cpu and
+ * records the interrupted pc and the current thread into a ring buffer.
+ * The PROF terminal sets the rate and drains the samples.  Use
+ * py/fx3/prof.py to symbolize them against main.elf.
+ *
+ * Add prof.c to SOURCE and -D PROF_GPIO=<pin> to CCFLAGS to enable.  The
+ * pin must be free and not share a complex gpio block with any other
+ * hwtimer pin.
+ **/
+
+#include "handlers.h"
+
+#ifndef PROF_RING_SIZE
+#define PROF_RING_SIZE 1024 // samples, must be a power of 2
+#endif
+
+typedef struct {
+  uint32_t pc;     // interrupted pc
+  uint32_t thread; // CyU3PThread* running when interrupted (0 for idle)
+} prof_sample_t;
+
+uint16_t prof_read(CyU3PDmaBuffer_t*);
+uint16_t prof_write(CyU3PDmaBuffer_t*);
+
+#define DECLARE_PROF_HANDLER(term) \
+  DECLARE_HANDLER(&glCpuHandler,term,0,0,prof_read,prof_write,0,0,0,0)
+
+#endif
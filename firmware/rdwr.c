@@ -6,6 +6,8 @@
 #include "vendor_commands.h"
 #include "rdwr.h"
 #include "main.h"
+#include "hwtimer.h"
+#include "notify.h"
 //#include "fx3_terminals.h"
 //#include <cyu3i2c.h>
 //#include <m24xx.h>
@@ -27,8 +29,143 @@ extern uint16_t get_serial(uint8_t*);
 
 rdwr_cmd_t gRdwrCmd;
 uint16_t gRdwrCmdInitStat=0;
+uint32_t gRdwrCallBytes;
 //uint8_t gSerialNum[32] __attribute__ ((aligned (32))); // actually 16 bytes but DMACache requires multiple of 32
 extern uint8_t glEp0Buffer[]; // dma aligned buffer for ep0 read/writes
+static uint16_t gEp0HeaderLen; // header size the host sent (old hosts send RDWR_HEADER_V0_SIZE)
+
+io_handler_t *rdwr_find_handler(uint16_t term) {
+  int i = 0;
+  while(io_handlers[i].handler) {
+    if ((io_handlers[i].handler->handler_filter &&
+         io_handlers[i].handler->handler_filter(term)) ||
+        io_handlers[i].term_addr == term) {
+      log_debug("Found handler %d\n", i);
+      return &(io_handlers[i]);
+    }
+    i++;
+  }
+  return NULL;
+}
+
+/* One v2 call with the rest of buf in up to IO_HANDLER_IOV_MAX chunks.
+ * Returns the handler's status, the bytes it moved and if it left a
+ * buffer short. */
+static uint16_t rdwr_callv(io_handler_t *handler, uint8_t command, uint8_t *buf, uint32_t len,
+                           uint32_t chunk, uint32_t *moved, CyBool_t *shortp) {
+  CyU3PDmaBuffer_t iov[IO_HANDLER_IOV_MAX];
+  uint32_t off = gRdwrCmd.transfered_so_far;
+  uint16_t n, i, status;
+
+  for (n=0; n<IO_HANDLER_IOV_MAX && off<len; ++n) {
+    iov[n].buffer = buf + off;
+    iov[n].count = iov[n].size = len - off < chunk ? len - off : chunk;
+    iov[n].status = 0;
+    off += iov[n].count;
+  }
+  status = (command & bmSETWRITE) ? handler->writev_handler(iov, n) : handler->readv_handler(iov, n);
+  *moved = 0;
+  *shortp = CyFalse;
+  for (i=0; i<n; ++i) {
+    if (iov[i].count < iov[i].size) {
+      *moved += iov[i].count;
+      *shortp = CyTrue;
+      break;
+    }
+    *moved += iov[i].size;
+  }
+  return status;
+}
+
+uint16_t rdwr_call(io_handler_t *handler, uint8_t command, uint16_t term, uint32_t reg,
+                   uint8_t *buf, uint32_t len) {
+  rdwr_data_header_t header = gRdwrCmd.header;
+  uint32_t transfered = gRdwrCmd.transfered_so_far;
+  CyU3PDmaBuffer_t dmaBuf;
+  uint32_t chunk = gRdwrCmd.ep_buffer_size ? gRdwrCmd.ep_buffer_size : len;
+  uint32_t moved;
+  uint16_t status=0, busy=0;
+  CyBool_t shortp;
+
+  gRdwrCmd.header.command = command;
+  gRdwrCmd.header.term_addr = term;
+  gRdwrCmd.header.reg_addr = reg;
+  gRdwrCmd.header.transfer_length = len;
+  gRdwrCmd.header.seq = 0;
+  gRdwrCmd.header.flags = 0;
+  gRdwrCmd.transfered_so_far = 0;
+
+  if (handler->init_handler) status = handler->init_handler();
+  while (!status && gRdwrCmd.transfered_so_far < len) {
+    if ((command & bmSETWRITE) ? handler->writev_handler != 0 : handler->readv_handler != 0) {
+      status = rdwr_callv(handler, command, buf, len, chunk, &moved, &shortp);
+      if (!status && shortp) {
+        if (!(command & bmSETWRITE)) {
+          gRdwrCmd.transfered_so_far += moved; // a short read ends it
+          break;
+        }
+        status = IO_HANDLER_BUSY;
+      }
+    } else {
+      dmaBuf.buffer = buf + gRdwrCmd.transfered_so_far;
+      dmaBuf.count = len - gRdwrCmd.transfered_so_far < chunk ? len - gRdwrCmd.transfered_so_far : chunk;
+      dmaBuf.size = dmaBuf.count;
+      if (command & bmSETWRITE) {
+        if (handler->write_handler) status = handler->write_handler(&dmaBuf);
+      } else {
+        if (handler->read_handler) status = handler->read_handler(&dmaBuf);
+      }
+      moved = status == IO_HANDLER_BUSY ? dmaBuf.buffer - (buf + gRdwrCmd.transfered_so_far) : dmaBuf.count;
+    }
+    gRdwrCmd.transfered_so_far += moved;
+    if (status == IO_HANDLER_BUSY) {
+      // count what it took and offer the rest again
+      busy = moved ? 0 : busy + 1;
+      if (busy > RDWR_BUSY_TRIES) {
+        status = CY_U3P_ERROR_TIMEOUT;
+        break;
+      }
+      rdwr_busy_wait();
+      status = 0;
+    }
+  }
+
+  gRdwrCallBytes = gRdwrCmd.transfered_so_far;
+  gRdwrCmd.header = header;
+  gRdwrCmd.transfered_so_far = transfered;
+  return status;
+}
+
+void io_handler_ready(void) {
+  CyU3PEventSet(&glThreadEvent, NITRO_EVENT_DATA, CYU3P_EVENT_OR);
+}
+
+uint32_t rdwr_busy_wait(void) {
+  uint32_t flags, t0 = hwtimer_ticks();
+  CyU3PEventGet(&glThreadEvent, NITRO_EVENT_DATA, CYU3P_EVENT_OR_CLEAR, &flags, RDWR_BUSY_WAIT_MS);
+  return hwtimer_ticks() - t0;
+}
+
+uint16_t rdwr_local(uint8_t command, uint16_t term, uint32_t reg, uint8_t *buf, uint32_t len) {
+  io_handler_t *handler;
+
+  if (!gRdwrCmd.done) return CY_U3P_ERROR_INVALID_SEQUENCE;
+  handler = rdwr_find_handler(term);
+  if (!handler || handler->handler != &glCpuHandler) return CY_U3P_ERROR_NOT_SUPPORTED;
+
+  // switch handlers the way start_rdwr does but without the cpu
+  // handler's dma channels, the data doesn't go over usb.
+  if (gRdwrCmd.io_handler != handler) {
+    if (gRdwrCmd.io_handler && gRdwrCmd.io_handler->uninit_handler)
+      gRdwrCmd.io_handler->uninit_handler();
+    if (gRdwrCmd.io_handler &&
+        gRdwrCmd.io_handler->handler->handler_teardown != handler->handler->handler_teardown &&
+        gRdwrCmd.io_handler->handler->handler_teardown)
+      gRdwrCmd.io_handler->handler->handler_teardown();
+    gRdwrCmd.io_handler = handler;
+  }
+  return rdwr_call(handler, command, term, reg, buf, len);
+}
 
 void rdwr_teardown() {
   gRdwrCmd.done=1;
@@ -67,13 +204,14 @@ void RDWR_DONE(CyBool_t main) {
 CyU3PReturnStatus_t ep0_rdwr_setup() {
     // Fetch the rdwr command
     // NOTE this api call acks the vendor command if it's successful
-    CyU3PReturnStatus_t status = CyU3PUsbGetEP0Data(sizeof(rdwr_data_header_t), glEp0Buffer, 0);
+    CyU3PReturnStatus_t status = CyU3PUsbGetEP0Data(gEp0HeaderLen, glEp0Buffer, 0);
 
     if(status != CY_U3P_SUCCESS){
       log_error("Error get EP0 Data\n", status);
       return status;
     }
-    CyU3PMemCopy ( (uint8_t*)&gRdwrCmd.header, glEp0Buffer, sizeof(gRdwrCmd.header) );
+    CyU3PMemSet ( (uint8_t*)&gRdwrCmd.header, 0, sizeof(gRdwrCmd.header) );
+    CyU3PMemCopy ( (uint8_t*)&gRdwrCmd.header, glEp0Buffer, gEp0HeaderLen );
     return CY_U3P_SUCCESS;
 }
 
@@ -83,10 +221,12 @@ CyU3PReturnStatus_t handle_rdwr(uint8_t bReqType, uint16_t wValue, uint16_t wInd
   // wIndex is a hint for slave fifo if we need auto or manual mode
   // start a rdwr command based on incoming ep0 traffic
     //log_debug("Entering handleRDWR\n");
-    if (bReqType != 0x40 || wLength != sizeof(rdwr_data_header_t)) {
+    if (bReqType != 0x40 ||
+        (wLength != sizeof(rdwr_data_header_t) && wLength != RDWR_HEADER_V0_SIZE)) {
       log_error("Bad ReqType or length=%d (%d)\n", wLength, sizeof(rdwr_data_header_t));
       return CY_U3P_ERROR_BAD_ARGUMENT;
     }
+    gEp0HeaderLen = wLength;
 
     RDWR_DONE(CyTrue); // if the last transaction failed go ahead and release the mutex before starting.
 
@@ -130,17 +270,7 @@ CyU3PReturnStatus_t start_rdwr( uint16_t term, uint16_t len_hint, rdwr_setup_han
    new_handler = &firmware_di_handler;
   } else {
   #endif
-  int i = 0;
-  while(io_handlers[i].handler) {
-    if ((io_handlers[i].handler->handler_filter &&
-         io_handlers[i].handler->handler_filter(term)) ||
-        io_handlers[i].term_addr == term) {
-      new_handler = &(io_handlers[i]);
-      log_debug("Found handler %d\n", i);
-      break;
-    }
-    i++;
-  }
+  new_handler = rdwr_find_handler(term);
   #ifdef FIRMWARE_DI
   }
   #endif
@@ -155,10 +285,11 @@ CyU3PReturnStatus_t start_rdwr( uint16_t term, uint16_t len_hint, rdwr_setup_han
   }
 
   // first tear down previous handlers DMA channels
-  // only if we're switching handler types
+  // only if we're switching handler types that don't share them
+  // (same teardown, see cpu_handler.h)
   if(gRdwrCmd.io_handler && (
 	!new_handler ||
- 	gRdwrCmd.io_handler->handler != new_handler->handler )) {
+ 	gRdwrCmd.io_handler->handler->handler_teardown != new_handler->handler->handler_teardown )) {
     log_debug ( "switching handler types, teardown old handler\n");
     if (gRdwrCmd.io_handler->handler->handler_teardown)
         gRdwrCmd.io_handler->handler->handler_teardown();
@@ -194,6 +325,8 @@ CyU3PReturnStatus_t start_rdwr( uint16_t term, uint16_t len_hint, rdwr_setup_han
 
   // rest of the header besides done
   gRdwrCmd.transfered_so_far = 0;
+  gRdwrCmd.stream_stop = 0;
+  gRdwrCmd.abort = 0;
 
 
   // NOTE from here on..
@@ -212,6 +345,7 @@ CyU3PReturnStatus_t start_rdwr( uint16_t term, uint16_t len_hint, rdwr_setup_han
     status=gRdwrCmd.io_handler->init_handler();
     if (status) {
       gRdwrCmdInitStat=status;
+      notify_post(NOTIFY_INIT_STAT, gRdwrCmd.header.term_addr, status);
       log_error ( "handler fail to init %d\n", status);
       return 0;
    }
@@ -223,6 +357,7 @@ CyU3PReturnStatus_t start_rdwr( uint16_t term, uint16_t len_hint, rdwr_setup_han
         status = gRdwrCmd.io_handler->handler->handler_start();
         if (status) {
           gRdwrCmdInitStat=status;
+          notify_post(NOTIFY_INIT_STAT, gRdwrCmd.header.term_addr, status);
           log_error ( "handler_start fail %d\n", status);
           return 0;
         }
@@ -345,6 +480,28 @@ CyU3PReturnStatus_t handle_serial_num(uint8_t bReqType, uint16_t wLength) {
 
 
 /******************************************************************************/
+// not glEp0Buffer, the app thread may still be using it
+uint8_t gFastEp0Buffer[32] __attribute__ ((aligned (32)));
+
+CyBool_t handle_fast_vendor_cmd(uint8_t bRequest, uint8_t bReqType, uint16_t wLength) {
+  time_pkt_t *t = (time_pkt_t*)gFastEp0Buffer;
+  uint64_t ticks;
+
+  if (bRequest != VC_TIME) return CyFalse;
+
+  if (bReqType != 0xc0 || wLength < sizeof(time_pkt_t)) {
+    CyU3PUsbStall (0, CyTrue, CyFalse);
+    return CyTrue;
+  }
+  ticks = hwtimer_ticks64();
+  t->ticks_lo = (uint32_t)ticks;
+  t->ticks_hi = (uint32_t)(ticks>>32);
+  t->ticks_hz = HWTIMER_HZ;
+  if (CyU3PUsbSendEP0Data(sizeof(time_pkt_t), gFastEp0Buffer))
+    CyU3PUsbStall (0, CyTrue, CyFalse);
+  return CyTrue;
+}
+
 CyBool_t handle_vendor_cmd(uint8_t  bRequest, uint8_t bReqType,
 			   uint8_t  bType, uint8_t bTarget,
 			   uint16_t wValue, uint16_t wIndex,
@@ -365,6 +522,37 @@ CyBool_t handle_vendor_cmd(uint8_t  bRequest, uint8_t bReqType,
     status = handle_serial_num(bReqType, wLength);
     break;
 
+  case VC_STREAM_STOP:
+    if (bReqType != 0x40) {
+      status = CY_U3P_ERROR_BAD_ARGUMENT;
+      break;
+    }
+    // a stop after the stream ended (or failed to start) is harmless
+    gRdwrCmd.stream_stop = 1;
+    status = CyU3PUsbAckSetup();
+    break;
+
+  case VC_ABORT:
+    if (bReqType != 0x40) {
+      status = CY_U3P_ERROR_BAD_ARGUMENT;
+      break;
+    }
+    if (!gRdwrCmd.done && !(gRdwrCmd.io_handler && gRdwrCmd.io_handler->handler->handler_abort)) {
+      // nothing would act on the flag, stall so the host knows
+      log_warn ( "abort not supported by term 0x%x\n", gRdwrCmd.header.term_addr );
+      status = CY_U3P_ERROR_NOT_SUPPORTED;
+      break;
+    }
+    status = CyU3PUsbAckSetup();
+    if (gRdwrCmd.done) break; // already finished (the host gets the normal ack)
+    log_debug ( "abort %d/%d\n", gRdwrCmd.transfered_so_far, gRdwrCmd.header.transfer_length );
+    // the data thread sees the flag after its current dma wait times out
+    // and aborts from there, so it can't race the ack of a transaction
+    // finishing now.  The flag is cleared by the next start_rdwr.
+    gRdwrCmd.abort = 1;
+    CyU3PEventSet(&glThreadEvent, NITRO_EVENT_DATA, CYU3P_EVENT_OR);
+    break;
+
   case VC_RENUM:
 
     CyU3PEventSet(&glThreadEvent, NITRO_EVENT_REBOOT, CYU3P_EVENT_OR);
@@ -13,12 +13,20 @@ typedef struct {
   uint16_t ep_buffer_size;     // usb end point buffer size
   uint8_t done;                // has this command been handled?
   uint32_t transfered_so_far;  // used by handler to know how much data it has transfered so far
+  uint8_t stream_stop;         // VC_STREAM_STOP received for the current streaming read
+  uint8_t abort;               // VC_ABORT received for the current command
 #ifdef FIRMWARE_DI
   CyU3PMutex rdwr_mutex;      // used to lock transactions if firmware device interface enabled.
 #endif
 } rdwr_cmd_t;
 
 extern rdwr_cmd_t gRdwrCmd;
+
+// current command is a streaming read (transfered_so_far wraps)
+#define RDWR_STREAMING() (gRdwrCmd.header.transfer_length == RDWR_STREAM_LENGTH && \
+                          !(gRdwrCmd.header.command & bmSETWRITE))
+// streaming read with a frame_hdr_t in front of each buffer
+#define RDWR_FRAMED() (RDWR_STREAMING() && (gRdwrCmd.header.flags & RDWR_FLAG_FRAMING))
 extern uint16_t gRdwrCmdInitStat; // last status of failed init handler in rdwr_start
 
 #ifdef FIRMWARE_DI
@@ -63,8 +71,59 @@ CyBool_t handle_vendor_cmd(uint8_t  bRequest, uint8_t bReqType,
 			   uint16_t wValue, uint16_t wIndex,
 			   uint16_t wLength);
 
+/**
+ * Vendor commands that are answered right from the usb setup callback
+ * (VC_TIME.)  Returns CyFalse for the rest, which go to handle_vendor_cmd
+ * on the app thread.
+ **/
+CyBool_t handle_fast_vendor_cmd(uint8_t bRequest, uint8_t bReqType, uint16_t wLength);
+
 void rdwr_teardown();
 
+/**
+ * The io_handlers[] entry start_rdwr would pick for term or NULL.
+ **/
+io_handler_t *rdwr_find_handler(uint16_t term);
+
+/**
+ * Runs a transaction against a cpu handler terminal from the firmware
+ * itself (macro.c) with buf in place of the usb data.  command is a
+ * NITRO_COMMAND.  The handler's init and read or write functions (in
+ * ep_buffer_size chunks) are called like for a host transaction and the
+ * first failing status is returned.  v2 handlers get up to
+ * IO_HANDLER_IOV_MAX chunks a call; gRdwrCallBytes has the length of a
+ * short read.
+ *
+ * App thread only and only between host transactions (gRdwrCmd.done),
+ * returns CY_U3P_ERROR_INVALID_SEQUENCE otherwise.  Terminals with
+ * other handler types return CY_U3P_ERROR_NOT_SUPPORTED.
+ **/
+uint16_t rdwr_local(uint8_t command, uint16_t term, uint32_t reg, uint8_t *buf, uint32_t len);
+
+/**
+ * The part of rdwr_local that calls handler's functions, with
+ * gRdwrCmd.header swapped for the local command and put back after.
+ * Doesn't switch gRdwrCmd.io_handler so a read handler can use it to
+ * read other terminals during its own transaction (sampler.c.)
+ **/
+uint16_t rdwr_call(io_handler_t *handler, uint8_t command, uint16_t term, uint32_t reg,
+                   uint8_t *buf, uint32_t len);
+extern uint32_t gRdwrCallBytes; // bytes the last rdwr_call moved, less than len after a short v2 read
+
+#ifndef RDWR_BUSY_WAIT_MS
+#define RDWR_BUSY_WAIT_MS 10 // longest wait for io_handler_ready between retries
+#endif
+#ifndef RDWR_BUSY_TRIES
+#define RDWR_BUSY_TRIES 100  // busy retries without progress before rdwr_call gives up
+#endif
+
+/**
+ * Waits for io_handler_ready or RDWR_BUSY_WAIT_MS after a write handler
+ * returned IO_HANDLER_BUSY.  Returns the hwtimer ticks waited.  Data
+ * thread (or rdwr_call's thread) only.
+ **/
+uint32_t rdwr_busy_wait(void);
+
 // this is an internal method used to get the serial number
 // it may return the cached serial number instead of doing a
 // fetch from the prom which is ideal in some circomstances.
@@ -0,0 +1,301 @@
+#include <cyu3system.h>
+#include <cyu3error.h>
+
+#include "reduce.h"
+#include "rdwr.h"
+#include "log.h"
+#include <fx3_terminals.h>
+
+#ifndef DEBUG_REDUCE
+#undef log_debug
+#define log_debug(...) do {} while (0)
+#endif
+
+#define REDUCE_OUT_SIZE (REDUCE_IN_SIZE + REDUCE_MAX_BINS*4) // a chunk's output is at most its input plus one histogram
+
+uint16_t gReduceIn[REDUCE_IN_SIZE/2] __attribute__ ((aligned (32)));
+uint8_t gReduceOut[REDUCE_OUT_SIZE] __attribute__ ((aligned (32)));
+uint32_t gReduceOutLen, gReduceOutPos; // kernel output not sent yet
+uint32_t gReduceInTotal; // read handler bytes this transaction
+uint8_t gReduceKernel=REDUCE_NONE;
+reduce_stats_t gReduceStats;
+
+// parameters (REDUCE terminal)
+uint32_t gReduceFactor=4;
+uint32_t gReduceBins=REDUCE_MAX_BINS;
+uint32_t gReduceShift=8;
+uint32_t gReduceHistSamples=65536;
+uint32_t gReduceThreshold=0x8000;
+uint32_t gReduceBitsPerSample=12;
+uint32_t gReduceMaxIn=1<<24; // input bytes per output buffer, 0 no limit
+
+// kernel state carried across chunks
+uint32_t gReduceLeft;   // samples to skip (decimate) or left in the window
+uint16_t gReduceLo, gReduceHi;
+uint32_t gReduceHist[REDUCE_MAX_BINS];
+uint32_t gReduceIndex;  // sample number (events)
+uint8_t gReduceAbove;   // last sample >= threshold, 2 before the first sample
+uint32_t gReduceAcc, gReduceAccBits; // pack bits not written yet
+
+static uint32_t reduce_decimate(const uint16_t *in, uint32_t n, uint8_t *out8) {
+  uint16_t *out = (uint16_t*)out8;
+  uint32_t skip = gReduceLeft;
+  while (n > skip) {
+    in += skip;
+    n -= skip;
+    *out++ = *in++;
+    --n;
+    skip = gReduceFactor-1;
+  }
+  gReduceLeft = skip - n;
+  return (uint8_t*)out - out8;
+}
+
+static uint32_t reduce_minmax(const uint16_t *in, uint32_t n, uint8_t *out8) {
+  uint16_t *out = (uint16_t*)out8;
+  uint32_t left = gReduceLeft;
+  uint16_t lo = gReduceLo, hi = gReduceHi, v;
+  while (n--) {
+    v = *in++;
+    if (v < lo) lo = v;
+    if (v > hi) hi = v;
+    if (!--left) {
+      *out++ = lo;
+      *out++ = hi;
+      lo = 0xFFFF;
+      hi = 0;
+      left = gReduceFactor;
+    }
+  }
+  gReduceLeft = left;
+  gReduceLo = lo;
+  gReduceHi = hi;
+  return (uint8_t*)out - out8;
+}
+
+static uint32_t reduce_histogram(const uint16_t *in, uint32_t n, uint8_t *out) {
+  uint8_t *start = out;
+  uint32_t left = gReduceLeft, shift = gReduceShift, top = gReduceBins-1, b;
+  while (n--) {
+    b = *in++ >> shift;
+    if (b > top) b = top;
+    ++gReduceHist[b];
+    if (!--left) {
+      CyU3PMemCopy(out, (uint8_t*)gReduceHist, gReduceBins*4);
+      CyU3PMemSet((uint8_t*)gReduceHist, 0, gReduceBins*4);
+      out += gReduceBins*4;
+      left = gReduceHistSamples;
+    }
+  }
+  gReduceLeft = left;
+  return out - start;
+}
+
+static uint32_t reduce_events(const uint16_t *in, uint32_t n, uint8_t *out8) {
+  reduce_event_t *e = (reduce_event_t*)out8, *end = e + REDUCE_IN_SIZE/sizeof(reduce_event_t);
+  uint32_t index = gReduceIndex, thr = gReduceThreshold;
+  uint8_t above = gReduceAbove;
+  uint16_t v;
+  if (above > 1 && n) above = in[0] >= thr;
+  while (n--) {
+    v = *in++;
+    if ((v >= thr) != above) {
+      above = !above;
+      if (e < end) {
+        e->index = index;
+        e->value = v;
+        e->rising = above;
+        ++e;
+      } else {
+        ++gReduceStats.dropped;
+      }
+    }
+    ++index;
+  }
+  gReduceIndex = index;
+  gReduceAbove = above;
+  return (uint8_t*)e - out8;
+}
+
+static uint32_t reduce_pack(const uint16_t *in, uint32_t n, uint8_t *out) {
+  uint8_t *start = out;
+  uint32_t acc = gReduceAcc, bits = gReduceAccBits, width = gReduceBitsPerSample;
+  uint32_t mask = (1u << width) - 1;
+  while (n--) {
+    acc |= (*in++ & mask) << bits;
+    bits += width;
+    if (bits >= 16) {
+      *out++ = acc;
+      *out++ = acc >> 8;
+      acc >>= 16;
+      bits -= 16;
+    }
+  }
+  // whole bytes out, at most 7 bits carried
+  while (bits >= 8) {
+    *out++ = acc;
+    acc >>= 8;
+    bits -= 8;
+  }
+  gReduceAcc = acc;
+  gReduceAccBits = bits;
+  return out - start;
+}
+
+uint16_t reduce_start(void) {
+  uint16_t flags = gRdwrCmd.header.flags;
+  gReduceKernel = (flags & RDWR_FLAG_REDUCE_MASK) >> RDWR_FLAG_REDUCE_SHIFT;
+  if (!gReduceKernel) return 0;
+
+  if (gReduceKernel >= REDUCE_KERNEL_COUNT || (gRdwrCmd.header.command & bmSETWRITE) ||
+      gRdwrCmd.io_handler->readv_handler ||
+      !gReduceFactor || (gReduceKernel == REDUCE_MINMAX && gReduceFactor < 2) ||
+      (gReduceKernel == REDUCE_HISTOGRAM &&
+       (gReduceHistSamples*2 < gReduceBins*4 || gReduceShift > 15)) ||
+      (gReduceKernel == REDUCE_PACK && (!gReduceBitsPerSample || gReduceBitsPerSample > 15))) {
+    log_error ( "Bad reduce kernel %d\n", gReduceKernel );
+    gReduceKernel = REDUCE_NONE;
+    return 1;
+  }
+
+  gReduceOutLen = gReduceOutPos = 0;
+  gReduceInTotal = 0;
+  CyU3PMemSet((uint8_t*)&gReduceStats, 0, sizeof(gReduceStats));
+  gReduceLeft = gReduceKernel == REDUCE_DECIMATE ? 0 :
+                gReduceKernel == REDUCE_HISTOGRAM ? gReduceHistSamples : gReduceFactor;
+  gReduceLo = 0xFFFF;
+  gReduceHi = 0;
+  CyU3PMemSet((uint8_t*)gReduceHist, 0, sizeof(gReduceHist));
+  gReduceIndex = 0;
+  gReduceAbove = 2;
+  gReduceAcc = gReduceAccBits = 0;
+  log_debug ( "reduce kernel %d\n", gReduceKernel );
+  return 0;
+}
+
+/**
+ * Reads the next input chunk and runs the kernel on it into gReduceOut.
+ **/
+static uint16_t reduce_chunk(uint16_t size) {
+  CyU3PDmaBuffer_t in;
+  uint32_t transfered = gRdwrCmd.transfered_so_far, n;
+  uint16_t status;
+
+  in.buffer = (uint8_t*)gReduceIn;
+  in.size = in.count = size < REDUCE_IN_SIZE ? size & ~3 : REDUCE_IN_SIZE;
+  in.status = 0;
+  // the handler sees its own input offsets
+  gRdwrCmd.transfered_so_far = gReduceInTotal;
+  status = gRdwrCmd.io_handler->read_handler(&in);
+  gRdwrCmd.transfered_so_far = transfered;
+  if (status) return status;
+  gReduceInTotal += in.count;
+
+  n = in.count/2;
+  switch (gReduceKernel) {
+    case REDUCE_DECIMATE:  gReduceOutLen = reduce_decimate(gReduceIn, n, gReduceOut); break;
+    case REDUCE_MINMAX:    gReduceOutLen = reduce_minmax(gReduceIn, n, gReduceOut); break;
+    case REDUCE_HISTOGRAM: gReduceOutLen = reduce_histogram(gReduceIn, n, gReduceOut); break;
+    case REDUCE_EVENTS:    gReduceOutLen = reduce_events(gReduceIn, n, gReduceOut); break;
+    case REDUCE_PACK:      gReduceOutLen = reduce_pack(gReduceIn, n, gReduceOut); break;
+    default:               return 1;
+  }
+  gReduceOutPos = 0;
+  gReduceStats.in_bytes += in.count;
+  gReduceStats.out_bytes += gReduceOutLen;
+  return 0;
+}
+
+uint16_t reduce_read(CyU3PDmaBuffer_t *buf) {
+  uint32_t n=0, take, in0=gReduceInTotal;
+  uint16_t status;
+
+  while (n < buf->count) {
+    if (gReduceOutPos == gReduceOutLen) {
+      if (gRdwrCmd.abort || (RDWR_STREAMING() && gRdwrCmd.stream_stop)) break;
+      if (gReduceMaxIn && gReduceInTotal - in0 >= gReduceMaxIn) break;
+      status = reduce_chunk(buf->size);
+      if (status) return status;
+      continue;
+    }
+    take = gReduceOutLen - gReduceOutPos;
+    if (take > buf->count - n) take = buf->count - n;
+    CyU3PMemCopy(buf->buffer + n, gReduceOut + gReduceOutPos, take);
+    gReduceOutPos += take;
+    n += take;
+  }
+  CyU3PMemSet(buf->buffer + n, 0, buf->count - n);
+  gReduceStats.padded += buf->count - n;
+  return 0;
+}
+
+uint16_t reduce_term_read(CyU3PDmaBuffer_t* buf) {
+  uint32_t val;
+  switch (gRdwrCmd.header.reg_addr) {
+    case REDUCE_FACTOR:
+      val = gReduceFactor;
+      break;
+    case REDUCE_BINS:
+      val = gReduceBins;
+      break;
+    case REDUCE_SHIFT:
+      val = gReduceShift;
+      break;
+    case REDUCE_HIST_SAMPLES:
+      val = gReduceHistSamples;
+      break;
+    case REDUCE_THRESHOLD:
+      val = gReduceThreshold;
+      break;
+    case REDUCE_BITS:
+      val = gReduceBitsPerSample;
+      break;
+    case REDUCE_MAX_IN:
+      val = gReduceMaxIn;
+      break;
+    case REDUCE_STATS:
+      CyU3PMemSet(buf->buffer, 0, buf->count);
+      CyU3PMemCopy(buf->buffer, (uint8_t*)&gReduceStats,
+                   buf->count < sizeof(gReduceStats) ? buf->count : sizeof(gReduceStats));
+      return 0;
+    default:
+      return 1;
+  }
+  CyU3PMemCopy(buf->buffer, (uint8_t*)&val, 4);
+  return 0;
+}
+
+uint16_t reduce_term_write(CyU3PDmaBuffer_t* buf) {
+  uint32_t val;
+  CyU3PMemCopy((uint8_t*)&val, buf->buffer, 4);
+  switch (gRdwrCmd.header.reg_addr) {
+    case REDUCE_FACTOR:
+      if (!val) return 1;
+      gReduceFactor = val;
+      return 0;
+    case REDUCE_BINS:
+      if (!val || val > REDUCE_MAX_BINS || (val & (val-1))) return 1;
+      gReduceBins = val;
+      return 0;
+    case REDUCE_SHIFT:
+      if (val > 15) return 1;
+      gReduceShift = val;
+      return 0;
+    case REDUCE_HIST_SAMPLES:
+      if (!val) return 1;
+      gReduceHistSamples = val;
+      return 0;
+    case REDUCE_THRESHOLD:
+      gReduceThreshold = val;
+      return 0;
+    case REDUCE_BITS:
+      if (!val || val > 15) return 1;
+      gReduceBitsPerSample = val;
+      return 0;
+    case REDUCE_MAX_IN:
+      gReduceMaxIn = val;
+      return 0;
+    default:
+      return 1;
+  }
+}
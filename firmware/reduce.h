@@ -0,0 +1,83 @@
+#ifndef REDUCE_H
+#define REDUCE_H
+
+/**
+ * Data reduction on the read path.
+ *
+ * A read with RDWR_FLAG_REDUCE(kernel) in the header flags gets the
+ * terminal's data through a kernel before it is committed.  The read
+ * handler fills REDUCE_IN_SIZE byte chunks as if for a read of its own
+ * (transfered_so_far counts its input bytes) and the kernel output is
+ * what the host receives: transfer_length is output bytes.  When the
+ * link can't carry the raw data (usb 2, slow hosts) a capture can keep
+ * running at a fraction of the bandwidth.
+ *
+ * Samples are 16 bit little endian words; narrower samples are in the
+ * low bits.  The kernel parameters are the REDUCE terminal registers and
+ * the kernel state carries across buffers (not across transactions.)
+ * Output of a partial window at the end of a transaction is dropped.
+ * Streams are padded with 0 after a stop.
+ *
+ * A kernel with little output (quiet events, big histograms) could read
+ * input for ever before a buffer fills.  Once a buffer has taken the
+ * max_in register's input bytes (checked between input chunks, 0 for no
+ * limit) the rest of it is padded with 0 and goes out, so each buffer
+ * costs a bounded read time.  The padding is counted in
+ * reduce_stats_t.padded.
+ *
+ * The kernels are word loops without divides for the ARM926 (no
+ * hardware divide, one load/store unit.)
+ *
+ * Add reduce.c to SOURCE and -D READ_REDUCE to CCFLAGS to enable.  Without
+ * it reads with the flag fail to start.
+ **/
+
+#include "handlers.h"
+
+#define REDUCE_IN_SIZE 16384 // input bytes per kernel call
+#define REDUCE_MAX_BINS 256
+
+enum REDUCE_KERNEL {
+  REDUCE_NONE=0,
+  REDUCE_DECIMATE,  // the first sample of every factor
+  REDUCE_MINMAX,    // min then max sample of every factor (>=2) samples
+  REDUCE_HISTOGRAM, // bins uint32 counts of sample>>shift every hist_samples samples
+  REDUCE_EVENTS,    // reduce_event_t each time a sample crosses threshold
+  REDUCE_PACK,      // the low bits of each sample packed lsb first
+  REDUCE_KERNEL_COUNT
+};
+
+typedef struct {
+  uint32_t index;  // sample number in the transaction
+  uint16_t value;  // the first sample past the crossing
+  uint16_t rising; // 1 crossed up to >= threshold, 0 down below it
+} reduce_event_t;
+
+typedef struct {
+  uint32_t in_bytes;  // read handler bytes of the last reduced read
+  uint32_t out_bytes; // kernel output bytes (some may be left unsent)
+  uint32_t dropped;   // events that didn't fit the output chunk
+  uint32_t padded;    // 0 bytes sent in place of output (max_in, stops)
+} reduce_stats_t;
+
+extern uint8_t gReduceKernel; // REDUCE_KERNEL of the current transaction
+
+/**
+ * Checks the flags and parameters and resets the kernel state.  Called
+ * by cpu_handler_cmd_start for every transaction.
+ **/
+uint16_t reduce_start(void);
+
+/**
+ * Fills buf with kernel output, calling the read handler for input.
+ * Used by cpu_handler_read in place of the read handler.
+ **/
+uint16_t reduce_read(CyU3PDmaBuffer_t *buf);
+
+uint16_t reduce_term_read(CyU3PDmaBuffer_t*);
+uint16_t reduce_term_write(CyU3PDmaBuffer_t*);
+
+#define DECLARE_REDUCE_HANDLER(term) \
+  DECLARE_HANDLER(&glCpuHandler,term,0,0,reduce_term_read,reduce_term_write,0,0,0,0)
+
+#endif
@@ -0,0 +1,270 @@
+#include <cyu3system.h>
+#include <cyu3error.h>
+#include <cyu3os.h>
+
+#include "sampler.h"
+#include "hwtimer.h"
+#include "rdwr.h"
+#include "log.h"
+#include <fx3_terminals.h>
+
+#ifndef DEBUG_SAMPLER
+#undef log_debug
+#define log_debug(...) do {} while (0)
+#endif
+
+#define SAMPLER_EVENT_TICK 1
+#define SAMPLER_PAD 0xFF // fill of rows after a stopped stream, seq 0xffffffff
+
+sampler_entry_t gSamplerEntries[SAMPLER_MAX_ENTRIES];
+io_handler_t *gSamplerHandlers[SAMPLER_MAX_ENTRIES];
+uint8_t gSamplerCount=0;
+uint16_t gSamplerRowSize=16;
+uint16_t gSamplerTerm;
+uint32_t gSamplerPeriodUs=1000;
+CyBool_t gSamplerRunning=CyFalse;
+CyU3PEvent gSamplerEvent;
+#ifndef SAMPLER_GPIO
+CyU3PTimer gSamplerTimer;
+#endif
+
+volatile uint32_t gSamplerTickSeq=0;   // written by the timer only
+volatile uint32_t gSamplerTickTicks=0; // hwtimer_ticks of the last timer tick
+uint32_t gSamplerSeq;       // tick of the last row
+uint32_t gSamplerLastTicks; // ticks of the last row
+CyBool_t gSamplerHaveLast;
+sampler_stats_t gSamplerStats;
+
+static void sampler_tick(void) {
+  gSamplerTickTicks = hwtimer_ticks();
+  ++gSamplerTickSeq;
+  CyU3PEventSet(&gSamplerEvent, SAMPLER_EVENT_TICK, CYU3P_EVENT_OR);
+}
+
+#ifndef SAMPLER_GPIO
+static void sampler_timer_cb(uint32_t unused) {
+  sampler_tick();
+}
+#endif
+
+void sampler_boot(uint16_t term) {
+  gSamplerTerm = term;
+  CyU3PEventCreate(&gSamplerEvent);
+#ifndef SAMPLER_GPIO
+  CyU3PTimerCreate(&gSamplerTimer, sampler_timer_cb, 0, 1, 1, CYU3P_NO_ACTIVATE);
+#endif
+}
+
+static void sampler_clear_stats(void) {
+  CyU3PMemSet((uint8_t*)&gSamplerStats, 0, sizeof(gSamplerStats));
+  gSamplerStats.lat_min = 0xFFFFFFFF;
+  gSamplerStats.period_min = 0xFFFFFFFF;
+  gSamplerStats.ticks_hz = HWTIMER_HZ;
+}
+
+static void sampler_stop(void) {
+  if (!gSamplerRunning) return;
+#ifdef SAMPLER_GPIO
+  hwtimer_periodic_stop(SAMPLER_GPIO);
+#else
+  CyU3PTimerStop(&gSamplerTimer);
+#endif
+  gSamplerRunning = CyFalse;
+}
+
+static uint16_t sampler_start(void) {
+  uint16_t status;
+#ifndef SAMPLER_GPIO
+  uint32_t ms = (gSamplerPeriodUs+500)/1000;
+  if (!ms) ms=1;
+#endif
+
+  sampler_stop();
+  sampler_clear_stats();
+#ifdef SAMPLER_GPIO
+  gSamplerStats.period = (uint64_t)gSamplerPeriodUs * HWTIMER_HZ / 1000000;
+  status = hwtimer_periodic_start(SAMPLER_GPIO, 1000000/gSamplerPeriodUs, sampler_tick);
+#else
+  gSamplerStats.period = (uint64_t)ms * HWTIMER_HZ / 1000;
+  CyU3PTimerModify(&gSamplerTimer, ms, ms);
+  status = CyU3PTimerStart(&gSamplerTimer);
+#endif
+  if (status) {
+    log_error ( "Fail to start sampler timer: %d\n", status );
+    return status;
+  }
+  gSamplerRunning = CyTrue;
+  log_debug ( "sampler %d entries every %d us\n", gSamplerCount, gSamplerPeriodUs );
+  return 0;
+}
+
+/**
+ * Checks and resolves the first count entries.
+ **/
+static uint16_t sampler_set_entries(uint32_t count) {
+  uint32_t i, need=sizeof(sampler_row_t);
+  io_handler_t *handler;
+
+  gSamplerCount = 0;
+  for (i=0;i<count;++i) {
+    sampler_entry_t *e = &gSamplerEntries[i];
+    handler = rdwr_find_handler(e->term);
+    if (e->width < 1 || e->width > 4 || e->term == gSamplerTerm ||
+        !handler || handler->handler != &glCpuHandler) {
+      log_error ( "Bad sampler entry %d term %d width %d\n", i, e->term, e->width );
+      return 1;
+    }
+    gSamplerHandlers[i] = handler;
+    need += e->width;
+  }
+  if (need > SAMPLER_MAX_ROW) return 1;
+  gSamplerRowSize = 16;
+  while (gSamplerRowSize < need) gSamplerRowSize <<= 1;
+  gSamplerCount = count;
+  return 0;
+}
+
+/**
+ * Waits for the next timer tick.  Returns CyFalse if the stream was
+ * stopped or the sampler turned off instead.
+ **/
+static CyBool_t sampler_wait(uint32_t *seq, uint32_t *ticks) {
+  uint32_t flags, mask;
+  while (gSamplerTickSeq == gSamplerSeq) {
+    if (!gSamplerRunning || gRdwrCmd.stream_stop || gRdwrCmd.abort) return CyFalse;
+    CyU3PEventGet(&gSamplerEvent, SAMPLER_EVENT_TICK, CYU3P_EVENT_OR_CLEAR, &flags, 10);
+  }
+  mask = CyU3PVicDisableAllInterrupts();
+  *seq = gSamplerTickSeq;
+  *ticks = gSamplerTickTicks;
+  CyU3PVicEnableInterrupts(mask);
+  gSamplerStats.missed += *seq - gSamplerSeq - 1;
+  gSamplerSeq = *seq;
+  return CyTrue;
+}
+
+static void sampler_row(uint8_t *dst, uint32_t seq, uint32_t tick) {
+  sampler_row_t *row = (sampler_row_t*)dst;
+  uint8_t *val = dst + sizeof(sampler_row_t);
+  uint32_t now = hwtimer_ticks(), lat = now - tick, v, period;
+  uint16_t status = 0;
+  int i;
+
+  for (i=0;i<gSamplerCount;++i) {
+    sampler_entry_t *e = &gSamplerEntries[i];
+    v = 0; // handlers copy whole 32 bit registers
+    status |= rdwr_call(gSamplerHandlers[i], COMMAND_GET, e->term, e->reg, (uint8_t*)&v, e->width);
+    CyU3PMemCopy(val, (uint8_t*)&v, e->width);
+    val += e->width;
+  }
+  CyU3PMemSet(val, 0, dst + gSamplerRowSize - val);
+  row->seq = seq;
+  row->ticks = now;
+  row->lat = lat > 0xFFFF ? 0xFFFF : lat;
+  row->status = status;
+
+  ++gSamplerStats.rows;
+  gSamplerStats.lat_sum += lat;
+  if (lat < gSamplerStats.lat_min) gSamplerStats.lat_min = lat;
+  if (lat > gSamplerStats.lat_max) gSamplerStats.lat_max = lat;
+  if (gSamplerHaveLast) {
+    period = now - gSamplerLastTicks;
+    if (period < gSamplerStats.period_min) gSamplerStats.period_min = period;
+    if (period > gSamplerStats.period_max) gSamplerStats.period_max = period;
+  }
+  gSamplerLastTicks = now;
+  gSamplerHaveLast = CyTrue;
+}
+
+/**
+ * Fills the buffer with whole rows, one per timer tick.  Rows left when
+ * the stream is stopped are SAMPLER_PAD.
+ **/
+static void sampler_rows(CyU3PDmaBuffer_t *buf) {
+  uint32_t n = buf->count / gSamplerRowSize, seq, ticks, last;
+  uint8_t *dst = buf->buffer;
+
+  for (; n; --n, dst += gSamplerRowSize) {
+    last = gSamplerSeq;
+    if (!sampler_wait(&seq, &ticks)) break;
+    if (seq != last+1) gSamplerHaveLast = CyFalse; // no period across a gap
+    sampler_row(dst, seq, ticks);
+  }
+  CyU3PMemSet(dst, SAMPLER_PAD, buf->count - (dst - buf->buffer));
+}
+
+uint16_t sampler_init() {
+  if (gRdwrCmd.header.reg_addr != SAMPLER_ROWS || (gRdwrCmd.header.command & bmSETWRITE))
+    return 0;
+  if (!gSamplerRunning) return 1;
+  // rows start with the next tick
+  gSamplerSeq = gSamplerTickSeq;
+  gSamplerHaveLast = CyFalse;
+  return 0;
+}
+
+uint16_t sampler_read(CyU3PDmaBuffer_t* buf) {
+  uint32_t val, off, n;
+  switch (gRdwrCmd.header.reg_addr) {
+    case SAMPLER_ENTRIES:
+      off = gRdwrCmd.transfered_so_far;
+      n = off < sizeof(gSamplerEntries) ? sizeof(gSamplerEntries) - off : 0;
+      if (n > buf->count) n = buf->count;
+      CyU3PMemCopy(buf->buffer, (uint8_t*)gSamplerEntries + off, n);
+      CyU3PMemSet(buf->buffer+n, 0, buf->count-n);
+      return 0;
+    case SAMPLER_PERIOD_US:
+      val = gSamplerPeriodUs;
+      break;
+    case SAMPLER_RUN:
+      val = gSamplerRunning;
+      break;
+    case SAMPLER_ROW_SIZE:
+      val = gSamplerRowSize;
+      break;
+    case SAMPLER_STATS:
+      CyU3PMemSet(buf->buffer, 0, buf->count);
+      CyU3PMemCopy(buf->buffer, (uint8_t*)&gSamplerStats,
+                   buf->count < sizeof(gSamplerStats) ? buf->count : sizeof(gSamplerStats));
+      return 0;
+    case SAMPLER_ROWS:
+      sampler_rows(buf);
+      return 0;
+    default:
+      return 1;
+  }
+  CyU3PMemCopy(buf->buffer, (uint8_t*)&val, 4);
+  return 0;
+}
+
+uint16_t sampler_write(CyU3PDmaBuffer_t* buf) {
+  uint32_t val, off;
+
+  if (gRdwrCmd.header.reg_addr == SAMPLER_ENTRIES) {
+    off = gRdwrCmd.transfered_so_far;
+    if (off + buf->count > sizeof(gSamplerEntries)) return 1;
+    CyU3PMemCopy((uint8_t*)gSamplerEntries + off, buf->buffer, buf->count);
+    return sampler_set_entries((off + buf->count) / sizeof(sampler_entry_t));
+  }
+
+  CyU3PMemCopy((uint8_t*)&val, buf->buffer, 4);
+  switch (gRdwrCmd.header.reg_addr) {
+    case SAMPLER_PERIOD_US:
+      if (!val || val > 1000000) return 1;
+      gSamplerPeriodUs = val;
+      return gSamplerRunning ? sampler_start() : 0;
+    case SAMPLER_RUN:
+      if (!val) {
+        sampler_stop();
+        return 0;
+      }
+      return sampler_start();
+    case SAMPLER_STATS:
+      val = gSamplerStats.period;
+      sampler_clear_stats();
+      gSamplerStats.period = val;
+      return 0;
+    default:
+      return 1;
+  }
+}
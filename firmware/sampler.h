@@ -0,0 +1,72 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+/**
+ * Periodic register sampler.
+ *
+ * The host sets a list of (terminal, register, width) entries and a
+ * period and then reads the rows register, usually as a streaming read.
+ * On every period the firmware reads the entries through their
+ * terminals' read handlers (rdwr_call) and packs a timestamped row into
+ * the read buffer, so telemetry at 1 kHz costs one stream instead of a
+ * transaction per sample.  Rows are padded to a power of 2 so they tile
+ * the dma buffers; periods nobody was reading rows for show as gaps in
+ * the row seq.  The stats register has the latency from the timer to
+ * the sample and the spread of the sample periods.  See
+ * py/fx3/sampler.py.
+ *
+ * Sampled terminals must be cpu handler terminals.  Their init handler
+ * runs before each sample like for a host get.
+ *
+ * -D SAMPLER_GPIO=<pin> times the periods with a hardware timer on a free
+ * pin (see hwtimer.h.)  Without it an os timer is used and periods are
+ * whole ms.
+ *
+ * Add sampler.c to SOURCE and -D SAMPLER to CCFLAGS to enable.
+ **/
+
+#include "handlers.h"
+
+#define SAMPLER_MAX_ENTRIES 32
+#define SAMPLER_MAX_ROW 128  // bytes including the sampler_row_t.  The
+                             // smallest dma buffer is a multiple of it.
+
+typedef struct {
+  uint16_t term;
+  uint8_t width;  // bytes 1-4
+  uint8_t reserved;
+  uint32_t reg;
+} sampler_entry_t;
+
+/**
+ * Row header.  The entry values follow packed in entry order and the row
+ * is padded with 0 to row_size.
+ **/
+typedef struct {
+  uint32_t seq;    // timer period of the sample
+  uint32_t ticks;  // hwtimer ticks when the sample started
+  uint16_t lat;    // ticks from the timer to the sample, saturates
+  uint16_t status; // handler statuses of the entries or'd
+} sampler_row_t;
+
+typedef struct {
+  uint32_t rows;
+  uint32_t missed;     // periods without a row
+  uint32_t lat_min;    // ticks from the timer to the sample
+  uint32_t lat_max;
+  uint64_t lat_sum;
+  uint32_t period_min; // ticks between consecutive rows
+  uint32_t period_max;
+  uint32_t period;     // nominal ticks between rows
+  uint32_t ticks_hz;
+} sampler_stats_t;
+
+void sampler_boot(uint16_t term);
+uint16_t sampler_init();
+uint16_t sampler_read(CyU3PDmaBuffer_t*);
+uint16_t sampler_write(CyU3PDmaBuffer_t*);
+
+#define DECLARE_SAMPLER_HANDLER(term) \
+  DECLARE_HANDLER(&glCpuHandler,term,sampler_boot,sampler_init,sampler_read,sampler_write,0,0,0,0)
+
+#endif
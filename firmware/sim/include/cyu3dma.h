@@ -0,0 +1,123 @@
+#ifndef _CYU3DMA_H_
+#define _CYU3DMA_H_
+
+#include "cyu3types.h"
+#include "cyu3os.h"
+
+typedef struct {
+  uint8_t *buffer;
+  uint16_t count;
+  uint16_t size;
+  uint16_t status;
+} CyU3PDmaBuffer_t;
+
+typedef enum {
+  CY_U3P_DMA_TYPE_AUTO=0,
+  CY_U3P_DMA_TYPE_AUTO_SIGNAL,
+  CY_U3P_DMA_TYPE_MANUAL,
+  CY_U3P_DMA_TYPE_MANUAL_IN,
+  CY_U3P_DMA_TYPE_MANUAL_OUT
+} CyU3PDmaType_t;
+
+typedef enum { CY_U3P_DMA_MODE_BYTE=0, CY_U3P_DMA_MODE_BUFFER } CyU3PDmaMode_t;
+
+typedef enum {
+  CY_U3P_DMA_NOT_CONFIGURED=0,
+  CY_U3P_DMA_CONFIGURED,
+  CY_U3P_DMA_ACTIVE,
+  CY_U3P_DMA_PROD_OVERRIDE,
+  CY_U3P_DMA_CONS_OVERRIDE,
+  CY_U3P_DMA_ERROR,
+  CY_U3P_DMA_IN_COMPLETION,
+  CY_U3P_DMA_ABORTED
+} CyU3PDmaState_t;
+
+typedef enum {
+  CY_U3P_DMA_CB_XFER_CPLT=1,
+  CY_U3P_DMA_CB_SEND_CPLT=2,
+  CY_U3P_DMA_CB_RECV_CPLT=4,
+  CY_U3P_DMA_CB_PROD_EVENT=8,
+  CY_U3P_DMA_CB_CONS_EVENT=16,
+  CY_U3P_DMA_CB_ABORTED=32,
+  CY_U3P_DMA_CB_ERROR=64,
+  CY_U3P_DMA_CB_PROD_SUSP=128,
+  CY_U3P_DMA_CB_CONS_SUSP=256
+} CyU3PDmaCbType_t;
+
+typedef uint16_t CyU3PDmaSocketId_t;
+
+#define CY_U3P_PIB_SOCKET_0          0x0100
+#define CY_U3P_PIB_SOCKET_1          0x0101
+#define CY_U3P_PIB_SOCKET_2          0x0102
+#define CY_U3P_PIB_SOCKET_3          0x0103
+#define CY_U3P_LPP_SOCKET_UART_CONS  0x0206
+#define CY_U3P_UIB_SOCKET_CONS_0     0x0300
+#define CY_U3P_UIB_SOCKET_CONS_1     0x0301
+#define CY_U3P_UIB_SOCKET_CONS_2     0x0302
+#define CY_U3P_UIB_SOCKET_CONS_3     0x0303
+#define CY_U3P_UIB_SOCKET_PROD_0     0x0400
+#define CY_U3P_UIB_SOCKET_PROD_1     0x0401
+#define CY_U3P_UIB_SOCKET_PROD_2     0x0402
+#define CY_U3P_UIB_SOCKET_PROD_3     0x0403
+#define CY_U3P_CPU_SOCKET_CONS       0x3F00
+#define CY_U3P_CPU_SOCKET_PROD       0x3F01
+
+/* max buffers per simulated channel */
+#define SIM_DMA_MAX_COUNT 32
+
+/**
+ * Simulated channel.  MANUAL_IN channels hold buffers the endpoint has
+ * filled until the cpu discards them.  MANUAL_OUT channels hold buffers
+ * the cpu committed until the host reads them.  Either way the buffers
+ * in flight are ring[head..head+used).
+ **/
+typedef struct CyU3PDmaChannel {
+  CyU3PDmaType_t type;
+  CyU3PDmaSocketId_t prodSckId;
+  CyU3PDmaSocketId_t consSckId;
+  uint16_t size;
+  uint16_t count;
+  uint16_t prodHeader; // cpu producers get buffers past the header
+  uint8_t *mem;
+  uint16_t fill[SIM_DMA_MAX_COUNT];
+  uint16_t head;
+  uint16_t used;
+  CyU3PDmaBuffer_t override; // CyU3PDmaChannelSetupSendBuffer/SetupRecvBuffer
+  CyBool_t override_active;
+  uint32_t override_xfer;    // bytes the last override buffer moved
+  CyU3PDmaState_t state;
+} CyU3PDmaChannel;
+
+struct CyU3PDmaCBInput;
+typedef void (*CyU3PDmaCallback_t)(CyU3PDmaChannel*, CyU3PDmaCbType_t, void*);
+
+typedef struct {
+  uint16_t size;
+  uint16_t count;
+  CyU3PDmaSocketId_t prodSckId;
+  CyU3PDmaSocketId_t consSckId;
+  uint16_t prodAvailCount;
+  uint16_t prodHeader;
+  uint16_t prodFooter;
+  uint16_t consHeader;
+  CyU3PDmaMode_t dmaMode;
+  uint32_t notification;
+  CyU3PDmaCallback_t cb;
+} CyU3PDmaChannelConfig_t;
+
+CyU3PReturnStatus_t CyU3PDmaChannelCreate(CyU3PDmaChannel*, CyU3PDmaType_t, CyU3PDmaChannelConfig_t*);
+CyU3PReturnStatus_t CyU3PDmaChannelDestroy(CyU3PDmaChannel*);
+CyU3PReturnStatus_t CyU3PDmaChannelGetBuffer(CyU3PDmaChannel*, CyU3PDmaBuffer_t*, uint32_t);
+CyU3PReturnStatus_t CyU3PDmaChannelCommitBuffer(CyU3PDmaChannel*, uint16_t, uint16_t);
+CyU3PReturnStatus_t CyU3PDmaChannelDiscardBuffer(CyU3PDmaChannel*);
+CyU3PReturnStatus_t CyU3PDmaChannelReset(CyU3PDmaChannel*);
+CyU3PReturnStatus_t CyU3PDmaChannelSetXfer(CyU3PDmaChannel*, uint32_t);
+CyU3PReturnStatus_t CyU3PDmaChannelGetStatus(CyU3PDmaChannel*, CyU3PDmaState_t*, uint32_t*, uint32_t*);
+CyU3PReturnStatus_t CyU3PDmaChannelSetupSendBuffer(CyU3PDmaChannel*, CyU3PDmaBuffer_t*);
+CyU3PReturnStatus_t CyU3PDmaChannelSetupRecvBuffer(CyU3PDmaChannel*, CyU3PDmaBuffer_t*);
+CyU3PReturnStatus_t CyU3PDmaChannelWaitForCompletion(CyU3PDmaChannel*, uint32_t);
+CyU3PReturnStatus_t CyU3PDmaChannelSetWrapUp(CyU3PDmaChannel*);
+CyU3PReturnStatus_t CyU3PDmaChannelAbort(CyU3PDmaChannel*);
+CyU3PReturnStatus_t CyU3PDmaChannelCacheControl(CyU3PDmaChannel*, CyBool_t);
+
+#endif
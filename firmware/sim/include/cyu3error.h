@@ -0,0 +1,32 @@
+#ifndef _CYU3ERROR_H_
+#define _CYU3ERROR_H_
+
+#define CY_U3P_SUCCESS                    0x00
+#define CY_U3P_ERROR_DELETED              0x01
+#define CY_U3P_ERROR_BAD_POINTER          0x03
+#define CY_U3P_ERROR_BAD_SIZE             0x05
+#define CY_U3P_ERROR_NO_EVENTS            0x07
+#define CY_U3P_ERROR_BAD_OPTION           0x08
+#define CY_U3P_ERROR_QUEUE_EMPTY          0x0A
+#define CY_U3P_ERROR_QUEUE_FULL           0x0B
+#define CY_U3P_ERROR_MEMORY_ERROR         0x10
+#define CY_U3P_ERROR_NOT_AVAILABLE        0x1D
+#define CY_U3P_ERROR_MUTEX_FAILURE        0x1E
+#define CY_U3P_ERROR_BAD_ARGUMENT         0x40
+#define CY_U3P_ERROR_NULL_POINTER         0x41
+#define CY_U3P_ERROR_NOT_STARTED          0x42
+#define CY_U3P_ERROR_ALREADY_STARTED      0x43
+#define CY_U3P_ERROR_NOT_CONFIGURED       0x44
+#define CY_U3P_ERROR_TIMEOUT              0x45
+#define CY_U3P_ERROR_NOT_SUPPORTED        0x46
+#define CY_U3P_ERROR_INVALID_SEQUENCE     0x47
+#define CY_U3P_ERROR_ABORTED              0x48
+#define CY_U3P_ERROR_DMA_FAILURE          0x49
+#define CY_U3P_ERROR_FAILURE              0x4A
+#define CY_U3P_ERROR_BAD_INDEX            0x4B
+#define CY_U3P_ERROR_INVALID_CONFIGURATION 0x4D
+#define CY_U3P_ERROR_CHANNEL_CREATE_FAILED 0x4E
+#define CY_U3P_ERROR_CHANNEL_DESTROY_FAILED 0x4F
+#define CY_U3P_ERROR_NO_REENUM_REQUIRED   0xFE
+
+#endif
@@ -0,0 +1 @@
+/* sim: nothing to do, the simulation is built as C */
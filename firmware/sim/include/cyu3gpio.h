@@ -0,0 +1,77 @@
+#ifndef _CYU3GPIO_H_
+#define _CYU3GPIO_H_
+
+#include "cyu3types.h"
+
+typedef enum {
+  CY_U3P_GPIO_NO_INTR=0,
+  CY_U3P_GPIO_INTR_POS_EDGE,
+  CY_U3P_GPIO_INTR_NEG_EDGE,
+  CY_U3P_GPIO_INTR_BOTH_EDGE,
+  CY_U3P_GPIO_INTR_LOW_LEVEL,
+  CY_U3P_GPIO_INTR_HIGH_LEVEL,
+  CY_U3P_GPIO_INTR_TIMER_THRES,
+  CY_U3P_GPIO_INTR_TIMER_ZERO
+} CyU3PGpioIntrMode_t;
+
+typedef enum {
+  CY_U3P_GPIO_MODE_STATIC=0,
+  CY_U3P_GPIO_MODE_TOGGLE,
+  CY_U3P_GPIO_MODE_SAMPLE_NOW,
+  CY_U3P_GPIO_MODE_PULSE_NOW,
+  CY_U3P_GPIO_MODE_PULSE,
+  CY_U3P_GPIO_MODE_PWM,
+  CY_U3P_GPIO_MODE_MEASURE_LOW,
+  CY_U3P_GPIO_MODE_MEASURE_HIGH,
+  CY_U3P_GPIO_MODE_MEASURE_LOW_ONCE,
+  CY_U3P_GPIO_MODE_MEASURE_HIGH_ONCE,
+  CY_U3P_GPIO_MODE_MEASURE_NEG,
+  CY_U3P_GPIO_MODE_MEASURE_POS,
+  CY_U3P_GPIO_MODE_MEASURE_ANY,
+  CY_U3P_GPIO_MODE_MEASURE_NEG_ONCE,
+  CY_U3P_GPIO_MODE_MEASURE_POS_ONCE,
+  CY_U3P_GPIO_MODE_MEASURE_ANY_ONCE
+} CyU3PGpioComplexMode_t;
+
+typedef enum {
+  CY_U3P_GPIO_TIMER_SHUTDOWN=0,
+  CY_U3P_GPIO_TIMER_HIGH_FREQ,
+  CY_U3P_GPIO_TIMER_LOW_FREQ,
+  CY_U3P_GPIO_TIMER_STANDBY_FREQ,
+  CY_U3P_GPIO_TIMER_POS_EDGE,
+  CY_U3P_GPIO_TIMER_NEG_EDGE,
+  CY_U3P_GPIO_TIMER_ANY_EDGE
+} CyU3PGpioTimerMode_t;
+
+typedef struct {
+  CyBool_t outValue;
+  CyBool_t driveLowEn;
+  CyBool_t driveHighEn;
+  CyBool_t inputEn;
+  CyU3PGpioIntrMode_t intrMode;
+} CyU3PGpioSimpleConfig_t;
+
+typedef struct {
+  CyBool_t outValue;
+  CyBool_t driveLowEn;
+  CyBool_t driveHighEn;
+  CyBool_t inputEn;
+  CyU3PGpioComplexMode_t pinMode;
+  CyU3PGpioIntrMode_t intrMode;
+  CyU3PGpioTimerMode_t timerMode;
+  uint32_t timer;
+  uint32_t period;
+  uint32_t threshold;
+} CyU3PGpioComplexConfig_t;
+
+CyU3PReturnStatus_t CyU3PGpioSetSimpleConfig(uint8_t, CyU3PGpioSimpleConfig_t*);
+CyU3PReturnStatus_t CyU3PGpioSetComplexConfig(uint8_t, CyU3PGpioComplexConfig_t*);
+CyU3PReturnStatus_t CyU3PGpioDisable(uint8_t);
+CyU3PReturnStatus_t CyU3PGpioSetValue(uint8_t, CyBool_t);
+CyU3PReturnStatus_t CyU3PGpioGetValue(uint8_t, CyBool_t*);
+CyU3PReturnStatus_t CyU3PGpioSimpleSetValue(uint8_t, CyBool_t);
+CyU3PReturnStatus_t CyU3PGpioSimpleGetValue(uint8_t, CyBool_t*);
+CyU3PReturnStatus_t CyU3PGpioComplexSampleNow(uint8_t, uint32_t*);
+CyU3PReturnStatus_t CyU3PGpioComplexUpdate(uint8_t, uint32_t, uint32_t);
+
+#endif
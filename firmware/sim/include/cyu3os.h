@@ -0,0 +1,63 @@
+#ifndef _CYU3OS_H_
+#define _CYU3OS_H_
+
+#include "cyu3types.h"
+
+/**
+ * The simulation has a single host thread.  Threads are never created,
+ * CyU3PThreadSleep advances the simulated clock and runs the data
+ * thread loop, events never block and mutexes fail instead of
+ * deadlocking.
+ **/
+
+typedef struct { const char *name; } CyU3PThread;
+typedef struct { uint32_t flags; } CyU3PEvent;
+typedef struct { int created; int count; } CyU3PMutex;
+typedef struct { void (*cb)(uint32_t); uint32_t arg, period, remain; int active; } CyU3PTimer;
+typedef void (*CyU3PThreadEntry_t)(uint32_t);
+typedef void (*CyU3PTimerCb_t)(uint32_t);
+
+#define CYU3P_NO_WAIT          0
+#define CYU3P_WAIT_FOREVER     0xFFFFFFFF
+#define CYU3P_EVENT_AND        2
+#define CYU3P_EVENT_AND_CLEAR  3
+#define CYU3P_EVENT_OR         0
+#define CYU3P_EVENT_OR_CLEAR   1
+#define CYU3P_NO_INHERIT       0
+#define CYU3P_INHERIT          1
+#define CYU3P_AUTO_START       1
+#define CYU3P_DONT_START       0
+#define CYU3P_NO_ACTIVATE      0
+#define CYU3P_AUTO_ACTIVATE    1
+#define CYU3P_NO_TIME_SLICE    0
+
+uint32_t CyU3PThreadCreate(CyU3PThread*, char*, CyU3PThreadEntry_t, uint32_t, void*, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t);
+CyU3PThread *CyU3PThreadIdentify(void);
+uint32_t CyU3PThreadSleep(uint32_t);
+
+uint32_t CyU3PEventCreate(CyU3PEvent*);
+uint32_t CyU3PEventSet(CyU3PEvent*, uint32_t, uint32_t);
+uint32_t CyU3PEventGet(CyU3PEvent*, uint32_t, uint32_t, uint32_t*, uint32_t);
+
+uint32_t CyU3PMutexCreate(CyU3PMutex*, uint32_t);
+uint32_t CyU3PMutexDestroy(CyU3PMutex*);
+uint32_t CyU3PMutexGet(CyU3PMutex*, uint32_t);
+uint32_t CyU3PMutexPut(CyU3PMutex*);
+
+uint32_t CyU3PTimerCreate(CyU3PTimer*, CyU3PTimerCb_t, uint32_t, uint32_t, uint32_t, uint32_t);
+uint32_t CyU3PTimerStart(CyU3PTimer*);
+uint32_t CyU3PTimerStop(CyU3PTimer*);
+uint32_t CyU3PTimerModify(CyU3PTimer*, uint32_t, uint32_t);
+
+uint32_t CyU3PGetTime(void);
+
+void *CyU3PMemAlloc(uint32_t);
+void CyU3PMemFree(void*);
+void CyU3PMemCopy(uint8_t*, uint8_t*, uint32_t);
+void CyU3PMemSet(uint8_t*, uint8_t, uint32_t);
+int32_t CyU3PMemCmp(const void*, const void*, uint32_t);
+
+void *CyU3PDmaBufferAlloc(uint16_t);
+int CyU3PDmaBufferFree(void*);
+
+#endif
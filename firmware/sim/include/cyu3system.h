@@ -0,0 +1,33 @@
+#ifndef _CYU3SYSTEM_H_
+#define _CYU3SYSTEM_H_
+
+#include "cyu3types.h"
+#include "cyu3os.h"
+#include "cyu3dma.h"
+
+typedef struct {
+  CyBool_t isDQ32Bit;
+  CyBool_t useUart;
+  CyBool_t useI2C;
+  CyBool_t useI2S;
+  CyBool_t useSpi;
+  int lppMode;
+  uint32_t gpioSimpleEn[2];
+  uint32_t gpioComplexEn[2];
+} CyU3PIoMatrixConfig_t;
+
+CyU3PReturnStatus_t CyU3PDeviceConfigureIOMatrix(CyU3PIoMatrixConfig_t*);
+CyU3PReturnStatus_t CyU3PDeviceGpioOverride(uint8_t, CyBool_t);
+CyU3PReturnStatus_t CyU3PDeviceCacheControl(CyBool_t, CyBool_t, CyBool_t);
+CyU3PReturnStatus_t CyU3PDeviceReset(CyBool_t);
+void CyU3PSysFlushDCache(void);
+uint32_t CyU3PVicDisableAllInterrupts(void);
+void CyU3PVicEnableInterrupts(uint32_t);
+
+CyU3PReturnStatus_t CyU3PDebugInit(uint16_t, uint8_t);
+void CyU3PDebugPreamble(CyBool_t);
+void CyU3PDebugEnable(uint16_t);
+CyU3PReturnStatus_t CyU3PDebugPrint(uint8_t, char*, ...);
+CyU3PReturnStatus_t CyU3PDebugStringPrint(uint8_t*, uint16_t, char*, ...);
+
+#endif
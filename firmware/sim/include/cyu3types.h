@@ -0,0 +1,19 @@
+/**
+ * Host simulation stand-ins for the FX3 SDK headers.  Only the parts of
+ * the SDK the simulated firmware sources use are declared.  Values are
+ * taken from the SDK where they matter to the firmware (error codes,
+ * socket ids) and are otherwise arbitrary.  See ../sim.h.
+ **/
+#ifndef _CYU3TYPES_H_
+#define _CYU3TYPES_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int CyBool_t;
+#define CyTrue 1
+#define CyFalse 0
+
+typedef uint32_t CyU3PReturnStatus_t;
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _CYU3UART_H_
+#define _CYU3UART_H_
+
+#include "cyu3system.h"
+
+typedef struct {
+  CyBool_t txEnable;
+  CyBool_t rxEnable;
+  CyBool_t flowCtrl;
+  CyBool_t isDma;
+  int baudRate;
+  int stopBit;
+  int parity;
+  uint32_t rxLatency;
+} CyU3PUartConfig_t;
+
+#define CY_U3P_UART_BAUDRATE_230400 230400
+#define CY_U3P_UART_ONE_STOP_BIT 1
+#define CY_U3P_UART_NO_PARITY 0
+
+CyU3PReturnStatus_t CyU3PUartInit(void);
+CyU3PReturnStatus_t CyU3PUartDeInit(void);
+CyU3PReturnStatus_t CyU3PUartSetConfig(CyU3PUartConfig_t*, void*);
+CyU3PReturnStatus_t CyU3PUartTxSetBlockXfer(uint32_t);
+
+#endif
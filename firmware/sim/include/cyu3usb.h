@@ -0,0 +1,35 @@
+#ifndef _CYU3USB_H_
+#define _CYU3USB_H_
+
+#include "cyu3types.h"
+#include "cyu3usbconst.h"
+#include "cyu3dma.h"
+
+typedef enum {
+  CY_U3P_NOT_CONNECTED=0,
+  CY_U3P_FULL_SPEED,
+  CY_U3P_HIGH_SPEED,
+  CY_U3P_SUPER_SPEED
+} CyU3PUSBSpeed_t;
+
+typedef struct {
+  CyBool_t enable;
+  uint8_t epType;
+  uint16_t streams;
+  uint16_t pcktSize;
+  uint8_t burstLen;
+  uint8_t isoPkts;
+} CyU3PEpConfig_t;
+
+CyU3PReturnStatus_t CyU3PSetEpConfig(uint8_t, CyU3PEpConfig_t*);
+CyU3PReturnStatus_t CyU3PUsbGetEP0Data(uint16_t, uint8_t*, uint16_t*);
+CyU3PReturnStatus_t CyU3PUsbSendEP0Data(uint16_t, uint8_t*);
+CyU3PReturnStatus_t CyU3PUsbAckSetup(void);
+CyU3PReturnStatus_t CyU3PUsbStall(uint8_t, CyBool_t, CyBool_t);
+CyU3PReturnStatus_t CyU3PUsbFlushEp(uint8_t);
+CyU3PReturnStatus_t CyU3PUsbResetEp(uint8_t);
+CyU3PReturnStatus_t CyU3PUsbSetEpNak(uint8_t, CyBool_t);
+CyU3PUSBSpeed_t CyU3PUsbGetSpeed(void);
+CyU3PReturnStatus_t CyU3PUsbGetErrorCounts(uint16_t*, uint16_t*);
+
+#endif
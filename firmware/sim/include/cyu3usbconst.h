@@ -0,0 +1,9 @@
+#ifndef _CYU3USBCONST_H_
+#define _CYU3USBCONST_H_
+
+#define CY_U3P_USB_EP_CONTROL 0
+#define CY_U3P_USB_EP_ISO     1
+#define CY_U3P_USB_EP_BULK    2
+#define CY_U3P_USB_EP_INTR    3
+
+#endif
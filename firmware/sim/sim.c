@@ -0,0 +1,779 @@
+/**
+ * Stub sdk implementation and host side of the simulation.  See sim.h.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include <cyu3system.h>
+#include <cyu3os.h>
+#include <cyu3dma.h>
+#include <cyu3usb.h>
+#include <cyu3uart.h>
+#include <cyu3gpio.h>
+#include <cyu3error.h>
+
+#include "main.h"
+#include "rdwr.h"
+#include "log.h"
+#include "error_handler.h"
+#include "hwtimer.h"
+#include "notify.h"
+#include "capture.h"
+#include "macro.h"
+#include "pretrig.h"
+#include "sim.h"
+
+sim_stats_t gSimStats;
+int gSimVerbose=0;
+uint16_t gSimSeq=0;
+uint16_t gSimFlags=0;
+ext_ack_pkt_t gSimExtAck;
+uint16_t gSimPhyErrors=0, gSimLinkErrors=0;
+
+static uint32_t gSimTime=0;
+static int gSimInDataThread=0;
+static int gSimInHostService=0;
+
+CyU3PEvent glThreadEvent;
+uint8_t glEp0Buffer[32] __attribute__ ((aligned (32)));
+
+static uint64_t sim_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+uint32_t sim_time(void) {
+  return gSimTime;
+}
+
+static int sim_host_service(void);
+
+#define SIM_TIMERS 16
+static CyU3PTimer *gSimTimers[SIM_TIMERS];
+
+// advances the clock a ms at a time running the os timers that come due
+static void sim_advance(uint32_t ms) {
+  CyU3PTimer *t;
+  int i;
+  while (ms--) {
+    ++gSimTime;
+    for (i=0; i<SIM_TIMERS && gSimTimers[i]; ++i) {
+      t = gSimTimers[i];
+      if (!t->active) continue;
+      if (t->remain > 1) {
+        --t->remain;
+        continue;
+      }
+      t->remain = t->period;
+      if (!t->period) t->active = 0;
+      t->cb(t->arg);
+    }
+  }
+}
+
+/******************************************************************************/
+/* os */
+
+uint32_t CyU3PThreadCreate(CyU3PThread *t, char *name, CyU3PThreadEntry_t entry, uint32_t input,
+                           void *stack, uint32_t stackSize, uint32_t prio, uint32_t preempt,
+                           uint32_t slice, uint32_t autoStart) {
+  // firmware threads are played by sim_vendor_cmd/sim_data_thread
+  t->name = name;
+  return CY_U3P_SUCCESS;
+}
+
+CyU3PThread *CyU3PThreadIdentify(void) {
+  return NULL;
+}
+
+uint32_t CyU3PThreadSleep(uint32_t ms) {
+  sim_advance(ms);
+  // let the "other threads" run while this one sleeps
+  if (!gSimInDataThread) sim_data_thread();
+  if (!gSimInHostService) sim_host_service();
+  return CY_U3P_SUCCESS;
+}
+
+uint32_t CyU3PEventCreate(CyU3PEvent *ev) {
+  ev->flags = 0;
+  return CY_U3P_SUCCESS;
+}
+
+uint32_t CyU3PEventSet(CyU3PEvent *ev, uint32_t flags, uint32_t option) {
+  if (option == CYU3P_EVENT_OR) ev->flags |= flags;
+  else ev->flags &= flags;
+  return CY_U3P_SUCCESS;
+}
+
+uint32_t CyU3PEventGet(CyU3PEvent *ev, uint32_t flags, uint32_t option, uint32_t *flagsOut, uint32_t wait) {
+  CyBool_t all = option == CYU3P_EVENT_AND || option == CYU3P_EVENT_AND_CLEAR;
+  uint32_t waited = 0;
+  // only os timers can set the event while waiting so let simulated
+  // time pass for them.  Waiting forever would never return.
+  while (all ? (ev->flags & flags) != flags : !(ev->flags & flags)) {
+    if (wait == CYU3P_WAIT_FOREVER || waited++ == wait)
+      return CY_U3P_ERROR_TIMEOUT;
+    sim_advance(1);
+  }
+  if (flagsOut) *flagsOut = ev->flags;
+  if (option == CYU3P_EVENT_OR_CLEAR || option == CYU3P_EVENT_AND_CLEAR)
+    ev->flags &= ~flags;
+  return CY_U3P_SUCCESS;
+}
+
+// ThreadX mutexes are recursive for the owner and there is only one
+// thread here so gets always succeed.
+uint32_t CyU3PMutexCreate(CyU3PMutex *m, uint32_t inherit) {
+  m->created = 1;
+  m->count = 0;
+  return CY_U3P_SUCCESS;
+}
+
+uint32_t CyU3PMutexDestroy(CyU3PMutex *m) {
+  m->created = 0;
+  return CY_U3P_SUCCESS;
+}
+
+uint32_t CyU3PMutexGet(CyU3PMutex *m, uint32_t wait) {
+  if (!m->created) return CY_U3P_ERROR_MUTEX_FAILURE;
+  ++m->count;
+  return CY_U3P_SUCCESS;
+}
+
+uint32_t CyU3PMutexPut(CyU3PMutex *m) {
+  if (!m->created || !m->count) return CY_U3P_ERROR_MUTEX_FAILURE;
+  --m->count;
+  return CY_U3P_SUCCESS;
+}
+
+uint32_t CyU3PTimerCreate(CyU3PTimer *t, CyU3PTimerCb_t cb, uint32_t arg, uint32_t initial,
+                          uint32_t period, uint32_t activate) {
+  int i;
+  for (i=0; i<SIM_TIMERS && gSimTimers[i] && gSimTimers[i] != t; ++i);
+  if (i<SIM_TIMERS) gSimTimers[i] = t;
+  t->cb = cb;
+  t->arg = arg;
+  t->remain = initial;
+  t->period = period;
+  t->active = activate;
+  return CY_U3P_SUCCESS;
+}
+
+uint32_t CyU3PTimerStart(CyU3PTimer *t) { t->active = 1; return CY_U3P_SUCCESS; }
+uint32_t CyU3PTimerStop(CyU3PTimer *t) { t->active = 0; return CY_U3P_SUCCESS; }
+uint32_t CyU3PTimerModify(CyU3PTimer *t, uint32_t initial, uint32_t period) {
+  t->remain = initial;
+  t->period = period;
+  return CY_U3P_SUCCESS;
+}
+
+uint32_t CyU3PGetTime(void) {
+  return gSimTime;
+}
+
+void *CyU3PMemAlloc(uint32_t size) { return malloc(size); }
+void CyU3PMemFree(void *p) { free(p); }
+void CyU3PMemCopy(uint8_t *dst, uint8_t *src, uint32_t count) { memmove(dst, src, count); }
+void CyU3PMemSet(uint8_t *dst, uint8_t val, uint32_t count) { memset(dst, val, count); }
+int32_t CyU3PMemCmp(const void *a, const void *b, uint32_t count) { return memcmp(a, b, count); }
+
+void *CyU3PDmaBufferAlloc(uint16_t size) {
+  return aligned_alloc(32, (size+31) & ~31);
+}
+
+int CyU3PDmaBufferFree(void *p) {
+  free(p);
+  return 0;
+}
+
+/******************************************************************************/
+/* system */
+
+CyU3PReturnStatus_t CyU3PDeviceConfigureIOMatrix(CyU3PIoMatrixConfig_t *cfg) { return CY_U3P_SUCCESS; }
+CyU3PReturnStatus_t CyU3PDeviceGpioOverride(uint8_t gpio, CyBool_t simple) { return CY_U3P_SUCCESS; }
+CyU3PReturnStatus_t CyU3PDeviceCacheControl(CyBool_t i, CyBool_t d, CyBool_t dma) { return CY_U3P_SUCCESS; }
+CyU3PReturnStatus_t CyU3PDeviceReset(CyBool_t warm) {
+  fprintf(stderr, "sim: device reset\n");
+  exit(2);
+}
+void CyU3PSysFlushDCache(void) {}
+uint32_t CyU3PVicDisableAllInterrupts(void) { return 0; }
+void CyU3PVicEnableInterrupts(uint32_t mask) {}
+
+CyU3PReturnStatus_t CyU3PDebugInit(uint16_t sck, uint8_t level) { return CY_U3P_SUCCESS; }
+void CyU3PDebugPreamble(CyBool_t preamble) {}
+void CyU3PDebugEnable(uint16_t mask) {}
+
+CyU3PReturnStatus_t CyU3PDebugPrint(uint8_t level, char *fmt, ...) {
+  va_list ap;
+  if (!gSimVerbose) return CY_U3P_SUCCESS;
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  return CY_U3P_SUCCESS;
+}
+
+CyU3PReturnStatus_t CyU3PDebugStringPrint(uint8_t *buf, uint16_t len, char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf((char*)buf, len, fmt, ap);
+  va_end(ap);
+  return CY_U3P_SUCCESS;
+}
+
+CyU3PReturnStatus_t CyU3PUartInit(void) { return CY_U3P_SUCCESS; }
+CyU3PReturnStatus_t CyU3PUartDeInit(void) { return CY_U3P_SUCCESS; }
+CyU3PReturnStatus_t CyU3PUartSetConfig(CyU3PUartConfig_t *cfg, void *cb) { return CY_U3P_SUCCESS; }
+CyU3PReturnStatus_t CyU3PUartTxSetBlockXfer(uint32_t count) { return CY_U3P_SUCCESS; }
+
+#define SIM_GPIO_COUNT 61
+static CyBool_t gSimGpio[SIM_GPIO_COUNT];
+static CyU3PGpioIntrMode_t gSimGpioIntr[SIM_GPIO_COUNT];
+
+CyU3PReturnStatus_t CyU3PGpioSetSimpleConfig(uint8_t gpio, CyU3PGpioSimpleConfig_t *cfg) {
+  if (gpio >= SIM_GPIO_COUNT) return CY_U3P_ERROR_BAD_ARGUMENT;
+  gSimGpioIntr[gpio] = cfg->intrMode;
+  return CY_U3P_SUCCESS;
+}
+CyU3PReturnStatus_t CyU3PGpioSetComplexConfig(uint8_t gpio, CyU3PGpioComplexConfig_t *cfg) { return CY_U3P_SUCCESS; }
+CyU3PReturnStatus_t CyU3PGpioDisable(uint8_t gpio) {
+  if (gpio < SIM_GPIO_COUNT) gSimGpioIntr[gpio] = CY_U3P_GPIO_NO_INTR;
+  return CY_U3P_SUCCESS;
+}
+CyU3PReturnStatus_t CyU3PGpioSetValue(uint8_t gpio, CyBool_t val) { return CY_U3P_SUCCESS; }
+CyU3PReturnStatus_t CyU3PGpioGetValue(uint8_t gpio, CyBool_t *val) { *val = CyFalse; return CY_U3P_SUCCESS; }
+CyU3PReturnStatus_t CyU3PGpioSimpleSetValue(uint8_t gpio, CyBool_t val) { return CY_U3P_SUCCESS; }
+CyU3PReturnStatus_t CyU3PGpioSimpleGetValue(uint8_t gpio, CyBool_t *val) {
+  *val = gpio < SIM_GPIO_COUNT ? gSimGpio[gpio] : CyFalse;
+  return CY_U3P_SUCCESS;
+}
+
+/* main.c nitro_gpio_interrupt */
+static void sim_gpio_interrupt(uint8_t gpio) {
+  if (hwtimer_isr(gpio)) return;
+  if (capture_isr(gpio)) return;
+  if (macro_isr(gpio)) return;
+  pretrig_isr(gpio);
+}
+
+void sim_gpio_set(uint8_t gpio, CyBool_t level) {
+  CyU3PGpioIntrMode_t m = gSimGpioIntr[gpio];
+  CyBool_t old = gSimGpio[gpio];
+  gSimGpio[gpio] = level;
+  if (old == level) return;
+  if (m == CY_U3P_GPIO_INTR_BOTH_EDGE ||
+      (m == CY_U3P_GPIO_INTR_POS_EDGE && level) ||
+      (m == CY_U3P_GPIO_INTR_NEG_EDGE && !level))
+    sim_gpio_interrupt(gpio);
+}
+CyU3PReturnStatus_t CyU3PGpioComplexSampleNow(uint8_t gpio, uint32_t *val) { *val = gSimTime; return CY_U3P_SUCCESS; }
+CyU3PReturnStatus_t CyU3PGpioComplexUpdate(uint8_t gpio, uint32_t threshold, uint32_t period) { return CY_U3P_SUCCESS; }
+
+void error_handler_0(CyU3PReturnStatus_t status, CyBool_t init) {
+  // the firmware loops forever here
+  fprintf(stderr, "sim: error_handler %d\n", status);
+  exit(2);
+}
+
+void error_handler(CyU3PReturnStatus_t status) {
+  error_handler_0(status, CyTrue);
+}
+
+/******************************************************************************/
+/* dma */
+
+#define SIM_MAX_CHANNELS 16
+static CyU3PDmaChannel *gSimChannels[SIM_MAX_CHANNELS];
+
+static CyBool_t sim_cpu_consumes(CyU3PDmaChannel *ch) {
+  return ch->consSckId == CY_U3P_CPU_SOCKET_CONS;
+}
+
+CyU3PReturnStatus_t CyU3PDmaChannelCreate(CyU3PDmaChannel *ch, CyU3PDmaType_t type, CyU3PDmaChannelConfig_t *cfg) {
+  int i;
+  if (!ch || !cfg) return CY_U3P_ERROR_NULL_POINTER;
+  if (!cfg->size || !cfg->count || cfg->count > SIM_DMA_MAX_COUNT)
+    return CY_U3P_ERROR_BAD_ARGUMENT;
+  memset(ch, 0, sizeof(*ch));
+  ch->type = type;
+  ch->prodSckId = cfg->prodSckId;
+  ch->consSckId = cfg->consSckId;
+  ch->size = cfg->size;
+  ch->count = cfg->count;
+  ch->prodHeader = cfg->prodHeader;
+  ch->mem = aligned_alloc(32, ((uint32_t)cfg->size*cfg->count+31) & ~31);
+  if (!ch->mem) return CY_U3P_ERROR_MEMORY_ERROR;
+  for (i=0;i<SIM_MAX_CHANNELS;++i) {
+    if (!gSimChannels[i]) {
+      gSimChannels[i] = ch;
+      break;
+    }
+  }
+  if (i==SIM_MAX_CHANNELS) return CY_U3P_ERROR_CHANNEL_CREATE_FAILED;
+  ch->state = CY_U3P_DMA_CONFIGURED;
+  ++gSimStats.creates;
+  return CY_U3P_SUCCESS;
+}
+
+CyU3PReturnStatus_t CyU3PDmaChannelDestroy(CyU3PDmaChannel *ch) {
+  int i;
+  if (ch->state == CY_U3P_DMA_NOT_CONFIGURED) return CY_U3P_ERROR_NOT_CONFIGURED;
+  for (i=0;i<SIM_MAX_CHANNELS;++i)
+    if (gSimChannels[i] == ch) gSimChannels[i] = NULL;
+  free(ch->mem);
+  ch->mem = NULL;
+  ch->state = CY_U3P_DMA_NOT_CONFIGURED;
+  return CY_U3P_SUCCESS;
+}
+
+CyU3PReturnStatus_t CyU3PDmaChannelReset(CyU3PDmaChannel *ch) {
+  if (ch->state == CY_U3P_DMA_NOT_CONFIGURED) return CY_U3P_ERROR_NOT_CONFIGURED;
+  ch->head = 0;
+  ch->used = 0;
+  ch->override_active = CyFalse;
+  ch->override_xfer = 0;
+  ch->state = CY_U3P_DMA_CONFIGURED;
+  ++gSimStats.resets;
+  return CY_U3P_SUCCESS;
+}
+
+CyU3PReturnStatus_t CyU3PDmaChannelSetXfer(CyU3PDmaChannel *ch, uint32_t count) {
+  if (ch->state == CY_U3P_DMA_NOT_CONFIGURED) return CY_U3P_ERROR_NOT_CONFIGURED;
+  ch->state = CY_U3P_DMA_ACTIVE;
+  return CY_U3P_SUCCESS;
+}
+
+static CyBool_t sim_buffer_ready(CyU3PDmaChannel *ch) {
+  return sim_cpu_consumes(ch) ? ch->used > 0 : ch->used < ch->count;
+}
+
+CyU3PReturnStatus_t CyU3PDmaChannelGetBuffer(CyU3PDmaChannel *ch, CyU3PDmaBuffer_t *buf, uint32_t wait) {
+  uint16_t idx;
+  if (ch->state != CY_U3P_DMA_ACTIVE) return CY_U3P_ERROR_NOT_STARTED;
+  if (!sim_buffer_ready(ch)) {
+    // the host would be moving data while we block
+    ++gSimStats.dma_waits;
+    if (wait != CYU3P_NO_WAIT && !gSimInHostService) sim_host_service();
+    if (!sim_buffer_ready(ch)) return CY_U3P_ERROR_TIMEOUT;
+  }
+  if (sim_cpu_consumes(ch)) {
+    idx = ch->head;
+    buf->count = ch->fill[idx];
+  } else {
+    idx = (ch->head + ch->used) % ch->count;
+    buf->count = 0;
+  }
+  buf->buffer = ch->mem + (uint32_t)idx*ch->size;
+  buf->size = ch->size;
+  if (!sim_cpu_consumes(ch)) {
+    // the cpu fills the header space itself and commits it with the data
+    buf->buffer += ch->prodHeader;
+    buf->size -= ch->prodHeader;
+  }
+  buf->status = 0;
+  ++gSimStats.get_buffers;
+  return CY_U3P_SUCCESS;
+}
+
+CyU3PReturnStatus_t CyU3PDmaChannelCommitBuffer(CyU3PDmaChannel *ch, uint16_t count, uint16_t status) {
+  if (ch->state != CY_U3P_DMA_ACTIVE) return CY_U3P_ERROR_NOT_STARTED;
+  if (sim_cpu_consumes(ch) || ch->used == ch->count) return CY_U3P_ERROR_INVALID_SEQUENCE;
+  if (count > ch->size) return CY_U3P_ERROR_BAD_SIZE;
+  ch->fill[(ch->head + ch->used) % ch->count] = count;
+  ++ch->used;
+  ++gSimStats.commits;
+  return CY_U3P_SUCCESS;
+}
+
+CyU3PReturnStatus_t CyU3PDmaChannelDiscardBuffer(CyU3PDmaChannel *ch) {
+  if (ch->state != CY_U3P_DMA_ACTIVE) return CY_U3P_ERROR_NOT_STARTED;
+  ++gSimStats.discards;
+  if (!sim_cpu_consumes(ch)) return CY_U3P_SUCCESS; // buffer just goes back
+  if (!ch->used) return CY_U3P_ERROR_INVALID_SEQUENCE;
+  ch->head = (ch->head+1) % ch->count;
+  --ch->used;
+  return CY_U3P_SUCCESS;
+}
+
+CyU3PReturnStatus_t CyU3PDmaChannelGetStatus(CyU3PDmaChannel *ch, CyU3PDmaState_t *state, uint32_t *prodXfer, uint32_t *consXfer) {
+  if (state) *state = ch->state;
+  // only overrides are counted
+  if (prodXfer) *prodXfer = sim_cpu_consumes(ch) ? 0 : ch->override_xfer;
+  if (consXfer) *consXfer = sim_cpu_consumes(ch) ? ch->override_xfer : 0;
+  return CY_U3P_SUCCESS;
+}
+
+CyU3PReturnStatus_t CyU3PDmaChannelSetupSendBuffer(CyU3PDmaChannel *ch, CyU3PDmaBuffer_t *buf) {
+  if (ch->state == CY_U3P_DMA_NOT_CONFIGURED) return CY_U3P_ERROR_NOT_CONFIGURED;
+  if (ch->override_active) return CY_U3P_ERROR_ALREADY_STARTED;
+  ch->override = *buf;
+  ch->override_active = CyTrue;
+  ch->state = CY_U3P_DMA_CONS_OVERRIDE;
+  return CY_U3P_SUCCESS;
+}
+
+CyU3PReturnStatus_t CyU3PDmaChannelSetupRecvBuffer(CyU3PDmaChannel *ch, CyU3PDmaBuffer_t *buf) {
+  if (ch->state == CY_U3P_DMA_NOT_CONFIGURED) return CY_U3P_ERROR_NOT_CONFIGURED;
+  if (ch->override_active) return CY_U3P_ERROR_ALREADY_STARTED;
+  if (buf->size & 15) return CY_U3P_ERROR_BAD_ARGUMENT;
+  ch->override = *buf;
+  ch->override.count = 0;
+  ch->override_active = CyTrue;
+  ch->state = CY_U3P_DMA_PROD_OVERRIDE;
+  return CY_U3P_SUCCESS;
+}
+
+CyU3PReturnStatus_t CyU3PDmaChannelWaitForCompletion(CyU3PDmaChannel *ch, uint32_t wait) {
+  if (ch->override_active && wait != CYU3P_NO_WAIT && !gSimInHostService) sim_host_service();
+  return ch->override_active ? CY_U3P_ERROR_TIMEOUT : CY_U3P_SUCCESS;
+}
+
+CyU3PReturnStatus_t CyU3PDmaChannelSetWrapUp(CyU3PDmaChannel *ch) { return CY_U3P_SUCCESS; }
+
+CyU3PReturnStatus_t CyU3PDmaChannelAbort(CyU3PDmaChannel *ch) {
+  ch->used = 0;
+  ch->override_active = CyFalse;
+  ch->state = CY_U3P_DMA_ABORTED;
+  return CY_U3P_SUCCESS;
+}
+
+CyU3PReturnStatus_t CyU3PDmaChannelCacheControl(CyU3PDmaChannel *ch, CyBool_t enable) { return CY_U3P_SUCCESS; }
+
+/******************************************************************************/
+/* usb */
+
+static uint8_t *gSimEp0Data;
+static uint16_t gSimEp0Len;
+static CyBool_t gSimEp0In;
+static CyBool_t gSimEp0Stall;
+
+CyU3PReturnStatus_t CyU3PUsbGetEP0Data(uint16_t count, uint8_t *buf, uint16_t *readCount) {
+  uint16_t n = count < gSimEp0Len ? count : gSimEp0Len;
+  if (gSimEp0In || !gSimEp0Data) return CY_U3P_ERROR_INVALID_SEQUENCE;
+  memcpy(buf, gSimEp0Data, n);
+  if (readCount) *readCount = n;
+  return CY_U3P_SUCCESS;
+}
+
+CyU3PReturnStatus_t CyU3PUsbSendEP0Data(uint16_t count, uint8_t *buf) {
+  uint16_t n = count < gSimEp0Len ? count : gSimEp0Len;
+  if (!gSimEp0In || !gSimEp0Data) return CY_U3P_ERROR_INVALID_SEQUENCE;
+  memcpy(gSimEp0Data, buf, n);
+  return CY_U3P_SUCCESS;
+}
+
+CyU3PReturnStatus_t CyU3PUsbAckSetup(void) { return CY_U3P_SUCCESS; }
+
+CyU3PReturnStatus_t CyU3PUsbStall(uint8_t ep, CyBool_t stall, CyBool_t toggle) {
+  if (ep == 0 && stall) {
+    gSimEp0Stall = CyTrue;
+    ++gSimStats.stalls;
+  }
+  return CY_U3P_SUCCESS;
+}
+
+CyU3PReturnStatus_t CyU3PSetEpConfig(uint8_t ep, CyU3PEpConfig_t *cfg) { return CY_U3P_SUCCESS; }
+CyU3PReturnStatus_t CyU3PUsbFlushEp(uint8_t ep) { return CY_U3P_SUCCESS; }
+CyU3PReturnStatus_t CyU3PUsbResetEp(uint8_t ep) { return CY_U3P_SUCCESS; }
+CyU3PReturnStatus_t CyU3PUsbSetEpNak(uint8_t ep, CyBool_t nak) { return CY_U3P_SUCCESS; }
+
+CyU3PUSBSpeed_t CyU3PUsbGetSpeed(void) {
+  switch (gRdwrCmd.ep_buffer_size) {
+    case 1024: return CY_U3P_SUPER_SPEED;
+    case 512: return CY_U3P_HIGH_SPEED;
+    default: return CY_U3P_FULL_SPEED;
+  }
+}
+
+CyU3PReturnStatus_t CyU3PUsbGetErrorCounts(uint16_t *phy, uint16_t *lnk) {
+  // counts since the last call like the sdk
+  *phy = gSimPhyErrors;
+  *lnk = gSimLinkErrors;
+  gSimPhyErrors = gSimLinkErrors = 0;
+  return CY_U3P_SUCCESS;
+}
+
+/******************************************************************************/
+/* host */
+
+static CyU3PDmaChannel *sim_ep_channel(uint8_t ep) {
+  int i;
+  for (i=0;i<SIM_MAX_CHANNELS;++i) {
+    CyU3PDmaChannel *ch = gSimChannels[i];
+    if (!ch) continue;
+    if (ep & 0x80) {
+      if (ch->consSckId == CY_U3P_UIB_SOCKET_CONS_0 + (ep & 0x0f)) return ch;
+    } else {
+      if (ch->prodSckId == CY_U3P_UIB_SOCKET_PROD_0 + (ep & 0x0f)) return ch;
+    }
+  }
+  return NULL;
+}
+
+uint32_t sim_ep_write(uint8_t ep, const uint8_t *data, uint32_t len) {
+  CyU3PDmaChannel *ch = sim_ep_channel(ep);
+  uint32_t accepted = 0;
+  if (ch && ch->override_active) {
+    // straight into the buffer until it's full or the transfer ends
+    accepted = len < ch->override.size ? len : ch->override.size;
+    memcpy(ch->override.buffer, data, accepted);
+    ch->override.count = accepted;
+    ch->override_xfer = accepted;
+    ch->override_active = CyFalse;
+    ch->state = CY_U3P_DMA_CONFIGURED;
+    return accepted;
+  }
+  if (!ch || ch->state != CY_U3P_DMA_ACTIVE) return 0;
+  while (len && ch->used < ch->count) {
+    uint16_t idx = (ch->head + ch->used) % ch->count;
+    uint16_t n = len < ch->size ? len : ch->size;
+    memcpy(ch->mem + (uint32_t)idx*ch->size, data, n);
+    ch->fill[idx] = n;
+    ++ch->used;
+    data += n;
+    len -= n;
+    accepted += n;
+  }
+  return accepted;
+}
+
+static int32_t sim_ep_read_x(uint8_t ep, uint8_t *data, uint32_t max, CyBool_t *shortpkt) {
+  CyU3PDmaChannel *ch = sim_ep_channel(ep);
+  uint32_t total = 0;
+  *shortpkt = CyFalse;
+  if (!ch) return 0;
+  if (ch->override_active) {
+    if (ch->override.count > max) return -1;
+    memcpy(data, ch->override.buffer, ch->override.count);
+    ch->override_active = CyFalse;
+    ch->override_xfer = ch->override.count;
+    ch->state = CY_U3P_DMA_CONFIGURED;
+    *shortpkt = ch->override.count % gRdwrCmd.ep_buffer_size != 0;
+    return ch->override.count;
+  }
+  while (ch->used && total < max) {
+    uint16_t c = ch->fill[ch->head];
+    if (c > max-total) return total ? (int32_t)total : -1;
+    memcpy(data+total, ch->mem + (uint32_t)ch->head*ch->size, c);
+    ch->head = (ch->head+1) % ch->count;
+    --ch->used;
+    total += c;
+    // a buffer of whole packets doesn't end the transfer, a zlp does
+    if (!c || c % gRdwrCmd.ep_buffer_size) {
+      *shortpkt = CyTrue;
+      break;
+    }
+  }
+  return total;
+}
+
+int32_t sim_ep_read(uint8_t ep, uint8_t *data, uint32_t max) {
+  CyBool_t shortpkt;
+  return sim_ep_read_x(ep, data, max, &shortpkt);
+}
+
+/**
+ * The host's pending bulk transfers.  sim_rdwr queues them and they are
+ * serviced whenever the firmware would block waiting on the host.
+ **/
+#define SIM_HOST_MAX_XFERS 4
+typedef struct {
+  uint8_t ep;
+  uint8_t *buf;
+  uint32_t len;
+  uint32_t done;
+  CyBool_t complete;
+  CyBool_t error;
+} sim_xfer_t;
+
+static sim_xfer_t gSimXfers[SIM_HOST_MAX_XFERS];
+static int gSimXferCount=0;
+
+static void sim_host_queue(uint8_t ep, uint8_t *buf, uint32_t len) {
+  sim_xfer_t *x = &gSimXfers[gSimXferCount++];
+  x->ep = ep;
+  x->buf = buf;
+  x->len = len;
+  x->done = 0;
+  x->complete = len == 0;
+  x->error = CyFalse;
+}
+
+static int sim_host_service(void) {
+  int i, moved=0;
+  gSimInHostService=1;
+  // one outstanding transfer per endpoint at a time, in queue order
+  for (i=0;i<gSimXferCount;++i) {
+    sim_xfer_t *x = &gSimXfers[i];
+    int j, blocked=0;
+    if (x->complete) continue;
+    for (j=0;j<i;++j)
+      if (!gSimXfers[j].complete && gSimXfers[j].ep == x->ep) blocked=1;
+    if (blocked) continue;
+    if (x->ep & 0x80) {
+      CyBool_t shortpkt;
+      int32_t n = sim_ep_read_x(x->ep, x->buf+x->done, x->len-x->done, &shortpkt);
+      if (n<0) {
+        x->error = x->complete = CyTrue;
+        continue;
+      }
+      x->done += n;
+      moved += n;
+      if (shortpkt || x->done == x->len) x->complete = CyTrue;
+    } else {
+      uint32_t n = sim_ep_write(x->ep, x->buf+x->done, x->len-x->done);
+      x->done += n;
+      moved += n;
+      if (x->done == x->len) x->complete = CyTrue;
+    }
+  }
+  gSimInHostService=0;
+  return moved;
+}
+
+static CyBool_t sim_host_idle(void) {
+  int i;
+  for (i=0;i<gSimXferCount;++i)
+    if (!gSimXfers[i].complete) return CyFalse;
+  return CyTrue;
+}
+
+/******************************************************************************/
+
+void sim_init(uint16_t ep_buffer_size) {
+  int i;
+  memset(&gSimStats, 0, sizeof(gSimStats));
+  CyU3PEventCreate(&glThreadEvent);
+#ifdef ENABLE_LOGGING
+  logging_boot();
+#endif
+  hwtimer_boot();
+  notify_boot();
+  gRdwrCmd.ep_buffer_size = ep_buffer_size;
+  notify_start(ep_buffer_size);
+  gRdwrCmd.done = 1; // NitroDataThread_Entry
+
+  i=0;
+  while (app_init[i].type != APP_INIT_TERMINATOR) {
+    if (app_init[i].boot) app_init[i].boot();
+    ++i;
+  }
+  i=0;
+  while (io_handlers[i].handler) {
+    if (io_handlers[i].boot_handler)
+      io_handlers[i].boot_handler(io_handlers[i].term_addr);
+    ++i;
+  }
+  i=0;
+  while (app_init[i].type != APP_INIT_TERMINATOR) {
+    if (app_init[i].start) app_init[i].start();
+    ++i;
+  }
+}
+
+CyU3PReturnStatus_t sim_vendor_cmd(uint8_t bRequest, uint8_t bReqType,
+                                   uint16_t wValue, uint16_t wIndex,
+                                   uint16_t wLength, uint8_t *data) {
+  uint64_t t0;
+  gSimEp0Data = data;
+  gSimEp0Len = wLength;
+  gSimEp0In = (bReqType & 0x80) != 0;
+  gSimEp0Stall = CyFalse;
+  ++gSimStats.vendor_cmds;
+
+  t0 = sim_ns();
+  // CyFxNitroApplnUSBSetupCB then the app thread
+  if (!handle_fast_vendor_cmd(bRequest, bReqType, wLength))
+    handle_vendor_cmd(bRequest, bReqType, bReqType & 0x60, bReqType & 0x03,
+                      wValue, wIndex, wLength);
+  gSimStats.fw_ns += sim_ns()-t0;
+
+  gSimEp0Data = NULL;
+  return gSimEp0Stall ? CY_U3P_ERROR_INVALID_SEQUENCE : CY_U3P_SUCCESS;
+}
+
+/* NitroDataThread_Entry without the blocking wait at the bottom */
+int sim_data_thread(void) {
+  int n=0;
+  uint64_t t0;
+  if (gSimInDataThread) return 0;
+  gSimInDataThread=1;
+  while (!gRdwrCmd.done &&
+         gRdwrCmd.io_handler &&
+         gRdwrCmd.io_handler->handler->handler_dma_cb) {
+    uint16_t ret;
+    t0 = sim_ns();
+    ret = gRdwrCmd.io_handler->handler->handler_dma_cb();
+    gSimStats.fw_ns += sim_ns()-t0;
+    ++gSimStats.dma_cbs;
+    if (ret) break;
+    ++n;
+  }
+  gSimInDataThread=0;
+  return n;
+}
+
+int32_t sim_host_read(uint8_t ep, uint8_t *data, uint32_t len) {
+  gSimXferCount = 0;
+  sim_host_queue(ep, data, len);
+  while (!sim_host_idle()) {
+    int progress = sim_data_thread();
+    progress += sim_host_service();
+    if (!progress) return -1;
+  }
+  return gSimXfers[0].error ? -1 : (int32_t)gSimXfers[0].done;
+}
+
+CyU3PReturnStatus_t sim_rdwr(uint8_t command, uint16_t term, uint32_t reg,
+                             uint8_t *buf, uint32_t len, ack_pkt_t *ack) {
+  rdwr_data_header_t h;
+  ext_ack_pkt_t a; // the ack_pkt_t or the whole ext ack
+  uint32_t ack_len = (gSimFlags & RDWR_FLAG_EXT_ACK) ? sizeof(ext_ack_pkt_t) : sizeof(ack_pkt_t);
+  CyU3PReturnStatus_t status;
+  int i;
+
+  h.command = command;
+  h.term_addr = term;
+  h.reg_addr = reg;
+  h.transfer_length = len;
+  h.seq = gSimSeq;
+  h.flags = gSimFlags;
+
+  memset(&a, 0, sizeof(a));
+  gSimXferCount = 0;
+  sim_host_queue((command & bmSETWRITE) ? CY_FX_EP_PRODUCER : CY_FX_EP_CONSUMER, buf, len);
+  sim_host_queue(CY_FX_EP_CONSUMER, (uint8_t*)&a, ack_len);
+
+  status = sim_vendor_cmd(VC_HI_RDWR, 0x40, term, len & 0xffff, sizeof(h), (uint8_t*)&h);
+  if (status) return status;
+
+  while (!sim_host_idle()) {
+    int progress = sim_data_thread();
+    progress += sim_host_service();
+    if (!progress) {
+      if (gSimVerbose) printf("sim: transaction stuck %d/%d\n", gSimXfers[0].done, len);
+      return CY_U3P_ERROR_TIMEOUT;
+    }
+  }
+  for (i=0;i<gSimXferCount;++i)
+    if (gSimXfers[i].error) return CY_U3P_ERROR_BAD_SIZE;
+
+  if (ack) *ack = a.ack;
+  if (ack_len == sizeof(a)) gSimExtAck = a;
+  if (gSimXfers[1].done != ack_len || a.ack.id != ACK_PKT_ID || a.ack.seq != h.seq) return CY_U3P_ERROR_FAILURE;
+  return a.ack.status;
+}
+
+CyU3PReturnStatus_t sim_get(uint16_t term, uint32_t reg, uint32_t *val, uint32_t width) {
+  *val = 0;
+  return sim_rdwr(COMMAND_GET, term, reg, (uint8_t*)val, width, NULL);
+}
+
+CyU3PReturnStatus_t sim_set(uint16_t term, uint32_t reg, uint32_t val, uint32_t width) {
+  return sim_rdwr(COMMAND_SET, term, reg, (uint8_t*)&val, width, NULL);
+}
@@ -0,0 +1,149 @@
+#ifndef SIM_H
+#define SIM_H
+
+/**
+ * Host simulation of the nitro rdwr/cpu_handler core.
+ *
+ * The firmware sources are compiled for the host against the stub sdk
+ * headers in include/.  sim.c implements that sdk (dma channels, ep0,
+ * bulk endpoints, events, mutexes) and stands in for both firmware
+ * threads and the host:
+ *
+ *  - sim_vendor_cmd runs a setup request the way the app thread does.
+ *  - sim_data_thread runs the data thread loop until it would block.
+ *  - sim_ep_write/sim_ep_read move data through the bulk endpoints.
+ *  - sim_rdwr (and sim_get/sim_set) do a whole nitro transaction the way
+ *    the host driver does: vendor command, data, ack.
+ *
+ * Everything runs on the calling thread so runs are deterministic.  Sdk
+ * calls that would block return CY_U3P_ERROR_TIMEOUT immediately, except
+ * that an event wait with a timeout lets os timers run until one sets the
+ * event.  CyU3PThreadSleep advances the simulated clock, firing os timers
+ * that come due, and runs the data thread loop (so code that polls with
+ * sleeps still works.)
+ **/
+
+#include <cyu3types.h>
+#include "vendor_commands.h"
+
+typedef struct {
+  uint32_t vendor_cmds;
+  uint32_t stalls;
+  uint32_t dma_cbs;      // handler_dma_cb calls
+  uint32_t get_buffers;  // successful CyU3PDmaChannelGetBuffer
+  uint32_t dma_waits;    // CyU3PDmaChannelGetBuffer that would have blocked
+  uint32_t commits;
+  uint32_t discards;
+  uint32_t resets;       // CyU3PDmaChannelReset
+  uint32_t creates;      // CyU3PDmaChannelCreate
+  uint64_t fw_ns;        // wall time spent in firmware entry points
+} sim_stats_t;
+
+extern sim_stats_t gSimStats;
+extern int gSimVerbose;
+extern uint16_t gSimSeq; // rdwr_data_header_t.seq sim_rdwr sends (0 = unnumbered)
+extern uint16_t gSimFlags; // rdwr_data_header_t.flags sim_rdwr sends
+extern ext_ack_pkt_t gSimExtAck; // last ack of a RDWR_FLAG_EXT_ACK sim_rdwr
+extern uint16_t gSimPhyErrors, gSimLinkErrors; // next CyU3PUsbGetErrorCounts
+
+/**
+ * Boots the simulated firmware as if the usb link enumerated with
+ * ep_buffer_size byte bulk packets (64, 512 or 1024.)
+ **/
+void sim_init(uint16_t ep_buffer_size);
+
+/**
+ * Sends a setup request.  data is the ep0 data stage (sent for OUT
+ * requests, received for IN requests.)  Returns 0 or
+ * CY_U3P_ERROR_INVALID_SEQUENCE if the firmware stalled ep0.
+ **/
+CyU3PReturnStatus_t sim_vendor_cmd(uint8_t bRequest, uint8_t bReqType,
+                                   uint16_t wValue, uint16_t wIndex,
+                                   uint16_t wLength, uint8_t *data);
+
+/**
+ * Runs the data thread loop until the transaction is done or the handler
+ * can't make progress.  Returns the number of handler_dma_cb calls that
+ * succeeded.
+ **/
+int sim_data_thread(void);
+
+/**
+ * Host side of the bulk endpoints.  sim_ep_write offers len bytes of an
+ * OUT transfer and returns how many the firmware had buffers for.
+ * sim_ep_read returns up to max bytes of committed IN data (stopping
+ * after a short packet) or -1 if a buffer doesn't fit in max.
+ **/
+uint32_t sim_ep_write(uint8_t ep, const uint8_t *data, uint32_t len);
+int32_t sim_ep_read(uint8_t ep, uint8_t *data, uint32_t max);
+
+/**
+ * A host IN transfer of up to len bytes on a transaction already started
+ * (around vendor commands of its own), with the data thread running
+ * while the host waits like sim_rdwr.  Returns the bytes read or -1 if
+ * it got stuck or a buffer didn't fit.
+ **/
+int32_t sim_host_read(uint8_t ep, uint8_t *data, uint32_t len);
+
+/**
+ * A nitro transaction.  command is a NITRO_COMMAND.  The ack is returned
+ * in ack when not NULL.  Returns 0 if the transaction completed and the
+ * ack status was 0.
+ **/
+CyU3PReturnStatus_t sim_rdwr(uint8_t command, uint16_t term, uint32_t reg,
+                             uint8_t *buf, uint32_t len, ack_pkt_t *ack);
+
+CyU3PReturnStatus_t sim_get(uint16_t term, uint32_t reg, uint32_t *val, uint32_t width);
+CyU3PReturnStatus_t sim_set(uint16_t term, uint32_t reg, uint32_t val, uint32_t width);
+
+/**
+ * Drives a gpio input.  Runs the gpio interrupt if the pin is set up
+ * for that edge.
+ **/
+void sim_gpio_set(uint8_t gpio, CyBool_t level);
+
+/** Simulated milliseconds since sim_init. **/
+uint32_t sim_time(void);
+
+/**
+ * Sim only terminal: a write sink that takes gSimSlowRate bytes per
+ * simulated ms into gSimSlow + reg and returns IO_HANDLER_BUSY for the
+ * rest, like a peripheral fifo slower than the usb link.  A one shot os
+ * timer calls io_handler_ready a ms after it gets busy.  gSimSlowBusy
+ * counts the busy returns.
+ **/
+#define SIM_TERM_SLOW 0x7f0
+#define SIM_SLOW_SIZE (1<<20)
+extern uint8_t gSimSlow[SIM_SLOW_SIZE];
+extern uint32_t gSimSlowRate, gSimSlowBusy;
+
+/**
+ * Sim only v2 terminal.  Reads fill the buffers with SIM_VEC_BYTE of the
+ * transaction offset up to gSimVecEnd bytes (a short read after that.)
+ * Writes take into gSimSlow + reg.  Either moves at most gSimVecStep
+ * bytes a call.  gSimVecCalls and gSimVecIovs count the calls and the
+ * buffers they got.
+ **/
+#define SIM_TERM_VEC 0x7f1
+#define SIM_VEC_BYTE(off) ((uint8_t)((off)*7 + ((off)>>9)))
+extern uint32_t gSimVecEnd, gSimVecStep, gSimVecCalls, gSimVecIovs;
+
+/**
+ * Sim only async.c terminal.  An os timer playing an isr commits
+ * gSimAsyncPerTick buffers of gSimAsyncChunk bytes every ms with
+ * SIM_VEC_BYTE of the offset, the last one at gSimVecEnd.
+ * gSimAsyncStatus is what the last async_commit returned and
+ * gSimAsyncStops counts the producer's stops.
+ **/
+#define SIM_TERM_ASYNC 0x7f2
+extern uint32_t gSimAsyncChunk, gSimAsyncPerTick, gSimAsyncStops;
+extern uint16_t gSimAsyncStatus;
+extern CyBool_t gSimAsyncRunning;
+
+/**
+ * Sim only: the BENCH registers through a cpu handler without
+ * handler_abort, like handlers VC_ABORT can't stop.
+ **/
+#define SIM_TERM_NOABORT 0x7f3
+
+#endif
@@ -0,0 +1,1384 @@
+/**
+ * Runs nitro transactions through the simulated firmware, checks the
+ * data and reports the firmware cpu time per transaction.
+ *
+ *   sim_bench [-n iterations] [-s ep_buffer_size] [-v]
+ *
+ * Exits 1 if any transaction fails or returns bad data.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <cyu3error.h>
+#include "main.h"
+#include "rdwr.h"
+#include "bench_term.h"
+#include "membench.h"
+#include "fx3_terminals.h"
+#include "prbs.h"
+#include "hwtimer.h"
+#include "notify.h"
+#include "capture.h"
+#include "macro.h"
+#include "sampler.h"
+#include "pretrig.h"
+#include "sram_term.h"
+#include "reduce.h"
+#include "compress.h"
+#include "async.h"
+#include "sim.h"
+
+static int gFailed=0;
+
+#define CHECK(x, ...) do { if (!(x)) { printf("FAIL: " __VA_ARGS__); printf("\n"); ++gFailed; } } while (0)
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+static void prbs_fill(uint8_t *buf, uint32_t len, uint32_t seed) {
+  uint32_t *p = (uint32_t*)buf, w = PRBS_SEED(seed), n;
+  for (n=len/4; n--; w = prbs31_next(w)) *p++ = w;
+}
+
+static void test_get_set(void) {
+  uint32_t val;
+  CHECK(!sim_set(TERM_BENCH, BENCH_SEED, 0x12345678, 4), "set seed");
+  CHECK(!sim_get(TERM_BENCH, BENCH_SEED, &val, 4), "get seed");
+  CHECK(val == 0x12345678, "seed %08x", val);
+  CHECK(sim_get(0x7ff, 0, &val, 4) != 0, "bad terminal succeeded");
+}
+
+static void test_write(uint32_t len, uint32_t seed) {
+  uint8_t *buf = malloc(len);
+  uint32_t errors=1, bytes=0;
+  ack_pkt_t ack;
+  prbs_fill(buf, len, seed);
+  sim_set(TERM_BENCH, BENCH_MODE, BENCH_PATTERN_PRBS, 4);
+  sim_set(TERM_BENCH, BENCH_VERIFY, 1, 4);
+  sim_set(TERM_BENCH, BENCH_SEED, seed, 4);
+  CHECK(!sim_rdwr(COMMAND_WRITE, TERM_BENCH, BENCH_DATA, buf, len, &ack), "write %d", len);
+  sim_get(TERM_BENCH, BENCH_ERRORS, &errors, 4);
+  sim_get(TERM_BENCH, BENCH_BYTES, &bytes, 4);
+  CHECK(errors == 0, "write %d: %d errors", len, errors);
+  CHECK(bytes == len, "write %d: firmware got %d bytes", len, bytes);
+  free(buf);
+}
+
+/**
+ * COUNTER data that skips three packets, repeats one and has a flipped
+ * bit: two drops and one word error.  Also through rdwr_local with no
+ * packet size yet, which mustn't divide by it.
+ **/
+static void test_write_dropped(void) {
+  uint32_t packet = gRdwrCmd.ep_buffer_size/4, n = 32*packet, i, w = 1000;
+  uint32_t *buf = malloc(n*4), errors=0, bits=0, dropped=0;
+  for (i=0; i<n; ++i, ++w) {
+    if (i == 5*packet) w += 3*packet;
+    if (i == 20*packet+7) w -= packet;
+    buf[i] = w;
+  }
+  buf[25*packet+1] ^= 1<<12;
+  sim_set(TERM_BENCH, BENCH_MODE, BENCH_PATTERN_COUNTER, 4);
+  sim_set(TERM_BENCH, BENCH_VERIFY, 1, 4);
+  sim_set(TERM_BENCH, BENCH_SEED, 1000, 4);
+  CHECK(!sim_rdwr(COMMAND_WRITE, TERM_BENCH, BENCH_DATA, (uint8_t*)buf, n*4, NULL), "dropped write");
+  sim_get(TERM_BENCH, BENCH_ERRORS, &errors, 4);
+  sim_get(TERM_BENCH, BENCH_BIT_ERRORS, &bits, 4);
+  sim_get(TERM_BENCH, BENCH_DROPPED, &dropped, 4);
+  CHECK(dropped == 2 && errors == 1 && bits == 1, "dropped write: %d dropped %d errors %d bits", dropped, errors, bits);
+  // a local write before the app started has no packet size to relock
+  // on, the word's bit count decides
+  packet = gRdwrCmd.ep_buffer_size;
+  gRdwrCmd.ep_buffer_size = 0;
+  CHECK(!rdwr_local(COMMAND_WRITE, TERM_BENCH, BENCH_DATA, (uint8_t*)buf, n*4), "dropped local write");
+  gRdwrCmd.ep_buffer_size = packet;
+  sim_get(TERM_BENCH, BENCH_ERRORS, &errors, 4);
+  sim_get(TERM_BENCH, BENCH_DROPPED, &dropped, 4);
+  CHECK(dropped + errors >= 3, "dropped local write: %d dropped %d errors", dropped, errors);
+  sim_set(TERM_BENCH, BENCH_VERIFY, 0, 4);
+  free(buf);
+}
+
+static void test_read(uint32_t len, uint32_t seed) {
+  uint8_t *buf = calloc(1, len), *expected = malloc(len);
+  prbs_fill(expected, len, seed);
+  sim_set(TERM_BENCH, BENCH_MODE, BENCH_PATTERN_PRBS, 4);
+  sim_set(TERM_BENCH, BENCH_SEED, seed, 4);
+  CHECK(!sim_rdwr(COMMAND_READ, TERM_BENCH, BENCH_DATA, buf, len, NULL), "read %d", len);
+  CHECK(!memcmp(buf, expected, len), "read %d: bad data", len);
+  free(buf);
+  free(expected);
+}
+
+/**
+ * Streams PRBS for at least len bytes, stops the stream and checks the
+ * data and the stream ack.
+ **/
+static void test_stream(uint32_t len, uint32_t seed) {
+  uint32_t max = len + (64<<10), got = 0;
+  uint8_t *buf = calloc(1, max), *expected = malloc(max);
+  rdwr_data_header_t h = { COMMAND_READ, TERM_BENCH, BENCH_DATA, RDWR_STREAM_LENGTH };
+  stream_ack_pkt_t ack;
+  int32_t n;
+  int stopped = 0, spins = 0;
+
+  prbs_fill(expected, max, seed);
+  sim_set(TERM_BENCH, BENCH_MODE, BENCH_PATTERN_PRBS, 4);
+  sim_set(TERM_BENCH, BENCH_SEED, seed, 4);
+  CHECK(!sim_vendor_cmd(VC_HI_RDWR, 0x40, TERM_BENCH, 0xffff, sizeof(h), (uint8_t*)&h), "stream start");
+  for (;;) {
+    sim_data_thread();
+    n = sim_ep_read(CY_FX_EP_CONSUMER, buf+got, max-got);
+    if (n < 0 || ++spins > 100000) break;
+    got += n;
+    if (stopped && n && (got % gRdwrCmd.ep_buffer_size)) break; // short packet
+    if (!stopped && got >= len) {
+      CHECK(!sim_vendor_cmd(VC_STREAM_STOP, 0x40, 0, 0, 0, NULL), "stream stop");
+      stopped = 1;
+    }
+  }
+  CHECK(n >= (int32_t)sizeof(ack), "stream %d: no ack", len);
+  got -= sizeof(ack);
+  memcpy(&ack, buf+got, sizeof(ack));
+  CHECK(ack.ack.id == ACK_PKT_ID && !ack.ack.status, "stream %d: bad ack", len);
+  CHECK(ack.total_lo == got && !ack.total_hi, "stream %d: ack total %d got %d", len, ack.total_lo, got);
+  CHECK(got >= len && !memcmp(buf, expected, got), "stream %d: bad data", len);
+  CHECK(gRdwrCmd.done, "stream %d: not done", len);
+  free(buf);
+  free(expected);
+}
+
+/**
+ * RDWR_FLAG_FRAMING stream: every buffer starts with a frame_hdr_t, the
+ * seqs count up and the payloads put together are the same PRBS.
+ **/
+static void test_stream_framed(uint32_t len, uint32_t seed) {
+  uint32_t max = len + (128<<10), got = 0, off = 0, payload = 0, seq = 0;
+  uint8_t *buf = calloc(1, max), *expected = malloc(max);
+  rdwr_data_header_t h = { COMMAND_READ, TERM_BENCH, BENCH_DATA, RDWR_STREAM_LENGTH, 0, RDWR_FLAG_FRAMING };
+  stream_ack_pkt_t ack;
+  frame_hdr_t f;
+  int32_t n;
+  int stopped = 0, spins = 0;
+
+  prbs_fill(expected, max, seed);
+  sim_set(TERM_BENCH, BENCH_MODE, BENCH_PATTERN_PRBS, 4);
+  sim_set(TERM_BENCH, BENCH_SEED, seed, 4);
+  CHECK(!sim_vendor_cmd(VC_HI_RDWR, 0x40, TERM_BENCH, 0xffff, sizeof(h), (uint8_t*)&h), "framed start");
+  for (;;) {
+    sim_data_thread();
+    n = sim_ep_read(CY_FX_EP_CONSUMER, buf+got, max-got);
+    if (n < 0 || ++spins > 100000) break;
+    got += n;
+    if (stopped && n && (got % gRdwrCmd.ep_buffer_size)) break;
+    if (!stopped && got >= len) {
+      CHECK(!sim_vendor_cmd(VC_STREAM_STOP, 0x40, 0, 0, 0, NULL), "framed stop");
+      stopped = 1;
+    }
+  }
+  CHECK(n >= (int32_t)sizeof(ack), "framed %d: no ack", len);
+  got -= sizeof(ack);
+  for (; off < got; off += sizeof(f) + f.count, ++seq) {
+    memcpy(&f, buf+off, sizeof(f));
+    if (f.id != FRAME_HDR_ID || f.seq != seq || f.status || !f.count) break;
+    if (memcmp(buf+off+sizeof(f), expected+payload, f.count)) break;
+    payload += f.count;
+  }
+  CHECK(off == got && seq > 1, "framed %d: bad frame %d at %d", len, seq, off);
+  memcpy(&ack, buf+got, sizeof(ack));
+  CHECK(ack.ack.id == ACK_PKT_ID && !ack.ack.status, "framed %d: bad ack", len);
+  CHECK(ack.total_lo == payload, "framed %d: ack total %d payload %d", len, ack.total_lo, payload);
+  free(buf);
+  free(expected);
+}
+
+static void pattern_fill(uint8_t *buf, uint32_t len, uint32_t mode, uint32_t seed) {
+  uint16_t *s = (uint16_t*)buf;
+  uint32_t *w = (uint32_t*)buf, n;
+  switch (mode) {
+    case BENCH_PATTERN_PRBS: prbs_fill(buf, len, seed); break;
+    case BENCH_PATTERN_RAMP: for (n=0; n<len/2; ++n) s[n] = seed+n; break;
+    default: for (n=0; n<len/4; ++n) w[n] = seed; break;
+  }
+}
+
+static uint32_t unrle(const uint8_t *in, uint32_t n, uint8_t *out) {
+  const uint8_t *end = in + n;
+  uint8_t *o = out;
+  uint32_t k;
+  while (in < end) {
+    k = *in++;
+    if (k < 0x80) {
+      memcpy(o, in, 2*(k+1));
+      o += 2*(k+1);
+      in += 2*(k+1);
+    } else {
+      for (k -= 0x80-3; k--; o += 2) memcpy(o, in, 2);
+      in += 2;
+    }
+  }
+  return o - out;
+}
+
+static uint32_t undelta(const uint8_t *in, uint32_t n, uint8_t *out) {
+  const uint8_t *end = in + n;
+  uint16_t *o = (uint16_t*)out, prev = 0, z;
+  int shift;
+  while (in < end) {
+    for (z=0, shift=0; *in & 0x80; shift += 7) z |= (*in++ & 0x7f) << shift;
+    z |= *in++ << shift;
+    prev += (z >> 1) ^ -(z & 1);
+    *o++ = prev;
+  }
+  return (uint8_t*)o - out;
+}
+
+typedef struct {
+  uint32_t raw, wire, frames, compressed;
+  uint64_t fw_ns;
+} compress_run_t;
+
+/**
+ * RDWR_FLAG_COMPRESS stream of the bench pattern until len bytes came
+ * over the wire: every frame decodes to the pattern, starts on a packet
+ * and the ack counts the bytes before compression.  COMPRESS_RAW is the
+ * plain framed stream for comparison.
+ **/
+static compress_run_t stream_compressed(uint8_t codec, uint32_t mode, uint32_t seed, uint32_t len) {
+  uint32_t max = len + (128<<10), got = 0, off = 0, seq = 0, ep = gRdwrCmd.ep_buffer_size, k;
+  uint8_t *buf = calloc(1, max), *expected = malloc(16*max), *out = malloc(64<<10), *data;
+  rdwr_data_header_t h = { COMMAND_READ, TERM_BENCH, BENCH_DATA, RDWR_STREAM_LENGTH, 0,
+                           RDWR_FLAG_FRAMING | RDWR_FLAG_COMPRESS(codec) };
+  compress_run_t r = { 0 };
+  stream_ack_pkt_t ack;
+  compress_hdr_t c;
+  frame_hdr_t f;
+  sim_stats_t s0 = gSimStats;
+  int32_t n;
+  int stopped = 0, spins = 0;
+
+  pattern_fill(expected, 16*max, mode, seed);
+  sim_set(TERM_BENCH, BENCH_MODE, mode, 4);
+  sim_set(TERM_BENCH, BENCH_SEED, seed, 4);
+  CHECK(!sim_vendor_cmd(VC_HI_RDWR, 0x40, TERM_BENCH, 0xffff, sizeof(h), (uint8_t*)&h), "compressed start");
+  for (;;) {
+    sim_data_thread();
+    n = sim_ep_read(CY_FX_EP_CONSUMER, buf+got, max-got);
+    if (n < 0 || ++spins > 100000) break;
+    got += n;
+    if (stopped && n && (got % ep)) break;
+    if (!stopped && got >= len) {
+      CHECK(!sim_vendor_cmd(VC_STREAM_STOP, 0x40, 0, 0, 0, NULL), "compressed stop");
+      stopped = 1;
+    }
+  }
+  r.fw_ns = gSimStats.fw_ns - s0.fw_ns;
+  CHECK(n >= (int32_t)sizeof(ack), "compressed %d: no ack", codec);
+  got -= sizeof(ack);
+  while (off < got) {
+    memcpy(&f, buf+off, sizeof(f));
+    if (codec) {
+      memcpy(&c, buf+off+sizeof(f), sizeof(c));
+    } else {
+      c.codec = COMPRESS_RAW;
+      c.raw_count = f.count;
+    }
+    if (f.id != FRAME_HDR_ID || f.seq != seq || f.status || f.count < (codec ? sizeof(c) : 1)) break;
+    data = buf+off+sizeof(f)+(codec ? sizeof(c) : 0);
+    n = f.count - (codec ? sizeof(c) : 0);
+    if (c.codec == COMPRESS_RLE) k = unrle(data, n, out);
+    else if (c.codec == COMPRESS_DELTA) k = undelta(data, n, out);
+    else memcpy(out, data, k = n);
+    if ((c.codec != COMPRESS_RAW && c.codec != codec) || k != c.raw_count ||
+        r.raw + k > 16*max || memcmp(out, expected + r.raw, k)) break;
+    r.compressed += c.codec != COMPRESS_RAW;
+    r.raw += k;
+    off += codec ? (sizeof(f) + f.count + ep - 1) & ~(ep - 1) : sizeof(f) + f.count;
+    ++seq;
+  }
+  r.wire = got;
+  r.frames = seq;
+  CHECK(off == got && seq > 1, "compressed %d mode %d: bad frame %d at %d", codec, mode, seq, off);
+  memcpy(&ack, buf+got, sizeof(ack));
+  CHECK(ack.ack.id == ACK_PKT_ID && !ack.ack.status, "compressed %d: bad ack", codec);
+  CHECK(ack.total_lo == r.raw, "compressed %d: ack total %d raw %d", codec, ack.total_lo, r.raw);
+  free(buf);
+  free(expected);
+  free(out);
+  return r;
+}
+
+static void test_stream_compressed(void) {
+  compress_run_t r;
+  rdwr_data_header_t h = { COMMAND_READ, TERM_BENCH, BENCH_DATA, RDWR_STREAM_LENGTH, 0, RDWR_FLAG_COMPRESS(COMPRESS_RLE) };
+  r = stream_compressed(COMPRESS_RLE, BENCH_PATTERN_CONSTANT, 0, 256<<10);
+  CHECK(r.compressed == r.frames && r.raw > r.wire, "rle constant: %d of %d frames compressed", r.compressed, r.frames);
+  r = stream_compressed(COMPRESS_DELTA, BENCH_PATTERN_RAMP, 0xfff0, 256<<10);
+  CHECK(r.compressed == r.frames && r.raw > r.wire, "delta ramp: %d of %d frames compressed", r.compressed, r.frames);
+  r = stream_compressed(COMPRESS_RLE, BENCH_PATTERN_RAMP, 7, 256<<10); // all literals
+  CHECK(!r.compressed, "rle ramp: %d frames compressed", r.compressed);
+  r = stream_compressed(COMPRESS_DELTA, BENCH_PATTERN_PRBS, 9, 256<<10);
+  CHECK(!r.compressed, "delta prbs: %d frames compressed", r.compressed);
+  // without framing the stream doesn't start
+  gRdwrCmdInitStat = 0;
+  CHECK(!sim_vendor_cmd(VC_HI_RDWR, 0x40, TERM_BENCH, 0xffff, sizeof(h), (uint8_t*)&h) &&
+        gRdwrCmd.done && gRdwrCmdInitStat, "unframed compressed stream started");
+  gSimFlags = RDWR_FLAG_COMPRESS(COMPRESS_RLE);
+  CHECK(sim_rdwr(COMMAND_READ, TERM_BENCH, BENCH_DATA, (uint8_t*)&r, 64, NULL) != 0, "compressed read");
+  gSimFlags = 0;
+}
+
+/**
+ * Compressed streams of each pattern against the uncompressed framed
+ * stream (same Src buffers): wire bytes per payload byte and firmware
+ * time.  With the
+ * usb rate (HS about 40MB/s, SS about 380MB/s) the wire fraction gives
+ * the effective rate as long as the firmware keeps up.
+ **/
+static void perf_compress(void) {
+  static const char *codecs[] = { "raw", "rle", "delta" };
+  static const char *modes[] = { "counter", "prbs", "constant", "static", "ramp" };
+  uint32_t pats[] = { BENCH_PATTERN_CONSTANT, BENCH_PATTERN_RAMP, BENCH_PATTERN_PRBS };
+  compress_run_t r;
+  uint8_t codec;
+  int i;
+  printf("%-14s %8s %10s %10s %8s %8s\n", "stream", "raw KB", "wire KB", "wire %", "frames", "fw ns/KB");
+  for (i=0; i<3; ++i)
+    for (codec=COMPRESS_RAW; codec<=COMPRESS_DELTA; ++codec) {
+      r = stream_compressed(codec, pats[i], pats[i] == BENCH_PATTERN_CONSTANT ? 0 : 0x12345678, 1<<20);
+      printf("%-5s %-8s %8d %10d %10.1f %8d %8.0f\n", codecs[codec], modes[pats[i]], r.raw>>10, r.wire>>10,
+             100.0*r.wire/r.raw, r.frames, r.fw_ns*1024.0/r.raw);
+    }
+}
+
+/**
+ * Numbered gets: the seq comes back in the ack, a retry is answered from
+ * the cache without reading the terminal again and old hosts sending the
+ * short header still work.
+ **/
+static void test_seq(void) {
+  rdwr_data_header_t h = { COMMAND_GET, TERM_BENCH, BENCH_PHY_ERRORS, 4 };
+  uint32_t val;
+  ack_pkt_t ack;
+  uint8_t buf[32];
+
+  sim_set(TERM_BENCH, BENCH_PHY_ERRORS, 0, 4);
+  gSimPhyErrors = 3;
+  gSimSeq = 7;
+  CHECK(!sim_get(TERM_BENCH, BENCH_PHY_ERRORS, &val, 4), "seq get");
+  CHECK(val == 3, "seq get %d", val);
+  gSimPhyErrors = 2; // reading the terminal again would return 5
+  CHECK(!sim_rdwr(COMMAND_GET, TERM_BENCH, BENCH_PHY_ERRORS, (uint8_t*)&val, 4, &ack), "retry");
+  CHECK(val == 3 && ack.seq == 7, "retry not replayed %d seq %d", val, ack.seq);
+  gSimSeq = 8;
+  CHECK(!sim_get(TERM_BENCH, BENCH_PHY_ERRORS, &val, 4), "next seq");
+  CHECK(val == 5, "next seq %d", val);
+  gSimSeq = 0;
+
+  CHECK(!sim_vendor_cmd(VC_HI_RDWR, 0x40, TERM_BENCH, 4, RDWR_HEADER_V0_SIZE, (uint8_t*)&h), "v0 header");
+  sim_data_thread();
+  CHECK(sim_ep_read(CY_FX_EP_CONSUMER, buf, sizeof(buf)) == 4, "v0 data");
+  CHECK(sim_ep_read(CY_FX_EP_CONSUMER, (uint8_t*)&ack, sizeof(ack)) == sizeof(ack) &&
+        ack.id == ACK_PKT_ID && !ack.status && !ack.seq, "v0 ack");
+}
+
+/**
+ * RDWR_FLAG_EXT_ACK transactions end with the metrics.
+ **/
+static void test_ext_ack(uint8_t command, uint32_t len) {
+  uint8_t *buf = calloc(1, len);
+  ext_ack_pkt_t *e = &gSimExtAck;
+  sim_set(TERM_BENCH, BENCH_MODE, BENCH_PATTERN_COUNTER, 4);
+  gSimFlags = RDWR_FLAG_EXT_ACK;
+  memset(e, 0xff, sizeof(*e));
+  CHECK(!sim_rdwr(command, TERM_BENCH, BENCH_DATA, buf, len, NULL), "ext ack %d", len);
+  CHECK(e->bytes == len && e->ticks_hz == HWTIMER_HZ && e->t_end - e->t_start < HWTIMER_HZ &&
+        !e->handler_status && !e->dma_status, "ext ack %d: bytes %d hz %d", len, e->bytes, e->ticks_hz);
+  gSimFlags = 0;
+  CHECK(!sim_rdwr(command, TERM_BENCH, BENCH_DATA, buf, len, NULL), "ack after ext ack %d", len);
+  free(buf);
+}
+
+/**
+ * Writes to SIM_TERM_SLOW, a sink slower than the link: its handler takes
+ * what fits, returns IO_HANDLER_BUSY and gets the rest after
+ * io_handler_ready.  From the host and through rdwr_local the data
+ * arrives whole in about len/gSimSlowRate simulated ms.  A sink that
+ * never gets ready times rdwr_local out.
+ **/
+static void test_busy_write(uint32_t len) {
+  uint8_t *buf = malloc(len);
+  uint32_t t, busy = gSimSlowBusy, ms = len/gSimSlowRate;
+  ext_ack_pkt_t *e = &gSimExtAck;
+  prbs_fill(buf, len, 21);
+
+  memset(gSimSlow, 0, len+16);
+  gSimFlags = RDWR_FLAG_EXT_ACK;
+  t = sim_time();
+  CHECK(!sim_rdwr(COMMAND_WRITE, SIM_TERM_SLOW, 16, buf, len, NULL), "busy write %d", len);
+  t = sim_time() - t;
+  gSimFlags = 0;
+  CHECK(!memcmp(gSimSlow+16, buf, len), "busy write %d: bad data", len);
+  CHECK(e->bytes == len && !e->handler_status && e->wait_ticks >= (ms-1)*(HWTIMER_HZ/1000),
+        "busy write %d: bytes %d status %d wait %d", len, e->bytes, e->handler_status, e->wait_ticks);
+  CHECK(gSimSlowBusy > busy && t+1 >= ms && t <= ms+ms/4+2, "busy write %d: %d busy in %d ms",
+        len, gSimSlowBusy-busy, t);
+
+  memset(gSimSlow, 0, len);
+  busy = gSimSlowBusy;
+  t = sim_time();
+  CHECK(!rdwr_local(COMMAND_WRITE, SIM_TERM_SLOW, 0, buf, len), "local busy write %d", len);
+  t = sim_time() - t;
+  CHECK(!memcmp(gSimSlow, buf, len), "local busy write %d: bad data", len);
+  CHECK(gSimSlowBusy > busy && t+1 >= ms && t <= ms+ms/4+2, "local busy write %d: %d busy in %d ms",
+        len, gSimSlowBusy-busy, t);
+
+  gSimSlowRate = 0;
+  CHECK(rdwr_local(COMMAND_WRITE, SIM_TERM_SLOW, 0, buf, len) == CY_U3P_ERROR_TIMEOUT, "stuck sink");
+  gSimSlowRate = 4096;
+  CHECK(!sim_rdwr(COMMAND_WRITE, SIM_TERM_SLOW, 0, buf, 64, NULL), "write after stuck sink");
+  free(buf);
+}
+
+/**
+ * SIM_TERM_VEC, a v2 terminal: reads and writes whole and in pieces
+ * (gSimVecStep bytes a call), reads the handler cuts short (the host
+ * gets a short transfer, with a zlp if it's whole packets), a stream
+ * in pieces that only sends whole buffers and rdwr_local with several
+ * buffers a call.
+ **/
+static void test_vec(void) {
+  uint32_t ep = gRdwrCmd.ep_buffer_size, len = ep*7+12, max = 64<<10;
+  uint32_t ends[] = { ep*3+5, ep*2, 0 };
+  uint32_t calls, iovs, i, got = 0, val;
+  uint8_t *buf = malloc(max+(64<<10)), *expected = malloc(max+(64<<10));
+  rdwr_data_header_t h = { COMMAND_READ, SIM_TERM_VEC, 0, RDWR_STREAM_LENGTH };
+  ext_ack_pkt_t *e = &gSimExtAck;
+  stream_ack_pkt_t ack;
+  int32_t n;
+  int stopped = 0, spins = 0;
+
+  for (i=0; i<max+(64<<10); ++i) expected[i] = SIM_VEC_BYTE(i);
+  gSimVecEnd = gSimVecStep = 0xFFFFFFFF;
+  calls = gSimVecCalls;
+  CHECK(!sim_rdwr(COMMAND_READ, SIM_TERM_VEC, 0, buf, len, NULL) && !memcmp(buf, expected, len), "vec read %d", len);
+  CHECK(gSimVecCalls - calls == (len+2*ep-1)/(2*ep) || ep == 1024, "vec read %d: %d calls", len, gSimVecCalls - calls);
+  gSimVecStep = 100;
+  calls = gSimVecCalls;
+  memset(buf, 0, len);
+  CHECK(!sim_rdwr(COMMAND_READ, SIM_TERM_VEC, 0, buf, len, NULL) && !memcmp(buf, expected, len), "vec read %d in pieces", len);
+  CHECK(gSimVecCalls - calls >= len/100, "vec read %d: %d calls in pieces", len, gSimVecCalls - calls);
+
+  gSimVecStep = 0xFFFFFFFF;
+  gSimFlags = RDWR_FLAG_EXT_ACK;
+  for (i=0; i<3; ++i) {
+    gSimVecEnd = ends[i];
+    memset(buf, 0xee, len);
+    CHECK(!sim_rdwr(COMMAND_READ, SIM_TERM_VEC, 0, buf, len, NULL), "vec short read %d", ends[i]);
+    CHECK(e->bytes == ends[i] && !memcmp(buf, expected, ends[i]) && buf[ends[i]] == 0xee,
+          "vec short read %d: %d bytes", ends[i], e->bytes);
+  }
+  gSimFlags = 0;
+  gSimVecEnd = 0xFFFFFFFF;
+  CHECK(!sim_get(TERM_BENCH, BENCH_SEED, &val, 4), "get after short read");
+
+  gSimVecStep = 300;
+  prbs_fill(buf, len, 31);
+  memset(gSimSlow, 0, len+8);
+  CHECK(!sim_rdwr(COMMAND_WRITE, SIM_TERM_VEC, 8, buf, len, NULL) && !memcmp(gSimSlow+8, buf, len), "vec write %d", len);
+
+  // only whole buffers go out, the one being filled makes way for the ack
+  gSimVecStep = 100;
+  memset(buf, 0, max);
+  CHECK(!sim_vendor_cmd(VC_HI_RDWR, 0x40, SIM_TERM_VEC, 0xffff, sizeof(h), (uint8_t*)&h), "vec stream start");
+  for (;;) {
+    sim_data_thread();
+    n = sim_ep_read(CY_FX_EP_CONSUMER, buf+got, max+(64<<10)-got);
+    if (n < 0 || ++spins > 100000) break;
+    got += n;
+    if (stopped && n && (got % ep)) break;
+    CHECK(!n || !(got % ep) || stopped, "vec stream short packet at %d", got);
+    if (!stopped && got >= max) {
+      CHECK(!sim_vendor_cmd(VC_STREAM_STOP, 0x40, 0, 0, 0, NULL), "vec stream stop");
+      stopped = 1;
+    }
+  }
+  CHECK(n >= (int32_t)sizeof(ack), "vec stream: no ack");
+  got -= sizeof(ack);
+  memcpy(&ack, buf+got, sizeof(ack));
+  CHECK(ack.ack.id == ACK_PKT_ID && !ack.ack.status && ack.total_lo == got, "vec stream: ack total %d got %d",
+        ack.total_lo, got);
+  CHECK(!memcmp(buf, expected, got), "vec stream: bad data");
+
+  gSimVecStep = 0xFFFFFFFF;
+  calls = gSimVecCalls;
+  iovs = gSimVecIovs;
+  CHECK(!rdwr_local(COMMAND_READ, SIM_TERM_VEC, 0, buf, max) && gRdwrCallBytes == max &&
+        !memcmp(buf, expected, max), "local vec read");
+  CHECK(gSimVecIovs - iovs == max/ep && gSimVecCalls - calls == (max/ep+IO_HANDLER_IOV_MAX-1)/IO_HANDLER_IOV_MAX,
+        "local vec read: %d buffers in %d calls", gSimVecIovs - iovs, gSimVecCalls - calls);
+  gSimVecEnd = 1000;
+  CHECK(!rdwr_local(COMMAND_READ, SIM_TERM_VEC, 0, buf, max) && gRdwrCallBytes == 1000, "local vec short read %d",
+        gRdwrCallBytes);
+  gSimVecEnd = 0xFFFFFFFF;
+  free(buf);
+  free(expected);
+}
+
+/**
+ * SIM_TERM_ASYNC: an os timer commits pool buffers the way an isr would
+ * and the data thread sends them as they come, more than one queued at a
+ * time.  Whole reads, reads the producer ends short (with a zlp when
+ * that's whole packets), a stream, a short commit that isn't the last
+ * (refused), an abort and reads the host gave up on, each stopping the
+ * producer at the end.
+ **/
+static void test_async(void) {
+  uint32_t ep = gRdwrCmd.ep_buffer_size, len = 3*ASYNC_BUFFER_SIZE+100, max = 64<<10;
+  uint32_t ends[] = { ASYNC_BUFFER_SIZE+ep+3, 2*ASYNC_BUFFER_SIZE };
+  uint32_t i, got = 0, val, stops;
+  uint8_t *buf = malloc(max+(64<<10)), *expected = malloc(max+(64<<10));
+  rdwr_data_header_t h = { COMMAND_READ, SIM_TERM_ASYNC, 0, RDWR_STREAM_LENGTH };
+  ext_ack_pkt_t *e = &gSimExtAck;
+  stream_ack_pkt_t sack;
+  ack_pkt_t ack;
+  int32_t n;
+  int stopped = 0, spins = 0;
+
+  for (i=0; i<max+(64<<10); ++i) expected[i] = SIM_VEC_BYTE(i);
+  gSimVecEnd = 0xFFFFFFFF;
+  gSimFlags = RDWR_FLAG_EXT_ACK;
+  CHECK(!sim_rdwr(COMMAND_READ, SIM_TERM_ASYNC, 0, buf, len, NULL) && !memcmp(buf, expected, len), "async read %d", len);
+  CHECK(e->bytes == len && gAsyncStats.sent == 4 && gAsyncStats.max_ready >= 2 && !gSimAsyncRunning,
+        "async read %d: %d bytes %d sent %d queued", len, e->bytes, gAsyncStats.sent, gAsyncStats.max_ready);
+  for (i=0; i<2; ++i) {
+    gSimVecEnd = ends[i];
+    memset(buf, 0xee, len);
+    CHECK(!sim_rdwr(COMMAND_READ, SIM_TERM_ASYNC, 0, buf, len, NULL), "async short read %d", ends[i]);
+    CHECK(e->bytes == ends[i] && !memcmp(buf, expected, ends[i]) && buf[ends[i]] == 0xee && !gSimAsyncRunning,
+          "async short read %d: %d bytes", ends[i], e->bytes);
+  }
+  gSimFlags = 0;
+  gSimVecEnd = 0xFFFFFFFF;
+
+  memset(buf, 0, max);
+  CHECK(!sim_vendor_cmd(VC_HI_RDWR, 0x40, SIM_TERM_ASYNC, 0xffff, sizeof(h), (uint8_t*)&h), "async stream start");
+  for (;;) {
+    sim_data_thread();
+    n = sim_ep_read(CY_FX_EP_CONSUMER, buf+got, max+(64<<10)-got);
+    if (n < 0 || ++spins > 100000) break;
+    got += n;
+    if (stopped && n && (got % ep)) break;
+    if (!stopped && got >= max) {
+      CHECK(!sim_vendor_cmd(VC_STREAM_STOP, 0x40, 0, 0, 0, NULL), "async stream stop");
+      stopped = 1;
+    }
+  }
+  CHECK(n >= (int32_t)sizeof(sack), "async stream: no ack");
+  got -= sizeof(sack);
+  memcpy(&sack, buf+got, sizeof(sack));
+  CHECK(sack.ack.id == ACK_PKT_ID && !sack.ack.status && sack.total_lo == got && got >= max,
+        "async stream: ack total %d got %d", sack.total_lo, got);
+  CHECK(!memcmp(buf, expected, got) && !gSimAsyncRunning, "async stream: bad data");
+
+  // a short buffer that isn't the last would end the host's read early
+  gSimAsyncChunk = 2*ep+3;
+  h.transfer_length = len;
+  CHECK(!sim_vendor_cmd(VC_HI_RDWR, 0x40, SIM_TERM_ASYNC, 0, sizeof(h), (uint8_t*)&h), "async short commit start");
+  // nothing gets committed so sim_data_thread would wait for ever
+  for (i=0; i<4; ++i) glAsyncHandler.handler_dma_cb();
+  n = sim_ep_read(CY_FX_EP_CONSUMER, buf, max);
+  CHECK(!n && gSimAsyncStatus == CY_U3P_ERROR_BAD_ARGUMENT && !gAsyncStats.commits && !gRdwrCmd.done,
+        "async short commit: %d bytes status %d", n, gSimAsyncStatus);
+  CHECK(!sim_vendor_cmd(VC_ABORT, 0x40, 0, 0, 0, NULL), "async short commit abort");
+  sim_data_thread();
+  n = sim_ep_read(CY_FX_EP_CONSUMER, buf, max);
+  memcpy(&ack, buf, sizeof(ack));
+  CHECK(gRdwrCmd.done && n == sizeof(ack) && (ack.status & RDWR_STATUS_ABORTED), "async short commit: no abort ack");
+  gSimAsyncChunk = ASYNC_BUFFER_SIZE;
+
+  h.transfer_length = 1<<20;
+  CHECK(!sim_vendor_cmd(VC_HI_RDWR, 0x40, SIM_TERM_ASYNC, 0, sizeof(h), (uint8_t*)&h), "async abort start");
+  sim_data_thread();
+  sim_ep_read(CY_FX_EP_CONSUMER, buf, max);
+  sim_data_thread();
+  CHECK(!gRdwrCmd.done && gSimAsyncRunning, "async abort: finished early");
+  CHECK(!sim_vendor_cmd(VC_ABORT, 0x40, 0, 0, 0, NULL), "async abort");
+  sim_data_thread();
+  got = 0;
+  while ((n = sim_ep_read(CY_FX_EP_CONSUMER, buf+got, max-got)) > 0) got += n;
+  memcpy(&ack, buf, sizeof(ack));
+  CHECK(gRdwrCmd.done && got == sizeof(ack) && ack.id == ACK_PKT_ID && (ack.status & RDWR_STATUS_ABORTED) &&
+        !gSimAsyncRunning, "async abort: %d bytes after abort", got);
+  CHECK(!sim_get(TERM_BENCH, BENCH_SEED, &val, 4), "get after async abort");
+
+  // the host gives up on a read without VC_ABORT: the next one (or
+  // another terminal) stops the producer first
+  for (i=0; i<2; ++i) {
+    stops = gSimAsyncStops;
+    CHECK(!sim_vendor_cmd(VC_HI_RDWR, 0x40, SIM_TERM_ASYNC, 0, sizeof(h), (uint8_t*)&h), "async abandoned start");
+    sim_data_thread();
+    CHECK(gSimAsyncRunning && gSimAsyncStops == stops, "async abandoned: not running");
+    while (sim_ep_read(CY_FX_EP_CONSUMER, buf, max) > 0);
+    if (!i) {
+      memset(buf, 0xee, len);
+      CHECK(!sim_rdwr(COMMAND_READ, SIM_TERM_ASYNC, 0, buf, len, NULL) && !memcmp(buf, expected, len),
+            "async read after an abandoned one");
+    } else {
+      CHECK(!sim_get(TERM_BENCH, BENCH_SEED, &val, 4), "get after an abandoned async read");
+    }
+    CHECK(gSimAsyncStops == stops+2-i && !gSimAsyncRunning, "async abandoned %d: %d stops", i, gSimAsyncStops - stops);
+  }
+  free(buf);
+  free(expected);
+}
+
+/**
+ * MEMBENCH runs start on the write and run from the app thread
+ * (membench_service here) once the transaction is over.  Copies and dma
+ * calls over a size sweep with the cache off and on.
+ **/
+static void test_membench(void) {
+  uint32_t sizes[] = { 64, 1000, 4096, MEMBENCH_MAX_SIZE };
+  uint32_t i, method, dcache, val, get_ticks, commit_ticks, commits;
+
+  sim_set(TERM_MEMBENCH, MEMBENCH_ITERS, 10, 4);
+  for (dcache=0; dcache<2; ++dcache) {
+    sim_set(TERM_MEMBENCH, MEMBENCH_DCACHE, dcache, 4);
+    for (method=MEMBENCH_COPY_MEMCOPY; method<=MEMBENCH_DMA_CALLS; ++method) {
+      sim_set(TERM_MEMBENCH, MEMBENCH_METHOD, method, 4);
+      for (i=0; i<sizeof(sizes)/sizeof(sizes[0]); ++i) {
+        sim_set(TERM_MEMBENCH, MEMBENCH_SIZE, sizes[i], 4);
+        CHECK(!sim_set(TERM_MEMBENCH, MEMBENCH_RUN, 1, 4), "membench run %d %d", method, sizes[i]);
+        CHECK(!sim_get(TERM_MEMBENCH, MEMBENCH_RUN, &val, 4) && val == 1, "membench %d %d: not pending", method, sizes[i]);
+        CHECK(sim_set(TERM_MEMBENCH, MEMBENCH_SIZE, 64, 4), "membench set while pending");
+        commits = gSimStats.commits;
+        membench_service();
+        commits = gSimStats.commits - commits;
+        CHECK(commits == (method == MEMBENCH_DMA_CALLS ? 10 : 0), "membench %d %d: %d commits", method, sizes[i], commits);
+        sim_get(TERM_MEMBENCH, MEMBENCH_RUN, &val, 4);
+        CHECK(!val, "membench %d %d: still pending", method, sizes[i]);
+        sim_get(TERM_MEMBENCH, MEMBENCH_STATUS, &val, 4);
+        CHECK(!val, "membench %d %d dcache %d: status %d", method, sizes[i], dcache, val);
+      }
+    }
+  }
+  sim_get(TERM_MEMBENCH, MEMBENCH_GET_TICKS, &get_ticks, 4);
+  sim_get(TERM_MEMBENCH, MEMBENCH_COMMIT_TICKS, &commit_ticks, 4);
+  sim_get(TERM_MEMBENCH, MEMBENCH_ELAPSED, &val, 4);
+  CHECK(val == get_ticks + commit_ticks, "membench dma ticks %d != %d + %d", val, get_ticks, commit_ticks);
+  CHECK(sim_set(TERM_MEMBENCH, MEMBENCH_SIZE, MEMBENCH_MAX_SIZE+1, 4) == 0 &&
+        sim_set(TERM_MEMBENCH, MEMBENCH_RUN, 1, 4), "membench oversize run started");
+  sim_set(TERM_MEMBENCH, MEMBENCH_SIZE, 4096, 4);
+  sim_set(TERM_MEMBENCH, MEMBENCH_DCACHE, 0, 4);
+  sim_set(TERM_MEMBENCH, MEMBENCH_METHOD, MEMBENCH_COPY_MEMCOPY, 4);
+}
+
+/**
+ * VC_TIME follows the simulated clock and the 64 bit timebase survives
+ * hwtimer_ticks wrapping.
+ **/
+static void test_time(void) {
+  time_pkt_t t0, t1;
+  uint64_t a, b;
+  CHECK(!sim_vendor_cmd(VC_TIME, 0xc0, 0, 0, sizeof(t0), (uint8_t*)&t0), "time");
+  CyU3PThreadSleep(10);
+  CHECK(!sim_vendor_cmd(VC_TIME, 0xc0, 0, 0, sizeof(t1), (uint8_t*)&t1), "time");
+  a = ((uint64_t)t0.ticks_hi<<32) | t0.ticks_lo;
+  b = ((uint64_t)t1.ticks_hi<<32) | t1.ticks_lo;
+  CHECK(t1.ticks_hz == HWTIMER_HZ && b - a == 10*(HWTIMER_HZ/1000), "time %d -> %d", t0.ticks_lo, t1.ticks_lo);
+  CHECK(sim_vendor_cmd(VC_TIME, 0x40, 0, 0, sizeof(t0), (uint8_t*)&t0), "time out request not stalled");
+
+  CyU3PThreadSleep(0x80000000u);
+  a = hwtimer_ticks64();
+  CyU3PThreadSleep(0x80000000u);
+  b = hwtimer_ticks64();
+  CHECK(b - a == 0x80000000u && b >> 32, "ticks64 wrap %llx %llx", (unsigned long long)a, (unsigned long long)b);
+}
+
+/**
+ * Starts a len byte transaction, moves part of the data and aborts it.
+ * Checks the abort ack, that the channels weren't recreated and that the
+ * next transaction works.  Then an abort after a read's ack is committed
+ * (the host hasn't read it yet) has to leave data and ack alone.
+ **/
+static void test_abort(uint8_t command, uint32_t len) {
+  uint8_t *buf = calloc(1, len);
+  rdwr_data_header_t h = { command, TERM_BENCH, BENCH_DATA, len };
+  uint32_t creates, got = 0, val;
+  ack_pkt_t ack;
+  int32_t n;
+
+  sim_set(TERM_BENCH, BENCH_MODE, BENCH_PATTERN_PRBS, 4);
+  CHECK(!sim_vendor_cmd(VC_HI_RDWR, 0x40, TERM_BENCH, len & 0xffff, sizeof(h), (uint8_t*)&h), "abort start");
+  creates = gSimStats.creates;
+  if (command & bmSETWRITE) sim_ep_write(CY_FX_EP_PRODUCER, buf, len/4);
+  sim_data_thread();
+  if (!(command & bmSETWRITE)) sim_ep_read(CY_FX_EP_CONSUMER, buf, len/4);
+  sim_data_thread();
+  CHECK(!gRdwrCmd.done, "abort %d: finished early", len);
+
+  CHECK(!sim_vendor_cmd(VC_ABORT, 0x40, 0, 0, 0, NULL), "abort");
+  sim_data_thread();
+  CHECK(gRdwrCmd.done, "abort %d: not done", len);
+  // buffered data was dropped so the ack is next
+  while ((n = sim_ep_read(CY_FX_EP_CONSUMER, buf+got, len-got)) > 0) got += n;
+  CHECK(got == sizeof(ack), "abort %d: %d bytes after abort", len, got);
+  memcpy(&ack, buf, sizeof(ack));
+  CHECK(ack.id == ACK_PKT_ID && (ack.status & RDWR_STATUS_ABORTED), "abort %d: bad ack %04x", len, ack.status);
+  CHECK(gSimStats.creates == creates, "abort %d: channels recreated", len);
+
+  CHECK(!sim_vendor_cmd(VC_ABORT, 0x40, 0, 0, 0, NULL), "abort when idle");
+  CHECK(!sim_get(TERM_BENCH, BENCH_SEED, &val, 4), "get after abort");
+
+  // an abort that comes after the data thread acked leaves the ack alone
+  h.command = COMMAND_READ;
+  h.transfer_length = 64;
+  CHECK(!sim_vendor_cmd(VC_HI_RDWR, 0x40, TERM_BENCH, 64, sizeof(h), (uint8_t*)&h), "late abort start");
+  sim_data_thread();
+  CHECK(gRdwrCmd.done, "late abort: not done");
+  CHECK(!sim_vendor_cmd(VC_ABORT, 0x40, 0, 0, 0, NULL), "late abort");
+  sim_data_thread();
+  got = 0;
+  while ((n = sim_ep_read(CY_FX_EP_CONSUMER, buf+got, len-got)) > 0) got += n;
+  memcpy(&ack, buf+64, sizeof(ack));
+  CHECK(got == 64+sizeof(ack) && ack.id == ACK_PKT_ID && !ack.status, "late abort: %d bytes status %04x",
+        got, ack.status);
+  free(buf);
+}
+
+/**
+ * VC_ABORT stalls for a handler without handler_abort and the
+ * transaction runs to its normal end.
+ **/
+static void test_abort_unsupported(void) {
+  uint32_t len = 1<<20;
+  uint8_t *buf = calloc(1, len+64);
+  rdwr_data_header_t h = { COMMAND_READ, SIM_TERM_NOABORT, BENCH_DATA, len };
+  ack_pkt_t ack;
+  int32_t got;
+
+  CHECK(!sim_vendor_cmd(VC_HI_RDWR, 0x40, SIM_TERM_NOABORT, len & 0xffff, sizeof(h), (uint8_t*)&h), "noabort start");
+  sim_data_thread();
+  CHECK(!gRdwrCmd.done, "noabort: finished early");
+  CHECK(sim_vendor_cmd(VC_ABORT, 0x40, 0, 0, 0, NULL), "noabort: abort didn't stall");
+  CHECK(!gRdwrCmd.abort, "noabort: abort flag set");
+  got = sim_host_read(CY_FX_EP_CONSUMER, buf, len+64);
+  memcpy(&ack, buf+len, sizeof(ack));
+  CHECK(gRdwrCmd.done && got == (int32_t)(len+sizeof(ack)) && ack.id == ACK_PKT_ID && !ack.status,
+        "noabort: %d bytes status %04x", got, ack.status);
+  free(buf);
+}
+
+/**
+ * Times iters transactions of len bytes and prints the firmware time and
+ * sdk calls per transaction.
+ **/
+static void perf(const char *name, uint8_t command, uint32_t len, int iters) {
+  uint8_t *buf = calloc(1, len);
+  sim_stats_t s0;
+  uint64_t t0;
+  double n = iters;
+  int i;
+
+  sim_set(TERM_BENCH, BENCH_MODE, BENCH_PATTERN_STATIC, 4);
+  sim_set(TERM_BENCH, BENCH_VERIFY, 0, 4);
+  s0 = gSimStats;
+  t0 = now_ns();
+  for (i=0;i<iters;++i) {
+    if (sim_rdwr(command, TERM_BENCH, BENCH_DATA, buf, len, NULL)) {
+      CHECK(0, "%s transaction %d", name, i);
+      break;
+    }
+  }
+  printf("%-14s %8d %10.0f %10.0f %8.1f %8.1f %8.1f %8.1f\n", name, len,
+         (gSimStats.fw_ns - s0.fw_ns)/n,
+         (now_ns() - t0)/n,
+         (gSimStats.dma_cbs - s0.dma_cbs)/n,
+         (gSimStats.get_buffers - s0.get_buffers)/n,
+         (gSimStats.commits + gSimStats.discards - s0.commits - s0.discards)/n,
+         (gSimStats.resets - s0.resets)/n);
+  free(buf);
+}
+
+/**
+ * Reads the notify endpoint the way the host does, running notify_flush
+ * (the app thread's part) in between.  Returns the records read.
+ **/
+static int notify_read(notify_pkt_t *p, int max) {
+  int got = 0;
+  int32_t n;
+  for (;;) {
+    notify_flush();
+    n = sim_ep_read(CY_FX_EP_NOTIFY, (uint8_t*)(p+got), NOTIFY_PKT_SIZE);
+    if (n <= 0 || got + n/(int)sizeof(*p) > max) break;
+    got += n/sizeof(*p);
+  }
+  return got;
+}
+
+/**
+ * Records come out in order, several to a packet, and records posted
+ * while the host isn't reading are kept up to NOTIFY_RING with the rest
+ * showing up as a seq gap.
+ **/
+static void test_notify(void) {
+  notify_pkt_t p[NOTIFY_RING*2];
+  uint16_t seq;
+  int i, n;
+
+  notify_read(p, NOTIFY_RING*2); // anything from earlier tests
+  for (i=0;i<6;++i) notify_post(NOTIFY_USER, i, ~i);
+  n = notify_read(p, NOTIFY_RING*2);
+  CHECK(n == 6, "notify %d records", n);
+  seq = p[0].seq;
+  for (i=0;i<n;++i)
+    CHECK(p[i].event == NOTIFY_USER && p[i].arg0 == i && p[i].arg1 == ~i &&
+          p[i].seq == (uint16_t)(seq+i), "notify record %d", i);
+
+  for (i=0;i<NOTIFY_RING+8;++i) CHECK(notify_post(NOTIFY_USER, i, 0) == (i < NOTIFY_RING), "post %d", i);
+  n = notify_read(p, NOTIFY_RING*2);
+  CHECK(n == NOTIFY_RING && p[n-1].arg0 == NOTIFY_RING-1, "notify overflow %d records", n);
+  notify_post(NOTIFY_USER+1, 0, 0);
+  CHECK(notify_read(p, 1) == 1 && p[0].seq == (uint16_t)(seq+6+NOTIFY_RING+8), "notify gap seq %d", p[0].seq);
+}
+
+/**
+ * Edges on captured pins come back in order with their level and
+ * timestamp, other pins and edges are ignored and a full ring counts
+ * drops and tells the host through the notify endpoint.
+ **/
+static void test_capture(void) {
+  capture_edge_t e[8];
+  notify_pkt_t p[NOTIFY_RING];
+  uint32_t val;
+  int i, n;
+
+  sim_set(TERM_CAPTURE, CAPTURE_PIN, 12, 4);
+  sim_set(TERM_CAPTURE, CAPTURE_EDGE, 3, 4); // both
+  sim_set(TERM_CAPTURE, CAPTURE_PIN, 13, 4);
+  sim_set(TERM_CAPTURE, CAPTURE_EDGE, 1, 4); // rising
+  CHECK(sim_set(TERM_CAPTURE, CAPTURE_PIN, CAPTURE_GPIO_COUNT, 4) != 0, "capture bad pin");
+  notify_read(p, NOTIFY_RING);
+
+  sim_gpio_set(12, CyTrue);
+  CyU3PThreadSleep(1);
+  sim_gpio_set(13, CyTrue);
+  sim_gpio_set(14, CyTrue); // not captured
+  CyU3PThreadSleep(1);
+  sim_gpio_set(12, CyFalse);
+  sim_gpio_set(13, CyFalse); // falling edge not captured
+  CHECK(!sim_get(TERM_CAPTURE, CAPTURE_COUNT, &val, 4) && val == 3, "capture count %d", val);
+  memset(e, 0, sizeof(e));
+  CHECK(!sim_rdwr(COMMAND_READ, TERM_CAPTURE, CAPTURE_EDGES, (uint8_t*)e, sizeof(e), NULL), "capture drain");
+  CHECK(e[0].pin == 12 && e[0].level == 1 && e[1].pin == 13 && e[1].level == 1 &&
+        e[2].pin == 12 && e[2].level == 0 && e[3].pin == CAPTURE_PAD_PIN,
+        "capture edges %d/%d %d/%d %d/%d", e[0].pin, e[0].level, e[1].pin, e[1].level, e[2].pin, e[2].level);
+  CHECK(e[1].ticks - e[0].ticks == HWTIMER_HZ/1000 && e[2].ticks - e[1].ticks == HWTIMER_HZ/1000 &&
+        e[1].seq == (uint16_t)(e[0].seq+1) && e[2].seq == (uint16_t)(e[0].seq+2), "capture ticks %d %d %d seq %d %d %d", e[0].ticks, e[1].ticks, e[2].ticks, e[0].seq, e[1].seq, e[2].seq);
+
+  for (i=0;i<CAPTURE_RING_SIZE+10;++i) sim_gpio_set(12, !(i&1));
+  sim_get(TERM_CAPTURE, CAPTURE_COUNT, &val, 4);
+  CHECK(val == CAPTURE_RING_SIZE-1, "capture full count %d", val);
+  sim_get(TERM_CAPTURE, CAPTURE_DROPPED, &val, 4);
+  CHECK(val == 11, "capture dropped %d", val);
+  n = notify_read(p, NOTIFY_RING);
+  CHECK(n == 1 && p[0].event == NOTIFY_CAPTURE, "capture notify %d", n);
+  sim_set(TERM_CAPTURE, CAPTURE_DROPPED, 0, 4);
+  sim_get(TERM_CAPTURE, CAPTURE_COUNT, &val, 4);
+  CHECK(val == 0, "capture clear %d", val);
+
+  sim_set(TERM_CAPTURE, CAPTURE_PIN, 12, 4);
+  sim_set(TERM_CAPTURE, CAPTURE_EDGE, 0, 4);
+  sim_set(TERM_CAPTURE, CAPTURE_PIN, 13, 4);
+  sim_set(TERM_CAPTURE, CAPTURE_EDGE, 0, 4);
+  sim_gpio_set(13, CyTrue);
+  sim_get(TERM_CAPTURE, CAPTURE_COUNT, &val, 4);
+  CHECK(val == 0, "capture off %d", val);
+}
+
+#define OP(o,w,t,r,v,m,a) { MACRO_OP_##o, w, t, r, v, m, a }
+
+static uint32_t macro_result(uint8_t slot, macro_result_t *r, uint8_t *data, uint32_t len) {
+  uint8_t buf[sizeof(macro_result_t)+64];
+  memset(buf, 0xaa, sizeof(buf));
+  sim_set(TERM_MACRO, MACRO_SLOT, slot, 4);
+  CHECK(!sim_rdwr(COMMAND_READ, TERM_MACRO, MACRO_RESULT, buf, sizeof(*r)+len, NULL), "macro result %d", slot);
+  memcpy(r, buf, sizeof(*r));
+  if (data) memcpy(data, buf+sizeof(*r), len);
+  return r->bytes;
+}
+
+static void macro_load(uint8_t slot, macro_op_t *ops, uint32_t n) {
+  sim_set(TERM_MACRO, MACRO_SLOT, slot, 4);
+  CHECK(!sim_rdwr(COMMAND_WRITE, TERM_MACRO, MACRO_PROGRAM, (uint8_t*)ops, n*sizeof(*ops), NULL), "macro load %d", slot);
+}
+
+/**
+ * Macros run gets, sets, polls and jumps against other terminals and
+ * return the GET values in one result.  Failing ops stop the run with a
+ * status and gpio edges and timers trigger runs.
+ **/
+static void test_macro(void) {
+  macro_op_t prog[] = {
+    OP(SET, 4, TERM_BENCH, BENCH_SEED, 0x1234, 0, 0),
+    OP(GET, 4, TERM_BENCH, BENCH_SEED, 0, 0, 0),
+    OP(SET, 4, TERM_BENCH, BENCH_MODE, BENCH_PATTERN_CONSTANT, 0, 0),
+    OP(POLL, 4, TERM_BENCH, BENCH_SEED, 0x1200, 0xff00, 5),
+    OP(JUMP_NE, 0, 0, 0, 0x1234, 0xffff, 7),
+    OP(GET, 2, TERM_BENCH, BENCH_MODE, 0, 0, 0),
+    OP(JUMP_EQ, 0, 0, 0, 0, 0, 8),
+    OP(SET, 4, TERM_BENCH, BENCH_SEED, 0xdead, 0, 0), // jumped over
+    OP(WAIT, 0, 0, 0, 3, 0, 0),
+  };
+  macro_op_t poll[] = { OP(POLL, 4, TERM_BENCH, BENCH_SEED, 1, ~0, 3) };
+  macro_op_t bad[] = { OP(GET, 4, 0x7ff, 0, 0, 0, 0) };
+  macro_op_t loop[] = { OP(JUMP_EQ, 0, 0, 0, 0, 0, 0) };
+  macro_op_t get[] = { OP(GET, 4, TERM_BENCH, BENCH_SEED, 0, 0, 0) };
+  macro_result_t r;
+  notify_pkt_t p[NOTIFY_RING];
+  uint8_t data[8];
+  uint32_t val, seed;
+  int n;
+
+  notify_read(p, NOTIFY_RING);
+  macro_load(0, prog, sizeof(prog)/sizeof(prog[0]));
+  CHECK(!sim_set(TERM_MACRO, MACRO_RUN, 0, 4), "macro run");
+  macro_service();
+  CHECK(macro_result(0, &r, data, 6) == 6, "macro bytes %d", r.bytes);
+  CHECK(r.status == MACRO_STATUS_OK && r.pc == 9 && r.steps == 8 && r.run == 1 &&
+        r.trigger == MACRO_TRIGGER_NONE, "macro status %d pc %d steps %d run %d", r.status, r.pc, r.steps, r.run);
+  memcpy(&val, data, 4);
+  CHECK(val == 0x1234 && data[4] == BENCH_PATTERN_CONSTANT && data[5] == 0, "macro get %x %d", val, data[4]);
+  CHECK(r.t_end - r.t_start >= 3*HWTIMER_HZ/1000, "macro wait %d ticks", r.t_end - r.t_start);
+  sim_get(TERM_BENCH, BENCH_SEED, &seed, 4);
+  CHECK(seed == 0x1234, "macro jump seed %x", seed);
+  n = notify_read(p, NOTIFY_RING);
+  CHECK(n == 1 && p[0].event == NOTIFY_MACRO && p[0].arg0 == 0 && p[0].arg1 == MACRO_STATUS_OK, "macro notify %d", n);
+  sim_set(TERM_BENCH, BENCH_MODE, BENCH_PATTERN_PRBS, 4);
+
+  macro_load(1, poll, 1);
+  sim_set(TERM_MACRO, MACRO_RUN, 1, 4);
+  macro_service();
+  macro_result(1, &r, NULL, 0);
+  CHECK(r.status == MACRO_STATUS_TIMEOUT && r.pc == 0, "macro poll status %d", r.status);
+  macro_load(1, bad, 1);
+  sim_set(TERM_MACRO, MACRO_RUN, 1, 4);
+  macro_service();
+  macro_result(1, &r, NULL, 0);
+  CHECK(r.status == MACRO_STATUS_HANDLER && r.handler_status == CY_U3P_ERROR_NOT_SUPPORTED, "macro bad term %d %d", r.status, r.handler_status);
+  macro_load(1, loop, 1);
+  sim_set(TERM_MACRO, MACRO_RUN, 1, 4);
+  macro_service();
+  macro_result(1, &r, NULL, 0);
+  CHECK(r.status == MACRO_STATUS_STEPS && r.steps == MACRO_MAX_STEPS && r.run == 3, "macro loop %d %d", r.status, r.steps);
+  CHECK(sim_set(TERM_MACRO, MACRO_RUN, MACRO_SLOTS, 4) != 0, "macro bad slot");
+
+  // a second edge before the run counts as missed
+  macro_load(2, get, 1);
+  sim_set(TERM_MACRO, MACRO_PIN, 20, 4);
+  CHECK(!sim_set(TERM_MACRO, MACRO_TRIGGER, MACRO_TRIGGER_RISING, 4), "macro gpio trigger");
+  sim_gpio_set(20, CyTrue);
+  sim_gpio_set(20, CyFalse);
+  sim_gpio_set(20, CyTrue);
+  sim_gpio_set(20, CyFalse);
+  macro_service();
+  sim_get(TERM_MACRO, MACRO_RUNS, &val, 4);
+  CHECK(val == 1, "macro gpio runs %d", val);
+  sim_get(TERM_MACRO, MACRO_MISSED, &val, 4);
+  CHECK(val == 1, "macro gpio missed %d", val);
+  CHECK(macro_result(2, &r, data, 4) == 4 && r.trigger == MACRO_TRIGGER_RISING, "macro gpio result %d", r.trigger);
+  sim_set(TERM_MACRO, MACRO_TRIGGER, MACRO_TRIGGER_NONE, 4);
+  sim_gpio_set(20, CyTrue);
+  macro_service();
+  sim_get(TERM_MACRO, MACRO_RUNS, &val, 4);
+  CHECK(val == 1, "macro gpio off runs %d", val);
+
+  macro_load(3, get, 1);
+  sim_set(TERM_MACRO, MACRO_PERIOD, 5, 4);
+  CHECK(!sim_set(TERM_MACRO, MACRO_TRIGGER, MACRO_TRIGGER_TIMER, 4), "macro timer trigger");
+  for (n=0; n<4; ++n) {
+    CyU3PThreadSleep(5);
+    macro_service();
+  }
+  sim_set(TERM_MACRO, MACRO_TRIGGER, MACRO_TRIGGER_NONE, 4);
+  CyU3PThreadSleep(10);
+  macro_service();
+  sim_get(TERM_MACRO, MACRO_RUNS, &val, 4);
+  CHECK(val == 4, "macro timer runs %d", val);
+  CHECK(macro_result(3, &r, NULL, 0) == 4 && r.trigger == MACRO_TRIGGER_TIMER, "macro timer result %d", r.trigger);
+  notify_read(p, NOTIFY_RING);
+}
+
+/**
+ * Rows come one per period with the entries' values, tile the dma
+ * buffers and the stats see every row.  Reading rows needs the sampler
+ * running.
+ **/
+static void test_sampler(void) {
+  sampler_entry_t entries[] = {
+    { TERM_BENCH, 4, 0, BENCH_SEED },
+    { TERM_BENCH, 2, 0, BENCH_MODE },
+  };
+  uint8_t buf[32*16];
+  sampler_row_t *row;
+  sampler_stats_t stats;
+  uint32_t val, seed;
+  int i;
+
+  sim_set(TERM_BENCH, BENCH_SEED, 0xabcd1234, 4);
+  sim_set(TERM_BENCH, BENCH_MODE, BENCH_PATTERN_CONSTANT, 4);
+  CHECK(!sim_rdwr(COMMAND_WRITE, TERM_SAMPLER, SAMPLER_ENTRIES, (uint8_t*)entries, sizeof(entries), NULL), "sampler entries");
+  sim_get(TERM_SAMPLER, SAMPLER_ROW_SIZE, &val, 4);
+  CHECK(val == 32, "sampler row size %d", val);
+  sim_set(TERM_SAMPLER, SAMPLER_PERIOD_US, 2000, 4);
+  CHECK(sim_rdwr(COMMAND_READ, TERM_SAMPLER, SAMPLER_ROWS, buf, 32, NULL) != 0, "sampler rows while stopped");
+  CHECK(!sim_set(TERM_SAMPLER, SAMPLER_RUN, 1, 4), "sampler run");
+
+  memset(buf, 0, sizeof(buf));
+  CHECK(!sim_rdwr(COMMAND_READ, TERM_SAMPLER, SAMPLER_ROWS, buf, sizeof(buf), NULL), "sampler rows");
+  for (i=0;i<16;++i) {
+    row = (sampler_row_t*)(buf + i*32);
+    memcpy(&seed, row+1, 4);
+    CHECK(seed == 0xabcd1234 && ((uint8_t*)(row+1))[4] == BENCH_PATTERN_CONSTANT && row->status == 0,
+          "sampler row %d values %08x", i, seed);
+    if (i) CHECK(row->seq == ((sampler_row_t*)(buf+(i-1)*32))->seq+1 &&
+                 row->ticks - ((sampler_row_t*)(buf+(i-1)*32))->ticks == 2*HWTIMER_HZ/1000,
+                 "sampler row %d seq %d ticks %d", i, row->seq, row->ticks);
+  }
+  CHECK(!sim_rdwr(COMMAND_READ, TERM_SAMPLER, SAMPLER_STATS, (uint8_t*)&stats, sizeof(stats), NULL), "sampler stats");
+  CHECK(stats.rows == 16 && stats.missed == 0 && stats.period == 2*HWTIMER_HZ/1000 &&
+        stats.period_min == stats.period && stats.period_max == stats.period && stats.lat_max == 0,
+        "sampler stats rows %d missed %d period %d %d-%d lat %d", stats.rows, stats.missed,
+        stats.period, stats.period_min, stats.period_max, stats.lat_max);
+
+  sim_set(TERM_SAMPLER, SAMPLER_RUN, 0, 4);
+  sim_set(TERM_BENCH, BENCH_MODE, BENCH_PATTERN_PRBS, 4);
+  entries[0].term = TERM_SAMPLER;
+  CHECK(sim_rdwr(COMMAND_WRITE, TERM_SAMPLER, SAMPLER_ENTRIES, (uint8_t*)entries, sizeof(entries), NULL) != 0, "sampler samples itself");
+}
+
+/**
+ * One pretrig pass per BENCH seed so each ring chunk says which pass
+ * filled it.
+ **/
+static void pretrig_passes(uint32_t first, uint32_t n) {
+  for (; n--; ++first) {
+    sim_set(TERM_BENCH, BENCH_SEED, first, 4);
+    pretrig_service();
+  }
+}
+
+/**
+ * Checks the window is the chunks of passes first.. in order.
+ **/
+static void pretrig_check(const char *name, uint32_t first, uint32_t pre, uint32_t post, uint16_t trigger) {
+  pretrig_info_t info;
+  uint32_t *win, i, len=pre+post;
+  CHECK(!sim_rdwr(COMMAND_READ, TERM_PRETRIG, PRETRIG_INFO, (uint8_t*)&info, sizeof(info), NULL), "%s info", name);
+  CHECK(info.state == PRETRIG_STATE_DONE && info.pre == pre && info.post == post &&
+        info.trigger == trigger && info.status == 0,
+        "%s state %d window %d+%d trigger %d status %d", name, info.state, info.pre, info.post, info.trigger, info.status);
+  win = calloc(1, len+4);
+  CHECK(!sim_rdwr(COMMAND_READ, TERM_PRETRIG, PRETRIG_WINDOW, (uint8_t*)win, len+4, NULL), "%s window", name);
+  for (i=0;i<len/4;++i) {
+    if (win[i] != first + i*4/256) {
+      CHECK(0, "%s window word %d %d", name, i, win[i]);
+      break;
+    }
+  }
+  CHECK(win[len/4] == 0, "%s window end %08x", name, win[len/4]);
+  free(win);
+}
+
+/**
+ * The window holds pre bytes before the trigger and post from it for
+ * host, gpio and match triggers, less pre if it fired early.
+ **/
+static void test_pretrig(void) {
+  notify_pkt_t p[NOTIFY_RING];
+  uint32_t val;
+
+  notify_read(p, NOTIFY_RING);
+  sim_set(TERM_BENCH, BENCH_MODE, BENCH_PATTERN_CONSTANT, 4);
+  sim_set(TERM_PRETRIG, PRETRIG_SOURCE_TERM, TERM_BENCH, 4);
+  sim_set(TERM_PRETRIG, PRETRIG_SOURCE_REG, BENCH_DATA, 4);
+  sim_set(TERM_PRETRIG, PRETRIG_CHUNK, 256, 4);
+  sim_set(TERM_PRETRIG, PRETRIG_SIZE, 4096, 4);
+  sim_set(TERM_PRETRIG, PRETRIG_PRE, 1024, 4);
+  sim_set(TERM_PRETRIG, PRETRIG_POST, 512, 4);
+  CHECK(sim_rdwr(COMMAND_READ, TERM_PRETRIG, PRETRIG_WINDOW, (uint8_t*)&val, 4, NULL) != 0, "pretrig window before done");
+  CHECK(sim_set(TERM_PRETRIG, PRETRIG_FIRE, 1, 4) != 0, "pretrig fire while idle");
+
+  // host trigger after the ring wrapped
+  CHECK(!sim_set(TERM_PRETRIG, PRETRIG_ARM, 1, 4), "pretrig arm");
+  CHECK(sim_set(TERM_PRETRIG, PRETRIG_CHUNK, 512, 4) != 0, "pretrig setup while armed");
+  pretrig_passes(0, 20);
+  CHECK(!sim_set(TERM_PRETRIG, PRETRIG_FIRE, 1, 4), "pretrig fire");
+  pretrig_passes(20, 2);
+  sim_get(TERM_PRETRIG, PRETRIG_ARM, &val, 4);
+  CHECK(val == PRETRIG_STATE_DONE, "pretrig state %d", val);
+  pretrig_passes(22, 2); // nothing once done
+  pretrig_check("pretrig host", 16, 1024, 512, PRETRIG_TRIGGER_HOST);
+  CHECK(notify_read(p, NOTIFY_RING) == 1 && p[0].event == NOTIFY_PRETRIG && p[0].arg0 == 1536 && p[0].arg1 == 0,
+        "pretrig notify %d %d", p[0].event, p[0].arg0);
+
+  // gpio trigger before pre bytes were in
+  sim_set(TERM_PRETRIG, PRETRIG_TRIGGER, PRETRIG_TRIGGER_RISING, 4);
+  sim_set(TERM_PRETRIG, PRETRIG_PIN, 20, 4);
+  sim_gpio_set(20, CyFalse);
+  CHECK(!sim_set(TERM_PRETRIG, PRETRIG_ARM, 1, 4), "pretrig arm gpio");
+  pretrig_passes(0, 3);
+  sim_gpio_set(20, CyTrue);
+  pretrig_passes(3, 2);
+  sim_gpio_set(20, CyFalse);
+  pretrig_check("pretrig gpio", 0, 768, 512, PRETRIG_TRIGGER_RISING);
+
+  // match trigger on the seed of pass 5, checked after its chunk
+  sim_set(TERM_PRETRIG, PRETRIG_TRIGGER, PRETRIG_TRIGGER_MATCH, 4);
+  sim_set(TERM_PRETRIG, PRETRIG_MATCH_TERM, TERM_BENCH, 4);
+  sim_set(TERM_PRETRIG, PRETRIG_MATCH_REG, BENCH_SEED, 4);
+  sim_set(TERM_PRETRIG, PRETRIG_MATCH_MASK, 0xff, 4);
+  sim_set(TERM_PRETRIG, PRETRIG_MATCH_VALUE, 5, 4);
+  sim_set(TERM_PRETRIG, PRETRIG_POST, 0, 4);
+  CHECK(!sim_set(TERM_PRETRIG, PRETRIG_ARM, 1, 4), "pretrig arm match");
+  pretrig_passes(0, 8);
+  pretrig_check("pretrig match", 2, 1024, 0, PRETRIG_TRIGGER_MATCH);
+
+  sim_set(TERM_PRETRIG, PRETRIG_SOURCE_TERM, TERM_PRETRIG, 4);
+  CHECK(sim_set(TERM_PRETRIG, PRETRIG_ARM, 1, 4) != 0, "pretrig captures itself");
+  sim_set(TERM_PRETRIG, PRETRIG_SOURCE_TERM, TERM_BENCH, 4);
+  sim_set(TERM_PRETRIG, PRETRIG_PRE, 4096, 4);
+  CHECK(sim_set(TERM_PRETRIG, PRETRIG_ARM, 1, 4) != 0, "pretrig window bigger than the ring");
+  notify_read(p, NOTIFY_RING);
+  sim_set(TERM_BENCH, BENCH_MODE, BENCH_PATTERN_PRBS, 4);
+}
+
+/**
+ * Aligned reads and writes dma straight to the region (only the ack
+ * goes through a cpu buffer) and don't recreate the cpu handler
+ * channels.  Other offsets, gets and sets use the cpu path.
+ **/
+static void test_sram(void) {
+  uint8_t *buf = malloc(SRAM_TERM_SIZE), *expected = malloc(SRAM_TERM_SIZE);
+  uint32_t creates = gSimStats.creates, discards = gSimStats.discards, commits, val;
+
+  prbs_fill(expected, SRAM_TERM_SIZE, 21);
+  CHECK(!sim_rdwr(COMMAND_WRITE, TERM_SRAM, 0, expected, SRAM_TERM_SIZE, NULL), "sram write");
+  CHECK(gSimStats.discards == discards, "sram write discarded %d buffers", gSimStats.discards - discards);
+  CHECK(!memcmp(gSramTerm, expected, SRAM_TERM_SIZE), "sram write data");
+  memset(buf, 0, SRAM_TERM_SIZE);
+  commits = gSimStats.commits;
+  CHECK(!sim_rdwr(COMMAND_READ, TERM_SRAM, 0, buf, SRAM_TERM_SIZE, NULL), "sram read");
+  CHECK(!memcmp(buf, expected, SRAM_TERM_SIZE), "sram read data");
+  CHECK(gSimStats.commits - commits == 1, "sram read committed %d buffers", gSimStats.commits - commits);
+
+  memset(expected+3, 0x5a, 1000);
+  CHECK(!sim_rdwr(COMMAND_WRITE, TERM_SRAM, 3, expected+3, 1000, NULL), "sram unaligned write");
+  CHECK(!sim_rdwr(COMMAND_READ, TERM_SRAM, 16, buf, 4000, NULL), "sram read after");
+  CHECK(!memcmp(buf, expected+16, 4000), "sram read after data");
+  CHECK(!sim_rdwr(COMMAND_READ, TERM_SRAM, 1, buf, 2000, NULL), "sram unaligned read");
+  CHECK(!memcmp(buf, expected+1, 2000), "sram unaligned read data");
+
+  CHECK(!sim_set(TERM_SRAM, 8, 0xfeedf00d, 4), "sram set");
+  CHECK(!sim_get(TERM_SRAM, 8, &val, 4) && val == 0xfeedf00d, "sram get %08x", val);
+  CHECK(sim_rdwr(COMMAND_READ, TERM_SRAM, SRAM_TERM_SIZE-16, buf, 32, NULL) != 0, "sram read past the end");
+  CHECK(sim_rdwr(COMMAND_WRITE, TERM_SRAM, SRAM_TERM_SIZE-16, buf, 32, NULL) != 0, "sram write past the end");
+  test_get_set(); // back to a cpu handler terminal
+  CHECK(gSimStats.creates == creates, "sram recreated channels %d", gSimStats.creates - creates);
+  free(buf);
+  free(expected);
+}
+
+/**
+ * The kernels the straightforward way for test_reduce's parameters:
+ * factor 4 (decimate) or 8 (minmax), 16 bins of sample>>12 every 4096
+ * samples, threshold 0xF000 and 12 bit packing.
+ **/
+static uint32_t reduce_expect(uint8_t kernel, const uint16_t *in, uint32_t n, uint8_t *out) {
+  uint16_t *o16 = (uint16_t*)out, lo, hi;
+  uint32_t *o32 = (uint32_t*)out, len=0, i, j, bit;
+  reduce_event_t *e = (reduce_event_t*)out;
+  switch (kernel) {
+    case REDUCE_DECIMATE:
+      for (i=0; i<n; i+=4) o16[len++] = in[i];
+      return len*2;
+    case REDUCE_MINMAX:
+      for (i=0; i+8<=n; i+=8) {
+        for (lo=0xffff, hi=0, j=i; j<i+8; ++j) {
+          if (in[j] < lo) lo = in[j];
+          if (in[j] > hi) hi = in[j];
+        }
+        o16[len++] = lo;
+        o16[len++] = hi;
+      }
+      return len*2;
+    case REDUCE_HISTOGRAM:
+      for (i=0; i+4096<=n; i+=4096, len+=16) {
+        memset(o32+len, 0, 64);
+        for (j=i; j<i+4096; ++j) ++o32[len + (in[j]>>12)];
+      }
+      return len*4;
+    case REDUCE_EVENTS:
+      for (i=1; i<n; ++i) {
+        if ((in[i] >= 0xF000) == (in[i-1] >= 0xF000)) continue;
+        e[len].index = i;
+        e[len].value = in[i];
+        e[len].rising = in[i] >= 0xF000;
+        ++len;
+      }
+      return len*sizeof(*e);
+    case REDUCE_PACK:
+      memset(out, 0, n*12/8+1);
+      for (i=0; i<n; ++i)
+        for (j=0; j<12; ++j, ++len) {
+          bit = (in[i]>>j) & 1;
+          out[len>>3] |= bit << (len&7);
+        }
+      return len/8;
+  }
+  return 0;
+}
+
+/**
+ * Reads of the PRBS bench pattern through each kernel match the host
+ * computation.  A kernel without output is padded after max_in.  Reads
+ * with bad parameters and writes fail to start.
+ **/
+static void test_reduce(void) {
+  uint32_t in_len = 2<<20, max = 64<<10, len, expected_len, stats[4], i;
+  uint8_t *in = malloc(in_len), *expected = malloc(in_len), *buf = malloc(max);
+  static const char *names[] = { "none", "decimate", "minmax", "histogram", "events", "pack" };
+  uint8_t k;
+
+  prbs_fill(in, in_len, 31);
+  sim_set(TERM_BENCH, BENCH_MODE, BENCH_PATTERN_PRBS, 4);
+  sim_set(TERM_BENCH, BENCH_SEED, 31, 4);
+  CHECK(!sim_set(TERM_REDUCE, REDUCE_BINS, 16, 4) && !sim_set(TERM_REDUCE, REDUCE_SHIFT, 12, 4) &&
+        !sim_set(TERM_REDUCE, REDUCE_HIST_SAMPLES, 4096, 4) &&
+        !sim_set(TERM_REDUCE, REDUCE_THRESHOLD, 0xF000, 4) && !sim_set(TERM_REDUCE, REDUCE_BITS, 12, 4),
+        "reduce parameters");
+  CHECK(sim_set(TERM_REDUCE, REDUCE_BINS, 12, 4) != 0, "reduce 12 bins");
+
+  for (k=REDUCE_DECIMATE; k<REDUCE_KERNEL_COUNT; ++k) {
+    sim_set(TERM_REDUCE, REDUCE_FACTOR, k == REDUCE_MINMAX ? 8 : 4, 4);
+    expected_len = reduce_expect(k, (uint16_t*)in, in_len/2, expected);
+    len = expected_len < max ? expected_len & ~3 : max;
+    memset(buf, 0xaa, len);
+    gSimFlags = RDWR_FLAG_REDUCE(k);
+    CHECK(!sim_rdwr(COMMAND_READ, TERM_BENCH, BENCH_DATA, buf, len, NULL), "reduce %s read", names[k]);
+    gSimFlags = 0;
+    CHECK(!memcmp(buf, expected, len), "reduce %s: bad data", names[k]);
+    CHECK(!sim_rdwr(COMMAND_READ, TERM_REDUCE, REDUCE_STATS, (uint8_t*)stats, sizeof(stats), NULL) &&
+          stats[1] >= len && stats[0] <= in_len && !stats[2] && !stats[3],
+          "reduce %s stats in %d out %d dropped %d padded %d", names[k], stats[0], stats[1], stats[2], stats[3]);
+  }
+
+  // no crossings: each buffer takes max_in of input (in chunks of its
+  // size) then goes out as 0s
+  sim_set(TERM_REDUCE, REDUCE_THRESHOLD, 0x10000, 4);
+  CHECK(!sim_set(TERM_REDUCE, REDUCE_MAX_IN, 2*REDUCE_IN_SIZE, 4), "reduce max_in");
+  memset(buf, 0xaa, 4096);
+  gSimFlags = RDWR_FLAG_REDUCE(REDUCE_EVENTS);
+  CHECK(!sim_rdwr(COMMAND_READ, TERM_BENCH, BENCH_DATA, buf, 4096, NULL), "reduce quiet events read");
+  gSimFlags = 0;
+  for (i=0; i<4096 && !buf[i]; ++i);
+  CHECK(i == 4096, "reduce quiet events: data at %d", i);
+  CHECK(!sim_rdwr(COMMAND_READ, TERM_REDUCE, REDUCE_STATS, (uint8_t*)stats, sizeof(stats), NULL) &&
+        stats[0] && !(stats[0] % (2*REDUCE_IN_SIZE)) && !stats[1] && stats[3] == 4096,
+        "reduce quiet events stats in %d out %d padded %d", stats[0], stats[1], stats[3]);
+  sim_set(TERM_REDUCE, REDUCE_MAX_IN, 1<<24, 4);
+
+  sim_set(TERM_REDUCE, REDUCE_FACTOR, 1, 4);
+  gSimFlags = RDWR_FLAG_REDUCE(REDUCE_MINMAX);
+  CHECK(sim_rdwr(COMMAND_READ, TERM_BENCH, BENCH_DATA, buf, 64, NULL) != 0, "reduce minmax factor 1");
+  gSimFlags = RDWR_FLAG_REDUCE(REDUCE_DECIMATE);
+  CHECK(sim_rdwr(COMMAND_WRITE, TERM_BENCH, BENCH_DATA, buf, 64, NULL) != 0, "reduce write");
+  gSimFlags = RDWR_FLAG_REDUCE(REDUCE_KERNEL_COUNT);
+  CHECK(sim_rdwr(COMMAND_READ, TERM_BENCH, BENCH_DATA, buf, 64, NULL) != 0, "reduce bad kernel");
+  gSimFlags = 0;
+  sim_set(TERM_REDUCE, REDUCE_FACTOR, 4, 4);
+  sim_set(TERM_REDUCE, REDUCE_BINS, 256, 4);
+  sim_set(TERM_REDUCE, REDUCE_SHIFT, 8, 4);
+  sim_set(TERM_REDUCE, REDUCE_HIST_SAMPLES, 65536, 4);
+  sim_set(TERM_REDUCE, REDUCE_THRESHOLD, 0x8000, 4);
+  test_read(4096, 32); // plain reads after
+  free(in);
+  free(expected);
+  free(buf);
+}
+
+int main(int argc, char *argv[]) {
+  int iters=10000, ep_size=1024, c;
+
+  while ((c = getopt(argc, argv, "n:s:v")) != -1) {
+    switch (c) {
+      case 'n': iters = atoi(optarg); break;
+      case 's': ep_size = atoi(optarg); break;
+      case 'v': gSimVerbose = 1; break;
+      default:
+        fprintf(stderr, "usage: %s [-n iterations] [-s ep_buffer_size] [-v]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  sim_init(ep_size);
+  printf("ep buffer size %d\n", ep_size);
+
+  test_get_set();
+  test_write(4, 1);
+  test_write(ep_size*2, 2);
+  test_write(ep_size*7+12, 3);
+  test_write(1<<20, 4);
+  test_write_dropped();
+  test_read(4, 5);
+  test_read(ep_size*2, 6);
+  test_read(ep_size*7+12, 7);
+  test_read(1<<20, 8);
+  test_stream(1<<20, 9);
+  test_get_set(); // the next transaction after a stream
+  test_stream_framed(1<<20, 11);
+  test_read(ep_size*7+12, 12); // and after the Src channel is put back
+  test_stream_compressed();
+  test_read(ep_size*7+12, 13);
+  test_seq();
+  test_time();
+  test_notify();
+  test_capture();
+  test_macro();
+  test_sampler();
+  test_pretrig();
+  test_sram();
+  test_reduce();
+  test_membench();
+  test_get_set(); // bench handler after the macros used it
+  test_ext_ack(COMMAND_READ, 1<<20);
+  test_ext_ack(COMMAND_WRITE, ep_size*3+4);
+  test_abort(COMMAND_READ, 1<<20);
+  test_abort(COMMAND_WRITE, 1<<20);
+  test_abort_unsupported();
+  test_busy_write(256<<10);
+  test_vec();
+  test_async();
+  test_read(ep_size*7+12, 10);
+
+  printf("%-14s %8s %10s %10s %8s %8s %8s %8s\n", "transaction", "bytes",
+         "fw ns", "total ns", "dma_cb", "get", "put", "reset");
+  perf("get", COMMAND_GET, 4, iters);
+  perf("set", COMMAND_SET, 4, iters);
+  perf("read", COMMAND_READ, 64, iters);
+  perf("write", COMMAND_WRITE, 64, iters);
+  perf("read", COMMAND_READ, 64<<10, iters/10+1);
+  perf("write", COMMAND_WRITE, 64<<10, iters/10+1);
+  perf_compress();
+
+  printf("%s\n", gFailed ? "FAILED" : "OK");
+  return gFailed ? 1 : 0;
+}
@@ -0,0 +1,188 @@
+/**
+ * Terminals built into the simulation.  Same as handlers.c minus the
+ * ones that need real peripherals (FX3, PROM.)
+ **/
+
+#include <string.h>
+#include <cyu3system.h>
+#include <cyu3error.h>
+#include "handlers.h"
+#include "fx3_terminals.h"
+#include "bench_term.h"
+#include "membench.h"
+#include "capture.h"
+#include "macro.h"
+#include "sampler.h"
+#include "pretrig.h"
+#include "sram_term.h"
+#include "reduce.h"
+#include "async.h"
+#include "cpu_handler.h"
+#include "rdwr.h"
+#include "log.h"
+#include "sim.h"
+
+/* SIM_TERM_SLOW */
+uint8_t gSimSlow[SIM_SLOW_SIZE];
+uint32_t gSimSlowRate=4096, gSimSlowBusy;
+static uint32_t gSimSlowCredit, gSimSlowTime;
+static CyU3PTimer gSimSlowTimer;
+
+static void sim_slow_ready(uint32_t arg) {
+  io_handler_ready();
+}
+
+static uint16_t sim_slow_init(void) {
+  if (gRdwrCmd.header.reg_addr > SIM_SLOW_SIZE ||
+      gRdwrCmd.header.transfer_length > SIM_SLOW_SIZE - gRdwrCmd.header.reg_addr)
+    return CY_U3P_ERROR_BAD_ARGUMENT;
+  gSimSlowCredit = 0;
+  gSimSlowTime = sim_time();
+  return 0;
+}
+
+static uint16_t sim_slow_write(CyU3PDmaBuffer_t *buf) {
+  uint32_t now = sim_time(), n;
+  // the fifo holds a ms worth
+  gSimSlowCredit += (now - gSimSlowTime) * gSimSlowRate;
+  if (gSimSlowCredit > gSimSlowRate) gSimSlowCredit = gSimSlowRate;
+  gSimSlowTime = now;
+  n = buf->count < gSimSlowCredit ? buf->count : gSimSlowCredit;
+  memcpy(gSimSlow + gRdwrCmd.header.reg_addr + gRdwrCmd.transfered_so_far, buf->buffer, n);
+  gSimSlowCredit -= n;
+  if (n < buf->count) {
+    buf->buffer += n;
+    buf->count -= n;
+    ++gSimSlowBusy;
+    CyU3PTimerCreate(&gSimSlowTimer, sim_slow_ready, 0, 1, 0, CyTrue);
+    return IO_HANDLER_BUSY;
+  }
+  return 0;
+}
+
+/* SIM_TERM_VEC */
+uint32_t gSimVecEnd=0xFFFFFFFF, gSimVecStep=0xFFFFFFFF, gSimVecCalls, gSimVecIovs;
+
+static uint16_t sim_vec_readv(CyU3PDmaBuffer_t *iov, uint16_t n) {
+  uint32_t off = gRdwrCmd.transfered_so_far, step = gSimVecStep, i, j, c;
+  ++gSimVecCalls;
+  gSimVecIovs += n;
+  for (i=0; i<n; ++i) {
+    c = iov[i].count;
+    if (c > step) c = step;
+    if (c > gSimVecEnd - off) c = off < gSimVecEnd ? gSimVecEnd - off : 0;
+    for (j=0; j<c; ++j) iov[i].buffer[j] = SIM_VEC_BYTE(off+j);
+    off += c;
+    step -= c;
+    if (c < iov[i].count) {
+      iov[i].count = c;
+      if (off >= gSimVecEnd) return 0; // the data ran out
+      io_handler_ready(); // the next step is ready right away
+      return IO_HANDLER_BUSY;
+    }
+  }
+  return 0;
+}
+
+static uint16_t sim_vec_writev(CyU3PDmaBuffer_t *iov, uint16_t n) {
+  uint32_t off = gRdwrCmd.header.reg_addr + gRdwrCmd.transfered_so_far, step = gSimVecStep, i;
+  ++gSimVecCalls;
+  gSimVecIovs += n;
+  for (i=0; i<n; ++i) {
+    if (iov[i].count > step) {
+      iov[i].count = step;
+      io_handler_ready();
+    }
+    if (off + iov[i].count > SIM_SLOW_SIZE) return CY_U3P_ERROR_BAD_ARGUMENT;
+    memcpy(gSimSlow + off, iov[i].buffer, iov[i].count);
+    off += iov[i].count;
+    step -= iov[i].count;
+  }
+  return 0;
+}
+
+/* SIM_TERM_ASYNC */
+uint32_t gSimAsyncChunk=ASYNC_BUFFER_SIZE, gSimAsyncPerTick=2;
+uint16_t gSimAsyncStatus;
+uint32_t gSimAsyncStops;
+CyBool_t gSimAsyncRunning;
+static uint32_t gSimAsyncOffset;
+static CyU3PTimer gSimAsyncTimer;
+
+static void sim_async_tick(uint32_t arg) {
+  CyU3PDmaBuffer_t *buf;
+  uint32_t i, j;
+  CyBool_t last;
+  for (i=0; i<gSimAsyncPerTick && (buf = async_get()); ++i) {
+    buf->count = gSimAsyncChunk;
+    if (buf->count > gSimVecEnd - gSimAsyncOffset) buf->count = gSimVecEnd - gSimAsyncOffset;
+    for (j=0; j<buf->count; ++j) buf->buffer[j] = SIM_VEC_BYTE(gSimAsyncOffset+j);
+    gSimAsyncOffset += buf->count;
+    last = gSimAsyncOffset >= gSimVecEnd;
+    if ((gSimAsyncStatus = async_commit(buf, last)) || last) break;
+  }
+}
+
+static void sim_async_start(void) {
+  gSimAsyncOffset = 0;
+  gSimAsyncRunning = CyTrue;
+  CyU3PTimerCreate(&gSimAsyncTimer, sim_async_tick, 0, 1, 1, CyTrue);
+}
+
+static void sim_async_stop(void) {
+  ++gSimAsyncStops;
+  gSimAsyncRunning = CyFalse;
+  CyU3PTimerStop(&gSimAsyncTimer);
+}
+
+static async_producer_t gSimAsyncProducer = { sim_async_start, sim_async_stop };
+
+/* SIM_TERM_NOABORT */
+static handler_t gSimNoAbortHandler = {
+  cpu_handler_setup,
+  cpu_handler_teardown,
+  cpu_handler_cmd_start,
+  cpu_handler_dmacb,
+  0,
+  0
+};
+
+app_init_t app_init[] = {
+    { APP_INIT_VALID, 0, 0, 0, 0 },
+    { 0 }
+};
+
+io_handler_t io_handlers[] = {
+#ifdef ENABLE_LOGGING
+#ifdef USB_LOGGING
+  DECLARE_LOG_HANDLER(TERM_LOG),
+#endif
+#endif
+  DECLARE_DUMMY_HANDLER(TERM_DUMMY_FX3),
+  DECLARE_BENCH_HANDLER(TERM_BENCH),
+  DECLARE_MEMBENCH_HANDLER(TERM_MEMBENCH),
+  DECLARE_CAPTURE_HANDLER(TERM_CAPTURE),
+  DECLARE_MACRO_HANDLER(TERM_MACRO),
+  DECLARE_SAMPLER_HANDLER(TERM_SAMPLER),
+  DECLARE_PRETRIG_HANDLER(TERM_PRETRIG),
+  DECLARE_SRAM_HANDLER(TERM_SRAM),
+  DECLARE_REDUCE_HANDLER(TERM_REDUCE),
+  DECLARE_HANDLER(&glCpuHandler, SIM_TERM_SLOW, 0, sim_slow_init, 0, sim_slow_write, 0, 0, 0, 0),
+  DECLARE_HANDLER_V2(&glCpuHandler, SIM_TERM_VEC, 0, 0, sim_vec_readv, sim_vec_writev, 0, 0, 0, 0),
+  DECLARE_ASYNC_HANDLER(SIM_TERM_ASYNC, 0, 0, 0, &gSimAsyncProducer),
+  DECLARE_HANDLER(&gSimNoAbortHandler, SIM_TERM_NOABORT, 0, bench_init, bench_read, bench_write, 0, 0, 0, 0),
+  DECLARE_TERMINATOR
+};
+
+/* serial.c without the prom */
+static uint8_t gSimSerial[16];
+
+uint16_t set_serial(uint8_t *serial) {
+  memcpy(gSimSerial, serial, sizeof(gSimSerial));
+  return 0;
+}
+
+uint16_t get_serial(uint8_t *buf) {
+  memcpy(buf, gSimSerial, sizeof(gSimSerial));
+  return 0;
+}
@@ -0,0 +1,142 @@
+#include <cyu3system.h>
+#include <cyu3error.h>
+#include <cyu3dma.h>
+
+#include "sram_term.h"
+#include "cpu_handler.h"
+#include "rdwr.h"
+#include "hwtimer.h"
+#include "log.h"
+
+#ifndef DEBUG_SRAM_TERM
+#undef log_debug
+#define log_debug(...) do {} while (0)
+#endif
+
+uint8_t gSramTerm[SRAM_TERM_SIZE] __attribute__ ((aligned (32)));
+CyBool_t gSramDirect;  // the current transaction dmas straight from/to gSramTerm
+CyBool_t gSramPending; // an override buffer is set up on the channel
+uint16_t gSramChunk;   // its bytes
+
+/**
+ * Bytes of the region at the current transaction offset up to want.
+ * Returns 0 past the end.
+ **/
+static uint32_t sram_term_span(uint32_t want) {
+  uint32_t reg = gRdwrCmd.header.reg_addr, off = gRdwrCmd.transfered_so_far;
+  if (reg >= SRAM_TERM_SIZE || off >= SRAM_TERM_SIZE - reg) return 0;
+  return SRAM_TERM_SIZE - reg - off < want ? SRAM_TERM_SIZE - reg - off : want;
+}
+
+uint16_t sram_term_read(CyU3PDmaBuffer_t* buf) {
+  uint32_t n = sram_term_span(buf->count);
+  CyU3PMemCopy(buf->buffer, gSramTerm + gRdwrCmd.header.reg_addr + gRdwrCmd.transfered_so_far, n);
+  CyU3PMemSet(buf->buffer + n, 0, buf->count - n);
+  return n < buf->count;
+}
+
+uint16_t sram_term_write(CyU3PDmaBuffer_t* buf) {
+  uint32_t n = sram_term_span(buf->count);
+  if (n < buf->count) return 1;
+  CyU3PMemCopy(gSramTerm + gRdwrCmd.header.reg_addr + gRdwrCmd.transfered_so_far, buf->buffer, n);
+  return 0;
+}
+
+uint16_t sram_handler_start() {
+  uint32_t reg = gRdwrCmd.header.reg_addr, len = gRdwrCmd.header.transfer_length;
+  uint8_t command = gRdwrCmd.header.command;
+  uint16_t status = cpu_handler_cmd_start();
+  if (status) return status;
+
+  // gets and sets stay on the cpu path for the replay cache, reduced reads
+  // for the kernel
+  gSramDirect = (command == COMMAND_READ || command == COMMAND_WRITE) &&
+                !(gRdwrCmd.header.flags & RDWR_FLAG_REDUCE_MASK) &&
+                !RDWR_STREAMING() && len && !(reg & 15) &&
+                reg < SRAM_TERM_SIZE && len <= SRAM_TERM_SIZE - reg;
+  gSramPending = CyFalse;
+  log_debug ( "sram %s %d bytes at %d\n", gSramDirect ? "direct" : "cpu", len, reg );
+  return 0;
+}
+
+/**
+ * Puts the channel back in normal mode after overrides.  Unlike the
+ * cpu handler resets the endpoint isn't flushed, the last packets of a
+ * read can still be in it.
+ **/
+static void sram_resume(CyU3PDmaChannel *ch) {
+  CyU3PDmaChannelReset(ch);
+  CyU3PDmaChannelSetXfer(ch, 0);
+}
+
+static void sram_finish(uint16_t status) {
+  gAckPkt.status |= status;
+  gExtAck.dma_status |= status;
+  sram_resume(&glChHandleBulkSrc); // for the ack
+  if (gRdwrCmd.header.command & bmSETWRITE) sram_resume(&glChHandleBulkSink);
+  cpu_handler_commit_ack();
+  gRdwrCmd.done = 1;
+}
+
+uint16_t sram_handler_dmacb() {
+  CyBool_t write = (gRdwrCmd.header.command & bmSETWRITE) != 0;
+  CyU3PDmaChannel *ch = write ? &glChHandleBulkSink : &glChHandleBulkSrc;
+  CyU3PDmaBuffer_t buf;
+  CyU3PDmaState_t state;
+  uint32_t n, left, t0;
+  uint16_t status;
+
+  if (!gSramDirect || gRdwrCmd.abort) {
+    gSramPending = CyFalse; // an abort resets the channels
+    return cpu_handler_dmacb();
+  }
+
+  if (!gSramPending) {
+    left = gRdwrCmd.header.transfer_length - gRdwrCmd.transfered_so_far;
+    gSramChunk = left < SRAM_TERM_CHUNK ? left : SRAM_TERM_CHUNK;
+    buf.buffer = gSramTerm + gRdwrCmd.header.reg_addr + gRdwrCmd.transfered_so_far;
+    buf.count = write ? 0 : gSramChunk;
+    buf.size = (gSramChunk + 15) & ~15; // in the region, offsets and its size are 16 byte aligned
+    buf.status = 0;
+    CyU3PDmaChannelReset(ch);
+    status = write ? CyU3PDmaChannelSetupRecvBuffer(ch, &buf) : CyU3PDmaChannelSetupSendBuffer(ch, &buf);
+    if (status) {
+      log_error ( "sram override fail %d\n", status );
+      sram_finish(status);
+      return 0;
+    }
+    gSramPending = CyTrue;
+  }
+
+  t0 = hwtimer_ticks();
+  status = CyU3PDmaChannelWaitForCompletion(ch, 500);
+  gExtAck.wait_ticks += hwtimer_ticks() - t0;
+  if (status == CY_U3P_ERROR_TIMEOUT) {
+    ++gExtAck.dma_waits;
+    return status; // the data loop calls again
+  }
+  gSramPending = CyFalse;
+  if (gRdwrCmd.abort) return cpu_handler_dmacb();
+  if (status) {
+    log_error ( "sram override wait fail %d\n", status );
+    sram_finish(status);
+    return 0;
+  }
+
+  n = gSramChunk;
+  if (write) CyU3PDmaChannelGetStatus(ch, &state, &n, 0);
+  gRdwrCmd.transfered_so_far += n;
+  // a short write ends the host's transfer early
+  if (gRdwrCmd.transfered_so_far >= gRdwrCmd.header.transfer_length || n < gSramChunk)
+    sram_finish(0);
+  return 0;
+}
+
+handler_t glSramHandler = {
+  cpu_handler_setup,
+  cpu_handler_teardown,
+  sram_handler_start,
+  sram_handler_dmacb,
+  0,
+  cpu_handler_abort
+};
@@ -0,0 +1,38 @@
+#ifndef SRAM_TERM_H
+#define SRAM_TERM_H
+
+/**
+ * SRAM scratch terminal.
+ *
+ * gSramTerm is a block of FX3 SRAM the host reads and writes as a byte
+ * addressed terminal (the register is the offset.)  Firmware modules can
+ * use it to stage tables or hand large buffers to the host without a
+ * handler of their own.  It is also a pure usb throughput reference: a
+ * read or write that starts on a 16 byte offset dmas straight between
+ * the endpoint and gSramTerm in SRAM_TERM_CHUNK pieces (dma override
+ * mode), with no cpu copy per buffer.  Other accesses, gets, sets and
+ * streams go through the cpu handler buffers like any other terminal.
+ *
+ * The handler type shares the cpu handler's channels so switching
+ * between it and cpu handler terminals doesn't recreate them.
+ *
+ * Add sram_term.c to SOURCE and -D SRAM_TERM to CCFLAGS to enable.
+ **/
+
+#include "handlers.h"
+
+#ifndef SRAM_TERM_SIZE
+#define SRAM_TERM_SIZE 0x8000 // a multiple of 16
+#endif
+#define SRAM_TERM_CHUNK 0x8000 // bytes per override buffer, whole packets at every speed
+
+extern uint8_t gSramTerm[SRAM_TERM_SIZE];
+extern handler_t glSramHandler;
+
+uint16_t sram_term_read(CyU3PDmaBuffer_t*);
+uint16_t sram_term_write(CyU3PDmaBuffer_t*);
+
+#define DECLARE_SRAM_HANDLER(term) \
+  DECLARE_HANDLER(&glSramHandler,term,0,0,sram_term_read,sram_term_write,0,0,0,0)
+
+#endif
@@ -58,9 +58,22 @@ typedef struct {
   uint32_t reg_addr;
 
   /**
-   * Total transfer length
+   * Total transfer length or RDWR_STREAM_LENGTH
    **/
   uint32_t transfer_length;
+
+  /**
+   * Echoed in the ack so the host can drop stale acks.  A get repeating
+   * the seq (and the rest of the header) of the transaction just
+   * completed is a retry and is answered from the cached response.
+   * 0 means unnumbered (never replayed.)
+   **/
+  uint16_t seq;
+
+  /**
+   * RDWR_FLAG_ options.
+   **/
+  uint16_t flags;
   
 } 
 #ifdef __GNUC__
@@ -68,6 +81,31 @@ typedef struct {
 #endif
 rdwr_data_header_t;
 
+/**
+ * transfer_length for a streaming read.  The device sends full buffers
+ * until the host sends VC_STREAM_STOP and then ends the stream with a
+ * stream_ack_pkt_t (a short packet.)  Writes don't stream.
+ **/
+#define RDWR_STREAM_LENGTH 0xFFFFFFFF
+
+/**
+ * Size of the header before seq and flags.  Older hosts still send it and
+ * get seq=0 and flags=0.
+ **/
+#define RDWR_HEADER_V0_SIZE 11
+
+/**
+ * rdwr_data_header_t.flags
+ **/
+#define RDWR_FLAG_EXT_ACK 0x0001 // end with an ext_ack_pkt_t (not for streaming reads)
+#define RDWR_FLAG_FRAMING 0x0002 // streaming reads only: each buffer starts with a frame_hdr_t
+#define RDWR_FLAG_REDUCE_MASK  0x00F0 // reads only: REDUCE_KERNEL applied on the device (reduce.h)
+#define RDWR_FLAG_REDUCE_SHIFT 4
+#define RDWR_FLAG_REDUCE(kernel) ((kernel) << RDWR_FLAG_REDUCE_SHIFT)
+#define RDWR_FLAG_COMPRESS_MASK  0x0300 // framed streams only: COMPRESS_CODEC of each frame (compress.h)
+#define RDWR_FLAG_COMPRESS_SHIFT 8
+#define RDWR_FLAG_COMPRESS(codec) ((codec) << RDWR_FLAG_COMPRESS_SHIFT)
+
 
 
 enum NITRO_VC { 
@@ -88,7 +126,7 @@ enum NITRO_VC {
  *
  * value = ep_addr
  * index = rdwr_addr
- * length = 5
+ * length = sizeof(rdwr_data_header_t) or RDWR_HEADER_V0_SIZE
  *  send 1 byte (0=read 1 = write, 2=get, 3=set) followed by 4 bytes for length (send 4 bytes little-endian!)
  **/
 VC_HI_RDWR=0xb4,
@@ -106,22 +144,167 @@ VC_RENUM=0xb5,
  * length = 8
  * \return 8 byte serial number 
  **/
-VC_SERIAL=0xb6
+VC_SERIAL=0xb6,
+
+/**
+ * type 0x40
+ * End a streaming read.  The device finishes the buffers in flight and
+ * sends the stream_ack_pkt_t.
+ **/
+VC_STREAM_STOP=0xb7,
+
+/**
+ * type 0x40
+ * Abort the transaction in progress without a stall.  The device drops
+ * the buffered data, sends the ack with RDWR_STATUS_ABORTED set in status
+ * and leaves the endpoints ready for the next transaction.  Nothing is
+ * sent if no transaction was in progress.  The data thread acts on it
+ * after its current dma wait (up to 500ms.)  Only handlers with a
+ * handler_abort (the cpu handler and the ones built on it: sram_term.c,
+ * async.c) can be aborted; for others (FIRMWARE_DI) the request stalls
+ * and the transaction goes on.
+ **/
+VC_ABORT=0xb8,
+
+/**
+ * type 0xc0
+ * length = sizeof(time_pkt_t)
+ * \return the device timebase.  Answered from the setup callback without
+ *  waiting for the app thread so the host can time the round trip and
+ *  map device ticks (traces, ext acks) to host time.  ticks_hz is 1000
+ *  (CyU3PGetTime) unless the firmware is built with HWTIMER_GPIO.
+ **/
+VC_TIME=0xb9
 
 };
 
 #define ACK_PKT_ID 0xA50F
+#define RDWR_STATUS_ABORTED 0x8000 // ack status bit of a VC_ABORT ended transaction
 typedef struct {
   uint16_t id;
   uint16_t checksum;
   uint16_t status;
-  uint16_t reserved;
+  uint16_t seq; // rdwr_data_header_t.seq
 }
 #ifdef __GNUC__
  __attribute__((__packed__))
 #endif
 ack_pkt_t;
 
+/**
+ * Ack of a RDWR_FLAG_EXT_ACK transaction.  The times let the host split
+ * a transaction into device time and host/usb time: t_start is when the
+ * device started the handler (after the setup request), t_end when the
+ * ack was queued and wait_ticks how long the device waited in between
+ * for the host to fill or drain dma buffers.
+ **/
+typedef struct {
+  ack_pkt_t ack;
+  uint32_t t_start;        // device ticks
+  uint32_t t_end;
+  uint32_t ticks_hz;       // device tick rate
+  uint32_t wait_ticks;     // ticks waiting for dma buffers
+  uint32_t bytes;          // bytes transferred
+  uint32_t dma_waits;      // dma buffer waits that timed out
+  uint16_t handler_status; // status of the read/write handler calls
+  uint16_t dma_status;     // status of the dma calls
+}
+#ifdef __GNUC__
+ __attribute__((__packed__))
+#endif
+ext_ack_pkt_t;
+
+/**
+ * VC_TIME response.  ext_ack_pkt_t times are ticks_lo of the same clock.
+ **/
+typedef struct {
+  uint32_t ticks_lo;
+  uint32_t ticks_hi;
+  uint32_t ticks_hz;
+}
+#ifdef __GNUC__
+ __attribute__((__packed__))
+#endif
+time_pkt_t;
+
+/**
+ * Start of every buffer of a RDWR_FLAG_FRAMING stream.  It sits in dma
+ * header space so the payload isn't copied.  Every buffer is the same
+ * size (header plus count) so the stream is a sequence of frames followed
+ * by the stream_ack_pkt_t.
+ **/
+#define FRAME_HDR_ID 0xF4A3
+typedef struct {
+  uint16_t id;     // FRAME_HDR_ID
+  uint16_t status; // ack status so far
+  uint32_t seq;    // buffer number in the stream from 0
+  uint32_t count;  // payload bytes that follow
+  uint32_t ticks;  // hwtimer ticks when the buffer was filled
+}
+#ifdef __GNUC__
+ __attribute__((__packed__))
+#endif
+frame_hdr_t;
+
+/**
+ * Follows the frame_hdr_t of every frame of a RDWR_FLAG_COMPRESS stream
+ * (count includes it.)  A buffer the codec can't shrink is sent as
+ * COMPRESS_RAW.  Compressed frames are padded to whole packets so frames
+ * are no longer all the same size: the next frame starts at the packet
+ * after header plus count.
+ **/
+enum COMPRESS_CODEC {
+  COMPRESS_RAW=0,
+  COMPRESS_RLE,   // 16 bit word runs (see compress.c)
+  COMPRESS_DELTA  // zigzag varint deltas of 16 bit words
+};
+typedef struct {
+  uint16_t codec;     // COMPRESS_CODEC of this frame
+  uint16_t reserved;
+  uint32_t raw_count; // payload bytes before compression
+}
+#ifdef __GNUC__
+ __attribute__((__packed__))
+#endif
+compress_hdr_t;
+
+/**
+ * Ack at the end of a streaming read.
+ **/
+typedef struct {
+  ack_pkt_t ack;
+  uint32_t total_lo; // total bytes streamed
+  uint32_t total_hi;
+}
+#ifdef __GNUC__
+ __attribute__((__packed__))
+#endif
+stream_ack_pkt_t;
+
+/**
+ * Record on the interrupt IN endpoint (see notify.h.)  A packet holds
+ * one or more of them.  seq counts every record posted so a gap means
+ * records were dropped.
+ **/
+#define NOTIFY_INIT_STAT 1 // handler init/start failed: arg0 term, arg1 status
+#define NOTIFY_LOG       2 // usb log has data: arg0 bytes buffered
+#define NOTIFY_ERROR     3 // firmware is stuck in error_handler: arg0 status
+#define NOTIFY_CAPTURE   4 // gpio capture ring half full: arg0 edges, arg1 dropped
+#define NOTIFY_MACRO     5 // macro run finished: arg0 slot, arg1 status
+#define NOTIFY_PRETRIG   6 // pretrig window ready: arg0 bytes, arg1 status
+#define NOTIFY_USER      0x100 // first event number for firmware use
+typedef struct {
+  uint16_t event;
+  uint16_t seq;
+  uint32_t ticks; // hwtimer ticks when posted
+  uint32_t arg0;
+  uint32_t arg1;
+}
+#ifdef __GNUC__
+ __attribute__((__packed__))
+#endif
+notify_pkt_t;
+
 
 #define LITTLE_ENDIAN_16(x) ((((uint16_t) (x))<<8) | (((uint16_t) (x)) >> 8))
 
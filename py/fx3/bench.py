@@ -0,0 +1,214 @@
+"""
+    Repeatable performance measurements for the fx3 nitro firmware.
+
+    Measures get/set round trip latency, read/write throughput over a
+    sweep of transfer sizes (using the BENCH terminal so no peripheral is
+    involved) and the transaction rate for small transfers.
+
+    Results are stored in a json file keyed by firmware version, nitro
+    protocol version and link speed so runs from different firmware or
+    links aren't mixed up::
+
+        python -m nitro_parts.Cypress.fx3.bench run --out results.json
+        python -m nitro_parts.Cypress.fx3.bench compare old.json new.json
+
+    compare exits non zero if any metric regressed by more than the
+    threshold.
+"""
+
+import time, json, argparse, sys
+import logging, numpy
+log=logging.getLogger(__name__)
+
+DEFAULT_SIZES=[ 1<<i for i in range(10,25,2) ] # 1KB - 16MB
+MB=1e6
+
+def device_info(dev):
+    """Returns the identity used to key results."""
+    ver=dev.get('FX3','version')
+    usbver=dev.get('FX3','usbver')
+    usb3=dev.get('FX3','USB3')
+    info={
+        'version':'%d.%d' % (ver>>8, ver&0xff),
+        'usbver':'%d.%d' % (usbver>>8, usbver&0xff),
+        'link':'USB3' if usb3 else 'USB2',
+    }
+    info['key']='fw%(version)s-nitro%(usbver)s-%(link)s' % info
+    return info
+
+def _percentiles(samples):
+    a=numpy.array(samples)*1e6
+    return { 'p50_us':float(numpy.percentile(a,50)),
+             'p99_us':float(numpy.percentile(a,99)),
+             'mean_us':float(a.mean()),
+             'n':len(samples) }
+
+def latency(dev, n=1000):
+    """get/set round trip latency of a 32 bit register."""
+    gets=[]
+    sets=[]
+    for i in range(n):
+        t0=time.time()
+        dev.get('BENCH','seed')
+        t1=time.time()
+        dev.set('BENCH','seed',i)
+        t2=time.time()
+        gets.append(t1-t0)
+        sets.append(t2-t1)
+    return { 'get':_percentiles(gets), 'set':_percentiles(sets) }
+
+def _dev_rate(dev, nbytes):
+    """Device side rate of the last BENCH data transaction."""
+    elapsed=dev.get('BENCH','elapsed')
+    hz=float(dev.get('BENCH','ticks_hz'))
+    if not elapsed:
+        return None
+    return nbytes/(elapsed/hz)/MB
+
+def throughput(dev, sizes=DEFAULT_SIZES, min_bytes=64<<20, mode=3):
+    """
+        Read and write throughput in MB/s for each transfer size.  Each
+        size is repeated until at least min_bytes moved.  mode is the
+        BENCH pattern (default static so the cpu is out of the way.)
+    """
+    dev.set('BENCH','mode',mode)
+    dev.set('BENCH','seed',0)
+    dev.set('BENCH','verify',0)
+    res={'read':{}, 'write':{}}
+    for size in sizes:
+        buf=numpy.zeros(size,dtype=numpy.uint8)
+        reps=max(1,min_bytes//size)
+        for direction in ('read','write'):
+            op=dev.read if direction=='read' else dev.write
+            op('BENCH','data',buf) # warm up
+            t0=time.time()
+            for i in range(reps):
+                op('BENCH','data',buf)
+            t=time.time()-t0
+            res[direction][str(size)]={
+                'MBps':size*reps/t/MB,
+                'device_MBps':_dev_rate(dev,size),
+            }
+            log.info("%s %8d bytes: %.1f MB/s" % (direction, size, size*reps/t/MB))
+    return res
+
+def transaction_rate(dev, size=64, seconds=2.0):
+    """Small transfers per second for reads and writes of size bytes."""
+    buf=numpy.zeros(size,dtype=numpy.uint8)
+    res={}
+    for direction in ('read','write'):
+        op=dev.read if direction=='read' else dev.write
+        n=0
+        t0=time.time()
+        while time.time()-t0 < seconds:
+            op('BENCH','data',buf)
+            n+=1
+        res['%s%d_per_s' % (direction,size)]=n/(time.time()-t0)
+    return res
+
+def run(dev, sizes=DEFAULT_SIZES, latency_n=1000):
+    info=device_info(dev)
+    log.info("Benchmarking %s" % info['key'])
+    return {
+        'device':info,
+        'time':time.strftime('%Y-%m-%dT%H:%M:%S'),
+        'latency':latency(dev,latency_n),
+        'throughput':throughput(dev,sizes),
+        'rate':transaction_rate(dev),
+    }
+
+def save(result, filename):
+    """Adds result to filename (a dict of runs by key), replacing an older run with the same key."""
+    try:
+        with open(filename) as f:
+            runs=json.load(f)
+    except (IOError, ValueError):
+        runs={}
+    runs[result['device']['key']]=result
+    with open(filename,'w') as f:
+        json.dump(runs,f,indent=2,sort_keys=True)
+
+
+def _metrics(result):
+    """Flattens a result to {name: (value, higher_is_better)}."""
+    m={}
+    for op,v in result['latency'].items():
+        for p in ('p50_us','p99_us'):
+            m['latency.%s.%s' % (op,p)]=(v[p],False)
+    for direction,sizes in result['throughput'].items():
+        for size,v in sizes.items():
+            m['%s.%s.MBps' % (direction,size)]=(v['MBps'],True)
+    for k,v in result['rate'].items():
+        m['rate.%s' % k]=(v,True)
+    return m
+
+def compare(old, new, threshold=5.0):
+    """
+        Compares two results.  Returns a list of (metric, old, new,
+        percent change, regressed) for metrics in both runs.  Changes are
+        signed so that negative is always worse.
+    """
+    a=_metrics(old)
+    b=_metrics(new)
+    rows=[]
+    for k in sorted(set(a)&set(b)):
+        va,hib=a[k]
+        vb=b[k][0]
+        if not va:
+            continue
+        change=100.0*(vb-va)/va
+        if not hib:
+            change=-change
+        rows.append( (k,va,vb,change,change < -threshold) )
+    return rows
+
+def _load_run(spec):
+    """file.json or file.json:key.  Without a key the file must hold one run."""
+    filename,_,key=spec.partition(':')
+    with open(filename) as f:
+        runs=json.load(f)
+    if key:
+        return runs[key]
+    if len(runs)!=1:
+        raise ValueError("%s has runs %s. Specify one with %s:key" % (filename, ', '.join(sorted(runs)), filename))
+    return list(runs.values())[0]
+
+
+def main():
+    parser=argparse.ArgumentParser(description="FX3 nitro benchmarks")
+    sub=parser.add_subparsers(dest='cmd')
+    r=sub.add_parser('run', help='run benchmarks against a device')
+    r.add_argument('--out', default='fx3_bench.json')
+    r.add_argument('--serial', default=None)
+    r.add_argument('--sizes', default=None, help='comma separated transfer sizes')
+    r.add_argument('--latency-n', type=int, default=1000)
+    c=sub.add_parser('compare', help='compare two runs (file.json[:key])')
+    c.add_argument('old')
+    c.add_argument('new')
+    c.add_argument('--threshold', type=float, default=5.0, help='percent change that counts as a regression')
+    args=parser.parse_args()
+    logging.basicConfig(level=logging.INFO)
+
+    if args.cmd=='run':
+        import nitro_parts.Cypress.fx3 as fx3
+        dev=fx3.get_dev(serial_num=args.serial)
+        sizes=[int(s) for s in args.sizes.split(',')] if args.sizes else DEFAULT_SIZES
+        result=run(dev,sizes,args.latency_n)
+        dev.close()
+        save(result,args.out)
+        log.info("Saved %s to %s" % (result['device']['key'], args.out))
+    elif args.cmd=='compare':
+        old=_load_run(args.old)
+        new=_load_run(args.new)
+        if old['device']['key'] != new['device']['key']:
+            log.warning("Comparing different configurations: %s vs %s" % (old['device']['key'],new['device']['key']))
+        regressed=False
+        for k,va,vb,change,bad in compare(old,new,args.threshold):
+            print("%-32s %12.2f %12.2f %+7.1f%% %s" % (k,va,vb,change,"REGRESSION" if bad else ""))
+            regressed = regressed or bad
+        sys.exit(1 if regressed else 0)
+    else:
+        parser.print_help()
+
+if __name__=='__main__':
+    main()
@@ -0,0 +1,102 @@
+"""
+    Host side of the firmware gpio edge capture (firmware/capture.c).
+
+    The firmware timestamps edges on the configured pins in the gpio
+    interrupt and buffers them.  This module sets up the pins and drains
+    the edges from the CAPTURE terminal in bulk.
+
+    Example::
+
+        python -m nitro_parts.Cypress.fx3.capture --pin 24 --pin 25:rising \\
+            --seconds 5
+
+    Edge times are device hwtimer ticks (CAPTURE ticks_hz).  timesync
+    maps them to host time.
+"""
+
+import time, argparse
+import logging, numpy
+log=logging.getLogger(__name__)
+
+EDGE_DTYPE=numpy.dtype([('ticks','<u4'),('pin','u1'),('level','u1'),('seq','<u2')])
+PAD_PIN=255
+EDGES={ 'off':0, 'rising':1, 'falling':2, 'both':3 }
+
+def configure(dev, pin, edge='both'):
+    """Capture edge ('rising', 'falling', 'both' or 'off') on pin."""
+    dev.set('CAPTURE','pin',pin)
+    dev.set('CAPTURE','edge',EDGES.get(edge,edge))
+
+def clear(dev):
+    """Drops buffered edges and the dropped count."""
+    dev.set('CAPTURE','dropped',0)
+
+def drain(dev):
+    """Returns all edges currently buffered on the device."""
+    c=dev.get('CAPTURE','count')
+    if not c:
+        return numpy.zeros(0,dtype=EDGE_DTYPE)
+    buf=numpy.zeros(c,dtype=EDGE_DTYPE)
+    dev.read('CAPTURE','edges',buf.view(numpy.uint8))
+    return buf[buf['pin']!=PAD_PIN]
+
+def gaps(edges):
+    """Number of edges dropped between the ones drained (seq gaps.)"""
+    if len(edges)<2:
+        return 0
+    return int(((numpy.diff(edges['seq'].astype(numpy.int32)) - 1) & 0xffff).sum())
+
+def capture(dev, seconds=1.0, poll=0.1):
+    """
+        Edges for seconds on the pins already configured.  The device
+        ring is drained every poll seconds so it doesn't overflow.
+    """
+    chunks=[]
+    clear(dev)
+    t_end=time.time()+seconds
+    while time.time() < t_end:
+        time.sleep(poll)
+        chunks.append(drain(dev))
+    chunks.append(drain(dev))
+    dropped=dev.get('CAPTURE','dropped')
+    if dropped:
+        log.warning("%d edges dropped. Poll more often." % dropped)
+    return numpy.concatenate(chunks)
+
+def pulses(edges, pin):
+    """(start ticks, width ticks, level) for each pair of edges on pin."""
+    e=edges[edges['pin']==pin]
+    w=(e['ticks'][1:]-e['ticks'][:-1]) & 0xffffffff
+    return e['ticks'][:-1], w, e['level'][:-1]
+
+def main():
+    import nitro_parts.Cypress.fx3 as fx3
+    parser=argparse.ArgumentParser(description="FX3 gpio edge capture")
+    parser.add_argument('--pin', action='append', default=[], help='pin[:rising|falling|both] (repeat for more pins)')
+    parser.add_argument('--seconds', type=float, default=1.0)
+    parser.add_argument('--poll', type=float, default=0.1)
+    parser.add_argument('--serial', default=None)
+    args=parser.parse_args()
+
+    logging.basicConfig(level=logging.INFO)
+    dev=fx3.get_dev(serial_num=args.serial)
+    pins=[]
+    for p in args.pin:
+        pin,_,edge=p.partition(':')
+        pins.append(int(pin,0))
+        configure(dev,pins[-1],edge or 'both')
+    hz=dev.get('CAPTURE','ticks_hz')
+    try:
+        edges=capture(dev, args.seconds, args.poll)
+    finally:
+        for pin in pins:
+            configure(dev,pin,'off')
+    dev.close()
+    log.info("%d edges %d lost" % (len(edges), gaps(edges)))
+    for pin in pins:
+        t,w,lvl=pulses(edges,pin)
+        if len(w):
+            log.info("pin %d: %d edges, shortest pulse %.3f us" % (pin, len(w)+1, w.min()*1e6/hz))
+
+if __name__=='__main__':
+    main()
@@ -0,0 +1,160 @@
+"""
+    Codecs of compressed streams (firmware/compress.c) and a throughput
+    benchmark against the uncompressed path.
+
+    RawDevice.stream(..., compress='rle') or 'delta' decompresses each
+    frame with decode() so callers get the same payload as an
+    uncompressed stream.  encode() is the firmware side for the
+    emulator and tests.
+
+        python -m nitro_parts.Cypress.fx3.compress --bytes 64e6
+
+    runs the BENCH constant, ramp and prbs patterns through each codec and
+    reports payload and wire MB/s.  'raw' is the plain framed stream; the
+    firmware gives it the same Src buffer size as the compressed ones so
+    the rows compare.  Run it once on a usb 2 port and once on usb 3 to
+    compare HS and SS.
+"""
+
+import time, argparse
+import logging, numpy
+from . import protocol as P
+log=logging.getLogger(__name__)
+
+CODECS=dict((v,k) for k,v in P.COMPRESS_NAMES.items())
+
+def _rle(words):
+    out=bytearray()
+    lit=None
+    i,n=0,len(words)
+    while i<n:
+        v=int(words[i])
+        run=1
+        while run<130 and i+run<n and words[i+run]==v:
+            run+=1
+        if run>=3:
+            out+=bytes((0x80+run-3, v & 0xff, v>>8))
+            lit=None
+            i+=run
+            continue
+        if lit is None:
+            lit=len(out)
+            out.append(0)
+        else:
+            out[lit]+=1
+        out+=bytes((v & 0xff, v>>8))
+        if out[lit]==0x7f:
+            lit=None
+        i+=1
+    return bytes(out)
+
+def _unrle(data):
+    out=[]
+    i,n=0,len(data)
+    while i<n:
+        c=data[i]
+        if c<0x80:
+            out.append(data[i+1:i+3+2*c])
+            i+=3+2*c
+        else:
+            out.append(data[i+1:i+3]*(c-0x80+3))
+            i+=3
+    return b''.join(out)
+
+def _delta(words):
+    d=numpy.diff(words.astype(numpy.int32), prepend=0).astype(numpy.int16).astype(numpy.int32)
+    z=((d << 1) ^ (d >> 15)) & 0xffff
+    b=numpy.empty((len(z),3), dtype=numpy.uint8)
+    b[:,0]=(z & 0x7f) | numpy.where(z>=0x80, 0x80, 0)
+    b[:,1]=((z >> 7) & 0x7f) | numpy.where(z>=0x4000, 0x80, 0)
+    b[:,2]=z >> 14
+    n=1+(z>=0x80)+(z>=0x4000)
+    return b[numpy.arange(3)<n[:,None]].tobytes()
+
+def _undelta(data):
+    b=numpy.frombuffer(data, dtype=numpy.uint8)
+    if not len(b):
+        return b''
+    last=(b & 0x80)==0
+    group=numpy.concatenate(([0],numpy.cumsum(last)[:-1]))
+    starts=numpy.flatnonzero(numpy.concatenate(([True],last[:-1])))
+    shift=7*(numpy.arange(len(b))-starts[group])
+    z=numpy.zeros(int(group[-1])+1, dtype=numpy.int64)
+    numpy.add.at(z, group, (b & 0x7f).astype(numpy.int64) << shift)
+    d=(z >> 1) ^ -(z & 1)
+    return (numpy.cumsum(d) & 0xffff).astype('<u2').tobytes()
+
+def encode(data, codec):
+    """compress_hdr_t and payload of a frame of data, raw if the codec doesn't shrink it."""
+    data=bytes(data)
+    enc=None
+    if codec!=P.COMPRESS_RAW and not len(data) & 1:
+        words=numpy.frombuffer(data, dtype='<u2')
+        enc=_rle(words) if codec==P.COMPRESS_RLE else _delta(words)
+        if len(enc)>=len(data):
+            enc=None
+    if enc is None:
+        return P.COMPRESS.pack(P.COMPRESS_RAW, 0, len(data))+data
+    return P.COMPRESS.pack(codec, 0, len(data))+enc
+
+def decode(payload):
+    """The frame payload before compression."""
+    payload=bytes(payload)
+    codec,_,raw_count=P.COMPRESS.unpack_from(payload)
+    data=payload[P.COMPRESS.size:]
+    if codec==P.COMPRESS_RLE:
+        data=_unrle(data)
+    elif codec==P.COMPRESS_DELTA:
+        data=_undelta(data)
+    if len(data)!=raw_count:
+        raise IOError("frame decodes to %d bytes, header says %d" % (len(data),raw_count))
+    return data
+
+# BENCH registers (terminals.py)
+BENCH_TERM=6
+BENCH_MODE=0
+BENCH_SEED=1
+BENCH_DATA=7
+PATTERNS={ 'constant':(2,0), 'ramp':(4,0), 'prbs':(1,0x12345678) }
+
+def throughput(raw, codec, nbytes, term=BENCH_TERM, reg=BENCH_DATA, chunk=1<<20):
+    """
+        Streams nbytes of payload.  Returns payload and wire MB/s and the
+        fraction of frames that were compressed.
+    """
+    got=wire=frames=compressed=0
+    align=raw.max_packet
+    t0=time.time()
+    for frame,payload in raw.stream(term, reg, chunk, nbytes, framing=True, compress=codec):
+        got+=len(payload)
+        frames+=1
+        compressed+=frame.get('codec',P.COMPRESS_RAW)!=P.COMPRESS_RAW
+        wire+=P.FRAME.size+frame['count']+(-(P.FRAME.size+frame['count']) % align)
+    dt=time.time()-t0
+    return { 'payload_MBps':got/dt/1e6, 'wire_MBps':wire/dt/1e6,
+             'ratio':wire/float(got or 1), 'compressed':compressed/float(frames or 1) }
+
+def main():
+    from .rawusb import RawDevice
+    parser=argparse.ArgumentParser(description="FX3 compressed stream throughput")
+    parser.add_argument('--serial', default=None)
+    parser.add_argument('--bytes', type=float, default=64e6, help='payload bytes per run')
+    parser.add_argument('--pattern', action='append', choices=sorted(PATTERNS), default=None)
+    args=parser.parse_args()
+    logging.basicConfig(level=logging.INFO)
+
+    raw=RawDevice(serial_num=args.serial)
+    speed={64:'FS', 512:'HS', 1024:'SS'}.get(raw.max_packet, str(raw.max_packet))
+    log.info("%s link (%d byte packets)" % (speed, raw.max_packet))
+    for name in args.pattern or ('constant','ramp','prbs'):
+        mode,seed=PATTERNS[name]
+        raw.set(BENCH_TERM, BENCH_MODE, mode)
+        raw.set(BENCH_TERM, BENCH_SEED, seed)
+        for codec in ('raw','rle','delta'):
+            r=throughput(raw, codec, int(args.bytes))
+            log.info("%s %-8s %-5s payload %7.1f MB/s wire %7.1f MB/s ratio %.3f compressed %3.0f%%" % (
+                speed, name, codec, r['payload_MBps'], r['wire_MBps'], r['ratio'], 100*r['compressed']))
+    raw.close()
+
+if __name__=='__main__':
+    main()
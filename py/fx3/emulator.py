@@ -0,0 +1,744 @@
+"""
+    Stand-in for the FX3 board built on Linux FunctionFS.
+
+    The gadget enumerates with the firmware's VID/PID and descriptors
+    (interface 0 alt 1 with bulk EP OUT/IN and the notify interrupt EP)
+    and answers VC_HI_RDWR,
+    VC_SERIAL, VC_RENUM, VC_STREAM_STOP, VC_ABORT and VC_TIME the way
+    firmware/rdwr.c does, followed by the bulk data and ack_pkt_t.  The
+    terminals from terminals.py that the default firmware build serves are
+    modeled in python: DUMMY_FX3, BENCH, MEMBENCH, FX3 and FX3_PROM.
+
+    With dummy_hcd the gadget shows up on the local host so rawusb and the
+    benchmarks run against it without hardware (get_dev() too when the
+    endpoint addresses match, see below.)  Needs root::
+
+        modprobe dummy_hcd   # is_super_speed=1 for a usb3 link
+        modprobe libcomposite
+        python -m nitro_parts.Cypress.fx3.emulator --config firmware/config.mk
+
+    The UDC picks the endpoint numbers, FunctionFS can't ask for the
+    firmware's.  dummy_hcd gives 0x81 for the IN endpoint like the FX3
+    but the OUT endpoint may not be 0x01.  The addresses are logged at
+    startup with a warning when they differ.  rawusb.RawDevice takes them
+    from the descriptors and works either way; get_dev() (libnitro) uses
+    the firmware's fixed addresses and only works when they match.
+"""
+
+import os, re, time, struct, threading, argparse, queue
+import logging, numpy
+from . import prbs
+from . import protocol as P
+from . import compress
+log=logging.getLogger(__name__)
+
+VID=0x1fe1
+PID=0x00f0
+FIRMWARE_VERSION=1
+TICKS_HZ=1000000 # device timebase (VC_TIME, ext acks)
+NOTIFY_RING=32 # firmware/notify.h
+USBVER=0x0400 # bcdDevice from firmware/dscr.c
+
+def read_config(path):
+    """VID, PID and FIRMWARE_VERSION from a firmware config.mk."""
+    cfg={ 'VID':VID, 'PID':PID, 'FIRMWARE_VERSION':FIRMWARE_VERSION }
+    for line in open(path):
+        m=re.match(r'\s*(VID|PID|FIRMWARE_VERSION)\s*=\s*(\w+)', line)
+        if m:
+            cfg[m.group(1)]=int(m.group(2),0)
+    return cfg
+
+def ramp(first, n):
+    """n words of the BENCH ramp pattern: 16 bit samples counting up from first."""
+    return ((numpy.arange(2*n,dtype=numpy.uint32)+first) & 0xffff).astype('<u2').view('<u4')
+
+################################################################################
+# terminals
+
+class Terminal(object):
+    """
+        Base terminal.  read returns (data, status) and write returns
+        status the way io_handler read/write functions do.  A non zero
+        status is or'd into the ack.
+    """
+    def __init__(self, addr):
+        self.addr=addr
+        self.device=None
+
+    def read(self, reg, length):
+        return bytes(length), 1
+
+    def write(self, reg, data):
+        return 1
+
+    def stream(self, reg, length, first):
+        """Next length bytes of a streaming read (first is True to restart.)"""
+        return self.read(reg, length)
+
+class DummyTerminal(Terminal):
+    """DECLARE_DUMMY_HANDLER. Reads return zeros and writes are dropped."""
+    def read(self, reg, length):
+        return bytes(length), 0
+
+    def write(self, reg, data):
+        return 0
+
+class RegisterTerminal(Terminal):
+    """
+        width byte registers.  Registers in regs are writable and return
+        their value.  Subclasses override get_reg/set_reg for the others.
+    """
+    def __init__(self, addr, width=4, regs=None):
+        Terminal.__init__(self,addr)
+        self.width=width
+        self.regs=dict(regs or {})
+        self.fmt='<'+{1:'B',2:'H',4:'I'}[width]
+
+    def get_reg(self, reg):
+        return self.regs.get(reg)
+
+    def set_reg(self, reg, val):
+        if reg not in self.regs:
+            return 1
+        self.regs[reg]=val
+        return 0
+
+    def read(self, reg, length):
+        val=self.get_reg(reg)
+        if val is None:
+            return bytes(length), 1
+        b=struct.pack(self.fmt, val & ((1<<(8*self.width))-1))
+        return (b+bytes(length))[:length], 0
+
+    def write(self, reg, data):
+        if len(data) < self.width:
+            return 1
+        return self.set_reg(reg, struct.unpack(self.fmt, bytes(data[:self.width]))[0])
+
+class BenchTerminal(RegisterTerminal):
+    """Model of firmware/bench_term.c."""
+    MODE,SEED,VERIFY,ERRORS,BYTES,ELAPSED,TICKS_HZ,DATA,BIT_ERRORS,DROPPED,PHY_ERRORS,LINK_ERRORS=range(12)
+    COUNTER,PRBS,CONSTANT,STATIC,RAMP=range(5) # enum BENCH_PATTERN
+    TICKS_PER_SEC=1000000
+
+    def __init__(self, addr=6):
+        RegisterTerminal.__init__(self, addr, 4, { self.MODE:0, self.SEED:0, self.VERIFY:0 })
+        self.stats={ self.ERRORS:0, self.BYTES:0, self.ELAPSED:0,
+                     self.BIT_ERRORS:0, self.DROPPED:0 }
+        self._cache=(None,None)
+
+    def pattern(self, nbytes):
+        mode,seed=self.regs[self.MODE],self.regs[self.SEED]
+        key=(mode,seed,nbytes)
+        if self._cache[0]==key:
+            return self._cache[1]
+        n=(nbytes+3)//4
+        if mode==0:
+            w=(numpy.arange(n,dtype=numpy.uint64)+seed).astype('<u4')
+        elif mode==1:
+            w=prbs.words(prbs.seed(seed),n)
+        elif mode==4:
+            w=ramp(seed,n)
+        else:
+            w=numpy.full(n,seed,dtype='<u4')
+        p=w.view(numpy.uint8)[:nbytes]
+        self._cache=(key,p)
+        return p
+
+    def stream(self, reg, length, first):
+        if reg!=self.DATA:
+            return self.read(reg,length)
+        mode,seed=self.regs[self.MODE],self.regs[self.SEED]
+        if first:
+            self._next=prbs.seed(seed) if mode==1 else seed & 0xffff if mode==4 else seed
+        n=length//4
+        if mode==0:
+            w=(numpy.arange(n,dtype=numpy.uint64)+self._next).astype('<u4')
+            self._next=(self._next+n) & 0xffffffff
+        elif mode==1:
+            w=prbs.words(self._next,n)
+            self._next=prbs.next_word(int(w[-1]))
+        elif mode==4:
+            w=ramp(self._next,n)
+            self._next=(self._next+2*n) & 0xffff
+        else:
+            w=numpy.full(n,seed,dtype='<u4')
+        return w.tobytes(), 0
+
+    def _account(self, nbytes, t0):
+        self.stats[self.BYTES]=nbytes
+        self.stats[self.ELAPSED]=int((time.time()-t0)*self.TICKS_PER_SEC)
+
+    def get_reg(self, reg):
+        if reg==self.TICKS_HZ:
+            return self.TICKS_PER_SEC
+        if reg in (self.PHY_ERRORS,self.LINK_ERRORS):
+            return 0
+        if reg in self.stats:
+            return self.stats[reg]
+        return RegisterTerminal.get_reg(self,reg)
+
+    def set_reg(self, reg, val):
+        if reg==self.MODE and val>self.RAMP:
+            return 1
+        if reg in (self.PHY_ERRORS,self.LINK_ERRORS):
+            return 0
+        return RegisterTerminal.set_reg(self,reg,val)
+
+    def read(self, reg, length):
+        if reg!=self.DATA:
+            return RegisterTerminal.read(self,reg,length)
+        t0=time.time()
+        data=self.pattern(length).tobytes()
+        self._account(length,t0)
+        return data, 0
+
+    def write(self, reg, data):
+        if reg!=self.DATA:
+            return RegisterTerminal.write(self,reg,data)
+        t0=time.time()
+        errors=bit_errors=dropped=0
+        if self.regs[self.VERIFY]:
+            got=numpy.frombuffer(data,dtype=numpy.uint8)
+            n=len(got)&~3
+            if self.regs[self.MODE]==1:
+                errors,bit_errors,dropped=prbs.check(got[:n],self.regs[self.SEED])
+            else:
+                x=got[:n]^self.pattern(n)
+                bc=prbs._POPCOUNT[x].reshape(-1,4).sum(axis=1)
+                errors=int(numpy.count_nonzero(bc))
+                bit_errors=int(bc.sum())
+        self.stats.update({ self.ERRORS:errors, self.BIT_ERRORS:bit_errors, self.DROPPED:dropped })
+        self._account(len(data),t0)
+        return 0
+
+class MemBenchTerminal(RegisterTerminal):
+    """
+        Model of firmware/membench.c.  Runs time numpy copies on the host
+        (dma calls time a buffer copy) and dma_stats fails like a build
+        without -DDMA_STATS.  Runs finish before the set returns.
+    """
+    SIZE,ITERS,METHOD,DCACHE,RUN,ELAPSED,TICKS_HZ,DMA_BUF_SIZE,DMA_STATS,STATUS,GET_TICKS,COMMIT_TICKS=range(12)
+    DMA_CALLS=3
+    TICKS_PER_SEC=1000000
+    MAX_SIZE=16384
+
+    def __init__(self, addr=7):
+        RegisterTerminal.__init__(self, addr, 4, { self.SIZE:4096, self.ITERS:256,
+                                                  self.METHOD:0, self.DCACHE:0 })
+        self.elapsed=0
+        self.status=0
+        self.calls=(0,0)
+
+    def get_reg(self, reg):
+        if reg==self.ELAPSED: return self.elapsed
+        if reg==self.RUN: return 0
+        if reg==self.STATUS: return self.status
+        if reg==self.GET_TICKS: return self.calls[0]
+        if reg==self.COMMIT_TICKS: return self.calls[1]
+        if reg==self.TICKS_HZ: return self.TICKS_PER_SEC
+        if reg==self.DMA_BUF_SIZE: return self.device.max_packet*2
+        return RegisterTerminal.get_reg(self,reg)
+
+    def set_reg(self, reg, val):
+        if reg==self.RUN:
+            size=self.regs[self.SIZE]
+            if not size or size>self.MAX_SIZE:
+                return 1
+            self.status=self.run()
+            return 0
+        if reg==self.METHOD and val>self.DMA_CALLS:
+            return 1
+        return RegisterTerminal.set_reg(self,reg,val)
+
+    def run(self):
+        size=self.regs[self.SIZE]
+        if not size or size>self.MAX_SIZE:
+            return 1
+        src=numpy.arange(size,dtype=numpy.uint32).astype(numpy.uint8)
+        dst=numpy.zeros(size,dtype=numpy.uint8)
+        t0=time.time()
+        for i in range(self.regs[self.ITERS]):
+            if self.regs[self.METHOD]==2:
+                dst.fill(i & 0xff)
+            else:
+                numpy.copyto(dst,src)
+        self.elapsed=int((time.time()-t0)*self.TICKS_PER_SEC)
+        self.calls=(self.elapsed//2,self.elapsed-self.elapsed//2) if self.regs[self.METHOD]==self.DMA_CALLS else (0,0)
+        return 0
+
+class Fx3Terminal(RegisterTerminal):
+    """Model of firmware/fx3_term.c."""
+    VERSION,USBVER,USB3,RDWR_INIT_STAT,FORCE_USB2=range(5)
+
+    def __init__(self, addr=0x100, version=FIRMWARE_VERSION):
+        RegisterTerminal.__init__(self, addr, 2, { self.FORCE_USB2:0 })
+        self.version=version
+
+    def get_reg(self, reg):
+        if reg==self.VERSION: return self.version
+        if reg==self.USBVER: return USBVER
+        if reg==self.USB3: return 1 if self.device.max_packet==1024 else 0
+        if reg==self.RDWR_INIT_STAT: return 0
+        return RegisterTerminal.get_reg(self,reg)
+
+class PromTerminal(Terminal):
+    """M24XX prom.  Byte addressed and the serial number lives at the end."""
+    SIZE=1<<17
+    SERIAL_ADDR=SIZE-P.SERIAL_LEN
+
+    def __init__(self, addr=0x50):
+        Terminal.__init__(self,addr)
+        self.mem=bytearray(b'\xff'*self.SIZE)
+
+    def read(self, reg, length):
+        if reg+length > self.SIZE:
+            return bytes(length), 1
+        return bytes(self.mem[reg:reg+length]), 0
+
+    def write(self, reg, data):
+        if reg+len(data) > self.SIZE:
+            return 1
+        self.mem[reg:reg+len(data)]=data
+        return 0
+
+    @property
+    def serial(self):
+        return bytes(self.mem[self.SERIAL_ADDR:self.SIZE])
+
+    @serial.setter
+    def serial(self, b):
+        self.mem[self.SERIAL_ADDR:self.SIZE]=b
+
+################################################################################
+
+class Device(object):
+    """
+        The protocol side of the emulator without any usb.  setup()
+        handles ep0 requests and transaction() runs the data phase of a
+        VC_HI_RDWR against the bulk endpoints.
+    """
+    def __init__(self, version=FIRMWARE_VERSION, serial=None, max_packet=512):
+        self.max_packet=max_packet
+        self.prom=PromTerminal()
+        self.terminals={}
+        for t in (DummyTerminal(5), BenchTerminal(), MemBenchTerminal(),
+                  Fx3Terminal(version=version), self.prom):
+            self.add_terminal(t)
+        if serial is not None:
+            self.prom.serial=P.encode_serial(serial)
+        self.renum=None # called for VC_RENUM
+        self.stream_stop=threading.Event()
+        self.abort=threading.Event()
+        self.busy=False
+        # the next delay_acks gets hold their ack ack_delay seconds, past
+        # the host's timeout, so its retry path can be exercised.  Their
+        # retries (same seq) aren't held.
+        self.delay_acks=0
+        self.ack_delay=2.0
+        self.delayed_seq=None
+        self.notify=queue.Queue(NOTIFY_RING) # notify_pkt_t records to send
+        self.notify_seq=0
+
+    def post(self, event, arg0=0, arg1=0):
+        """Queues a notification like notify_post.  False if dropped."""
+        rec=P.pack_notify(event,self.notify_seq,arg0,arg1,int(time.monotonic()*TICKS_HZ))
+        self.notify_seq=(self.notify_seq+1) & 0xffff # dropped records leave a gap
+        try:
+            self.notify.put_nowait(rec)
+            return True
+        except queue.Full:
+            return False
+
+    def add_terminal(self, t):
+        t.device=self
+        self.terminals[t.addr]=t
+
+    @property
+    def serial(self):
+        return P.decode_serial(self.prom.serial)
+
+    def accepts(self, bReqType, bRequest, wValue, wLength):
+        """False if the request should be stalled before its data stage."""
+        if bRequest==P.VC_HI_RDWR:
+            if bReqType!=0x40 or wLength not in (P.HEADER.size,P.HEADER_V0.size):
+                return False
+            if wValue not in self.terminals:
+                log.warning("No handler for terminal %d" % wValue)
+                return False
+            return True
+        if bRequest==P.VC_SERIAL:
+            return bReqType in (0x40,0xc0) and wLength==P.SERIAL_LEN
+        if bRequest in (P.VC_RENUM,P.VC_STREAM_STOP,P.VC_ABORT):
+            return bReqType==0x40
+        if bRequest==P.VC_TIME:
+            return bReqType==0xc0 and wLength>=P.TIME.size
+        return False
+
+    def setup(self, bReqType, bRequest, wValue, wIndex, wLength, data=None):
+        """
+            Returns (response, header).  response is the IN data stage (or
+            b'' to ack an OUT request) or None to stall.  header is the
+            (command,term,reg,length) of a transaction to start.
+        """
+        if not self.accepts(bReqType, bRequest, wValue, wLength):
+            return None, None
+        if bRequest==P.VC_HI_RDWR:
+            h=P.unpack_header(data or b'')
+            if h is None or h[1] not in self.terminals:
+                return None, None
+            self.stream_stop.clear()
+            self.abort.clear()
+            self.busy=True
+            return b'', h
+        if bRequest==P.VC_SERIAL:
+            if bReqType==0xc0:
+                return self.prom.serial, None
+            if data is None or len(data)!=P.SERIAL_LEN:
+                return None, None
+            self.prom.serial=bytes(data)
+            log.info("Setting new serial number: %s" % self.serial)
+            return b'', None
+        if bRequest==P.VC_STREAM_STOP:
+            self.stream_stop.set()
+            return b'', None
+        if bRequest==P.VC_TIME:
+            return P.pack_time(int(time.monotonic()*TICKS_HZ),TICKS_HZ), None
+        if bRequest==P.VC_ABORT:
+            if self.busy:
+                self.abort.set()
+            return b'', None
+        # VC_RENUM
+        if self.renum:
+            threading.Thread(target=self.renum).start()
+        return b'', None
+
+    def transaction(self, header, ep_read, ep_write):
+        """
+            Runs the data phase and ack.  ep_read(n) returns up to n bytes
+            from the OUT endpoint and ep_write(b) sends on the IN endpoint.
+            VC_ABORT is checked between chunks.
+        """
+        try:
+            return self._transaction(header, ep_read, ep_write)
+        finally:
+            self.busy=False
+
+    def _transaction(self, header, ep_read, ep_write):
+        command,term,reg,length,seq,flags=header
+        t=self.terminals[term]
+        chunk=64<<10
+        t0=time.monotonic()
+        if length==P.STREAM_LENGTH and not P.is_write(command):
+            return self.stream(t, reg, ep_write, seq, flags)
+        if P.is_write(command):
+            data=bytearray()
+            while len(data)<length and not self.abort.is_set():
+                b=ep_read(min(chunk,length-len(data)))
+                if not b:
+                    break
+                data+=b
+            if self.abort.is_set():
+                return self._aborted(ep_write, seq, flags)
+            status=t.write(reg,data)
+            chk=P.checksum(data)
+        else:
+            data,status=t.read(reg,length)
+            for i in range(0,length,chunk):
+                if self.abort.is_set():
+                    return self._aborted(ep_write, seq, flags)
+                ep_write(data[i:i+chunk])
+            chk=P.checksum(data)
+        if command==P.COMMAND_GET and self.delay_acks>0 and seq!=self.delayed_seq:
+            self.delay_acks-=1
+            self.delayed_seq=seq
+            log.info("Holding the ack of seq %d %.1fs" % (seq,self.ack_delay))
+            time.sleep(self.ack_delay)
+        if flags & P.FLAG_EXT_ACK:
+            ticks=lambda t: int(t*TICKS_HZ)
+            ep_write(P.pack_ext_ack(status,chk,seq,ticks(t0),ticks(time.monotonic()),TICKS_HZ,
+                                    nbytes=len(data),handler_status=status))
+        else:
+            ep_write(P.pack_ack(status,chk,seq))
+        return status
+
+    def _aborted(self, ep_write, seq, flags=0):
+        if flags & P.FLAG_EXT_ACK:
+            ep_write(P.pack_ext_ack(P.STATUS_ABORTED,0,seq,ticks_hz=TICKS_HZ))
+        else:
+            ep_write(P.pack_ack(P.STATUS_ABORTED,0,seq))
+        return P.STATUS_ABORTED
+
+    def stream(self, t, reg, ep_write, seq=0, flags=0, chunk=64<<10):
+        """
+            Full chunks until VC_STREAM_STOP then the stream ack.  With
+            FLAG_FRAMING each chunk is a frame.  Compressed frames are
+            padded to whole packets like the firmware's.
+        """
+        framed=flags & P.FLAG_FRAMING
+        codec=(flags & P.FLAG_COMPRESS_MASK) >> P.FLAG_COMPRESS_SHIFT
+        if codec and not framed:
+            ep_write(P.pack_stream_ack(1,0,seq))
+            return 1
+        if framed:
+            chunk-=P.FRAME.size+(P.COMPRESS.size if codec else 0)
+        total=0
+        status=0
+        first=True
+        while not self.stream_stop.is_set():
+            if self.abort.is_set():
+                status|=P.STATUS_ABORTED
+                break
+            data,s=t.stream(reg,chunk,first)
+            first=False
+            status|=s
+            if codec:
+                frame=compress.encode(data,codec)
+                frame=P.pack_frame(total//chunk,len(frame),int(time.monotonic()*TICKS_HZ),status)+frame
+                ep_write(frame+bytes(-len(frame) % self.max_packet))
+            elif framed:
+                # one write so the header doesn't end up a short packet
+                ep_write(P.pack_frame(total//chunk,len(data),int(time.monotonic()*TICKS_HZ),status)+bytes(data))
+            else:
+                ep_write(data)
+            total+=len(data)
+        ep_write(P.pack_stream_ack(status,total,seq))
+        return status
+
+################################################################################
+# FunctionFS
+
+FUNCTIONFS_DESCRIPTORS_MAGIC_V2=3
+FUNCTIONFS_STRINGS_MAGIC=2
+FUNCTIONFS_HAS_FS_DESC=1
+FUNCTIONFS_HAS_HS_DESC=2
+FUNCTIONFS_HAS_SS_DESC=4
+FUNCTIONFS_ALL_CTRL_RECIP=64
+
+FUNCTIONFS_BIND,FUNCTIONFS_UNBIND,FUNCTIONFS_ENABLE,FUNCTIONFS_DISABLE,FUNCTIONFS_SETUP,FUNCTIONFS_SUSPEND,FUNCTIONFS_RESUME=range(7)
+EVENT=struct.Struct('<BBHHHB3x') # usb_functionfs_event
+
+def _intf(alt, neps):
+    # same class/subclass/protocol as firmware/dscr.c
+    return struct.pack('<BBBBBBBBB', 9, 4, 0, alt, neps, 0xff, 0x1f, 0x01, 0)
+
+def _ep(addr, maxpacket, eptype=2, interval=0):
+    return struct.pack('<BBBBHB', 7, 5, addr, eptype, maxpacket, interval)
+
+def _ss_comp(bytes_per_interval=0):
+    return struct.pack('<BBBBH', 6, 0x30, 0, 0, bytes_per_interval)
+
+def _notify_ep(interval):
+    return _ep(P.EP_NOTIFY, P.NOTIFY_PKT_SIZE, 3, interval)
+
+def descriptors():
+    """FunctionFS v2 descriptors mirroring the firmware interface."""
+    fs=[_intf(0,0), _intf(1,3), _ep(P.EP_OUT,64), _ep(P.EP_IN,64), _notify_ep(1)]
+    hs=[_intf(0,0), _intf(1,3), _ep(P.EP_OUT,512), _ep(P.EP_IN,512), _notify_ep(4)]
+    ss=[_intf(0,0), _intf(1,3), _ep(P.EP_OUT,1024), _ss_comp(), _ep(P.EP_IN,1024), _ss_comp(),
+        _notify_ep(4), _ss_comp(P.NOTIFY_PKT_SIZE)]
+    flags=FUNCTIONFS_HAS_FS_DESC|FUNCTIONFS_HAS_HS_DESC|FUNCTIONFS_HAS_SS_DESC|FUNCTIONFS_ALL_CTRL_RECIP
+    body=struct.pack('<III',len(fs),len(hs),len(ss))+b''.join(fs+hs+ss)
+    return struct.pack('<III',FUNCTIONFS_DESCRIPTORS_MAGIC_V2,12+len(body),flags)+body
+
+def strings():
+    return struct.pack('<IIII',FUNCTIONFS_STRINGS_MAGIC,16,0,0)
+
+class FunctionFS(object):
+    """
+        Serves a Device on a mounted FunctionFS instance.  ep1 is the OUT
+        endpoint, ep2 the IN endpoint and ep3 the notify endpoint
+        (descriptor order.)
+    """
+    def __init__(self, device, path):
+        self.device=device
+        self.path=path
+        self.ep0=os.open(os.path.join(path,'ep0'), os.O_RDWR)
+        os.write(self.ep0, descriptors())
+        os.write(self.ep0, strings())
+        self.ep_out=self.ep_in=self.ep_notify=None
+        self.work=queue.Queue()
+        self.worker=threading.Thread(target=self._data_thread)
+        self.worker.daemon=True
+        self.worker.start()
+        self.notifier=threading.Thread(target=self._notify_thread)
+        self.notifier.daemon=True
+        self.notifier.start()
+
+    def _open_eps(self):
+        self._close_eps()
+        self.ep_out=os.open(os.path.join(self.path,'ep1'), os.O_RDWR)
+        self.ep_in=os.open(os.path.join(self.path,'ep2'), os.O_RDWR)
+        self.ep_notify=os.open(os.path.join(self.path,'ep3'), os.O_RDWR)
+
+    def _close_eps(self):
+        for fd in (self.ep_out,self.ep_in,self.ep_notify):
+            if fd is not None:
+                os.close(fd)
+        self.ep_out=self.ep_in=self.ep_notify=None
+
+    def _notify_thread(self):
+        # like notify_flush: whatever is queued, several records a packet
+        per_pkt=P.NOTIFY_PKT_SIZE//P.NOTIFY.size
+        while True:
+            recs=[self.device.notify.get()]
+            while len(recs)<per_pkt and not self.device.notify.empty():
+                recs.append(self.device.notify.get())
+            if self.ep_notify is None:
+                continue # not configured, nobody to send to
+            try:
+                os.write(self.ep_notify, b''.join(recs))
+            except OSError as e:
+                log.warning("Notify dropped: %s" % e)
+
+    def _data_thread(self):
+        while True:
+            h=self.work.get()
+            if h is None:
+                return
+            try:
+                self.device.transaction(h,
+                    lambda n: os.read(self.ep_out,n),
+                    lambda b: os.write(self.ep_in,b))
+            except OSError as e:
+                log.warning("Transaction %s aborted: %s" % (str(h),e))
+
+    def _stall(self, bReqType):
+        # ep0 io in the wrong direction stalls the request
+        try:
+            if bReqType & 0x80:
+                os.read(self.ep0,0)
+            else:
+                os.write(self.ep0,b'')
+        except OSError:
+            pass
+
+    def _setup(self, bReqType, bRequest, wValue, wIndex, wLength):
+        if not self.device.accepts(bReqType,bRequest,wValue,wLength):
+            log.debug("VC stalled %02x %02x" % (bReqType,bRequest))
+            self._stall(bReqType)
+            return
+        data=None
+        if not bReqType & 0x80 and wLength:
+            data=os.read(self.ep0,wLength) # acks the request
+        resp,header=self.device.setup(bReqType,bRequest,wValue,wIndex,wLength,data)
+        if resp is None:
+            # too late to stall once the data stage is done.  The host
+            # finds out when the ack never arrives (same as the firmware.)
+            log.warning("VC %02x failed after data stage" % bRequest)
+            return
+        if bReqType & 0x80:
+            os.write(self.ep0,resp[:wLength])
+        elif data is None:
+            os.read(self.ep0,0) # status stage
+        if header:
+            self.work.put(header)
+
+    def serve(self):
+        while True:
+            buf=os.read(self.ep0,EVENT.size*4)
+            for i in range(0,len(buf),EVENT.size):
+                bReqType,bRequest,wValue,wIndex,wLength,etype=EVENT.unpack(buf[i:i+EVENT.size])
+                if etype==FUNCTIONFS_SETUP:
+                    self._setup(bReqType,bRequest,wValue,wIndex,wLength)
+                elif etype==FUNCTIONFS_ENABLE:
+                    self._open_eps()
+                    self._log_eps()
+                elif etype in (FUNCTIONFS_DISABLE,FUNCTIONFS_UNBIND):
+                    self._close_eps()
+                    log.info("Disabled")
+
+    def _log_eps(self):
+        # FUNCTIONFS_ENDPOINT_DESC ioctl has the addresses the udc picked
+        try:
+            import fcntl
+            for name,fd in (('out',self.ep_out),('in',self.ep_in)):
+                d=bytearray(9)
+                fcntl.ioctl(fd, 0x80096782, d)
+                maxp=struct.unpack('<H',bytes(d[4:6]))[0]
+                self.device.max_packet=maxp
+                log.info("Enabled ep %s 0x%02x max packet %d" % (name,d[2],maxp))
+                want=P.EP_OUT if name=='out' else P.EP_IN
+                if d[2]!=want:
+                    log.warning("ep %s is 0x%02x, not the firmware's 0x%02x: use rawusb, get_dev() won't find it" % (
+                        name,d[2],want))
+        except Exception as e:
+            log.info("Enabled (%s)" % e)
+
+################################################################################
+# configfs
+
+GADGET_ROOT='/sys/kernel/config/usb_gadget'
+
+class Gadget(object):
+    """Creates a configfs gadget with one FunctionFS function and binds it."""
+    def __init__(self, name, vid, pid, serial, udc=None):
+        self.path=os.path.join(GADGET_ROOT,name)
+        self.name=name
+        self.udc=udc
+        self.ffs='/dev/ffs-%s' % name
+        func=os.path.join(self.path,'functions','ffs.%s' % name)
+        conf=os.path.join(self.path,'configs','c.1')
+        for d in (self.path, os.path.join(self.path,'strings','0x409'), func,
+                  conf, os.path.join(conf,'strings','0x409'), self.ffs):
+            if not os.path.isdir(d):
+                os.makedirs(d)
+        self._w('idVendor','0x%04x' % vid)
+        self._w('idProduct','0x%04x' % pid)
+        self._w('bcdDevice','0x%04x' % USBVER)
+        self._w('strings/0x409/serialnumber',serial)
+        self._w('strings/0x409/product','Nitro FX3 emulator')
+        self._w('configs/c.1/MaxPower','400')
+        link=os.path.join(conf,'ffs.%s' % name)
+        if not os.path.islink(link):
+            os.symlink(func,link)
+        if not os.path.ismount(self.ffs):
+            if os.system('mount -t functionfs %s %s' % (name,self.ffs)):
+                raise Exception("Unable to mount functionfs at %s" % self.ffs)
+
+    def _w(self, f, val):
+        with open(os.path.join(self.path,f),'w') as fh:
+            fh.write(val)
+
+    def bind(self):
+        """Connects to the udc.  The FunctionFS descriptors must be written first."""
+        udc=self.udc or sorted(os.listdir('/sys/class/udc'))[0]
+        self._w('UDC',udc)
+        log.info("Bound %s to %s" % (self.name,udc))
+
+    def unbind(self):
+        self._w('UDC','\n')
+
+    def renum(self):
+        self.unbind()
+        time.sleep(1)
+        self.bind()
+
+def main():
+    parser=argparse.ArgumentParser(description="Nitro FX3 FunctionFS emulator")
+    parser.add_argument('--config', default=None, help='firmware config.mk for VID/PID/FIRMWARE_VERSION')
+    parser.add_argument('--serial', default='EMU00001')
+    parser.add_argument('--name', default='nitro')
+    parser.add_argument('--udc', default=None, help='udc to bind (default first in /sys/class/udc)')
+    parser.add_argument('--delay-acks', type=int, default=0, help='hold the ack of this many gets (see rawusb --check-retry)')
+    parser.add_argument('--ack-delay', type=float, default=2.0, help='seconds to hold them')
+    args=parser.parse_args()
+    logging.basicConfig(level=logging.INFO)
+
+    cfg=read_config(args.config) if args.config else \
+        { 'VID':VID, 'PID':PID, 'FIRMWARE_VERSION':FIRMWARE_VERSION }
+    dev=Device(cfg['FIRMWARE_VERSION'], args.serial)
+    dev.delay_acks=args.delay_acks
+    dev.ack_delay=args.ack_delay
+    gadget=Gadget(args.name, cfg['VID'], cfg['PID'], args.serial, args.udc)
+    ffs=FunctionFS(dev, gadget.ffs)
+    dev.renum=gadget.renum
+    gadget.bind()
+    log.info("Serving 0x%04x:0x%04x serial %s" % (cfg['VID'],cfg['PID'],args.serial))
+    try:
+        ffs.serve()
+    finally:
+        gadget.unbind()
+
+if __name__=='__main__':
+    main()
@@ -0,0 +1,96 @@
+"""
+    Line rate link integrity test using the BENCH terminal.
+
+    write: the host streams PRBS31 and the firmware checks it as it
+           arrives.
+    read:  the firmware generates PRBS31 and the host checks it.
+
+    Reports bit error rate, dropped buffers (times the checker relocked to
+    the stream), the USB3 phy/link error counters and the sustained
+    throughput::
+
+        python -m nitro_parts.Cypress.fx3.linktest --seconds 60 --direction both
+"""
+
+import time, argparse
+import logging, numpy
+from . import prbs
+log=logging.getLogger(__name__)
+
+PATTERN_PRBS=1
+
+def setup(dev, seed, verify):
+    dev.set('BENCH','mode',PATTERN_PRBS)
+    dev.set('BENCH','seed',seed)
+    dev.set('BENCH','verify',1 if verify else 0)
+
+def run(dev, direction='write', seconds=10.0, size=16<<20, seed=1):
+    """
+        Streams size byte transactions in direction for seconds.  Returns
+        a dict of totals.
+    """
+    expected=prbs.pattern(seed,size)
+    buf=expected.copy() if direction=='write' else numpy.zeros(size,dtype=numpy.uint8)
+    setup(dev,seed,direction=='write')
+    dev.set('BENCH','phy_errors',0)
+
+    res={ 'direction':direction, 'bytes':0, 'transactions':0,
+          'word_errors':0, 'bit_errors':0, 'dropped':0 }
+    t0=time.time()
+    busy=0.0
+    while time.time()-t0 < seconds:
+        t=time.time()
+        if direction=='write':
+            dev.write('BENCH','data',buf)
+            busy+=time.time()-t
+            res['word_errors']+=dev.get('BENCH','errors')
+            res['bit_errors']+=dev.get('BENCH','bit_errors')
+            res['dropped']+=dev.get('BENCH','dropped')
+        else:
+            dev.read('BENCH','data',buf)
+            busy+=time.time()-t
+            if not numpy.array_equal(buf,expected):
+                e,b,d=prbs.check(buf,seed)
+                res['word_errors']+=e
+                res['bit_errors']+=b
+                res['dropped']+=d
+        res['bytes']+=size
+        res['transactions']+=1
+
+    res['seconds']=time.time()-t0
+    res['MBps']=res['bytes']/busy/1e6 if busy else 0.0
+    res['ber']=float(res['bit_errors'])/(res['bytes']*8) if res['bytes'] else 0.0
+    res['phy_errors']=dev.get('BENCH','phy_errors')
+    res['link_errors']=dev.get('BENCH','link_errors')
+    return res
+
+def report(res):
+    ber="%.3g" % res['ber'] if res['bit_errors'] else "< %.3g" % (1.0/(res['bytes']*8))
+    print("%-5s %10.1f MB/s  %d bytes  BER %s  bit errors %d  word errors %d  dropped %d  phy %d  link %d" % (
+        res['direction'], res['MBps'], res['bytes'], ber, res['bit_errors'],
+        res['word_errors'], res['dropped'], res['phy_errors'], res['link_errors'] ))
+
+def main():
+    import nitro_parts.Cypress.fx3 as fx3
+    parser=argparse.ArgumentParser(description="FX3 PRBS link test")
+    parser.add_argument('--seconds', type=float, default=10.0, help='seconds per direction')
+    parser.add_argument('--size', type=int, default=16<<20, help='bytes per transaction')
+    parser.add_argument('--seed', type=lambda x: int(x,0), default=1)
+    parser.add_argument('--direction', choices=['write','read','both'], default='both')
+    parser.add_argument('--serial', default=None)
+    args=parser.parse_args()
+    logging.basicConfig(level=logging.INFO)
+
+    dev=fx3.get_dev(serial_num=args.serial)
+    log.info("Link %s" % ('USB3' if dev.get('FX3','USB3') else 'USB2'))
+    dirs=['write','read'] if args.direction=='both' else [args.direction]
+    failed=False
+    for d in dirs:
+        res=run(dev,d,args.seconds,args.size,args.seed)
+        report(res)
+        failed = failed or res['bit_errors'] or res['dropped']
+    dev.close()
+    raise SystemExit(1 if failed else 0)
+
+if __name__=='__main__':
+    main()
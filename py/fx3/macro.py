@@ -0,0 +1,186 @@
+"""
+    Host side of the firmware register macros (firmware/macro.c).
+
+    A macro is a list of gets, sets, waits and polls the firmware runs
+    against its own terminals.  A whole sequence then costs one run and
+    one result read instead of a round trip per register::
+
+        from nitro_parts.Cypress.fx3 import macro
+        m=macro.Macro(dev)
+        m.set('SENSOR','reset',1)
+        m.wait(2)
+        m.set('SENSOR','reset',0)
+        m.poll('SENSOR','status',0x1,mask=0x1,timeout=50)
+        m.get('SENSOR','id',name='id')
+        macro.load(dev,0,m)
+        r=macro.run(dev,0)
+        print(r['status'], m.decode(r['data'])['id'])
+
+    Runs can also be triggered by a gpio edge or a timer (arm) in which
+    case the result holds the last run.  NOTIFY_MACRO on the notify
+    endpoint says when a run finished.
+
+        python -m nitro_parts.Cypress.fx3.macro --slot 0 --run
+"""
+
+import time, struct, argparse
+import logging, numpy
+log=logging.getLogger(__name__)
+
+# macro_op_t: op, width, term, reg, val, mask, arg
+OP=struct.Struct('<BBHIIII')
+OP_END, OP_SET, OP_GET, OP_WAIT, OP_POLL, OP_JUMP_EQ, OP_JUMP_NE = range(7)
+
+# macro_result_t
+RESULT=struct.Struct('<HHBBHIIIII')
+RESULT_FIELDS=('status','handler_status','slot','trigger','pc','steps','run','t_start','t_end','bytes')
+STATUS_NAMES=('ok','handler','timeout','steps','full','bad_op')
+
+TRIGGERS={ 'none':0, 'rising':1, 'falling':2, 'both':3, 'timer':4 }
+MAX_OPS=64
+
+def resolve(dev, term, reg):
+    """(term, reg) addresses for names in dev's di.  Addresses pass through."""
+    if isinstance(term,str):
+        t=dev.get_di()[term]
+        if isinstance(reg,str):
+            reg=t[reg].addr
+        term=t.addr
+    return term, reg
+
+class Macro(object):
+    def __init__(self, dev=None):
+        """
+            dev is only needed to look up terminal and register names in
+            its di.  Addresses work without it.
+        """
+        self.dev=dev
+        self.ops=[] # [op, width, term, reg, val, mask, arg or label]
+        self.labels={}
+        self.gets=[] # (name, width) of each GET in result order
+
+    def _op(self, op, width=0, term=0, reg=0, val=0, mask=0, arg=0):
+        term,reg=resolve(self.dev,term,reg)
+        self.ops.append([op, width, term, reg, val & 0xffffffff, mask & 0xffffffff, arg])
+        if len(self.ops) > MAX_OPS:
+            raise ValueError("Macro is longer than %d ops" % MAX_OPS)
+
+    def set(self, term, reg, val, width=4):
+        self._op(OP_SET, width, term, reg, val)
+
+    def get(self, term, reg, width=4, name=None):
+        """Adds the register to the result.  name is the decode() key."""
+        self._op(OP_GET, width, term, reg)
+        self.gets.append((name or '%s.%s' % (term, reg), width))
+
+    def wait(self, ms):
+        self._op(OP_WAIT, val=ms)
+
+    def poll(self, term, reg, val, mask=0xffffffff, timeout=100, width=4):
+        """Reads every ms until (value & mask) == val.  Fails the run after timeout ms."""
+        self._op(OP_POLL, width, term, reg, val, mask, timeout)
+
+    def label(self, name):
+        self.labels[name]=len(self.ops)
+
+    def jump(self, label, val=0, mask=0, eq=True):
+        """
+            Continues at label if (last get or poll value & mask) == val
+            (!= val if not eq.)  The defaults always jump.
+        """
+        self._op(OP_JUMP_EQ if eq else OP_JUMP_NE, val=val, mask=mask, arg=label)
+
+    def pack(self):
+        """The macro_op_t program."""
+        out=b''
+        for op in self.ops:
+            arg=op[6]
+            if op[0] in (OP_JUMP_EQ, OP_JUMP_NE) and not isinstance(arg,int):
+                arg=self.labels[arg]
+            out+=OP.pack(*(op[:6]+[arg]))
+        return out
+
+    def decode(self, data):
+        """Dict of the GET values in a result's data."""
+        vals={}
+        off=0
+        for name,width in self.gets:
+            vals[name]=int.from_bytes(bytes(data[off:off+width]),'little')
+            off+=width
+        return vals
+
+def load(dev, slot, macro):
+    """Loads a Macro (or packed ops) into slot."""
+    prog=macro.pack() if isinstance(macro,Macro) else bytes(macro)
+    dev.set('MACRO','slot',slot)
+    dev.write('MACRO','program',numpy.frombuffer(prog,dtype=numpy.uint8).copy())
+
+def arm(dev, slot, trigger, pin=None, period=None):
+    """Runs slot on trigger ('rising', 'falling', 'both' of pin, 'timer' every period ms or 'none'.)"""
+    dev.set('MACRO','slot',slot)
+    dev.set('MACRO','trigger',0)
+    if pin is not None:
+        dev.set('MACRO','pin',pin)
+    if period is not None:
+        dev.set('MACRO','period',period)
+    dev.set('MACRO','trigger',TRIGGERS.get(trigger,trigger))
+
+def result(dev, slot, nbytes=None):
+    """
+        The last run of slot as a dict of the macro_result_t fields plus
+        data, the GET values.  Reads the header first unless nbytes is
+        known.
+    """
+    dev.set('MACRO','slot',slot)
+    if nbytes is None:
+        buf=numpy.zeros(RESULT.size,dtype=numpy.uint8)
+        dev.read('MACRO','result',buf)
+        nbytes=RESULT.unpack(buf.tobytes())[-1]
+    buf=numpy.zeros(RESULT.size+nbytes,dtype=numpy.uint8)
+    dev.read('MACRO','result',buf)
+    r=dict(zip(RESULT_FIELDS,RESULT.unpack_from(buf.tobytes())))
+    r['data']=buf[RESULT.size:RESULT.size+r['bytes']].tobytes()
+    return r
+
+def run(dev, slot, timeout=1.0):
+    """Runs slot and returns its result."""
+    dev.set('MACRO','slot',slot)
+    runs=dev.get('MACRO','runs')
+    dev.set('MACRO','run',slot)
+    t_end=time.time()+timeout
+    while dev.get('MACRO','runs') == runs:
+        if time.time() > t_end:
+            raise Exception("Macro %d didn't finish" % slot)
+        time.sleep(0.001)
+    r=result(dev, slot)
+    if r['status']:
+        log.warning("macro %d stopped at op %d: %s (handler status %d)" % (
+            slot, r['pc'], STATUS_NAMES[r['status']], r['handler_status']))
+    return r
+
+def main():
+    import nitro_parts.Cypress.fx3 as fx3
+    parser=argparse.ArgumentParser(description="FX3 register macros")
+    parser.add_argument('--slot', type=int, default=0)
+    parser.add_argument('--run', action='store_true', help='run the slot first')
+    parser.add_argument('--trigger', default=None, choices=sorted(TRIGGERS))
+    parser.add_argument('--pin', type=int, default=None)
+    parser.add_argument('--period', type=int, default=None, help='ms between timer runs')
+    parser.add_argument('--serial', default=None)
+    args=parser.parse_args()
+    logging.basicConfig(level=logging.INFO)
+
+    dev=fx3.get_dev(serial_num=args.serial)
+    if args.trigger:
+        arm(dev, args.slot, args.trigger, args.pin, args.period)
+    r=run(dev, args.slot) if args.run else result(dev, args.slot)
+    log.info("slot %d run %d: %s after %d ops, %d bytes: %s" % (r['slot'], r['run'],
+        STATUS_NAMES[r['status']], r['steps'], r['bytes'], r['data'].hex()))
+    dev.set('MACRO','slot',args.slot)
+    missed=dev.get('MACRO','missed')
+    if missed:
+        log.info("%d triggers missed" % missed)
+    dev.close()
+
+if __name__=='__main__':
+    main()
@@ -0,0 +1,128 @@
+"""
+    Internal bandwidth ceilings measured by the MEMBENCH terminal.
+
+    Sweeps CyU3PMemCopy, a word copy loop, CyU3PMemSet and dma
+    GetBuffer/CommitBuffer calls over buffer sizes with the data cache off
+    and on, then (if the firmware was built with -DDMA_STATS) times the
+    cpu handler dma calls during a BENCH read and write::
+
+        python -m nitro_parts.Cypress.fx3.membench
+"""
+
+import argparse, time
+import logging, numpy
+log=logging.getLogger(__name__)
+
+METHODS=['memcopy','wordcopy','memset']
+DMA_CALLS=3 # MEMBENCH_DMA_CALLS
+DEFAULT_SIZES=[64,256,1024,4096,16384]
+DMA_STATS=['get(read)','commit','get(write)','discard']
+
+def run(dev, size, iters, method=0, dcache=0, timeout=10):
+    """
+        Runs MEMBENCH and returns the elapsed seconds.  The firmware runs
+        it from the app thread after the set so poll until it's done.
+    """
+    dev.set('MEMBENCH','size',size)
+    dev.set('MEMBENCH','iters',iters)
+    dev.set('MEMBENCH','method',method)
+    dev.set('MEMBENCH','dcache',dcache)
+    dev.set('MEMBENCH','run',1)
+    t0=time.time()
+    while dev.get('MEMBENCH','run'):
+        if time.time()-t0 > timeout:
+            raise IOError("membench run didn't finish")
+        time.sleep(0.001)
+    status=dev.get('MEMBENCH','status')
+    if status:
+        raise IOError("membench run failed %d" % status)
+    return dev.get('MEMBENCH','elapsed')/float(dev.get('MEMBENCH','ticks_hz'))
+
+def copy_rate(dev, size, method=0, dcache=0, total=1<<22):
+    """MB/s for the given copy method, size and cache setting."""
+    iters=max(1,total//size)
+    elapsed=run(dev,size,iters,method,dcache)
+    if not elapsed:
+        return float('inf')
+    return size*iters/elapsed/1e6
+
+def dma_call_us(dev, size, dcache=0, iters=1000):
+    """us per GetBuffer and per CommitBuffer on a manual channel of size byte buffers."""
+    run(dev,size,iters,DMA_CALLS,dcache)
+    hz=float(dev.get('MEMBENCH','ticks_hz'))
+    return (1e6*dev.get('MEMBENCH','get_ticks')/hz/iters,
+            1e6*dev.get('MEMBENCH','commit_ticks')/hz/iters)
+
+def sweep(dev, sizes=DEFAULT_SIZES):
+    """Returns {(method,dcache): {size: MB/s}} and {dcache: {size: (get us, commit us)}}."""
+    res={}
+    calls={}
+    for dcache in (0,1):
+        for m,name in enumerate(METHODS):
+            res[(name,dcache)]={ s:copy_rate(dev,s,m,dcache) for s in sizes }
+        calls[dcache]={ s:dma_call_us(dev,s,dcache) for s in sizes }
+    return res, calls
+
+def dma_stats(dev):
+    """Returns [(name, calls, ticks)] or None if not built with DMA_STATS."""
+    buf=numpy.zeros(len(DMA_STATS)*2,dtype='<u4')
+    try:
+        dev.read('MEMBENCH','dma_stats',buf.view(numpy.uint8))
+    except Exception as e:
+        log.info("dma stats unavailable (build with -DDMA_STATS): %s" % e)
+        return None
+    return [ (n,int(buf[2*i]),int(buf[2*i+1])) for i,n in enumerate(DMA_STATS) ]
+
+def dma_overhead(dev, nbytes=16<<20):
+    """Times the cpu handler dma calls while moving nbytes each way with BENCH."""
+    try:
+        dev.set('MEMBENCH','dma_stats',0)
+    except Exception:
+        return None
+    dev.set('BENCH','mode',3) # static, the cpu doesn't touch the data
+    dev.set('BENCH','verify',0)
+    buf=numpy.zeros(nbytes,dtype=numpy.uint8)
+    dev.read('BENCH','data',buf)
+    dev.write('BENCH','data',buf)
+    return dma_stats(dev)
+
+def print_sweep(res, sizes=DEFAULT_SIZES):
+    print("%-10s %6s " % ("method","dcache") + " ".join("%9d" % s for s in sizes) + "  (MB/s)")
+    for (name,dcache),rates in sorted(res.items()):
+        print("%-10s %6d " % (name,dcache) + " ".join("%9.1f" % rates[s] for s in sizes))
+
+def print_calls(calls, sizes=DEFAULT_SIZES):
+    print("%-10s %6s " % ("dma call","dcache") + " ".join("%9d" % s for s in sizes) + "  (us/call)")
+    for dcache,res in sorted(calls.items()):
+        for i,name in enumerate(('get','commit')):
+            print("%-10s %6d " % (name,dcache) + " ".join("%9.2f" % res[s][i] for s in sizes))
+
+def print_dma(stats, hz, buf_size):
+    print("dma buffer size %d (read channel x8 at super speed)" % buf_size)
+    print("%-12s %10s %12s" % ("call","calls","us/call"))
+    for name,calls,ticks in stats:
+        print("%-12s %10d %12.2f" % (name,calls, 1e6*ticks/hz/calls if calls else 0.0))
+
+def main():
+    import nitro_parts.Cypress.fx3 as fx3
+    parser=argparse.ArgumentParser(description="FX3 internal bandwidth")
+    parser.add_argument('--sizes', default=None, help='comma separated copy sizes')
+    parser.add_argument('--serial', default=None)
+    args=parser.parse_args()
+    logging.basicConfig(level=logging.INFO)
+
+    sizes=[int(s) for s in args.sizes.split(',')] if args.sizes else DEFAULT_SIZES
+    dev=fx3.get_dev(serial_num=args.serial)
+    hz=float(dev.get('MEMBENCH','ticks_hz'))
+    if hz < 1e6:
+        log.warning("Device timer is %d Hz. Build with -DHWTIMER_GPIO for usable results." % hz)
+    res,calls=sweep(dev,sizes)
+    print_sweep(res,sizes)
+    print_calls(calls,sizes)
+    stats=dma_overhead(dev)
+    if stats:
+        print_dma(stats, hz, dev.get('MEMBENCH','dma_buf_size'))
+    dev.close()
+
+if __name__=='__main__':
+    main()
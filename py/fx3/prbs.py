@@ -0,0 +1,90 @@
+"""
+    Host side PRBS31 matching firmware/prbs.h.
+
+    The sequence obeys b[n] = b[n-31] ^ b[n-28] and the firmware packs bit
+    32k+j of the sequence into bit j of word k.  Squaring the polynomial
+    gives b[n] = b[n-31*2^i] ^ b[n-28*2^i] so each numpy step can produce
+    28*2^i new bits at once, doubling the block size as the sequence
+    grows.  The result is bit exact with prbs31_next().
+"""
+
+import numpy
+
+def seed(s):
+    """An all zero state locks the generator. Same as PRBS_SEED."""
+    return s or 1
+
+def next_word(w):
+    """Scalar step identical to prbs31_next in firmware/prbs.h."""
+    t = ((w>>4) ^ (w>>1)) & 0xffffffff
+    t ^= (t<<28) & 0xffffffff
+    t ^= (t<<31) & 0xffffffff
+    return t
+
+def _bits(first, nbits):
+    b=numpy.zeros(max(nbits,32),dtype=numpy.uint8)
+    b[:32]=(first>>numpy.arange(32,dtype=numpy.uint32)) & 1
+    n=32
+    while n<nbits:
+        # largest block whose taps are all already known
+        step=1
+        while 1+31*step*2 <= n:
+            step*=2
+        run=min(28*step, nbits-n)
+        b[n:n+run] = b[n-31*step:n-31*step+run] ^ b[n-28*step:n-28*step+run]
+        n+=run
+    return b[:nbits]
+
+def words(first, count):
+    """count PRBS31 words starting with first (already seeded.)"""
+    if count<=0:
+        return numpy.zeros(0,dtype='<u4')
+    b=_bits(first, count*32)
+    return numpy.packbits(b, bitorder='little').view('<u4')
+
+def pattern(s, nbytes):
+    """Bytes the firmware BENCH terminal sends/expects for seed s."""
+    w=words(seed(s), (nbytes+3)//4)
+    return w.view(numpy.uint8)[:nbytes]
+
+_POPCOUNT=numpy.array([bin(i).count('1') for i in range(256)],dtype=numpy.uint8)
+
+def check(data, s, sync_bits=8):
+    """
+        Checks data (bytes) against the pattern from seed s the same way
+        the firmware checker does.  Returns (word_errors, bit_errors,
+        dropped).  When a word is off by more than sync_bits bits the
+        checker relocks to the received data and counts a drop.
+    """
+    data=numpy.asarray(data).view(numpy.uint8)
+    n=len(data)//4
+    got=data[:n*4].view('<u4')
+    errors=bit_errors=dropped=0
+    start=0
+    first=seed(s)
+    while start<n:
+        exp=words(first, n-start)
+        diff=numpy.nonzero(got[start:]!=exp)[0]
+        if not len(diff):
+            break
+        i=diff[0]
+        bits=int(_POPCOUNT[ (got[start+i:start+i+1]^exp[i:i+1]).view(numpy.uint8) ].sum())
+        if bits>sync_bits:
+            dropped+=1
+            first=next_word(int(got[start+i]))
+            start+=i+1
+            continue
+        # corrupted words don't disturb the sequence so count them all
+        # up to the next word that looks like a loss of sync
+        x=(got[start:]^exp)
+        bc=_POPCOUNT[x.view(numpy.uint8)].reshape(-1,4).sum(axis=1)
+        lost=numpy.nonzero(bc>sync_bits)[0]
+        end=lost[0] if len(lost) else len(bc)
+        errors+=int(numpy.count_nonzero(bc[:end]))
+        bit_errors+=int(bc[:end].sum())
+        if end==len(bc):
+            break
+        dropped+=1
+        first=next_word(int(got[start+end]))
+        start+=end+1
+    return errors, bit_errors, dropped
@@ -0,0 +1,145 @@
+"""
+    Host side of the firmware pre-trigger capture (firmware/pretrig.c).
+
+    Once armed the firmware keeps reading a source register into a ring
+    in SRAM.  A trigger freezes pre bytes from before it and post bytes
+    from after it, and the host reads just that window::
+
+        from nitro_parts.Cypress.fx3 import pretrig
+        pretrig.configure(dev, 'SAMPLER', 'rows', pre=32*1024, post=8*1024, chunk=512)
+        pretrig.arm(dev, 'rising', pin=20)
+        info=pretrig.wait(dev, timeout=10)
+        data=pretrig.window(dev, info)
+
+    The 'match' trigger fires when a register matches after a chunk
+    (see arm()).  NOTIFY_PRETRIG on the notify endpoint says when the
+    window is ready.
+
+        python -m nitro_parts.Cypress.fx3.pretrig --source BENCH:data --pre 4096 --post 4096 --fire
+"""
+
+import time, struct, argparse
+import logging, numpy
+from .macro import resolve
+log=logging.getLogger(__name__)
+
+# pretrig_info_t
+INFO=struct.Struct('<IIIIIHH')
+INFO_FIELDS=('state','captured','pre','post','trigger_ticks','trigger','status')
+STATE_NAMES=('idle','armed','triggered','done')
+STATE_DONE=3
+
+TRIGGERS={ 'host':0, 'rising':1, 'falling':2, 'both':3, 'match':4 }
+
+def configure(dev, term, reg, pre, post, chunk=1024, size=None):
+    """
+        Ring source (term, reg by name or address) and window.  size
+        defaults to the whole firmware ring; it is rounded down to chunks.
+    """
+    term,reg=resolve(dev,term,reg)
+    dev.set('PRETRIG','arm',0)
+    dev.set('PRETRIG','source_term',term)
+    dev.set('PRETRIG','source_reg',reg)
+    dev.set('PRETRIG','chunk',chunk)
+    if size is not None:
+        dev.set('PRETRIG','size',size//chunk*chunk)
+    dev.set('PRETRIG','pre',pre)
+    dev.set('PRETRIG','post',post)
+
+def arm(dev, trigger='host', pin=None, match=None):
+    """
+        Starts capturing.  trigger is 'host' (fire() only), 'rising',
+        'falling' or 'both' edges of pin, or 'match' with match=(term,
+        reg, value, mask).
+    """
+    dev.set('PRETRIG','arm',0)
+    if pin is not None:
+        dev.set('PRETRIG','pin',pin)
+    if match is not None:
+        term,reg,value,mask=match
+        term,reg=resolve(dev,term,reg)
+        dev.set('PRETRIG','match_term',term)
+        dev.set('PRETRIG','match_reg',reg)
+        dev.set('PRETRIG','match_mask',mask)
+        dev.set('PRETRIG','match_value',value)
+    dev.set('PRETRIG','trigger',TRIGGERS.get(trigger,trigger))
+    dev.set('PRETRIG','arm',1)
+
+def fire(dev):
+    dev.set('PRETRIG','fire',1)
+
+def disarm(dev):
+    dev.set('PRETRIG','arm',0)
+
+def info(dev):
+    """pretrig_info_t as a dict."""
+    buf=numpy.zeros(INFO.size,dtype=numpy.uint8)
+    dev.read('PRETRIG','info',buf)
+    return dict(zip(INFO_FIELDS,INFO.unpack(buf.tobytes())))
+
+def wait(dev, timeout=1.0):
+    """Polls until the window is ready and returns info()."""
+    t_end=time.time()+timeout
+    while True:
+        i=info(dev)
+        if i['state']==STATE_DONE:
+            if i['status']:
+                log.warning("pretrig stopped early, handler status %d" % i['status'])
+            return i
+        if time.time() > t_end:
+            raise Exception("pretrig %s after %d bytes" % (STATE_NAMES[i['state']], i['captured']))
+        time.sleep(0.001)
+
+def window(dev, i=None):
+    """
+        The window bytes oldest first as a uint8 array.  The trigger is at
+        offset i['pre'].
+    """
+    if i is None:
+        i=info(dev)
+    buf=numpy.zeros(i['pre']+i['post'],dtype=numpy.uint8)
+    if len(buf):
+        dev.read('PRETRIG','window',buf)
+    return buf
+
+def main():
+    import nitro_parts.Cypress.fx3 as fx3
+    parser=argparse.ArgumentParser(description="FX3 pre-trigger capture")
+    parser.add_argument('--source', required=True, help='TERM:reg read into the ring')
+    parser.add_argument('--pre', type=int, default=4096)
+    parser.add_argument('--post', type=int, default=4096)
+    parser.add_argument('--chunk', type=int, default=1024)
+    parser.add_argument('--trigger', default='host', choices=sorted(TRIGGERS))
+    parser.add_argument('--pin', type=int, default=None)
+    parser.add_argument('--match', default=None, help='TERM:reg:value[:mask] for the match trigger')
+    parser.add_argument('--fire', action='store_true', help='fire from the host after arming')
+    parser.add_argument('--timeout', type=float, default=10.0)
+    parser.add_argument('--out', default=None, help='save the window to this file')
+    parser.add_argument('--serial', default=None)
+    args=parser.parse_args()
+    logging.basicConfig(level=logging.INFO)
+
+    dev=fx3.get_dev(serial_num=args.serial)
+    term,reg=args.source.split(':')
+    configure(dev, term, reg, args.pre, args.post, args.chunk)
+    match=None
+    if args.match:
+        f=args.match.split(':')
+        match=(f[0], f[1], int(f[2],0), int(f[3],0) if len(f)>3 else 0xffffffff)
+    arm(dev, args.trigger, args.pin, match)
+    if args.fire:
+        fire(dev)
+    try:
+        i=wait(dev, args.timeout)
+    except:
+        disarm(dev)
+        raise
+    data=window(dev, i)
+    log.info("window %d+%d bytes of %d captured, trigger %d at tick %d" % (
+        i['pre'], i['post'], i['captured'], i['trigger'], i['trigger_ticks']))
+    if args.out:
+        data.tofile(args.out)
+    dev.close()
+
+if __name__=='__main__':
+    main()
@@ -0,0 +1,156 @@
+"""
+    Host side of the firmware sampling profiler (firmware/prof.c).
+
+    The firmware records the interrupted pc and the current thread on a
+    hardware timer interrupt.  This module drains those samples from the
+    PROF terminal and symbolizes them against the main.elf built by
+    firmware/nitrofx3.mk.
+
+    Example::
+
+        python -m nitro_parts.Cypress.fx3.prof --elf firmware/main.elf \\
+            --seconds 5 --rate 2000 --folded out.folded
+
+    The folded output (thread;function count) can be fed directly to
+    flamegraph.pl.
+"""
+
+import time, bisect, subprocess, collections, argparse, os
+import logging, numpy
+log=logging.getLogger(__name__)
+
+SAMPLE_DTYPE=numpy.dtype([('pc','<u4'),('thread','<u4')])
+
+def start(dev, rate=1000):
+    """Start (or restart) sampling at rate samples per second."""
+    dev.set('PROF','rate',rate)
+
+def stop(dev):
+    dev.set('PROF','rate',0)
+
+def drain(dev):
+    """Returns all samples currently buffered on the device."""
+    c=dev.get('PROF','count')
+    if not c:
+        return numpy.zeros(0,dtype=SAMPLE_DTYPE)
+    buf=numpy.zeros(c,dtype=SAMPLE_DTYPE)
+    dev.read('PROF','samples',buf.view(numpy.uint8))
+    return buf[buf['pc']!=0]
+
+def capture(dev, seconds=1.0, rate=1000, poll=0.1):
+    """
+        Profile for seconds.  The device ring buffer is drained every
+        poll seconds so it doesn't overflow.  Note the drains themselves
+        show up in the profile as rdwr/cpu_handler activity.
+    """
+    chunks=[]
+    start(dev,rate)
+    t_end=time.time()+seconds
+    try:
+        while time.time() < t_end:
+            time.sleep(poll)
+            chunks.append(drain(dev))
+    finally:
+        stop(dev)
+    chunks.append(drain(dev))
+    dropped=dev.get('PROF','dropped')
+    if dropped:
+        log.warning("%d samples dropped. Lower the rate or poll more often." % dropped)
+    return numpy.concatenate(chunks)
+
+
+class Symbols(object):
+    """
+        Address to symbol lookup built from nm output.  Text symbols are
+        used for pcs and data symbols for thread structures (the
+        CyU3PThread globals like NitroDataThread.)
+    """
+
+    def __init__(self, elf, nm=None):
+        nm = nm or os.environ.get('NM','arm-none-eabi-nm')
+        out=subprocess.check_output([nm,'-n','-S','--defined-only',elf])
+        if not isinstance(out,str):
+            out=out.decode()
+        self.text=([],[],[]) # addr, end, name
+        self.data={}
+        for line in out.splitlines():
+            parts=line.split()
+            if len(parts)==4:
+                addr,size,typ,name=parts
+                size=int(size,16)
+            elif len(parts)==3:
+                addr,typ,name=parts
+                size=0
+            else:
+                continue
+            addr=int(addr,16)
+            if typ in 'tTwW':
+                self.text[0].append(addr)
+                self.text[1].append(addr+size)
+                self.text[2].append(name)
+            elif typ in 'bBdD':
+                self.data[addr]=name
+
+    def func(self, pc):
+        addrs,ends,names=self.text
+        i=bisect.bisect_right(addrs,pc)-1
+        if i<0:
+            return '0x%08x' % pc
+        # sized symbols must contain the pc, unsized ones are trusted
+        if ends[i]>addrs[i] and pc>=ends[i]:
+            return '0x%08x' % pc
+        return names[i]
+
+    def thread(self, ptr):
+        if not ptr:
+            return 'idle'
+        return self.data.get(ptr, '0x%08x' % ptr)
+
+
+def flat_profile(samples, syms):
+    """Returns [(function, count, percent)] sorted by count."""
+    counts=collections.Counter(syms.func(int(pc)) for pc in samples['pc'])
+    total=float(len(samples)) or 1.0
+    return [ (f,c,100.0*c/total) for f,c in counts.most_common() ]
+
+def folded(samples, syms):
+    """
+        Returns folded stack lines.  The firmware only records the pc so
+        each stack is thread;function.
+    """
+    counts=collections.Counter( "%s;%s" % (syms.thread(int(t)), syms.func(int(pc)))
+                                for pc,t in zip(samples['pc'],samples['thread']) )
+    return [ "%s %d" % (k,v) for k,v in sorted(counts.items()) ]
+
+def print_flat(profile, limit=40):
+    print("%8s %7s  %s" % ("samples","%","function"))
+    for f,c,p in profile[:limit]:
+        print("%8d %6.2f%%  %s" % (c,p,f))
+
+
+def main():
+    import nitro_parts.Cypress.fx3 as fx3
+    parser=argparse.ArgumentParser(description="FX3 sampling profiler")
+    parser.add_argument('--elf', default='main.elf', help='firmware elf built by nitrofx3.mk')
+    parser.add_argument('--nm', default=None, help='nm tool (default $NM or arm-none-eabi-nm)')
+    parser.add_argument('--seconds', type=float, default=1.0)
+    parser.add_argument('--rate', type=int, default=1000, help='samples per second')
+    parser.add_argument('--serial', default=None)
+    parser.add_argument('--folded', default=None, help='write folded stacks to this file')
+    parser.add_argument('--limit', type=int, default=40, help='rows in the flat profile')
+    args=parser.parse_args()
+
+    logging.basicConfig(level=logging.INFO)
+    syms=Symbols(args.elf, args.nm)
+    dev=fx3.get_dev(serial_num=args.serial)
+    samples=capture(dev, args.seconds, args.rate)
+    dev.close()
+    log.info("%d samples" % len(samples))
+
+    print_flat(flat_profile(samples,syms), args.limit)
+    if args.folded:
+        with open(args.folded,'w') as f:
+            f.write("\n".join(folded(samples,syms))+"\n")
+
+if __name__=='__main__':
+    main()
@@ -0,0 +1,247 @@
+"""
+    Nitro wire protocol as implemented by firmware/rdwr.c and
+    firmware/vendor_commands.h.
+
+    A transaction is a VC_HI_RDWR vendor request (bmRequestType 0x40,
+    wValue=terminal, wIndex=low 16 bits of the length) whose data stage
+    is a packed rdwr_data_header_t.  The data follows on the bulk
+    endpoints and the device finishes with an 8 byte ack_pkt_t on the
+    bulk IN endpoint.  The ack echoes the header's seq so a host that
+    timed out can tell a stale ack from the one it is waiting for.
+"""
+
+import struct
+
+VC_RDWR_RAM=0xa0
+VC_RDWR_STAT=0xb1
+VC_HI_RDWR=0xb4
+VC_RENUM=0xb5
+VC_SERIAL=0xb6
+VC_STREAM_STOP=0xb7
+VC_ABORT=0xb8
+VC_TIME=0xb9
+
+VC_NAMES={ VC_RDWR_RAM:'VC_RDWR_RAM', VC_RDWR_STAT:'VC_RDWR_STAT',
+           VC_HI_RDWR:'VC_HI_RDWR', VC_RENUM:'VC_RENUM',
+           VC_SERIAL:'VC_SERIAL', VC_STREAM_STOP:'VC_STREAM_STOP',
+           VC_ABORT:'VC_ABORT', VC_TIME:'VC_TIME' }
+
+bmSETWRITE=8
+COMMAND_READ=0
+COMMAND_WRITE=bmSETWRITE
+COMMAND_GET=1
+COMMAND_SET=bmSETWRITE|1
+
+COMMAND_NAMES={ COMMAND_READ:'read', COMMAND_WRITE:'write',
+                COMMAND_GET:'get', COMMAND_SET:'set' }
+
+# rdwr_data_header_t: command, term_addr, reg_addr, transfer_length, seq, flags
+# Firmware before seq was added takes (and older hosts send) HEADER_V0.
+HEADER=struct.Struct('<BHIIHH')
+HEADER_V0=struct.Struct('<BHII')
+
+# rdwr_data_header_t.flags
+FLAG_EXT_ACK=0x0001 # end with an ext_ack_pkt_t
+FLAG_FRAMING=0x0002 # streaming reads: each buffer starts with a frame_hdr_t
+FLAG_REDUCE_MASK=0x00F0 # reads: data through a kernel of firmware/reduce.c
+FLAG_REDUCE_SHIFT=4
+
+REDUCE_DECIMATE=1
+REDUCE_MINMAX=2
+REDUCE_HISTOGRAM=3
+REDUCE_EVENTS=4
+REDUCE_PACK=5
+REDUCE_NAMES={ REDUCE_DECIMATE:'decimate', REDUCE_MINMAX:'minmax',
+               REDUCE_HISTOGRAM:'histogram', REDUCE_EVENTS:'events',
+               REDUCE_PACK:'pack' }
+
+def flag_reduce(kernel):
+    """Header flags of a read through a reduce kernel."""
+    return (kernel << FLAG_REDUCE_SHIFT) & FLAG_REDUCE_MASK
+
+FLAG_COMPRESS_MASK=0x0300 # framed streams: frames compressed (see compress.py)
+FLAG_COMPRESS_SHIFT=8
+
+COMPRESS_RAW=0
+COMPRESS_RLE=1
+COMPRESS_DELTA=2
+COMPRESS_NAMES={ COMPRESS_RAW:'raw', COMPRESS_RLE:'rle', COMPRESS_DELTA:'delta' }
+
+def flag_compress(codec):
+    """Header flags of a compressed stream (with FLAG_FRAMING.)"""
+    return (codec << FLAG_COMPRESS_SHIFT) & FLAG_COMPRESS_MASK
+
+# ack_pkt_t: id, checksum, status, seq
+ACK=struct.Struct('<HHHH')
+ACK_PKT_ID=0xA50F
+STATUS_ABORTED=0x8000 # ack status bit of a transaction ended by VC_ABORT
+
+# ext_ack_pkt_t: ack_pkt_t, t_start, t_end, ticks_hz, wait_ticks, bytes,
+# dma_waits, handler_status, dma_status
+EXT_ACK=struct.Struct('<HHHHIIIIIIHH')
+EXT_ACK_FIELDS=('checksum','status','seq','t_start','t_end','ticks_hz',
+                'wait_ticks','bytes','dma_waits','handler_status','dma_status')
+
+# transfer_length of a streaming read.  The stream ends with a
+# stream_ack_pkt_t: the ack followed by the 64 bit byte count.
+STREAM_LENGTH=0xFFFFFFFF
+STREAM_ACK=struct.Struct('<HHHHQ')
+
+# frame_hdr_t: id, status, seq, count, ticks.  Every buffer of a
+# FLAG_FRAMING stream is a frame: the header and count payload bytes.
+FRAME=struct.Struct('<HHIII')
+FRAME_ID=0xF4A3
+FRAME_FIELDS=('status','seq','count','ticks')
+
+# compress_hdr_t: codec, reserved, raw_count.  The start of the payload
+# of a compressed frame.  Compressed frames are padded to whole packets.
+COMPRESS=struct.Struct('<HHI')
+
+# time_pkt_t: ticks (64 bit), ticks_hz
+TIME=struct.Struct('<QI')
+
+# bulk endpoints from firmware/main.h
+EP_OUT=0x01
+EP_IN=0x81
+
+# notify_pkt_t records on the interrupt endpoint: event, seq, ticks,
+# arg0, arg1.  A packet (up to NOTIFY_PKT_SIZE) holds one or more.
+EP_NOTIFY=0x82
+NOTIFY_PKT_SIZE=64
+NOTIFY=struct.Struct('<HHIII')
+NOTIFY_FIELDS=('event','seq','ticks','arg0','arg1')
+NOTIFY_INIT_STAT=1 # arg0 term, arg1 status
+NOTIFY_LOG=2       # arg0 log bytes buffered
+NOTIFY_ERROR=3     # arg0 status
+NOTIFY_CAPTURE=4   # gpio capture ring half full: arg0 edges, arg1 dropped
+NOTIFY_MACRO=5     # macro run finished: arg0 slot, arg1 status
+NOTIFY_PRETRIG=6   # pretrig window ready: arg0 bytes, arg1 status
+NOTIFY_USER=0x100  # firmware defined from here up
+NOTIFY_NAMES={ NOTIFY_INIT_STAT:'init_stat', NOTIFY_LOG:'log', NOTIFY_ERROR:'error',
+               NOTIFY_CAPTURE:'capture', NOTIFY_MACRO:'macro',
+               NOTIFY_PRETRIG:'pretrig' }
+
+SERIAL_LEN=16 # 8 utf-16 characters
+
+def is_write(command):
+    return bool(command & bmSETWRITE)
+
+def pack_header(command, term, reg, length, seq=0, flags=0):
+    return HEADER.pack(command, term, reg, length, seq & 0xffff, flags)
+
+def unpack_header(data):
+    """
+        Returns (command, term, reg, length, seq, flags) or None if data
+        isn't a header.  A HEADER_V0 has seq and flags 0.
+    """
+    if len(data) >= HEADER.size:
+        return HEADER.unpack(bytes(data[:HEADER.size]))
+    if len(data) == HEADER_V0.size:
+        return HEADER_V0.unpack(bytes(data)) + (0,0)
+    return None
+
+def pack_ack(status=0, checksum=0, seq=0):
+    return ACK.pack(ACK_PKT_ID, checksum & 0xffff, status & 0xffff, seq & 0xffff)
+
+def unpack_ack(data):
+    """Returns (checksum, status, seq) or None if data isn't an ack."""
+    if len(data) != ACK.size:
+        return None
+    pid,checksum,status,seq=ACK.unpack(bytes(data))
+    if pid != ACK_PKT_ID:
+        return None
+    return checksum, status, seq
+
+def pack_ext_ack(status=0, checksum=0, seq=0, t_start=0, t_end=0, ticks_hz=1000000,
+                 wait_ticks=0, nbytes=0, dma_waits=0, handler_status=0, dma_status=0):
+    return EXT_ACK.pack(ACK_PKT_ID, checksum & 0xffff, status & 0xffff, seq & 0xffff,
+                        t_start & 0xffffffff, t_end & 0xffffffff, ticks_hz,
+                        wait_ticks & 0xffffffff, nbytes & 0xffffffff, dma_waits,
+                        handler_status & 0xffff, dma_status & 0xffff)
+
+def unpack_ext_ack(data):
+    """
+        Returns a dict of the ext_ack_pkt_t fields plus device_s (t_start
+        to t_end) and wait_s in seconds or None if data isn't an ext ack.
+    """
+    if len(data) != EXT_ACK.size:
+        return None
+    f=EXT_ACK.unpack(bytes(data))
+    if f[0] != ACK_PKT_ID:
+        return None
+    ack=dict(zip(EXT_ACK_FIELDS,f[1:]))
+    hz=float(ack['ticks_hz'] or 1)
+    ack['device_s']=((ack['t_end']-ack['t_start']) & 0xffffffff)/hz
+    ack['wait_s']=ack['wait_ticks']/hz
+    return ack
+
+def pack_stream_ack(status, total, seq=0):
+    return STREAM_ACK.pack(ACK_PKT_ID, 0, status & 0xffff, seq & 0xffff, total)
+
+def unpack_stream_ack(data):
+    """Returns (status, total) or None."""
+    if len(data) != STREAM_ACK.size:
+        return None
+    pid,checksum,status,seq,total=STREAM_ACK.unpack(bytes(data))
+    if pid != ACK_PKT_ID:
+        return None
+    return status, total
+
+def pack_frame(seq, count, ticks=0, status=0):
+    return FRAME.pack(FRAME_ID, status & 0xffff, seq & 0xffffffff, count, ticks & 0xffffffff)
+
+def unpack_frames(data, align=1):
+    """
+        Splits a buffer of whole frames.  Returns a list of (frame,
+        payload) where frame is a dict of the frame_hdr_t fields and
+        payload a view into data, and the number of bytes used (the rest
+        is a partial frame or the stream ack.)  Frames of compressed
+        streams start on a packet: align is the max packet size.
+    """
+    data=memoryview(data).cast('B')
+    frames=[]
+    off=0
+    while off+FRAME.size <= len(data):
+        f=FRAME.unpack_from(data,off)
+        if f[0] != FRAME_ID:
+            break
+        frame=dict(zip(FRAME_FIELDS,f[1:]))
+        end=off+FRAME.size+frame['count']
+        padded=end+(-end % align)
+        if padded > len(data):
+            break
+        frames.append((frame, data[off+FRAME.size:end]))
+        off=padded
+    return frames, off
+
+def pack_notify(event, seq, arg0=0, arg1=0, ticks=0):
+    return NOTIFY.pack(event, seq & 0xffff, ticks & 0xffffffff, arg0 & 0xffffffff, arg1 & 0xffffffff)
+
+def unpack_notify(data):
+    """List of notify_pkt_t dicts in a notify endpoint packet."""
+    n=len(data)-len(data) % NOTIFY.size
+    return [ dict(zip(NOTIFY_FIELDS,f)) for f in NOTIFY.iter_unpack(bytes(data[:n])) ]
+
+def pack_time(ticks, ticks_hz):
+    return TIME.pack(ticks, ticks_hz)
+
+def unpack_time(data):
+    """Returns (ticks, ticks_hz) or None."""
+    if len(data) != TIME.size:
+        return None
+    return TIME.unpack(bytes(data))
+
+def checksum(data):
+    """16 bit sum of the bytes (what handler chksum functions report.)"""
+    return sum(bytearray(data)) & 0xffff
+
+def rdwr_setup(command, term, reg, length, seq=0, flags=0):
+    """(bmRequestType, bRequest, wValue, wIndex, data) for a transaction."""
+    return 0x40, VC_HI_RDWR, term, length & 0xffff, pack_header(command, term, reg, length, seq, flags)
+
+def encode_serial(s):
+    """Serial numbers are 8 utf-16 characters padded with spaces."""
+    return s[:SERIAL_LEN//2].ljust(SERIAL_LEN//2).encode('utf-16-le')
+
+def decode_serial(b):
+    return bytes(b).decode('utf-16-le', 'replace')
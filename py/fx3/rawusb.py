@@ -0,0 +1,459 @@
+"""
+    Nitro transactions over pyusb.
+
+    The nitro driver only does bounded transactions so streaming reads
+    (transfer_length RDWR_STREAM_LENGTH) go straight to the endpoints::
+
+        from nitro_parts.Cypress.fx3.rawusb import RawDevice
+        dev=RawDevice()
+        for chunk in dev.stream(6, 7, nbytes=1<<30): # BENCH DATA
+            ...
+
+    Each chunk is a numpy uint8 array.  Leaving the loop (break, an
+    exception or nbytes reached) sends VC_STREAM_STOP, drains the
+    remaining buffers and keeps the stream ack (status, total bytes) in
+    dev.stream_ack.
+
+    With framing=True the device puts a frame_hdr_t in front of every
+    dma buffer and the generator yields (frame, payload) for each one:
+    frame has the device's seq, count, status and hwtimer ticks (see
+    timesync to map them to host time) and payload is a numpy view of the
+    read, not a copy.  Gaps in seq are counted in dev.stream_drops.
+
+    Device events (notify_pkt_t on the interrupt endpoint) go to
+    callbacks from a reader thread instead of polling registers::
+
+        def on_init_stat(rec):
+            log.error("term %(arg0)d init failed status %(arg1)d" % rec)
+        dev.subscribe(on_init_stat, P.NOTIFY_INIT_STAT)
+
+    Callbacks run on the reader thread so they shouldn't start
+    transactions of their own while the main thread is using dev.
+
+        python -m nitro_parts.Cypress.fx3.rawusb --term 6 --reg 7 --bytes 1e9
+
+    --check-retry N does N retried gets of values it set instead.  Against
+    the emulator started with --delay-acks each delayed ack times the get
+    out, the late ack turns up during the retry and has to be skipped.
+"""
+
+import time, argparse, threading
+import logging, numpy
+import usb.core, usb.util
+from . import protocol as P
+log=logging.getLogger(__name__)
+
+VID=0x1fe1
+PID=0x00f0
+
+class RawDevice(object):
+    def __init__(self, VID=VID, PID=PID, serial_num=None, timeout=1000, ext_ack=False):
+        """
+            ext_ack requests the ext_ack_pkt_t for every transaction.  The
+            metrics of the last one are in last_ack (see
+            protocol.unpack_ext_ack) with host_s, the host's time from
+            the setup request to the ack.
+        """
+        self.timeout=timeout
+        self.ext_ack=ext_ack
+        self.last_ack=None
+        self.stream_ack=None
+        self.stream_drops=0
+        self.seq=0
+        self.notify_drops=0
+        self._subs=[]
+        self._notify_thread=None
+        self._notify_lock=threading.Lock()
+        self._notify_seq=None
+        self.dev=None
+        for d in usb.core.find(find_all=True, idVendor=VID, idProduct=PID):
+            if serial_num is None or self._serial(d).strip()==serial_num:
+                self.dev=d
+                break
+        if self.dev is None:
+            raise IOError("No device 0x%04x:0x%04x serial %s" % (VID,PID,serial_num))
+        self.dev.set_configuration()
+        usb.util.claim_interface(self.dev,0)
+        self.dev.set_interface_altsetting(0,1)
+        intf=self.dev.get_active_configuration()[(0,1)]
+        # the firmware's addresses unless the descriptors say otherwise
+        # (the emulator under dummy_hcd)
+        self.ep_out=P.EP_OUT
+        self.ep_in=P.EP_IN
+        self.max_packet=None
+        self.ep_notify=None
+        bulk=set()
+        for ep in intf:
+            if usb.util.endpoint_type(ep.bmAttributes)==usb.util.ENDPOINT_TYPE_INTR:
+                self.ep_notify=ep.bEndpointAddress
+                continue
+            if usb.util.endpoint_type(ep.bmAttributes)!=usb.util.ENDPOINT_TYPE_BULK:
+                continue
+            if usb.util.endpoint_direction(ep.bEndpointAddress)==usb.util.ENDPOINT_IN:
+                self.ep_in=ep.bEndpointAddress
+                self.max_packet=ep.wMaxPacketSize
+                bulk.add('in')
+            else:
+                self.ep_out=ep.bEndpointAddress
+                bulk.add('out')
+        if bulk!=set(('in','out')):
+            usb.util.dispose_resources(self.dev)
+            self.dev=None
+            raise IOError("Device 0x%04x:0x%04x has no bulk IN/OUT endpoint pair on interface 0 alt 1 (found %s)" % (
+                VID,PID,', '.join(sorted(bulk)) or 'none'))
+
+    def _serial(self, d):
+        try:
+            return P.decode_serial(d.ctrl_transfer(0xc0, P.VC_SERIAL, 0, 0, P.SERIAL_LEN))
+        except usb.core.USBError:
+            return ''
+
+    def close(self):
+        t=self._notify_thread
+        self._subs=[]
+        if t:
+            t.join()
+        if self.dev is not None:
+            usb.util.dispose_resources(self.dev)
+            self.dev=None
+
+    def subscribe(self, callback, events=None):
+        """
+            Calls callback(record) for each notify_pkt_t (a dict, see
+            protocol.unpack_notify) whose event is in events (an event
+            number or a list, None for all.)  The reader thread starts
+            with the first subscription.
+        """
+        if self.ep_notify is None:
+            raise IOError("Firmware has no notify endpoint")
+        if isinstance(events, int):
+            events=(events,)
+        with self._notify_lock:
+            self._subs.append((callback, events and frozenset(events)))
+            if not self._notify_thread:
+                self._notify_thread=threading.Thread(target=self._notify_loop)
+                self._notify_thread.daemon=True
+                self._notify_thread.start()
+
+    def unsubscribe(self, callback):
+        """The reader thread stops with the last subscription."""
+        self._subs=[ s for s in self._subs if s[0]!=callback ]
+
+    def _notify_loop(self):
+        while True:
+            with self._notify_lock:
+                if not self._subs:
+                    self._notify_thread=None
+                    return
+            try:
+                b=self.dev.read(self.ep_notify, P.NOTIFY_PKT_SIZE, 100)
+            except usb.core.USBTimeoutError:
+                continue
+            except usb.core.USBError as e:
+                log.error("Notify endpoint: %s" % e)
+                with self._notify_lock:
+                    self._notify_thread=None
+                return
+            for rec in P.unpack_notify(b):
+                if self._notify_seq is not None and rec['seq']!=self._notify_seq:
+                    n=(rec['seq']-self._notify_seq) & 0xffff
+                    log.warning("%d device notifications dropped" % n)
+                    self.notify_drops+=n
+                self._notify_seq=(rec['seq']+1) & 0xffff
+                for cb,events in list(self._subs):
+                    if events is None or rec['event'] in events:
+                        try:
+                            cb(rec)
+                        except Exception:
+                            log.exception("Notify callback")
+
+    def vendor(self, bRequest, wValue=0, wIndex=0, data=b''):
+        self.dev.ctrl_transfer(0x40, bRequest, wValue, wIndex, data, self.timeout)
+
+    def device_time(self):
+        """(ticks, ticks_hz) of the device timebase (VC_TIME.)"""
+        return P.unpack_time(self.dev.ctrl_transfer(0xc0, P.VC_TIME, 0, 0, P.TIME.size, self.timeout))
+
+    def abort(self):
+        """
+            Aborts a transaction left running (a timed out read for
+            instance.)  Returns the ack status or None if there was
+            nothing to abort.  The device stalls VC_ABORT (a
+            usb.core.USBError here) when the terminal's handler can't be
+            aborted (FIRMWARE_DI) and the transaction goes on.
+        """
+        self.vendor(P.VC_ABORT)
+        while True:
+            try:
+                b=bytes(self.dev.read(self.ep_in, 1<<20, self.timeout))
+            except usb.core.USBError:
+                return None
+            # the ack is always a packet of its own
+            ack=P.unpack_ack(b)
+            if ack:
+                return ack[1]
+            ack=P.unpack_ext_ack(b)
+            if ack:
+                return ack['status']
+            ack=P.unpack_stream_ack(b)
+            if ack:
+                return ack[0]
+
+    def transaction(self, command, term, reg, data, retries=0, flags=0):
+        """
+            data is the bytes to write or the number of bytes to read.
+            Returns the bytes read (or written) and raises on a bad ack.
+            flags are or'd into the header flags (P.flag_reduce.)
+
+            Each transaction gets the next seq.  A timed out transaction
+            is sent again with the same seq up to retries times; the
+            firmware answers a retried get from its cache so only use
+            retries where running the transaction twice is harmless.
+
+            An attempt that timed out waiting for its ack was run by the
+            firmware, so its ack (with the same seq) is still to come
+            before the retry's data and ack unless the drain before the
+            retry got it.  Those late acks are counted and skipped.
+        """
+        length=len(data) if P.is_write(command) else data
+        self.seq=self.seq % 0xffff + 1 # 0 is unnumbered
+        late=0
+        for attempt in range(retries+1):
+            try:
+                return self._transaction(command, term, reg, data, length, flags, late)
+            except usb.core.USBTimeoutError:
+                if attempt==retries:
+                    raise
+                log.warning("term 0x%x reg 0x%x seq %d timed out, retry" % (term,reg,self.seq))
+                if self._phase=='ack':
+                    late+=1
+                late=max(0,late-self._drain())
+
+    def _ack_seq(self, b):
+        """The seq of b if it parses as an ack or ext ack, else None."""
+        ack=P.unpack_ack(b)
+        if ack is None:
+            e=P.unpack_ext_ack(b)
+            ack=e and (e['checksum'],e['status'],e['seq'])
+        return None if ack is None else ack[2]
+
+    def _drain(self, timeout=10):
+        """
+            Drops what a timed out attempt left on the IN endpoint (its
+            data and late ack) before it's sent again.  Returns the number
+            of acks of the current seq dropped.
+        """
+        n=0
+        while True:
+            try:
+                b=bytes(self.dev.read(self.ep_in, 1<<16, timeout))
+            except usb.core.USBTimeoutError:
+                return n
+            seq=self._ack_seq(b)
+            n+=seq==self.seq
+            log.debug("Dropped %d bytes of seq %s" % (len(b),seq))
+
+    def _transaction(self, command, term, reg, data, length, flags=0, late=0):
+        flags|=P.FLAG_EXT_ACK if self.ext_ack else 0
+        ack_size=P.EXT_ACK.size if self.ext_ack else P.ACK.size
+        _,bRequest,wValue,wIndex,hdr=P.rdwr_setup(command, term, reg, length, self.seq, flags)
+        t0=time.time()
+        ack_b=None
+        self._phase='data'
+        self.vendor(bRequest, wValue, wIndex, hdr)
+        if P.is_write(command):
+            self.dev.write(self.ep_out, data, self.timeout)
+            ret=data
+        else:
+            # room for an ack so one of an earlier transaction or a late
+            # one of a timed out attempt doesn't overflow a small get.
+            # A read of the data's length is the data unless a late ack
+            # is still to come.
+            while True:
+                ret=bytes(self.dev.read(self.ep_in, max(length,ack_size), self.timeout))
+                seq=None if len(ret)==length and not late else self._ack_seq(ret)
+                if seq is None:
+                    break
+                if seq==self.seq:
+                    if not late:
+                        ack_b,ret=ret,b'' # no data, it's the ack
+                        break
+                    late-=1
+                log.debug("Dropped ack seq %d before the data of seq %d" % (seq,self.seq))
+        self._phase='ack'
+        while True:
+            if ack_b is None:
+                b=bytes(self.dev.read(self.ep_in, ack_size, self.timeout))
+            else:
+                b,ack_b=ack_b,None
+            if self.ext_ack:
+                e=P.unpack_ext_ack(b)
+                ack=e and (e['checksum'],e['status'],e['seq'])
+            else:
+                ack=P.unpack_ack(b)
+            if ack is None:
+                raise IOError("Bad ack for term 0x%x reg 0x%x" % (term,reg))
+            if ack[2]==self.seq and not late:
+                break
+            if ack[2]==self.seq:
+                late-=1
+            log.debug("Dropped ack seq %d (want %d, %d late)" % (ack[2],self.seq,late))
+        if self.ext_ack:
+            e['host_s']=time.time()-t0
+            self.last_ack=e
+        if ack[1]:
+            raise IOError("term 0x%x reg 0x%x status %d" % (term,reg,ack[1]))
+        return ret
+
+    def get(self, term, reg, width=4, retries=1):
+        return int.from_bytes(bytes(self.transaction(P.COMMAND_GET, term, reg, width, retries)), 'little')
+
+    def set(self, term, reg, val, width=4):
+        self.transaction(P.COMMAND_SET, term, reg, int(val).to_bytes(width, 'little'))
+
+    def read(self, term, reg, length, flags=0):
+        """Up to length bytes, fewer if a v2 terminal ends the read short."""
+        return numpy.frombuffer(bytes(self.transaction(P.COMMAND_READ, term, reg, length, flags=flags)), dtype=numpy.uint8)
+
+    def write(self, term, reg, data):
+        self.transaction(P.COMMAND_WRITE, term, reg, bytes(data))
+
+    def stream(self, term, reg, chunk=1<<20, nbytes=None, framing=False, flags=0, compress=None):
+        """
+            Generator of numpy uint8 chunks from a streaming read (or
+            (frame, payload) with framing.)  chunk should be a multiple of
+            the max packet size; the device only sends a short packet for
+            the stream ack.  nbytes counts payload bytes.
+
+            compress ('rle', 'delta' or P.COMPRESS_*) has the device
+            compress each buffer.  Payloads come out decompressed and
+            frames get the codec and raw_count of the compress_hdr_t.
+        """
+        from . import compress as codecs
+        codec=codecs.CODECS.get(compress,compress) or P.COMPRESS_RAW
+        chunk-=chunk % self.max_packet
+        self.stream_ack=None
+        self.stream_drops=0
+        self.seq=self.seq % 0xffff + 1
+        flags|=P.FLAG_FRAMING if framing or codec else 0
+        flags|=P.flag_compress(codec)
+        _,bRequest,wValue,wIndex,hdr=P.rdwr_setup(P.COMMAND_READ, term, reg, P.STREAM_LENGTH, self.seq, flags)
+        self.vendor(bRequest, wValue, wIndex, hdr)
+        got=0
+        tail=b''
+        partial=None
+        next_seq=0
+        try:
+            while nbytes is None or got<nbytes:
+                b=self.dev.read(self.ep_in, chunk, self.timeout)
+                short=len(b) % self.max_packet
+                if short:
+                    # the device ended the stream on its own
+                    tail=bytes(b[len(b)-P.STREAM_ACK.size:])
+                    b=b[:len(b)-P.STREAM_ACK.size]
+                data=numpy.frombuffer(b, dtype=numpy.uint8)
+                if not framing and not codec:
+                    got+=len(data)
+                    if len(data):
+                        yield data
+                else:
+                    if partial is not None and len(partial):
+                        data=numpy.concatenate((partial,data))
+                    frames,used=P.unpack_frames(data, self.max_packet if codec else 1)
+                    partial=data[used:]
+                    if frames and not codec and chunk % (used//len(frames)):
+                        # whole frames per read from now on so nothing is copied
+                        size=used//len(frames)
+                        chunk=max(size, chunk-chunk % size)
+                    for frame,payload in frames:
+                        if frame['seq']!=next_seq:
+                            log.warning("Stream frames %d..%d dropped" % (next_seq,frame['seq']-1))
+                            self.stream_drops+=(frame['seq']-next_seq) & 0xffffffff
+                        next_seq=(frame['seq']+1) & 0xffffffff
+                        if codec:
+                            frame['codec'],_,frame['raw_count']=P.COMPRESS.unpack_from(payload)
+                            payload=codecs.decode(payload)
+                        got+=len(payload)
+                        payload=numpy.frombuffer(payload, dtype=numpy.uint8)
+                        yield (frame, payload) if framing else payload
+                if short:
+                    return
+        finally:
+            self._stream_stop(tail, chunk)
+
+    def _stream_stop(self, tail, chunk, reads=16):
+        """
+            Stops the stream and reads up to its ack (tail if the device
+            already ended it), at most reads chunks.  Errors here are only
+            logged so a timeout that ended the stream is what the caller
+            sees rather than the cleanup's.
+        """
+        try:
+            self.vendor(P.VC_STREAM_STOP)
+            for i in range(reads):
+                if tail:
+                    break
+                b=self.dev.read(self.ep_in, chunk, self.timeout)
+                if len(b) % self.max_packet:
+                    tail=bytes(b)
+        except usb.core.USBError as e:
+            log.error("Stopping the stream: %s" % e)
+        self.stream_ack=P.unpack_stream_ack(tail[-P.STREAM_ACK.size:]) if tail else None
+        if self.stream_ack is None:
+            log.error("Stream ended without an ack")
+        elif self.stream_ack[0]:
+            log.error("Stream status %d after %d bytes" % self.stream_ack)
+
+BENCH_TERM=6
+BENCH_SEED=1
+
+def check_retry(dev, n=10):
+    """
+        Sets the BENCH seed and gets it back with a retry n times.
+        Returns the number of gets that came back wrong or failed.
+    """
+    bad=0
+    for i in range(n):
+        val=0x5eed0000+i
+        dev.set(BENCH_TERM, BENCH_SEED, val)
+        try:
+            got=dev.get(BENCH_TERM, BENCH_SEED, retries=1)
+        except (IOError, usb.core.USBError) as e:
+            log.error("get %d: %s" % (i,e))
+            bad+=1
+            continue
+        if got!=val:
+            log.error("get %d: 0x%x, set 0x%x" % (i,got,val))
+            bad+=1
+    return bad
+
+def main():
+    parser=argparse.ArgumentParser(description="Nitro FX3 streaming read")
+    parser.add_argument('--serial', default=None)
+    parser.add_argument('--term', type=lambda x: int(x,0), default=6, help='terminal address (default BENCH)')
+    parser.add_argument('--reg', type=lambda x: int(x,0), default=7, help='register address (default BENCH DATA)')
+    parser.add_argument('--bytes', type=float, default=1e9)
+    parser.add_argument('--chunk', type=int, default=1<<20)
+    parser.add_argument('--framing', action='store_true', help='frame headers with seq and device ticks')
+    parser.add_argument('--check-retry', type=int, default=0, metavar='N', help='N retried gets instead of the stream')
+    args=parser.parse_args()
+    logging.basicConfig(level=logging.INFO)
+
+    dev=RawDevice(serial_num=args.serial)
+    if args.check_retry:
+        bad=check_retry(dev, args.check_retry)
+        log.info("%d of %d retried gets bad" % (bad,args.check_retry))
+        dev.close()
+        raise SystemExit(1 if bad else 0)
+    t0=time.time()
+    got=0
+    for c in dev.stream(args.term, args.reg, args.chunk, int(args.bytes), args.framing):
+        got+=len(c[1] if args.framing else c)
+    dt=time.time()-t0
+    log.info("%d bytes in %.3fs %.1f MB/s ack %s" % (got, dt, got/dt/1e6, dev.stream_ack))
+    if args.framing:
+        log.info("%d frames dropped" % dev.stream_drops)
+    dev.close()
+
+if __name__=='__main__':
+    main()
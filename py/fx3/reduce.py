@@ -0,0 +1,103 @@
+"""
+    Host side of the read path reduction kernels (firmware/reduce.c).
+
+    A read with a kernel in the header flags gets the terminal's 16 bit
+    samples through the kernel on the device, so a capture that doesn't
+    fit the link can still run at a fraction of the bandwidth::
+
+        from nitro_parts.Cypress.fx3 import reduce
+        from nitro_parts.Cypress.fx3.rawusb import RawDevice
+        raw=RawDevice()
+        reduce.configure(raw, factor=16)
+        mm=reduce.minmax(reduce.read(raw, 6, 7, 'minmax', 64<<10))
+
+    The nitro driver doesn't send header flags so reads go through a
+    RawDevice; the length is output bytes.  The decoders turn the output
+    back into arrays.
+
+        python -m nitro_parts.Cypress.fx3.reduce --kernel histogram --bins 64 --shift 10
+"""
+
+import time, argparse
+import logging, numpy
+from . import protocol as P
+log=logging.getLogger(__name__)
+
+# terminal and register addresses for RawDevice (terminals.py)
+TERM=252
+REGS={ 'factor':0, 'bins':1, 'shift':2, 'hist_samples':3, 'threshold':4, 'bits':5, 'max_in':6 }
+REG_STATS=7
+
+KERNELS=dict((v,k) for k,v in P.REDUCE_NAMES.items())
+EVENT_DTYPE=numpy.dtype([('index','<u4'),('value','<u2'),('rising','<u2')])
+STATS_DTYPE=numpy.dtype([('in_bytes','<u4'),('out_bytes','<u4'),('dropped','<u4'),('padded','<u4')])
+
+def configure(raw, **params):
+    """Sets kernel parameters by register name (factor=16, bins=64 ...)"""
+    for name,val in params.items():
+        raw.set(TERM, REGS[name], val)
+
+def read(raw, term, reg, kernel, nbytes):
+    """nbytes of kernel ('decimate', 'minmax' ... or P.REDUCE_*) output of a read of term/reg."""
+    kernel=KERNELS.get(kernel,kernel)
+    return raw.read(term, reg, nbytes, flags=P.flag_reduce(kernel))
+
+def stream(raw, term, reg, kernel, chunk=1<<20, nbytes=None):
+    """Generator of kernel output chunks of a streaming read.  A stopped stream ends in zeros."""
+    kernel=KERNELS.get(kernel,kernel)
+    return raw.stream(term, reg, chunk, nbytes, flags=P.flag_reduce(kernel))
+
+def stats(raw):
+    """Input and output bytes, dropped events and padded bytes of the last reduced read."""
+    buf=numpy.frombuffer(bytes(raw.read(TERM, REG_STATS, STATS_DTYPE.itemsize)), dtype=STATS_DTYPE)
+    return dict(zip(STATS_DTYPE.names,(int(v) for v in buf[0])))
+
+def decimate(data):
+    return numpy.frombuffer(bytes(data), dtype='<u2')
+
+def minmax(data):
+    """(n,2) array of min, max per window."""
+    return decimate(data).reshape(-1,2)
+
+def histograms(data, bins):
+    """(n,bins) array of counts."""
+    h=numpy.frombuffer(bytes(data), dtype='<u4')
+    return h[:len(h)//bins*bins].reshape(-1,bins)
+
+def events(data):
+    """Event records.  Zero padding after a stopped stream shows up as index 0 events past the first."""
+    data=bytes(data)
+    return numpy.frombuffer(data[:len(data)//EVENT_DTYPE.itemsize*EVENT_DTYPE.itemsize], dtype=EVENT_DTYPE)
+
+def unpack(data, bits):
+    """Samples of bits each packed lsb first."""
+    b=numpy.unpackbits(numpy.frombuffer(bytes(data), dtype=numpy.uint8), bitorder='little')
+    n=len(b)//bits
+    w=b[:n*bits].reshape(n,bits).astype(numpy.uint16)
+    return (w << numpy.arange(bits, dtype=numpy.uint16)).sum(axis=1).astype(numpy.uint16)
+
+def main():
+    from .rawusb import RawDevice
+    parser=argparse.ArgumentParser(description="FX3 read path reduction kernels")
+    parser.add_argument('--serial', default=None)
+    parser.add_argument('--term', type=lambda x: int(x,0), default=6, help='terminal address (default BENCH)')
+    parser.add_argument('--reg', type=lambda x: int(x,0), default=7, help='register address (default BENCH DATA)')
+    parser.add_argument('--kernel', choices=sorted(KERNELS), default='decimate')
+    parser.add_argument('--bytes', type=int, default=1<<20, help='output bytes to read')
+    for name in REGS:
+        parser.add_argument('--'+name.replace('_','-'), type=lambda x: int(x,0), default=None)
+    args=parser.parse_args()
+    logging.basicConfig(level=logging.INFO)
+
+    raw=RawDevice(serial_num=args.serial)
+    configure(raw, **dict((n,getattr(args,n)) for n in REGS if getattr(args,n) is not None))
+    t0=time.time()
+    data=read(raw, args.term, args.reg, args.kernel, args.bytes)
+    dt=time.time()-t0
+    s=stats(raw)
+    raw.close()
+    log.info("%s: %d input bytes to %d output bytes in %.3fs, %.1f MB/s of input, %d events dropped, %d bytes padded" % (
+        args.kernel, s['in_bytes'], s['out_bytes'], dt, s['in_bytes']/dt/1e6, s['dropped'], s['padded']))
+
+if __name__=='__main__':
+    main()
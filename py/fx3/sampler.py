@@ -0,0 +1,145 @@
+"""
+    Host side of the firmware register sampler (firmware/sampler.c).
+
+    The firmware reads a list of registers every period and packs
+    timestamped rows into the read buffers so telemetry is one stream
+    instead of a transaction per sample::
+
+        from nitro_parts.Cypress.fx3 import sampler
+        sampler.configure(dev, [('SENSOR','temp',2), ('SENSOR','status',4)], period_us=1000)
+        sampler.start(dev)
+        rows=sampler.read_rows(dev, 1000) # a second of samples
+        sampler.stop(dev)
+        rows['SENSOR.temp'], rows['ticks'], rows['lat']
+
+    The nitro driver only does bounded reads.  stream() takes a RawDevice
+    and streams rows until the generator is closed.
+
+        python -m nitro_parts.Cypress.fx3.sampler --entry SENSOR:temp:2 --seconds 5
+"""
+
+import time, argparse
+import logging, numpy
+from .macro import resolve
+log=logging.getLogger(__name__)
+
+# terminal and rows register addresses for RawDevice (terminals.py)
+TERM=249
+REG_ROWS=5
+
+ENTRY_DTYPE=numpy.dtype([('term','<u2'),('width','u1'),('reserved','u1'),('reg','<u4')])
+STATS_DTYPE=numpy.dtype([('rows','<u4'),('missed','<u4'),('lat_min','<u4'),('lat_max','<u4'),
+                         ('lat_sum','<u8'),('period_min','<u4'),('period_max','<u4'),
+                         ('period','<u4'),('ticks_hz','<u4')])
+ROW_HDR=[('seq','<u4'),('ticks','<u4'),('lat','<u2'),('status','<u2')]
+PAD_SEQ=0xffffffff
+WIDTH_TYPES={1:'u1', 2:'<u2', 4:'<u4'}
+
+def configure(dev, entries, period_us=1000):
+    """
+        entries are (term, reg, width) with names or addresses.  Returns
+        the numpy dtype of a row.
+    """
+    e=numpy.zeros(len(entries),dtype=ENTRY_DTYPE)
+    names=[]
+    for i,(term,reg,width) in enumerate(entries):
+        e[i]['term'],e[i]['reg']=resolve(dev,term,reg)
+        e[i]['width']=width
+        names.append('%s.%s' % (term,reg))
+    dev.write('SAMPLER','entries',e.view(numpy.uint8))
+    dev.set('SAMPLER','period_us',period_us)
+    return row_dtype(names, [w for _,_,w in entries], dev.get('SAMPLER','row_size'))
+
+def row_dtype(names, widths, row_size):
+    """Row layout.  3 byte values are left as raw bytes."""
+    fields=list(ROW_HDR)
+    for name,width in zip(names,widths):
+        fields.append((name, WIDTH_TYPES.get(width,('u1',width))))
+    used=numpy.dtype(fields).itemsize
+    if row_size>used:
+        fields.append(('pad','u1',row_size-used))
+    return numpy.dtype(fields)
+
+def start(dev):
+    """Starts the sample timer and clears the stats."""
+    dev.set('SAMPLER','run',1)
+
+def stop(dev):
+    dev.set('SAMPLER','run',0)
+
+def read_rows(dev, n, dtype):
+    """Reads the next n rows (n periods.)"""
+    rows=numpy.zeros(n,dtype=dtype)
+    dev.read('SAMPLER','rows',rows.view(numpy.uint8))
+    return rows
+
+def stream(raw, dtype, chunk_rows=1024):
+    """
+        Generator of row arrays from a streaming read on a RawDevice.
+        With framing the device pads each dma buffer to whole rows; the
+        padding and rows after a stop are dropped.
+    """
+    for frame,payload in raw.stream(TERM, REG_ROWS, chunk=chunk_rows*dtype.itemsize, framing=True):
+        n=len(payload)//dtype.itemsize
+        rows=numpy.frombuffer(payload[:n*dtype.itemsize],dtype=dtype)
+        yield rows[rows['seq']!=PAD_SEQ]
+
+def gaps(rows):
+    """Periods without a row between the rows given (seq gaps.)"""
+    if len(rows)<2:
+        return 0
+    return int((numpy.diff(rows['seq'].astype(numpy.int64))-1).sum())
+
+def stats(dev):
+    """
+        Device sample statistics as a dict.  Latencies (timer to sample)
+        and periods are in us.  jitter_us is the period spread.
+    """
+    buf=numpy.zeros(1,dtype=STATS_DTYPE)
+    dev.read('SAMPLER','stats',buf.view(numpy.uint8))
+    s=dict(zip(STATS_DTYPE.names,(int(v) for v in buf[0])))
+    us=1e6/s['ticks_hz']
+    rows=s['rows'] or 1
+    s['lat_avg_us']=s['lat_sum']*us/rows
+    s['lat_max_us']=s['lat_max']*us
+    s['period_us']=s['period']*us
+    if s['period_max']>=s['period_min']:
+        s['jitter_us']=(s['period_max']-s['period_min'])*us
+    else:
+        s['jitter_us']=None # fewer than 2 rows in a row
+    return s
+
+def main():
+    import nitro_parts.Cypress.fx3 as fx3
+    parser=argparse.ArgumentParser(description="FX3 register sampler")
+    parser.add_argument('--entry', action='append', default=[], help='TERM:reg[:width] (repeat for more registers)')
+    parser.add_argument('--period-us', type=int, default=1000)
+    parser.add_argument('--seconds', type=float, default=1.0)
+    parser.add_argument('--serial', default=None)
+    args=parser.parse_args()
+    logging.basicConfig(level=logging.INFO)
+
+    dev=fx3.get_dev(serial_num=args.serial)
+    entries=[]
+    for e in args.entry:
+        f=e.split(':')
+        entries.append((f[0], f[1], int(f[2]) if len(f)>2 else 4))
+    dtype=configure(dev, entries, args.period_us)
+    n=int(args.seconds*1e6/args.period_us)
+    start(dev)
+    try:
+        rows=read_rows(dev, n, dtype)
+    finally:
+        stop(dev)
+    s=stats(dev)
+    dev.close()
+    log.info("%d rows %d gaps, period %.1f us jitter %s us, latency avg %.1f max %.1f us" % (
+        len(rows), gaps(rows), s['period_us'],
+        '%.1f' % s['jitter_us'] if s['jitter_us'] is not None else '-',
+        s['lat_avg_us'], s['lat_max_us']))
+    for name in dtype.names[len(ROW_HDR):]:
+        if name!='pad' and not dtype[name].shape:
+            log.info("%-24s min %d max %d" % (name, rows[name].min(), rows[name].max()))
+
+if __name__=='__main__':
+    main()
@@ -0,0 +1,75 @@
+"""
+    Host side of the SRAM scratch terminal (firmware/sram_term.c).
+
+    The terminal is a block of FX3 SRAM addressed by byte offset.  Reads
+    and writes at 16 byte aligned offsets dma straight between the
+    endpoint and SRAM, so its throughput is the usb ceiling without the
+    cpu copy of the BENCH terminal::
+
+        from nitro_parts.Cypress.fx3 import sram
+        sram.write(dev, 0, table)
+        data=sram.read(dev, 0, len(table))
+
+        python -m nitro_parts.Cypress.fx3.sram --size 32768
+"""
+
+import time, argparse
+import logging, numpy
+log=logging.getLogger(__name__)
+
+MB=1e6
+DEFAULT_SIZE=0x8000 # SRAM_TERM_SIZE of the default firmware build
+
+def read(dev, offset, n):
+    """n bytes from offset as a uint8 array."""
+    buf=numpy.zeros(n,dtype=numpy.uint8)
+    dev.read('SRAM',offset,buf)
+    return buf
+
+def write(dev, offset, data):
+    """Writes bytes or an array at offset."""
+    if isinstance(data,numpy.ndarray):
+        buf=data.view(numpy.uint8)
+    else:
+        buf=numpy.frombuffer(bytes(data),dtype=numpy.uint8).copy()
+    dev.write('SRAM',offset,buf)
+
+def check(dev, size=DEFAULT_SIZE, seed=0):
+    """Writes random data over the region and reads it back.  Returns the bad bytes."""
+    data=numpy.random.RandomState(seed).randint(0,256,size).astype(numpy.uint8)
+    write(dev, 0, data)
+    return int((read(dev, 0, size)!=data).sum())
+
+def throughput(dev, size=DEFAULT_SIZE, min_bytes=64<<20):
+    """Host side read and write MB/s of whole region transfers."""
+    buf=numpy.zeros(size,dtype=numpy.uint8)
+    reps=max(1,min_bytes//size)
+    res={}
+    for direction in ('read','write'):
+        op=dev.read if direction=='read' else dev.write
+        op('SRAM',0,buf) # warm up
+        t0=time.time()
+        for i in range(reps):
+            op('SRAM',0,buf)
+        res[direction]=size*reps/(time.time()-t0)/MB
+    return res
+
+def main():
+    import nitro_parts.Cypress.fx3 as fx3
+    parser=argparse.ArgumentParser(description="FX3 SRAM scratch terminal check and throughput")
+    parser.add_argument('--size', type=int, default=DEFAULT_SIZE, help='bytes of the region (SRAM_TERM_SIZE)')
+    parser.add_argument('--min-bytes', type=int, default=64<<20)
+    parser.add_argument('--serial', default=None)
+    args=parser.parse_args()
+    logging.basicConfig(level=logging.INFO)
+
+    dev=fx3.get_dev(serial_num=args.serial)
+    bad=check(dev, args.size)
+    if bad:
+        log.error("%d bytes read back wrong" % bad)
+    r=throughput(dev, args.size, args.min_bytes)
+    log.info("%d byte transfers: read %.1f MB/s write %.1f MB/s" % (args.size, r['read'], r['write']))
+    dev.close()
+
+if __name__=='__main__':
+    main()
@@ -0,0 +1,135 @@
+"""
+    Maps the device timebase (hwtimer ticks) to host time.
+
+    Each sample is a VC_TIME round trip.  The firmware answers it from the
+    usb setup callback so the device time was read somewhere between the
+    host's send and receive times; like NTP the midpoint is taken as the
+    host time of the reading and the round trip bounds the error.  Only
+    the fastest round trips are used and a line fit over samples spread
+    in time gives the drift between the two clocks::
+
+        from nitro_parts.Cypress.fx3.rawusb import RawDevice
+        from nitro_parts.Cypress.fx3.timesync import ClockSync
+        dev=RawDevice(ext_ack=True)
+        sync=ClockSync(dev.device_time)
+        sync.run(duration=2)
+        ...
+        t=sync.to_host(dev.last_ack['t_start'])  # 32 bit ticks are unwrapped
+
+    Host times are time.monotonic() unless another clock is passed.
+
+    The default firmware build has no HWTIMER_GPIO so the device ticks
+    come from CyU3PGetTime at 1 kHz and the sync is only good to about a
+    millisecond.  Build with -DHWTIMER_GPIO=<free pin> (config.mk) for the
+    201.6 MHz timebase.
+
+        python -m nitro_parts.Cypress.fx3.timesync --duration 5
+"""
+
+import time, argparse
+import logging, numpy
+log=logging.getLogger(__name__)
+
+class ClockSync(object):
+    def __init__(self, read_time, clock=time.monotonic):
+        """read_time() returns (ticks, ticks_hz) of the device clock."""
+        self.read_time=read_time
+        self.clock=clock
+        self.samples=[] # (host send, host receive, device ticks)
+        self.hz=None
+        self.offset=None # host seconds at device tick 0
+        self.rate=1.0    # host seconds per device second
+        self.error=None  # estimated error of to_host in seconds
+
+    def sample(self, n=16):
+        """Adds n round trips."""
+        for i in range(n):
+            t0=self.clock()
+            ticks,hz=self.read_time()
+            t1=self.clock()
+            if hz!=self.hz and hz==1000:
+                log.warning("device clock is 1 kHz (CyU3PGetTime), build the firmware with HWTIMER_GPIO for sub ms sync")
+            self.hz=hz
+            self.samples.append((t0,t1,ticks))
+
+    def fit(self, keep=0.25):
+        """
+            Fits offset and rate to the fastest keep fraction of the
+            samples.  Returns the estimated error (seconds.)
+        """
+        s=numpy.array(self.samples, dtype=numpy.float64)
+        if not len(s):
+            raise ValueError("No samples")
+        rtt=s[:,1]-s[:,0]
+        best=s[rtt<=numpy.percentile(rtt,100*keep)]
+        host=(best[:,0]+best[:,1])/2
+        dev=best[:,2]/self.hz
+        if len(best)>1 and dev.max()-dev.min()>0.1:
+            self.rate,self.offset=numpy.polyfit(dev-dev[0],host,1)
+            self.offset-=self.rate*dev[0]
+        else:
+            self.rate=1.0
+            self.offset=float(numpy.mean(host-dev))
+        resid=host-(self.offset+self.rate*dev)
+        self.error=float(rtt.min()/2+numpy.abs(resid).max())
+        log.debug("offset %.6f drift %.2f ppm error %.1f us (%d/%d samples)" % (
+            self.offset, self.drift_ppm, self.error*1e6, len(best), len(s)))
+        return self.error
+
+    def run(self, duration=1.0, n=16, keep=0.25):
+        """Samples in bursts of n over duration seconds and fits."""
+        t_end=self.clock()+duration
+        while True:
+            self.sample(n)
+            if self.clock()>=t_end:
+                break
+            time.sleep(min(0.1,duration/10.))
+        return self.fit(keep)
+
+    @property
+    def drift_ppm(self):
+        return (self.rate-1.0)*1e6
+
+    def unwrap(self, ticks):
+        """
+            Full device ticks for a 32 bit timestamp (ext acks, traces)
+            taken within half a wrap of the last sample.
+        """
+        ref=int(self.samples[-1][2])
+        ticks=(ref & ~0xffffffff) | (int(ticks) & 0xffffffff)
+        if ticks-ref > 1<<31:
+            ticks-=1<<32
+        elif ref-ticks > 1<<31:
+            ticks+=1<<32
+        return ticks
+
+    def to_host(self, ticks):
+        """Host time of a device timestamp.  32 bit ticks are unwrapped."""
+        if ticks < 1<<32:
+            ticks=self.unwrap(ticks)
+        return self.offset+self.rate*ticks/self.hz
+
+    def to_device(self, t):
+        """Device ticks at host time t."""
+        return int(round((t-self.offset)/self.rate*self.hz))
+
+def main():
+    parser=argparse.ArgumentParser(description="Nitro FX3 host/device clock sync")
+    parser.add_argument('--serial', default=None)
+    parser.add_argument('--duration', type=float, default=2.0)
+    parser.add_argument('--samples', type=int, default=16, help='round trips per burst')
+    args=parser.parse_args()
+    logging.basicConfig(level=logging.INFO)
+
+    from .rawusb import RawDevice
+    dev=RawDevice(serial_num=args.serial)
+    sync=ClockSync(dev.device_time)
+    err=sync.run(args.duration, args.samples)
+    rtt=min(t1-t0 for t0,t1,_ in sync.samples)
+    log.info("%d samples, device clock %d Hz" % (len(sync.samples), sync.hz))
+    log.info("offset %.6f s drift %.2f ppm min rtt %.1f us error %.1f us" % (
+        sync.offset, sync.drift_ppm, rtt*1e6, err*1e6))
+    dev.close()
+
+if __name__=='__main__':
+    main()
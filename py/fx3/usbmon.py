@@ -0,0 +1,351 @@
+"""
+    Reconstructs nitro transactions from Linux usbmon captures.
+
+    Reads the text format (cat /sys/kernel/debug/usb/usbmon/Nu) or the
+    binary format saved by tcpdump/wireshark (pcap or pcapng with
+    LINKTYPE_USB_LINUX or LINKTYPE_USB_LINUX_MMAPPED.)  Each transaction
+    is the VC_HI_RDWR setup, the bulk data and the ack packet.  Times are
+    split into:
+
+        control  setup submitted until the device acked it
+        start    control done until the host submitted data
+        data     first data urb submitted until the last one completed
+        ack      last data (or control) completion until the ack arrived
+        gap      previous ack until this setup was submitted (host time)
+
+    Capture with::
+
+        tcpdump -i usbmon1 -w capture.pcap
+        python -m nitro_parts.Cypress.fx3.usbmon capture.pcap
+"""
+
+import struct, binascii, argparse
+import logging, numpy
+from . import protocol as P
+log=logging.getLogger(__name__)
+
+class Urb(object):
+    """One usbmon event.  xfer is C(ontrol) B(ulk) I(nterrupt) Z(iso.)"""
+    __slots__=('tag','ts','event','xfer','ep','bus','dev','status','length','data','setup')
+    def __init__(self, tag, ts, event, xfer, ep, bus, dev, status, length, data, setup=None):
+        self.tag=tag; self.ts=ts; self.event=event; self.xfer=xfer; self.ep=ep
+        self.bus=bus; self.dev=dev; self.status=status; self.length=length
+        self.data=data; self.setup=setup
+
+################################################################################
+# text format
+
+def parse_text(lines):
+    """Urbs from usbmon text lines.  Timestamps (us) are unwrapped to seconds."""
+    last=None
+    wrap=0
+    for line in lines:
+        t=line.split()
+        if len(t)<5 or t[2] not in ('S','C','E'):
+            continue
+        addr=t[3].split(':')
+        xfer,d=addr[0][0],addr[0][1]
+        if len(addr)==4:
+            bus,dev,ep=int(addr[1]),int(addr[2]),int(addr[3])
+        else:
+            bus,dev,ep=0,int(addr[1]),int(addr[2])
+        if d=='i':
+            ep|=0x80
+        us=int(t[1])
+        if last is not None and us+wrap<last-(1<<31):
+            wrap+=1<<32
+        last=us+wrap
+        i=4
+        setup=None
+        status=0
+        if t[i]=='s':
+            setup=tuple(int(x,16) for x in t[i+1:i+6])
+            i+=6
+        else:
+            status=int(t[i].split(':')[0])
+            i+=1
+        length=int(t[i]) if i<len(t) and t[i].lstrip('-').isdigit() else 0
+        i+=1
+        data=b''
+        if i<len(t) and t[i]=='=':
+            data=binascii.unhexlify(''.join(t[i+1:]))
+        yield Urb(t[0],last/1e6,t[2],xfer,ep,bus,dev,status,length,data,setup)
+
+################################################################################
+# binary format
+
+LINKTYPE_USB_LINUX=189
+LINKTYPE_USB_LINUX_MMAPPED=220
+XFER_TYPES='ZICB'
+MON_HDR=struct.Struct('<QBBBBHbbqiiII8s')
+
+def _mon_packet(buf, linktype):
+    if len(buf)<MON_HDR.size:
+        return None
+    (tag,event,xfer,ep,dev,bus,flag_setup,flag_data,sec,usec,status,
+     length,len_cap,setup)=MON_HDR.unpack_from(buf)
+    hdr=64 if linktype==LINKTYPE_USB_LINUX_MMAPPED else MON_HDR.size
+    s=None
+    if flag_setup==0:
+        bmReqType,bRequest,wValue,wIndex,wLength=struct.unpack('<BBHHH',setup)
+        s=(bmReqType,bRequest,wValue,wIndex,wLength)
+    return Urb(tag,sec+usec/1e6,chr(event),XFER_TYPES[xfer&3],ep,bus,dev,
+               status,length,bytes(buf[hdr:hdr+len_cap]),s)
+
+def parse_pcap(f):
+    """Urbs from a pcap or pcapng file object."""
+    magic=f.read(4)
+    if magic==b'\x0a\x0d\x0d\x0a':
+        for u in _parse_pcapng(f, magic):
+            yield u
+        return
+    if magic in (b'\xd4\xc3\xb2\xa1',b'\x4d\x3c\xb2\xa1'):
+        e='<'
+    elif magic in (b'\xa1\xb2\xc3\xd4',b'\xa1\xb2\x3c\x4d'):
+        e='>'
+    else:
+        raise Exception("Not a pcap file")
+    hdr=f.read(20)
+    linktype=struct.unpack(e+'HHiIII',hdr)[5] & 0xffff
+    if linktype not in (LINKTYPE_USB_LINUX,LINKTYPE_USB_LINUX_MMAPPED):
+        raise Exception("pcap link type %d is not usbmon" % linktype)
+    rec=struct.Struct(e+'IIII')
+    while True:
+        h=f.read(rec.size)
+        if len(h)<rec.size:
+            return
+        caplen=rec.unpack(h)[2]
+        u=_mon_packet(f.read(caplen), linktype)
+        if u: yield u
+
+def _parse_pcapng(f, magic):
+    e='<'
+    linktypes=[]
+    block=magic
+    while True:
+        if block is None:
+            block=f.read(4)
+        if len(block)<4:
+            return
+        head=f.read(8) if block==magic else f.read(4)
+        if block==magic:
+            btype=0x0a0d0d0a
+            blen_raw,bom=head[:4],head[4:]
+            e='<' if bom==b'\x4d\x3c\x2b\x1a' else '>'
+            blen=struct.unpack(e+'I',blen_raw)[0]
+            body=f.read(blen-12)
+        else:
+            btype=struct.unpack(e+'I',block)[0]
+            blen=struct.unpack(e+'I',head)[0]
+            body=f.read(blen-8)
+        block=None
+        if btype==0x0a0d0d0a:
+            linktypes=[]
+        elif btype==1: # interface description
+            linktypes.append(struct.unpack(e+'H',body[:2])[0])
+        elif btype==6: # enhanced packet
+            iface,tsh,tsl,caplen,origlen=struct.unpack(e+'IIIII',body[:20])
+            lt=linktypes[iface] if iface<len(linktypes) else None
+            if lt in (LINKTYPE_USB_LINUX,LINKTYPE_USB_LINUX_MMAPPED):
+                u=_mon_packet(body[20:20+caplen],lt)
+                if u: yield u
+        elif btype==3: # simple packet
+            caplen=min(struct.unpack(e+'I',body[:4])[0],len(body)-8)
+            lt=linktypes[0] if linktypes else None
+            if lt in (LINKTYPE_USB_LINUX,LINKTYPE_USB_LINUX_MMAPPED):
+                u=_mon_packet(body[4:4+caplen],lt)
+                if u: yield u
+
+def parse(filename):
+    """Urbs from a capture file in either format."""
+    with open(filename,'rb') as f:
+        binary=f.read(4) in (b'\xd4\xc3\xb2\xa1',b'\x4d\x3c\xb2\xa1',
+                             b'\xa1\xb2\xc3\xd4',b'\xa1\xb2\x3c\x4d',
+                             b'\x0a\x0d\x0d\x0a')
+    if binary:
+        with open(filename,'rb') as f:
+            return list(parse_pcap(f))
+    with open(filename) as f:
+        return list(parse_text(f))
+
+################################################################################
+
+class Transaction(object):
+    """A reconstructed VC_HI_RDWR transaction.  Times are seconds."""
+    def __init__(self, bus, dev, setup_s, header, wValue, wIndex):
+        self.bus=bus
+        self.dev=dev
+        self.header=header # (command,term,reg,length,seq,flags) or None if not captured
+        self.term=header[1] if header else wValue
+        self.command=header[0] if header else None
+        self.length=header[3] if header else wIndex
+        self.setup_s=setup_s
+        self.setup_c=None
+        self.data_s=None
+        self.data_c=None
+        self.ack_c=None
+        self.prev_ack=None
+        self.bytes=0
+        self.ack=None # (checksum,status,seq)
+        self.ext_ack=None # protocol.unpack_ext_ack for FLAG_EXT_ACK transactions
+        self.ack_size=P.EXT_ACK.size if header and header[5] & P.FLAG_EXT_ACK else P.ACK.size
+        self.error=None
+
+    @property
+    def done(self):
+        return self.ack_c is not None
+
+    def times(self):
+        """dict of control, start, data, ack, gap and total (None if unknown.)"""
+        ctl=self.setup_c-self.setup_s if self.setup_c else None
+        start=max(0.0,self.data_s-self.setup_c) if self.data_s is not None and self.setup_c else None
+        data=self.data_c-self.data_s if self.data_c is not None and self.data_s is not None else 0.0
+        last=self.data_c if self.data_c is not None else self.setup_c
+        ack=self.ack_c-last if self.ack_c and last else None
+        gap=self.setup_s-self.prev_ack if self.prev_ack is not None else None
+        total=self.ack_c-self.setup_s if self.ack_c else None
+        return { 'control':ctl, 'start':start, 'data':data, 'ack':ack, 'gap':gap, 'total':total }
+
+    def __str__(self):
+        t=self.times()
+        f=lambda x: "%9.1f" % (x*1e6) if x is not None else "%9s" % '-'
+        cmd=P.COMMAND_NAMES.get(self.command,'?')
+        status='err %s' % self.error if self.error else \
+               ('status %d' % self.ack[1] if self.ack else '')
+        return "%12.6f %-5s %5d %10d " % (self.setup_s,cmd,self.term,self.bytes) + \
+            " ".join(f(t[k]) for k in ('control','start','data','ack','gap','total')) + " " + status
+
+def transactions(urbs, bus=None, dev=None):
+    """Transactions in capture order from a list of Urbs."""
+    res=[]
+    cur={}   # (bus,dev) -> Transaction in progress
+    last={}  # (bus,dev) -> last ack time
+    ctl={}   # control urb tag -> Transaction
+    for u in urbs:
+        if bus is not None and u.bus!=bus: continue
+        if dev is not None and u.dev!=dev: continue
+        key=(u.bus,u.dev)
+        t=cur.get(key)
+        if u.xfer=='C':
+            if u.event=='S' and u.setup and u.setup[0]==0x40 and u.setup[1]==P.VC_HI_RDWR:
+                if t and not t.done:
+                    t.error='incomplete'
+                t=Transaction(u.bus,u.dev,u.ts,P.unpack_header(u.data),u.setup[2],u.setup[3])
+                t.prev_ack=last.get(key)
+                cur[key]=t
+                ctl[u.tag]=t
+                res.append(t)
+            elif u.event in 'CE' and u.tag in ctl:
+                t2=ctl.pop(u.tag)
+                t2.setup_c=u.ts
+                if u.status:
+                    t2.error='stall' if u.status==-32 else 'control %d' % u.status
+            continue
+        if u.xfer!='B' or not t or t.done or t.error:
+            continue
+        reading = t.command is not None and not P.is_write(t.command)
+        data_ep_in = reading or t.command is None
+        if u.event=='S':
+            if t.data_s is None and t.bytes < t.length and bool(u.ep & 0x80)==data_ep_in:
+                t.data_s=u.ts
+            continue
+        if u.status and u.status!=-121: # -EREMOTEIO is a short read
+            t.error='bulk %d' % u.status
+            continue
+        if u.ep & 0x80:
+            ack=None
+            if u.length==t.ack_size and t.ack_size==P.EXT_ACK.size:
+                t.ext_ack=P.unpack_ext_ack(u.data)
+                if t.ext_ack:
+                    ack=tuple(t.ext_ack[k] for k in ('checksum','status','seq'))
+            elif u.length==t.ack_size:
+                ack=P.unpack_ack(u.data)
+            if (not reading or t.bytes>=t.length) and u.length==t.ack_size and \
+                    (ack is not None or len(u.data)<t.ack_size):
+                t.ack_c=u.ts
+                t.ack=ack
+                last[key]=u.ts
+                continue
+            if reading or t.command is None:
+                t.bytes+=u.length
+                t.data_c=u.ts
+        elif not reading:
+            t.bytes+=u.length
+            t.data_c=u.ts
+    return res
+
+################################################################################
+
+def _pct(a, p):
+    return float(numpy.percentile(a,p)) if len(a) else float('nan')
+
+def summary(txns):
+    """Per component {p50,p99,mean} in us plus throughput totals."""
+    done=[ t for t in txns if t.done ]
+    res={ 'transactions':len(txns), 'complete':len(done),
+          'errors':sum(1 for t in txns if t.error or (t.ack and t.ack[1])) }
+    for k in ('control','start','data','ack','gap','total'):
+        a=numpy.array([ t.times()[k] for t in done if t.times()[k] is not None ])*1e6
+        res[k]={ 'p50':_pct(a,50), 'p99':_pct(a,99), 'mean':float(a.mean()) if len(a) else float('nan') }
+    nbytes=sum(t.bytes for t in done)
+    busy=sum(t.times()['total'] for t in done)
+    wall=done[-1].ack_c-done[0].setup_s if done else 0
+    res['bytes']=nbytes
+    res['busy_MBps']=nbytes/busy/1e6 if busy else 0.0
+    res['wall_MBps']=nbytes/wall/1e6 if wall else 0.0
+    # where the wall time went
+    res['device_frac']=sum((t.times()['control'] or 0)+t.times()['data']+(t.times()['ack'] or 0) for t in done)/wall if wall else 0.0
+    return res
+
+def outliers(txns, factor=3.0):
+    """Complete transactions taking over factor x the median of their (command,size)."""
+    groups={}
+    for t in txns:
+        if t.done:
+            groups.setdefault((t.command,t.bytes),[]).append(t)
+    res=[]
+    for g in groups.values():
+        med=numpy.median([ t.times()['total'] for t in g ])
+        res+=[ t for t in g if t.times()['total'] > factor*med ]
+    return sorted(res, key=lambda t:-t.times()['total'])
+
+HEADER_LINE="%12s %-5s %5s %10s " % ('time','cmd','term','bytes') + \
+    " ".join("%9s" % k for k in ('control','start','data','ack','gap','total')) + "  (us)"
+
+def report(txns, factor=3.0, max_outliers=20):
+    s=summary(txns)
+    print("%d transactions, %d complete, %d errors" % (s['transactions'],s['complete'],s['errors']))
+    print("%-8s %10s %10s %10s  (us)" % ('','p50','p99','mean'))
+    for k in ('control','start','data','ack','gap','total'):
+        print("%-8s %10.1f %10.1f %10.1f" % (k,s[k]['p50'],s[k]['p99'],s[k]['mean']))
+    print("%d bytes  %.1f MB/s in transactions  %.1f MB/s wall  device busy %.0f%%" % (
+        s['bytes'],s['busy_MBps'],s['wall_MBps'],100*s['device_frac']))
+    o=outliers(txns,factor)
+    if o:
+        print("%d outliers (> %.1fx median)" % (len(o),factor))
+        print(HEADER_LINE)
+        for t in o[:max_outliers]:
+            print(t)
+    bad=[ t for t in txns if t.error ]
+    for t in bad[:max_outliers]:
+        print(t)
+
+def main():
+    parser=argparse.ArgumentParser(description="Nitro transactions from a usbmon capture")
+    parser.add_argument('capture', help='usbmon text log or pcap/pcapng')
+    parser.add_argument('--bus', type=int, default=None)
+    parser.add_argument('--dev', type=int, default=None)
+    parser.add_argument('--factor', type=float, default=3.0, help='outlier threshold x median')
+    parser.add_argument('--list', action='store_true', help='print every transaction')
+    args=parser.parse_args()
+    logging.basicConfig(level=logging.INFO)
+
+    txns=transactions(parse(args.capture),args.bus,args.dev)
+    if args.list:
+        print(HEADER_LINE)
+        for t in txns:
+            print(t)
+    report(txns,args.factor)
+
+if __name__=='__main__':
+    main()
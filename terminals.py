@@ -43,6 +43,105 @@ di=DeviceInterface(
             regAddrWidth=16,
             regDataWidth=8,
             ),
+        Terminal(
+            name="BENCH",
+            comment="Pattern generator and sink for measuring usb throughput.",
+            addr = 6,
+            regAddrWidth=16,
+            regDataWidth=32,
+            register_list = [
+                Register(name="mode",
+                         mode="write",
+                         init=0,
+                         comment="Data pattern. 0=counter 1=prbs31 2=constant 3=static (constant but the cpu only writes the first buffers) 4=ramp (16 bit samples counting up)"),
+                Register(name="seed",
+                         mode="write",
+                         init=0,
+                         comment="First word of the pattern (or the constant.) Each data transaction restarts from the seed."),
+                Register(name="verify",
+                         mode="write",
+                         init=0,
+                         comment="1 to check data written to the data register against the pattern."),
+                Register(name="errors",
+                         mode="read",
+                         comment="Mismatched words in the last data write."),
+                Register(name="bytes",
+                         mode="read",
+                         comment="Bytes transferred by the last data transaction."),
+                Register(name="elapsed",
+                         mode="read",
+                         comment="Device time of the last data transaction in ticks_hz ticks."),
+                Register(name="ticks_hz",
+                         mode="read",
+                         comment="Device timer rate."),
+                Register(name="data",
+                         mode="write",
+                         comment="Read or write pattern data here."),
+                Register(name="bit_errors",
+                         mode="read",
+                         comment="Flipped bits in the mismatched words of the last data write."),
+                Register(name="dropped",
+                         mode="read",
+                         comment="Times the checker lost sync and relocked to the data (dropped or repeated buffers) in the last data write."),
+                Register(name="phy_errors",
+                         mode="write",
+                         init=0,
+                         comment="USB3 phy errors since last cleared. Write to clear phy_errors and link_errors."),
+                Register(name="link_errors",
+                         mode="write",
+                         init=0,
+                         comment="USB3 link errors since last cleared. Write to clear phy_errors and link_errors."),
+              ]
+            ),
+        Terminal(
+            name="MEMBENCH",
+            comment="Internal memory copy bandwidth and dma call overhead.",
+            addr = 7,
+            regAddrWidth=16,
+            regDataWidth=32,
+            register_list = [
+                Register(name="size",
+                         mode="write",
+                         init=4096,
+                         comment="Bytes per copy (max 16384)."),
+                Register(name="iters",
+                         mode="write",
+                         init=256,
+                         comment="Copies per run."),
+                Register(name="method",
+                         mode="write",
+                         init=0,
+                         comment="0=CyU3PMemCopy 1=32 bit word copy 2=CyU3PMemSet 3=dma GetBuffer/CommitBuffer calls"),
+                Register(name="dcache",
+                         mode="write",
+                         init=0,
+                         comment="1 to enable the data cache during the run."),
+                Register(name="run",
+                         mode="write",
+                         comment="Write to start a run in the app thread. Reads 1 until it's done."),
+                Register(name="elapsed",
+                         mode="read",
+                         comment="Device time of the last run in ticks_hz ticks."),
+                Register(name="ticks_hz",
+                         mode="read",
+                         comment="Device timer rate."),
+                Register(name="dma_buf_size",
+                         mode="read",
+                         comment="Cpu handler dma buffer size (the read channel is 8x larger at super speed.)"),
+                Register(name="dma_stats",
+                         mode="write",
+                         comment="Read 4 x {calls,ticks} for get(read) commit get(write) discard. Write to clear. Needs -DDMA_STATS."),
+                Register(name="status",
+                         mode="read",
+                         comment="Error of the last run, 0 if it succeeded."),
+                Register(name="get_ticks",
+                         mode="read",
+                         comment="Ticks of the last dma calls run in GetBuffer."),
+                Register(name="commit_ticks",
+                         mode="read",
+                         comment="Ticks of the last dma calls run in CommitBuffer."),
+              ]
+            ),
         Terminal(
             name='FX3',
             comment='Special FX3 functions.',
@@ -101,6 +200,242 @@ di=DeviceInterface(
             ]
 
          ),
+         Terminal(
+            name="PROF",
+            comment="Sampling profiler if firmware compiled with PROF_GPIO.",
+            regAddrWidth=16,
+            regDataWidth=32,
+            addr=246,
+            register_list=[
+                Register(name="rate",
+                         mode="write",
+                         init=0,
+                         comment="Samples per second.  Writing restarts the profile. 0 stops it."),
+                Register(name="count",
+                         mode="read",
+                         comment="count of samples available."),
+                Register(name="dropped",
+                         mode="read",
+                         comment="samples dropped because the ring buffer was full."),
+                Register(name="samples",
+                         mode="read",
+                         comment="read from this register to drain samples (pc, thread) 8 bytes each."),
+            ]
+         ),
+         Terminal(
+            name="CAPTURE",
+            comment="GPIO edge capture if firmware compiled with GPIO_CAPTURE.",
+            regAddrWidth=16,
+            regDataWidth=32,
+            addr=247,
+            register_list=[
+                Register(name="pin",
+                         mode="write",
+                         init=0,
+                         comment="GPIO the edge register applies to."),
+                Register(name="edge",
+                         mode="write",
+                         init=0,
+                         comment="Edges captured on pin. 0=off 1=rising 2=falling 3=both.  The pin must be free on the board."),
+                Register(name="count",
+                         mode="read",
+                         comment="count of edges available."),
+                Register(name="dropped",
+                         mode="read",
+                         comment="edges dropped because the ring buffer was full. Write to clear it and the ring."),
+                Register(name="ticks_hz",
+                         mode="read",
+                         comment="Rate of the edge timestamps (hwtimer ticks.)"),
+                Register(name="edges",
+                         mode="read",
+                         comment="read from this register to drain edges (ticks, pin, level, seq) 8 bytes each. pin 255 is padding."),
+            ]
+         ),
+         Terminal(
+            name="MACRO",
+            comment="Register macros run by the firmware if compiled with MACRO_ENGINE.",
+            regAddrWidth=16,
+            regDataWidth=32,
+            addr=248,
+            register_list=[
+                Register(name="slot",
+                         mode="write",
+                         init=0,
+                         comment="Macro slot the other registers apply to."),
+                Register(name="program",
+                         mode="write",
+                         comment="Write the slot's ops (macro_op_t, 20 bytes each) in one transaction.  Read back the program."),
+                Register(name="run",
+                         mode="write",
+                         comment="Write a slot number to run that slot's macro."),
+                Register(name="trigger",
+                         mode="write",
+                         init=0,
+                         comment="Also run the slot on 0=nothing else 1=rising 2=falling 3=both edges of pin 4=every period ms."),
+                Register(name="pin",
+                         mode="write",
+                         init=0,
+                         comment="GPIO for edge triggers.  Set before the trigger.  The pin must be free on the board."),
+                Register(name="period",
+                         mode="write",
+                         init=0,
+                         comment="ms between timer triggered runs.  Set before the trigger."),
+                Register(name="runs",
+                         mode="read",
+                         comment="Runs of the slot finished."),
+                Register(name="missed",
+                         mode="read",
+                         comment="Triggers that came while a run of the slot was already pending.  Write to clear."),
+                Register(name="result",
+                         mode="read",
+                         comment="Result of the slot's last run: macro_result_t (28 bytes) then the values of the GET ops."),
+            ]
+         ),
+         Terminal(
+            name="SAMPLER",
+            comment="Periodic register sampler if firmware compiled with SAMPLER.",
+            regAddrWidth=16,
+            regDataWidth=32,
+            addr=249,
+            register_list=[
+                Register(name="entries",
+                         mode="write",
+                         comment="Registers sampled each period: sampler_entry_t (term, width, reserved, reg) 8 bytes each, up to 32.  Write the whole list in one transaction."),
+                Register(name="period_us",
+                         mode="write",
+                         init=1000,
+                         comment="us between samples.  Whole ms unless the firmware has SAMPLER_GPIO."),
+                Register(name="run",
+                         mode="write",
+                         init=0,
+                         comment="1 starts the sample timer (and clears stats), 0 stops it."),
+                Register(name="row_size",
+                         mode="read",
+                         comment="Bytes per row: a 12 byte sampler_row_t (seq, ticks, lat, status) then the values, padded to a power of 2."),
+                Register(name="stats",
+                         mode="read",
+                         comment="sampler_stats_t (40 bytes): rows, missed, latency min/max/sum and period min/max in ticks.  Write to clear."),
+                Register(name="rows",
+                         mode="read",
+                         comment="Read (or stream) rows, one per period.  Rows of 0xFF are padding after a stopped stream."),
+            ]
+         ),
+         Terminal(
+            name="PRETRIG",
+            comment="Triggered capture with pre-trigger history if firmware compiled with PRETRIG.",
+            regAddrWidth=16,
+            regDataWidth=32,
+            addr=250,
+            register_list=[
+                Register(name="source_term",
+                         mode="write",
+                         init=0,
+                         comment="Terminal read into the ring while armed.  Must be a cpu handler terminal."),
+                Register(name="source_reg",
+                         mode="write",
+                         init=0,
+                         comment="Register of source_term read into the ring."),
+                Register(name="chunk",
+                         mode="write",
+                         init=1024,
+                         comment="Bytes read from the source per pass, a multiple of 4.  The trigger position is only as fine as a chunk."),
+                Register(name="size",
+                         mode="write",
+                         comment="Ring bytes used, a multiple of chunk and at most the firmware's PRETRIG_RING_SIZE (the reset value.)"),
+                Register(name="pre",
+                         mode="write",
+                         init=0,
+                         comment="Window bytes kept from before the trigger.  pre+post+chunk must fit in size."),
+                Register(name="post",
+                         mode="write",
+                         init=0,
+                         comment="Window bytes captured from the trigger on."),
+                Register(name="trigger",
+                         mode="write",
+                         init=0,
+                         comment="0=fire register only 1=rising 2=falling 3=both edges of pin 4=match register after each chunk.  The fire register always works."),
+                Register(name="pin",
+                         mode="write",
+                         init=0,
+                         comment="GPIO for edge triggers.  The pin must be free on the board."),
+                Register(name="match_term",
+                         mode="write",
+                         init=0,
+                         comment="Terminal of the match trigger register."),
+                Register(name="match_reg",
+                         mode="write",
+                         init=0,
+                         comment="Match trigger register, fires when (value & match_mask) == match_value."),
+                Register(name="match_mask",
+                         mode="write",
+                         init=0,
+                         comment="Bits of the match register compared."),
+                Register(name="match_value",
+                         mode="write",
+                         init=0,
+                         comment="Value the masked match register fires on."),
+                Register(name="arm",
+                         mode="write",
+                         init=0,
+                         comment="1 clears the ring and starts capturing, 0 stops.  Reads the state: 0=idle 1=armed 2=triggered 3=window ready."),
+                Register(name="fire",
+                         mode="write",
+                         comment="Write to trigger now.  Fails unless armed."),
+                Register(name="info",
+                         mode="read",
+                         comment="pretrig_info_t (24 bytes): state, bytes captured, window pre and post bytes, trigger ticks, trigger, status."),
+                Register(name="window",
+                         mode="read",
+                         comment="The pre+post window bytes oldest first once the state is 3.  Zero past the end."),
+            ]
+         ),
+         Terminal(
+            name="SRAM",
+            comment="SRAM scratch space if firmware compiled with SRAM_TERM.  The address is the byte offset.  Reads and writes at 16 byte aligned offsets dma straight to and from SRAM.",
+            addr=251,
+            regAddrWidth=32,
+            regDataWidth=8,
+         ),
+         Terminal(
+            name="REDUCE",
+            comment="Parameters of the read path reduction kernels if firmware compiled with READ_REDUCE.  A read picks its kernel with RDWR_FLAG_REDUCE(kernel) in the header flags.",
+            addr=252,
+            regAddrWidth=16,
+            regDataWidth=32,
+            register_list=[
+                Register(name="factor",
+                         mode="write",
+                         init=4,
+                         comment="Decimate keeps 1 of factor samples, minmax sends min and max of every factor (>=2) samples."),
+                Register(name="bins",
+                         mode="write",
+                         init=256,
+                         comment="Histogram bins, a power of 2 up to 256."),
+                Register(name="shift",
+                         mode="write",
+                         init=8,
+                         comment="Histogram bin of a sample is sample>>shift, the top bin counts everything above."),
+                Register(name="hist_samples",
+                         mode="write",
+                         init=65536,
+                         comment="Samples per histogram, at least 2*bins."),
+                Register(name="threshold",
+                         mode="write",
+                         init=0x8000,
+                         comment="Events kernel threshold."),
+                Register(name="bits",
+                         mode="write",
+                         init=12,
+                         comment="Pack kernel bits per sample (1-15)."),
+                Register(name="max_in",
+                         mode="write",
+                         init=0x1000000,
+                         comment="Input bytes a read buffer takes before the rest of it is padded with 0 (checked between input chunks of up to 16K, 0 for no limit)."),
+                Register(name="stats",
+                         mode="read",
+                         comment="reduce_stats_t (16 bytes) of the last reduced read: input bytes, output bytes, dropped events, padded bytes."),
+            ]
+         ),
          fx3_prom_term
      ]
 )